@@ -1,62 +1,64 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
+#include <sx127x.h>
 
-void print_op_mode(uint8_t value) {
-  printf("0x01 RegOpMode: \n");
+void print_op_mode(uint8_t value, FILE *out) {
+  fprintf(out, "0x01 RegOpMode: \n");
   if ((value & 0b10000000) == 0b10000000) {
-    printf("\tLongRangeMode=LORA\n");
+    fprintf(out, "\tLongRangeMode=LORA\n");
   } else {
-    printf("\tLongRangeMode=FSK\n");
+    fprintf(out, "\tLongRangeMode=FSK\n");
   }
   if (((value & 0b01000000) >> 6) == 0) {
-    printf("\tAccessSharedReg=Access LoRa registers\n");
+    fprintf(out, "\tAccessSharedReg=Access LoRa registers\n");
   } else {
-    printf("\tAccessSharedReg=Access FSK registers\n");
+    fprintf(out, "\tAccessSharedReg=Access FSK registers\n");
   }
   if (((value & 0b00001000) >> 3) == 0) {
-    printf("\tLowFrequencyModeOn=High Frequency Mode\n");
+    fprintf(out, "\tLowFrequencyModeOn=High Frequency Mode\n");
   } else {
-    printf("\tLowFrequencyModeOn=Low Frequency Mode\n");
+    fprintf(out, "\tLowFrequencyModeOn=Low Frequency Mode\n");
   }
   uint8_t mode = (value & 0b111);
   switch (mode) {
     case 0b000:
-      printf("\tMode=SLEEP\n");
+      fprintf(out, "\tMode=SLEEP\n");
       break;
     case 0b001:
-      printf("\tMode=STDBY\n");
+      fprintf(out, "\tMode=STDBY\n");
       break;
     case 0b010:
-      printf("\tMode=Frequency synthesis TX\n");
+      fprintf(out, "\tMode=Frequency synthesis TX\n");
       break;
     case 0b011:
-      printf("\tMode=Transmit (TX)\n");
+      fprintf(out, "\tMode=Transmit (TX)\n");
       break;
     case 0b100:
-      printf("\tMode=Frequency synthesis RX (FSRX)\n");
+      fprintf(out, "\tMode=Frequency synthesis RX (FSRX)\n");
       break;
     case 0b101:
-      printf("\tMode=Receive continuous\n");
+      fprintf(out, "\tMode=Receive continuous\n");
       break;
     case 0b110:
-      printf("\tMode=receive single\n");
+      fprintf(out, "\tMode=receive single\n");
       break;
     case 0b111:
-      printf("\tMode=Channel activity detection\n");
+      fprintf(out, "\tMode=Channel activity detection\n");
       break;
   }
 }
 
-void print_ocp(uint8_t value) {
-  printf("0x0b: RegOcp:\n");
+void print_ocp(uint8_t value, FILE *out) {
+  fprintf(out, "0x0b: RegOcp:\n");
   if ((value & 0b100000) != 0) {
-    printf("\tOcpOn=OCP enabled\n");
+    fprintf(out, "\tOcpOn=OCP enabled\n");
   } else {
-    printf("\tOcpOn=OCP disabled\n");
+    fprintf(out, "\tOcpOn=OCP disabled\n");
   }
-  printf("\tOcpTrim=0x%x\n", (value & 0b11111));
+  fprintf(out, "\tOcpTrim=0x%x\n", (value & 0b11111));
 }
 
 double calculate_bw(uint8_t value) {
@@ -79,513 +81,513 @@ double calculate_bw(uint8_t value) {
   return 32000000.0 / (mantissa * ((uint32_t) 1 << ((value & 0b111) + 2)));
 }
 
-void print_lna(uint8_t value) {
-  printf("0x0c: RegLna:\n");
-  printf("\tLnaGain=%d\n", ((value & 0b11100000) >> 5));
-  printf("\tLnaBoostLf=%d\n", ((value & 0b11000) >> 3));
+void print_lna(uint8_t value, FILE *out) {
+  fprintf(out, "0x0c: RegLna:\n");
+  fprintf(out, "\tLnaGain=%d\n", ((value & 0b11100000) >> 5));
+  fprintf(out, "\tLnaBoostLf=%d\n", ((value & 0b11000) >> 3));
   if (((value & 0b11)) != 0) {
-    printf("\tLnaBoostHf=Boost on\n");
+    fprintf(out, "\tLnaBoostHf=Boost on\n");
   } else {
-    printf("\tLnaBoostHf=Default LNA current\n");
+    fprintf(out, "\tLnaBoostHf=Default LNA current\n");
   }
 }
 
-int dump_fsk_registers(const uint8_t *regs) {
+int dump_fsk_registers(const uint8_t *regs, FILE *out) {
   uint8_t value = regs[0x01];
-  print_op_mode(value);
-  printf("0x02: RegBitrateMsb:\n");
+  print_op_mode(value, out);
+  fprintf(out, "0x02: RegBitrateMsb:\n");
   double bit_rate = 32000000.0 / (((regs[0x02] << 8) | (regs[0x03])) + regs[0x5D] / 16.0);
-  printf("\tBitRate=%f\n", bit_rate);
-  printf("0x04: RegFdevMsb\n");
+  fprintf(out, "\tBitRate=%f\n", bit_rate);
+  fprintf(out, "0x04: RegFdevMsb\n");
   double freq_deviation = (32000000.0 / (1 << 19)) * (((regs[0x04] & 0b111111) << 8) | regs[0x05]);
-  printf("\tFdev=%f\n", freq_deviation);
+  fprintf(out, "\tFdev=%f\n", freq_deviation);
   uint64_t freq = (((uint64_t) regs[0x06]) << 16) | (((uint64_t) regs[0x07]) << 8) | (regs[0x08]);
-  printf("0x06: RegFr:\n");
-  printf("\tFrf=%" PRIu64 "\n", ((freq * 32000000) / (1 << 19)));
-  printf("0x09: RegPaConfig:\n");
+  fprintf(out, "0x06: RegFr:\n");
+  fprintf(out, "\tFrf=%" PRIu64 "\n", ((freq * 32000000) / (1 << 19)));
+  fprintf(out, "0x09: RegPaConfig:\n");
   value = regs[0x09];
   if ((value & 0b10000000) == 0b10000000) {
-    printf("\tPaSelect=PA_BOOST pin\n");
+    fprintf(out, "\tPaSelect=PA_BOOST pin\n");
   } else {
-    printf("\tPaSelect=RFO pin\n");
+    fprintf(out, "\tPaSelect=RFO pin\n");
   }
-  printf("\tMaxPower=0x%x\n", ((value & 0b110000) >> 4));
-  printf("\tOutputPower=0x%x\n", ((value & 0b1111)));
-  printf("0x0a: RegPaRamp:\n");
-  printf("\tModulationShaping=");
+  fprintf(out, "\tMaxPower=0x%x\n", ((value & 0b110000) >> 4));
+  fprintf(out, "\tOutputPower=0x%x\n", ((value & 0b1111)));
+  fprintf(out, "0x0a: RegPaRamp:\n");
+  fprintf(out, "\tModulationShaping=");
   value = (regs[0x0a] & 0b01100000) >> 5;
   switch (value) {
     case 0b00:
-      printf("No shaping");
+      fprintf(out, "No shaping");
       break;
     case 0b01:
-      printf("Gaussian filter BT = 1.0");
+      fprintf(out, "Gaussian filter BT = 1.0");
       break;
     case 0b10:
-      printf("Gaussian filter BT = 0.5");
+      fprintf(out, "Gaussian filter BT = 0.5");
       break;
     case 0b11:
-      printf("Gaussian filter BT = 0.3");
+      fprintf(out, "Gaussian filter BT = 0.3");
       break;
   }
-  printf("\n");
-  printf("\tPaRamp=0x%x\n", (regs[0x0a] & 0b1111));
-  print_ocp(regs[0x0b]);
-  print_lna(regs[0x0c]);
-  printf("0x0d: RegRxConfig\n");
+  fprintf(out, "\n");
+  fprintf(out, "\tPaRamp=0x%x\n", (regs[0x0a] & 0b1111));
+  print_ocp(regs[0x0b], out);
+  print_lna(regs[0x0c], out);
+  fprintf(out, "0x0d: RegRxConfig\n");
   if ((regs[0x0d] & 0b10000000) != 0) {
-    printf("\tRestartRxOnCollision=Automatic restart On\n");
+    fprintf(out, "\tRestartRxOnCollision=Automatic restart On\n");
   } else {
-    printf("\tRestartRxOnCollision=No automatic Restart\n");
+    fprintf(out, "\tRestartRxOnCollision=No automatic Restart\n");
   }
   if ((regs[0x0d] & 0b1000000) != 0) {
-    printf("\tRestartRxWithoutPllLock=Manual Restart of the Receiver\n");
+    fprintf(out, "\tRestartRxWithoutPllLock=Manual Restart of the Receiver\n");
   } else {
-    printf("\tRestartRxWithoutPllLock=No restart\n");
+    fprintf(out, "\tRestartRxWithoutPllLock=No restart\n");
   }
   if ((regs[0x0d] & 0b100000) != 0) {
-    printf("\tRestartRxWithPllLock=Manual Restart of the Receiver\n");
+    fprintf(out, "\tRestartRxWithPllLock=Manual Restart of the Receiver\n");
   } else {
-    printf("\tRestartRxWithPllLock=No restart\n");
+    fprintf(out, "\tRestartRxWithPllLock=No restart\n");
   }
   if ((regs[0x0d] & 0b10000) != 0) {
-    printf("\tAfcAutoOn=AFC is performed at each receiver startup\n");
+    fprintf(out, "\tAfcAutoOn=AFC is performed at each receiver startup\n");
   } else {
-    printf("\tAfcAutoOn=No AFC performed at receiver startup\n");
+    fprintf(out, "\tAfcAutoOn=No AFC performed at receiver startup\n");
   }
   if ((regs[0x0d] & 0b1000) != 0) {
-    printf("\tAgcAutoOn=LNA gain is controlled by the AGC\n");
+    fprintf(out, "\tAgcAutoOn=LNA gain is controlled by the AGC\n");
   } else {
-    printf("\tAgcAutoOn=LNA gain forced by the LnaGain Setting\n");
+    fprintf(out, "\tAgcAutoOn=LNA gain forced by the LnaGain Setting\n");
   }
   uint8_t trigger_event = (regs[0x0d] & 0b111);
   switch (trigger_event) {
     case 0b000:
-      printf("\tRxTrigger=None\n");
+      fprintf(out, "\tRxTrigger=None\n");
       break;
     case 0b001:
-      printf("\tRxTrigger=RSSI\n");
+      fprintf(out, "\tRxTrigger=RSSI\n");
       break;
     case 0b110:
-      printf("\tRxTrigger=PreambleDetect\n");
+      fprintf(out, "\tRxTrigger=PreambleDetect\n");
       break;
     case 0b111:
-      printf("\tRxTrigger=RSSI and PreambleDetect\n");
-      break;
-  }
-  printf("0x0e: RegRssiConfig\n");
-  printf("\tRssiOffset=%d\n", (regs[0x0e] & 0b11111000) >> 3);
-  printf("\tRssiSmoothing=%d\n", (regs[0x0e] & 0b111));
-  printf("0x0f: RegRssiCollision\n");
-  printf("\tRssiCollisionThreshold=%d\n", (regs[0x0f]));
-  printf("0x10: RegRssiThresh\n");
-  printf("\tRssiThreshold=%d\n", (regs[0x10] / 2));
-  printf("0x11: RegRssiValue\n");
-  printf("\tRssiValue=%f\n", (regs[0x11] / 2.0f));
-  printf("0x12: RegRxBw\n");
-  printf("\tRxBw=%f\n", calculate_bw(regs[0x12]));
-  printf("0x13: RegAfcBw\n");
-  printf("\tAfcBw=%f\n", calculate_bw(regs[0x13]));
-  printf("0x1a: RegAfcFei\n");
+      fprintf(out, "\tRxTrigger=RSSI and PreambleDetect\n");
+      break;
+  }
+  fprintf(out, "0x0e: RegRssiConfig\n");
+  fprintf(out, "\tRssiOffset=%d\n", (regs[0x0e] & 0b11111000) >> 3);
+  fprintf(out, "\tRssiSmoothing=%d\n", (regs[0x0e] & 0b111));
+  fprintf(out, "0x0f: RegRssiCollision\n");
+  fprintf(out, "\tRssiCollisionThreshold=%d\n", (regs[0x0f]));
+  fprintf(out, "0x10: RegRssiThresh\n");
+  fprintf(out, "\tRssiThreshold=%d\n", (regs[0x10] / 2));
+  fprintf(out, "0x11: RegRssiValue\n");
+  fprintf(out, "\tRssiValue=%f\n", (regs[0x11] / 2.0f));
+  fprintf(out, "0x12: RegRxBw\n");
+  fprintf(out, "\tRxBw=%f\n", calculate_bw(regs[0x12]));
+  fprintf(out, "0x13: RegAfcBw\n");
+  fprintf(out, "\tAfcBw=%f\n", calculate_bw(regs[0x13]));
+  fprintf(out, "0x1a: RegAfcFei\n");
   if ((regs[0x1a] & 0b1) == 1) {
-    printf("\tAfcAutoClearOn=AFC register is not cleared at the beginning of the automatic AFC phase\n");
+    fprintf(out, "\tAfcAutoClearOn=AFC register is not cleared at the beginning of the automatic AFC phase\n");
   } else {
-    printf("\tAfcAutoClearOn=AFC register is cleared at the beginning of the automatic AFC phase\n");
+    fprintf(out, "\tAfcAutoClearOn=AFC register is cleared at the beginning of the automatic AFC phase\n");
   }
-  printf("0x1f: RegPreambleDetect\n");
+  fprintf(out, "0x1f: RegPreambleDetect\n");
   if ((regs[0x1f] & 0b10000000) != 0) {
-    printf("\tPreambleDetectorOn=1\n");
+    fprintf(out, "\tPreambleDetectorOn=1\n");
   } else {
-    printf("\tPreambleDetectorOn=0\n");
-  }
-  printf("\tPreambleDetectorSize=%d\n", ((regs[0x1f] & 0b1100000) >> 5) + 1);
-  printf("\tPreambleDetectorTol=%d\n", (regs[0x1f] & 0b11111));
-  printf("0x20: RegRxTimeout1\n");
-  printf("\tTimeoutRxRssi=%d\n", regs[0x20]);
-  printf("0x21: RegRxTimeout2\n");
-  printf("\tTimeoutRxPreamble=%d\n", regs[0x21]);
-  printf("0x22: RegRxTimeout3\n");
-  printf("\tTimeoutSignalSync=%d\n", regs[0x22]);
-  printf("0x23: RegRxDelay\n");
-  printf("\tInterPacketRxDelay=%d\n", regs[0x23]);
-  printf("0x24: RegOsc\n");
+    fprintf(out, "\tPreambleDetectorOn=0\n");
+  }
+  fprintf(out, "\tPreambleDetectorSize=%d\n", ((regs[0x1f] & 0b1100000) >> 5) + 1);
+  fprintf(out, "\tPreambleDetectorTol=%d\n", (regs[0x1f] & 0b11111));
+  fprintf(out, "0x20: RegRxTimeout1\n");
+  fprintf(out, "\tTimeoutRxRssi=%d\n", regs[0x20]);
+  fprintf(out, "0x21: RegRxTimeout2\n");
+  fprintf(out, "\tTimeoutRxPreamble=%d\n", regs[0x21]);
+  fprintf(out, "0x22: RegRxTimeout3\n");
+  fprintf(out, "\tTimeoutSignalSync=%d\n", regs[0x22]);
+  fprintf(out, "0x23: RegRxDelay\n");
+  fprintf(out, "\tInterPacketRxDelay=%d\n", regs[0x23]);
+  fprintf(out, "0x24: RegOsc\n");
   switch (regs[0x24] & 0b111) {
     case 0b000:
-      printf("\tClkOut=FXOSC\n");
+      fprintf(out, "\tClkOut=FXOSC\n");
       break;
     case 0b001:
-      printf("\tClkOut=FXOSC/2\n");
+      fprintf(out, "\tClkOut=FXOSC/2\n");
       break;
     case 0b010:
-      printf("\tClkOut=FXOSC/4\n");
+      fprintf(out, "\tClkOut=FXOSC/4\n");
       break;
     case 0b011:
-      printf("\tClkOut=FXOSC/8\n");
+      fprintf(out, "\tClkOut=FXOSC/8\n");
       break;
     case 0b100:
-      printf("\tClkOut=FXOSC/16\n");
+      fprintf(out, "\tClkOut=FXOSC/16\n");
       break;
     case 0b101:
-      printf("\tClkOut=FXOSC/32\n");
+      fprintf(out, "\tClkOut=FXOSC/32\n");
       break;
     case 0b110:
-      printf("\tClkOut=RC (automatically enabled)\n");
+      fprintf(out, "\tClkOut=RC (automatically enabled)\n");
       break;
     case 0b111:
-      printf("\tClkOut=OFF\n");
+      fprintf(out, "\tClkOut=OFF\n");
       break;
   }
-  printf("0x25: RegPreambleMsb\n");
-  printf("\tPreambleSize=%d\n", (regs[0x25] << 8) | regs[0x26]);
-  printf("0x27: RegSyncConfig\n");
+  fprintf(out, "0x25: RegPreambleMsb\n");
+  fprintf(out, "\tPreambleSize=%d\n", (regs[0x25] << 8) | regs[0x26]);
+  fprintf(out, "0x27: RegSyncConfig\n");
   switch ((regs[0x27] & 0b11000000) >> 6) {
     case 0b00:
-      printf("\tAutoRestartRxMode=Off\n");
+      fprintf(out, "\tAutoRestartRxMode=Off\n");
       break;
     case 0b01:
-      printf("\tAutoRestartRxMode=On, without waiting for the PLL to re-lock\n");
+      fprintf(out, "\tAutoRestartRxMode=On, without waiting for the PLL to re-lock\n");
       break;
     case 0b10:
-      printf("\tAutoRestartRxMode=On, wait for the PLL to lock (frequency changed)\n");
+      fprintf(out, "\tAutoRestartRxMode=On, wait for the PLL to lock (frequency changed)\n");
       break;
     case 0b11:
-      printf("\tAutoRestartRxMode=Invalid\n");
+      fprintf(out, "\tAutoRestartRxMode=Invalid\n");
       break;
   }
   if ((regs[0x27] & 0b100000) != 0) {
-    printf("\tPreamblePolarity=0x55\n");
+    fprintf(out, "\tPreamblePolarity=0x55\n");
   } else {
-    printf("\tPreamblePolarity=0xAA\n");
+    fprintf(out, "\tPreamblePolarity=0xAA\n");
   }
   if ((regs[0x27] & 0b10000) != 0) {
-    printf("\tSyncOn=On\n");
+    fprintf(out, "\tSyncOn=On\n");
   } else {
-    printf("\tSyncOn=Off\n");
+    fprintf(out, "\tSyncOn=Off\n");
   }
   uint8_t sync_size = (regs[0x27] & 0b111) + 1;
-  printf("\tSyncSize=%d\n", sync_size);
-  printf("0x28: RegSyncValue\n");
-  printf("\tSyncValue=");
+  fprintf(out, "\tSyncSize=%d\n", sync_size);
+  fprintf(out, "0x28: RegSyncValue\n");
+  fprintf(out, "\tSyncValue=");
   for (int i = 0; i < sync_size; i++) {
-    printf("%x", regs[0x28 + i]);
+    fprintf(out, "%x", regs[0x28 + i]);
   }
-  printf("\n");
-  printf("0x30: RegPacketConfig1\n");
+  fprintf(out, "\n");
+  fprintf(out, "0x30: RegPacketConfig1\n");
   if ((regs[0x30] & 0b10000000) != 0) {
-    printf("\tPacketFormat=Variable\n");
+    fprintf(out, "\tPacketFormat=Variable\n");
   } else {
-    printf("\tPacketFormat=Fixed\n");
+    fprintf(out, "\tPacketFormat=Fixed\n");
   }
   switch ((regs[0x30] & 0b1100000) >> 5) {
     case 0b00:
-      printf("\tDcFree=Off (NRZ)\n");
+      fprintf(out, "\tDcFree=Off (NRZ)\n");
       break;
     case 0b01:
-      printf("\tDcFree=Manchester\n");
+      fprintf(out, "\tDcFree=Manchester\n");
       break;
     case 0b10:
-      printf("\tDcFree=Whitening\n");
+      fprintf(out, "\tDcFree=Whitening\n");
       break;
     case 0b11:
-      printf("\tDcFree=Invalid\n");
+      fprintf(out, "\tDcFree=Invalid\n");
       break;
   }
   if ((regs[0x30] & 0b10000) != 0) {
-    printf("\tCrcOn=1\n");
+    fprintf(out, "\tCrcOn=1\n");
   } else {
-    printf("\tCrcOn=0\n");
+    fprintf(out, "\tCrcOn=0\n");
   }
   if ((regs[0x30] & 0b1000) != 0) {
-    printf("\tCrcAutoClearOff=Do not clear FIFO\n");
+    fprintf(out, "\tCrcAutoClearOff=Do not clear FIFO\n");
   } else {
-    printf("\tCrcAutoClearOff=Clear FIFO and restart new packet reception\n");
+    fprintf(out, "\tCrcAutoClearOff=Clear FIFO and restart new packet reception\n");
   }
   switch ((regs[0x30] & 0b110) >> 1) {
     case 0b00:
-      printf("\tAddressFiltering=None\n");
+      fprintf(out, "\tAddressFiltering=None\n");
       break;
     case 0b01:
-      printf("\tAddressFiltering=Address field must match NodeAddress\n");
+      fprintf(out, "\tAddressFiltering=Address field must match NodeAddress\n");
       break;
     case 0b10:
-      printf("\tAddressFiltering=Address field must match NodeAddress or BroadcastAddress\n");
+      fprintf(out, "\tAddressFiltering=Address field must match NodeAddress or BroadcastAddress\n");
       break;
     case 0b11:
-      printf("\tAddressFiltering=Invalid\n");
+      fprintf(out, "\tAddressFiltering=Invalid\n");
       break;
   }
   if ((regs[0x30] & 0b1) != 0) {
-    printf("\tCrcWhiteningType=IBM CRC\n");
+    fprintf(out, "\tCrcWhiteningType=IBM CRC\n");
   } else {
-    printf("\tCrcWhiteningType=CCITT CRC\n");
+    fprintf(out, "\tCrcWhiteningType=CCITT CRC\n");
   }
-  printf("0x31: RegPacketConfig2\n");
+  fprintf(out, "0x31: RegPacketConfig2\n");
   if ((regs[0x31] & 0b1000000) != 0) {
-    printf("\tDataMode=Packet\n");
+    fprintf(out, "\tDataMode=Packet\n");
   } else {
-    printf("\tDataMode=Continuous\n");
+    fprintf(out, "\tDataMode=Continuous\n");
   }
   if ((regs[0x31] & 0b100000) != 0) {
-    printf("\tIoHomeOn=1\n");
+    fprintf(out, "\tIoHomeOn=1\n");
   } else {
-    printf("\tIoHomeOn=0\n");
+    fprintf(out, "\tIoHomeOn=0\n");
   }
   if ((regs[0x31] & 0b1000) != 0) {
-    printf("\tBeaconOn=1\n");
+    fprintf(out, "\tBeaconOn=1\n");
   } else {
-    printf("\tBeaconOn=0\n");
-  }
-  printf("\tPayloadLength=%d\n", ((regs[0x31] & 0b111) << 8) | regs[0x32]);
-  printf("0x33: RegNodeAdrs\n");
-  printf("\tNodeAddress=%d\n", regs[0x33]);
-  printf("0x34: RegBroadcastAdrs\n");
-  printf("\tBroadcastAddress=%d\n", regs[0x34]);
-  printf("0x35: RegFifoThresh\n");
+    fprintf(out, "\tBeaconOn=0\n");
+  }
+  fprintf(out, "\tPayloadLength=%d\n", ((regs[0x31] & 0b111) << 8) | regs[0x32]);
+  fprintf(out, "0x33: RegNodeAdrs\n");
+  fprintf(out, "\tNodeAddress=%d\n", regs[0x33]);
+  fprintf(out, "0x34: RegBroadcastAdrs\n");
+  fprintf(out, "\tBroadcastAddress=%d\n", regs[0x34]);
+  fprintf(out, "0x35: RegFifoThresh\n");
   if ((regs[0x35] & 0b10000000) != 0) {
-    printf("\tTxStartCondition=FifoEmpty goes low\n");
+    fprintf(out, "\tTxStartCondition=FifoEmpty goes low\n");
   } else {
-    printf("\tTxStartCondition=FifoLevel\n");
+    fprintf(out, "\tTxStartCondition=FifoLevel\n");
   }
-  printf("\tFifoThreshold=%d\n", (regs[0x35] & 0b111111));
-  printf("0x36: RegSeqConfig1\n");
+  fprintf(out, "\tFifoThreshold=%d\n", (regs[0x35] & 0b111111));
+  fprintf(out, "0x36: RegSeqConfig1\n");
   if ((regs[0x36] & 0b100000) != 0) {
-    printf("\tIdleMode=Sleep mode\n");
+    fprintf(out, "\tIdleMode=Sleep mode\n");
   } else {
-    printf("\tIdleMode=Standby mode\n");
+    fprintf(out, "\tIdleMode=Standby mode\n");
   }
   switch ((regs[0x36] & 0b11000) >> 3) {
     case 0b00:
-      printf("\tFromStart=to LowPowerSelection\n");
+      fprintf(out, "\tFromStart=to LowPowerSelection\n");
       break;
     case 0b01:
-      printf("\tFromStart=to Receive state\n");
+      fprintf(out, "\tFromStart=to Receive state\n");
       break;
     case 0b10:
-      printf("\tFromStart=to Transmit state\n");
+      fprintf(out, "\tFromStart=to Transmit state\n");
       break;
     case 0b11:
-      printf("\tFromStart=to Transmit state on a FifoLevel interrupt\n");
+      fprintf(out, "\tFromStart=to Transmit state on a FifoLevel interrupt\n");
       break;
   }
   if ((regs[0x36] & 0b100) != 0) {
-    printf("\tLowPowerSelection=Idle state with chip on Standby or Sleep mode\n");
+    fprintf(out, "\tLowPowerSelection=Idle state with chip on Standby or Sleep mode\n");
   } else {
-    printf("\tLowPowerSelection=SequencerOff state\n");
+    fprintf(out, "\tLowPowerSelection=SequencerOff state\n");
   }
   if ((regs[0x36] & 0b10) != 0) {
-    printf("\tFromIdle=to Receive state\n");
+    fprintf(out, "\tFromIdle=to Receive state\n");
   } else {
-    printf("\tFromIdle=to Transmit state\n");
+    fprintf(out, "\tFromIdle=to Transmit state\n");
   }
   if ((regs[0x36] & 0b1) != 0) {
-    printf("\tFromTransmit=to Receive state on a PacketSent interrupt\n");
+    fprintf(out, "\tFromTransmit=to Receive state on a PacketSent interrupt\n");
   } else {
-    printf("\tFromTransmit=to LowPowerSelection on a PacketSent interrupt\n");
+    fprintf(out, "\tFromTransmit=to LowPowerSelection on a PacketSent interrupt\n");
   }
-  printf("0x37: RegSeqConfig2\n");
+  fprintf(out, "0x37: RegSeqConfig2\n");
   switch ((regs[0x37] & 0b11100000) >> 5) {
     case 0b000:
     case 0b111:
-      printf("\tFromReceive=unused\n");
+      fprintf(out, "\tFromReceive=unused\n");
       break;
     case 0b001:
-      printf("\tFromReceive=to PacketReceived state on a PayloadReady interrupt\n");
+      fprintf(out, "\tFromReceive=to PacketReceived state on a PayloadReady interrupt\n");
       break;
     case 0b010:
-      printf("\tFromReceive=to LowPowerSelection on a PayloadReady interrupt\n");
+      fprintf(out, "\tFromReceive=to LowPowerSelection on a PayloadReady interrupt\n");
       break;
     case 0b011:
-      printf("\tFromReceive=to PacketReceived state on a CrcOk interrupt\n");
+      fprintf(out, "\tFromReceive=to PacketReceived state on a CrcOk interrupt\n");
       break;
     case 0b100:
-      printf("\tFromReceive=to SequencerOff state on a Rssi interrupt\n");
+      fprintf(out, "\tFromReceive=to SequencerOff state on a Rssi interrupt\n");
       break;
     case 0b101:
-      printf("\tFromReceive=to SequencerOff state on a SyncAddress interrupt\n");
+      fprintf(out, "\tFromReceive=to SequencerOff state on a SyncAddress interrupt\n");
       break;
     case 0b110:
-      printf("\tFromReceive=to SequencerOff state on a PreambleDetect interrupt\n");
+      fprintf(out, "\tFromReceive=to SequencerOff state on a PreambleDetect interrupt\n");
       break;
   }
   switch ((regs[0x37] & 0b11000) >> 3) {
     case 0b00:
-      printf("\tFromRxTimeout=to Receive State, via ReceiveRestart\n");
+      fprintf(out, "\tFromRxTimeout=to Receive State, via ReceiveRestart\n");
       break;
     case 0b01:
-      printf("\tFromRxTimeout=to Transmit state\n");
+      fprintf(out, "\tFromRxTimeout=to Transmit state\n");
       break;
     case 0b10:
-      printf("\tFromRxTimeout=to LowPowerSelection\n");
+      fprintf(out, "\tFromRxTimeout=to LowPowerSelection\n");
       break;
     case 0b11:
-      printf("\tFromRxTimeout=to SequencerOff state\n");
+      fprintf(out, "\tFromRxTimeout=to SequencerOff state\n");
       break;
   }
   switch ((regs[0x37] & 0b111)) {
     case 0b000:
-      printf("\tFromPacketReceived=to SequencerOff state\n");
+      fprintf(out, "\tFromPacketReceived=to SequencerOff state\n");
       break;
     case 0b001:
-      printf("\tFromPacketReceived=to Transmit state on a FifoEmpty interrupt\n");
+      fprintf(out, "\tFromPacketReceived=to Transmit state on a FifoEmpty interrupt\n");
       break;
     case 0b010:
-      printf("\tFromPacketReceived=to LowPowerSelection\n");
+      fprintf(out, "\tFromPacketReceived=to LowPowerSelection\n");
       break;
     case 0b011:
-      printf("\tFromPacketReceived=to Receive via FS mode, if frequency was changed\n");
+      fprintf(out, "\tFromPacketReceived=to Receive via FS mode, if frequency was changed\n");
       break;
     case 0b100:
-      printf("\tFromPacketReceived=to Receive state\n");
+      fprintf(out, "\tFromPacketReceived=to Receive state\n");
       break;
   }
-  printf("0x38: RegTimerResol\n");
+  fprintf(out, "0x38: RegTimerResol\n");
   switch ((regs[0x38] & 0b1100) >> 2) {
     case 0b00:
-      printf("\tTimer1Resolution=disabled\n");
+      fprintf(out, "\tTimer1Resolution=disabled\n");
       break;
     case 0b01:
-      printf("\tTimer1Resolution=64 us\n");
+      fprintf(out, "\tTimer1Resolution=64 us\n");
       break;
     case 0b10:
-      printf("\tTimer1Resolution=4.1 ms\n");
+      fprintf(out, "\tTimer1Resolution=4.1 ms\n");
       break;
     case 0b11:
-      printf("\tTimer1Resolution=262 ms\n");
+      fprintf(out, "\tTimer1Resolution=262 ms\n");
       break;
   }
   switch ((regs[0x38] & 0b11)) {
     case 0b00:
-      printf("\tTimer2Resolution=disabled\n");
+      fprintf(out, "\tTimer2Resolution=disabled\n");
       break;
     case 0b01:
-      printf("\tTimer2Resolution=64 us\n");
+      fprintf(out, "\tTimer2Resolution=64 us\n");
       break;
     case 0b10:
-      printf("\tTimer2Resolution=4.1 ms\n");
+      fprintf(out, "\tTimer2Resolution=4.1 ms\n");
       break;
     case 0b11:
-      printf("\tTimer2Resolution=262 ms\n");
+      fprintf(out, "\tTimer2Resolution=262 ms\n");
       break;
   }
-  printf("0x39: RegTimer1Coef\n");
-  printf("\tTimer1Coefficient=%d\n", regs[0x39]);
-  printf("0x3a: RegTimer2Coef\n");
-  printf("\tTimer2Coefficient=%d\n", regs[0x3a]);
-  printf("0x3b: RegImageCal\n");
+  fprintf(out, "0x39: RegTimer1Coef\n");
+  fprintf(out, "\tTimer1Coefficient=%d\n", regs[0x39]);
+  fprintf(out, "0x3a: RegTimer2Coef\n");
+  fprintf(out, "\tTimer2Coefficient=%d\n", regs[0x3a]);
+  fprintf(out, "0x3b: RegImageCal\n");
   if ((regs[0x3b] & 0b10000000) != 0) {
-    printf("\tAutoImageCalOn=1\n");
+    fprintf(out, "\tAutoImageCalOn=1\n");
   } else {
-    printf("\tAutoImageCalOn=0\n");
+    fprintf(out, "\tAutoImageCalOn=0\n");
   }
   if ((regs[0x3b] & 0b1000) != 0) {
-    printf("\tTempChange=Temperature change greater than TempThreshold\n");
+    fprintf(out, "\tTempChange=Temperature change greater than TempThreshold\n");
   } else {
-    printf("\tTempChange=Temperature change lower than TempThreshold\n");
+    fprintf(out, "\tTempChange=Temperature change lower than TempThreshold\n");
   }
   switch ((regs[0x3b] & 0b110) >> 1) {
     case 0b00:
-      printf("\tTempThreshold=5 °C\n");
+      fprintf(out, "\tTempThreshold=5 °C\n");
       break;
     case 0b01:
-      printf("\tTempThreshold=10 °C\n");
+      fprintf(out, "\tTempThreshold=10 °C\n");
       break;
     case 0b10:
-      printf("\tTempThreshold=15 °C\n");
+      fprintf(out, "\tTempThreshold=15 °C\n");
       break;
     case 0b11:
-      printf("\tTempThreshold=20 °C\n");
+      fprintf(out, "\tTempThreshold=20 °C\n");
       break;
   }
   if ((regs[0x3b] & 0b1) != 0) {
-    printf("\tTempChange=Temperature monitoring stopped\n");
+    fprintf(out, "\tTempChange=Temperature monitoring stopped\n");
   } else {
-    printf("\tTempChange=Temperature monitoring done in all modes except Sleep and Standby\n");
+    fprintf(out, "\tTempChange=Temperature monitoring done in all modes except Sleep and Standby\n");
   }
-  printf("0x3c: RegTemp\n");
-  printf("\tTempValue=%d\n", regs[0x3c]);
-  printf("0x3d: RegLowBat\n");
+  fprintf(out, "0x3c: RegTemp\n");
+  fprintf(out, "\tTempValue=%d\n", regs[0x3c]);
+  fprintf(out, "0x3d: RegLowBat\n");
   if ((regs[0x3d] & 0b1000) != 0) {
-    printf("\tLowBatOn=1\n");
+    fprintf(out, "\tLowBatOn=1\n");
   } else {
-    printf("\tLowBatOn=0\n");
+    fprintf(out, "\tLowBatOn=0\n");
   }
   switch ((regs[0x3d] & 0b111)) {
     case 0b000:
-      printf("\tLowBatTrim=1.695 V\n");
+      fprintf(out, "\tLowBatTrim=1.695 V\n");
       break;
     case 0b001:
-      printf("\tLowBatTrim=1.764 V\n");
+      fprintf(out, "\tLowBatTrim=1.764 V\n");
       break;
     case 0b010:
-      printf("\tLowBatTrim=1.835 V\n");
+      fprintf(out, "\tLowBatTrim=1.835 V\n");
       break;
     case 0b011:
-      printf("\tLowBatTrim=1.905 V\n");
+      fprintf(out, "\tLowBatTrim=1.905 V\n");
       break;
     case 0b100:
-      printf("\tLowBatTrim=1.976 V\n");
+      fprintf(out, "\tLowBatTrim=1.976 V\n");
       break;
     case 0b101:
-      printf("\tLowBatTrim=2.045 V\n");
+      fprintf(out, "\tLowBatTrim=2.045 V\n");
       break;
     case 0b110:
-      printf("\tLowBatTrim=2.116 V\n");
+      fprintf(out, "\tLowBatTrim=2.116 V\n");
       break;
     case 0b111:
-      printf("\tLowBatTrim=2.185 V\n");
+      fprintf(out, "\tLowBatTrim=2.185 V\n");
       break;
   }
-  printf("0x3e: RegIrqFlags1\n");
+  fprintf(out, "0x3e: RegIrqFlags1\n");
   if ((regs[0x3e] >> 7) & 0x1) {
-    printf("\tModeReady\n");
+    fprintf(out, "\tModeReady\n");
   }
   if ((regs[0x3e] >> 6) & 0x1) {
-    printf("\tRxReady\n");
+    fprintf(out, "\tRxReady\n");
   }
   if ((regs[0x3e] >> 5) & 0x1) {
-    printf("\tTxReady\n");
+    fprintf(out, "\tTxReady\n");
   }
   if ((regs[0x3e] >> 4) & 0x1) {
-    printf("\tPllLock\n");
+    fprintf(out, "\tPllLock\n");
   }
   if ((regs[0x3e] >> 3) & 0x1) {
-    printf("\tRssi\n");
+    fprintf(out, "\tRssi\n");
   }
   if ((regs[0x3e] >> 2) & 0x1) {
-    printf("\tTimeout\n");
+    fprintf(out, "\tTimeout\n");
   }
   if ((regs[0x3e] >> 1) & 0x1) {
-    printf("\tPreambleDetect\n");
+    fprintf(out, "\tPreambleDetect\n");
   }
   if ((regs[0x3e] >> 0) & 0x1) {
-    printf("\tSyncAddressMatch\n");
+    fprintf(out, "\tSyncAddressMatch\n");
   }
-  printf("0x3f: RegIrqFlags2\n");
+  fprintf(out, "0x3f: RegIrqFlags2\n");
   if ((regs[0x3f] >> 7) & 0x1) {
-    printf("\tFifoFull\n");
+    fprintf(out, "\tFifoFull\n");
   }
   if ((regs[0x3f] >> 6) & 0x1) {
-    printf("\tFifoEmpty\n");
+    fprintf(out, "\tFifoEmpty\n");
   }
   if ((regs[0x3f] >> 5) & 0x1) {
-    printf("\tFifoLevel\n");
+    fprintf(out, "\tFifoLevel\n");
   }
   if ((regs[0x3f] >> 4) & 0x1) {
-    printf("\tFifoOverrun\n");
+    fprintf(out, "\tFifoOverrun\n");
   }
   if ((regs[0x3f] >> 3) & 0x1) {
-    printf("\tPacketSent\n");
+    fprintf(out, "\tPacketSent\n");
   }
   if ((regs[0x3f] >> 2) & 0x1) {
-    printf("\tPayloadReady\n");
+    fprintf(out, "\tPayloadReady\n");
   }
   if ((regs[0x3f] >> 1) & 0x1) {
-    printf("\tCrcOk\n");
+    fprintf(out, "\tCrcOk\n");
   }
   if ((regs[0x3f] >> 0) & 0x1) {
-    printf("\tLowBat\n");
+    fprintf(out, "\tLowBat\n");
   }
-  printf("0x40: RegDioMapping1\n");
+  fprintf(out, "0x40: RegDioMapping1\n");
   if ((regs[0x31] & 0b1000000) != 0) {
     uint8_t dio0 = ((regs[0x40] & 0b11000000) >> 6);
     uint8_t dio1 = ((regs[0x40] & 0b00110000) >> 4);
@@ -598,128 +600,128 @@ int dump_fsk_registers(const uint8_t *regs) {
       case 0b000:
         switch (dio1) {
           case 0b00:
-            printf("\tDIO1=FifoLevel\n");
+            fprintf(out, "\tDIO1=FifoLevel\n");
             break;
           case 0b01:
-            printf("\tDIO1=FifoEmpty\n");
+            fprintf(out, "\tDIO1=FifoEmpty\n");
             break;
           case 0b10:
-            printf("\tDIO1=FifoFull\n");
+            fprintf(out, "\tDIO1=FifoFull\n");
             break;
         }
         switch (dio2) {
           case 0b00:
           case 0b10:
           case 0b11:
-            printf("\tDIO2=FifoFull\n");
+            fprintf(out, "\tDIO2=FifoFull\n");
             break;
         }
         switch (dio3) {
           case 0b00:
           case 0b10:
           case 0b11:
-            printf("\tDIO3=FifoEmpty\n");
+            fprintf(out, "\tDIO3=FifoEmpty\n");
             break;
         }
         if (dio5 == 0b00) {
-          printf("\tDIO5=ClkOut if RC\n");
+          fprintf(out, "\tDIO5=ClkOut if RC\n");
         }
         break;
       case 0b001:
       case 0b010:
       case 0b100:
         if (dio0 == 0b11) {
-          printf("\tDIO0=TempChange / LowBat\n");
+          fprintf(out, "\tDIO0=TempChange / LowBat\n");
         }
         switch (dio1) {
           case 0b00:
-            printf("\tDIO1=FifoLevel\n");
+            fprintf(out, "\tDIO1=FifoLevel\n");
             break;
           case 0b01:
-            printf("\tDIO1=FifoEmpty\n");
+            fprintf(out, "\tDIO1=FifoEmpty\n");
             break;
           case 0b10:
-            printf("\tDIO1=FifoFull\n");
+            fprintf(out, "\tDIO1=FifoFull\n");
             break;
         }
         switch (dio2) {
           case 0b00:
           case 0b10:
           case 0b11:
-            printf("\tDIO2=FifoFull\n");
+            fprintf(out, "\tDIO2=FifoFull\n");
             break;
         }
         switch (dio3) {
           case 0b00:
           case 0b10:
           case 0b11:
-            printf("\tDIO3=FifoEmpty\n");
+            fprintf(out, "\tDIO3=FifoEmpty\n");
             break;
         }
         if (dio4 == 0b00) {
-          printf("\tDIO4=TempChange / LowBat\n");
+          fprintf(out, "\tDIO4=TempChange / LowBat\n");
         }
         switch (dio5) {
           case 0b00:
-            printf("\tDIO5=ClkOut\n");
+            fprintf(out, "\tDIO5=ClkOut\n");
             break;
           case 0b11:
-            printf("\tDIO5=ModeReady\n");
+            fprintf(out, "\tDIO5=ModeReady\n");
             break;
         }
         break;
       case 0b011:
         switch (dio0) {
           case 0b00:
-            printf("\tDIO0=PacketSent\n");
+            fprintf(out, "\tDIO0=PacketSent\n");
             break;
           case 0b11:
-            printf("\tDIO0=TempChange / LowBat\n");
+            fprintf(out, "\tDIO0=TempChange / LowBat\n");
             break;
         }
         switch (dio1) {
           case 0b00:
-            printf("\tDIO1=FifoLevel\n");
+            fprintf(out, "\tDIO1=FifoLevel\n");
             break;
           case 0b01:
-            printf("\tDIO1=FifoEmpty\n");
+            fprintf(out, "\tDIO1=FifoEmpty\n");
             break;
           case 0b10:
-            printf("\tDIO1=FifoFull\n");
+            fprintf(out, "\tDIO1=FifoFull\n");
             break;
         }
         switch (dio2) {
           case 0b00:
           case 0b10:
           case 0b11:
-            printf("\tDIO2=FifoFull\n");
+            fprintf(out, "\tDIO2=FifoFull\n");
             break;
         }
         switch (dio3) {
           case 0b00:
           case 0b10:
           case 0b11:
-            printf("\tDIO3=FifoEmpty\n");
+            fprintf(out, "\tDIO3=FifoEmpty\n");
             break;
           case 0b01:
-            printf("\tDIO3=TxReady\n");
+            fprintf(out, "\tDIO3=TxReady\n");
             break;
         }
         if (dio4 == 0b00) {
-          printf("\tDIO4=TempChange / LowBat\n");
+          fprintf(out, "\tDIO4=TempChange / LowBat\n");
         }
         switch (dio5) {
           case 0b00:
-            printf("\tDIO5=ClkOut\n");
+            fprintf(out, "\tDIO5=ClkOut\n");
             break;
           case 0b01:
-            printf("\tDIO5=PllLock\n");
+            fprintf(out, "\tDIO5=PllLock\n");
             break;
           case 0b10:
-            printf("\tDIO5=Data\n");
+            fprintf(out, "\tDIO5=Data\n");
             break;
           case 0b11:
-            printf("\tDIO5=ModeReady\n");
+            fprintf(out, "\tDIO5=ModeReady\n");
             break;
         }
         break;
@@ -727,304 +729,304 @@ int dump_fsk_registers(const uint8_t *regs) {
       case 0b110:
         switch (dio0) {
           case 0b00:
-            printf("\tDIO0=PayloadReady\n");
+            fprintf(out, "\tDIO0=PayloadReady\n");
             break;
           case 0b01:
-            printf("\tDIO0=CrcOk\n");
+            fprintf(out, "\tDIO0=CrcOk\n");
             break;
           case 0b11:
-            printf("\tDIO0=TempChange / LowBat\n");
+            fprintf(out, "\tDIO0=TempChange / LowBat\n");
             break;
         }
         switch (dio1) {
           case 0b00:
-            printf("\tDIO1=FifoLevel\n");
+            fprintf(out, "\tDIO1=FifoLevel\n");
             break;
           case 0b01:
-            printf("\tDIO1=FifoEmpty\n");
+            fprintf(out, "\tDIO1=FifoEmpty\n");
             break;
           case 0b10:
-            printf("\tDIO1=FifoFull\n");
+            fprintf(out, "\tDIO1=FifoFull\n");
             break;
         }
         switch (dio2) {
           case 0b00:
-            printf("\tDIO2=FifoFull\n");
+            fprintf(out, "\tDIO2=FifoFull\n");
             break;
           case 0b01:
-            printf("\tDIO2=RxReady\n");
+            fprintf(out, "\tDIO2=RxReady\n");
             break;
           case 0b10:
-            printf("\tDIO2=Timeout\n");
+            fprintf(out, "\tDIO2=Timeout\n");
             break;
           case 0b11:
-            printf("\tDIO2=SyncAddress\n");
+            fprintf(out, "\tDIO2=SyncAddress\n");
             break;
         }
         switch (dio3) {
           case 0b00:
           case 0b10:
           case 0b11:
-            printf("\tDIO3=FifoEmpty\n");
+            fprintf(out, "\tDIO3=FifoEmpty\n");
             break;
         }
         switch (dio4) {
           case 0b00:
-            printf("\tDIO4=TempChange / LowBat\n");
+            fprintf(out, "\tDIO4=TempChange / LowBat\n");
             break;
           case 0b01:
-            printf("\tDIO4=PllLock\n");
+            fprintf(out, "\tDIO4=PllLock\n");
             break;
           case 0b10:
-            printf("\tDIO4=Timeout\n");
+            fprintf(out, "\tDIO4=Timeout\n");
             break;
           case 0b11:
-            printf("\tDIO4=Rssi/Preamble Detect\n");
+            fprintf(out, "\tDIO4=Rssi/Preamble Detect\n");
             break;
         }
         switch (dio5) {
           case 0b00:
-            printf("\tDIO5=ClkOut\n");
+            fprintf(out, "\tDIO5=ClkOut\n");
             break;
           case 0b01:
-            printf("\tDIO5=PllLock\n");
+            fprintf(out, "\tDIO5=PllLock\n");
             break;
           case 0b10:
-            printf("\tDIO5=Data\n");
+            fprintf(out, "\tDIO5=Data\n");
             break;
           case 0b11:
-            printf("\tDIO5=ModeReady\n");
+            fprintf(out, "\tDIO5=ModeReady\n");
             break;
         }
         break;
     }
   } else {
-    printf("\tDIO mapping in Continuous mode\n");
+    fprintf(out, "\tDIO mapping in Continuous mode\n");
   }
-  printf("0x41: RegDioMapping2\n");
+  fprintf(out, "0x41: RegDioMapping2\n");
   if ((regs[0x41] & 0b1) != 0) {
-    printf("\tMapPreambleDetect=PreambleDetect interrupt\n");
+    fprintf(out, "\tMapPreambleDetect=PreambleDetect interrupt\n");
   } else {
-    printf("\tMapPreambleDetect=Rssi interrupt\n");
+    fprintf(out, "\tMapPreambleDetect=Rssi interrupt\n");
   }
-  printf("0x44: RegPllHop\n");
-  printf("\tFastHopOn=%d\n", ((regs[0x44] & 0b10000000) >> 7));
-  printf("0x4b: RegTcxo\n");
-  printf("\tTcxoInputOn=%d\n", ((regs[0x4b] & 0b10000) >> 4));
-  printf("0x4d: RegPaDac\n");
+  fprintf(out, "0x44: RegPllHop\n");
+  fprintf(out, "\tFastHopOn=%d\n", ((regs[0x44] & 0b10000000) >> 7));
+  fprintf(out, "0x4b: RegTcxo\n");
+  fprintf(out, "\tTcxoInputOn=%d\n", ((regs[0x4b] & 0b10000) >> 4));
+  fprintf(out, "0x4d: RegPaDac\n");
   if ((regs[0x4d] & 0b111) == 0x04) {
-    printf("\tPaDac=Default\n");
+    fprintf(out, "\tPaDac=Default\n");
   } else if ((regs[0x4d] & 0b111) == 0x07) {
-    printf("\tPaDac=+20dBm on PA_BOOST\n");
+    fprintf(out, "\tPaDac=+20dBm on PA_BOOST\n");
   } else {
-    printf("\tPaDac=Invalid\n");
+    fprintf(out, "\tPaDac=Invalid\n");
   }
   return EXIT_SUCCESS;
 }
 
-int dump_lora_registers(uint8_t *regs) {
+int dump_lora_registers(const uint8_t *regs, FILE *out) {
   uint8_t value = regs[0x01];
-  print_op_mode(value);
+  print_op_mode(value, out);
   uint64_t freq = (((uint64_t) regs[0x06]) << 16) | (((uint64_t) regs[0x07]) << 8) | (regs[0x08]);
-  printf("0x06: RegFr:\n");
-  printf("\tFrf=%" PRIu64 "\n", ((freq * 32000000) / (1 << 19)));
-  printf("0x09: RegPaConfig:\n");
+  fprintf(out, "0x06: RegFr:\n");
+  fprintf(out, "\tFrf=%" PRIu64 "\n", ((freq * 32000000) / (1 << 19)));
+  fprintf(out, "0x09: RegPaConfig:\n");
   value = regs[0x09];
   if ((value & 0b10000000) == 0b10000000) {
-    printf("\tPaSelect=PA_BOOST pin\n");
+    fprintf(out, "\tPaSelect=PA_BOOST pin\n");
   } else {
-    printf("\tPaSelect=RFO pin\n");
-  }
-  printf("\tMaxPower=0x%x\n", ((value & 0b110000) >> 4));
-  printf("\tOutputPower=0x%x\n", ((value & 0b1111)));
-  printf("0x0a: RegPaRamp:\n");
-  printf("\tPaRamp=0x%x\n", regs[0x0a]);
-  print_ocp(regs[0x0b]);
-  print_lna(regs[0x0c]);
-  printf("0x0d: RegFifoAddrPtr:\n");
-  printf("\tFifoAddrPtr=%x\n", regs[0x0d]);
-  printf("0x0e: RegFifoTxBaseAddr:\n");
-  printf("\tFifoTxBaseAddr=%x\n", regs[0x0e]);
-  printf("0x0f: RegFifoRxBaseAddr:\n");
-  printf("\tFifoRxBaseAddr=%x\n", regs[0x0f]);
-  printf("0x10: RegFifoRxCurrentAddr:\n");
-  printf("\tFifoRxCurrentAddr=%x\n", regs[0x10]);
+    fprintf(out, "\tPaSelect=RFO pin\n");
+  }
+  fprintf(out, "\tMaxPower=0x%x\n", ((value & 0b110000) >> 4));
+  fprintf(out, "\tOutputPower=0x%x\n", ((value & 0b1111)));
+  fprintf(out, "0x0a: RegPaRamp:\n");
+  fprintf(out, "\tPaRamp=0x%x\n", regs[0x0a]);
+  print_ocp(regs[0x0b], out);
+  print_lna(regs[0x0c], out);
+  fprintf(out, "0x0d: RegFifoAddrPtr:\n");
+  fprintf(out, "\tFifoAddrPtr=%x\n", regs[0x0d]);
+  fprintf(out, "0x0e: RegFifoTxBaseAddr:\n");
+  fprintf(out, "\tFifoTxBaseAddr=%x\n", regs[0x0e]);
+  fprintf(out, "0x0f: RegFifoRxBaseAddr:\n");
+  fprintf(out, "\tFifoRxBaseAddr=%x\n", regs[0x0f]);
+  fprintf(out, "0x10: RegFifoRxCurrentAddr:\n");
+  fprintf(out, "\tFifoRxCurrentAddr=%x\n", regs[0x10]);
   value = regs[0x1d];
-  printf("0x1d: RegModemConfig1:\n");
+  fprintf(out, "0x1d: RegModemConfig1:\n");
   switch (((value & 0b11110000) >> 4)) {
     case 0b0000:
-      printf("\tBw=7.8 kHz\n");
+      fprintf(out, "\tBw=7.8 kHz\n");
       break;
     case 0b0001:
-      printf("\tBw=10.4 kHz\n");
+      fprintf(out, "\tBw=10.4 kHz\n");
       break;
     case 0b0010:
-      printf("\tBw=15.6 kHz\n");
+      fprintf(out, "\tBw=15.6 kHz\n");
       break;
     case 0b0011:
-      printf("\tBw=20.8kHz\n");
+      fprintf(out, "\tBw=20.8kHz\n");
       break;
     case 0b0100:
-      printf("\tBw=31.25 kHz\n");
+      fprintf(out, "\tBw=31.25 kHz\n");
       break;
     case 0b0101:
-      printf("\tBw=41.7 kHz\n");
+      fprintf(out, "\tBw=41.7 kHz\n");
       break;
     case 0b0110:
-      printf("\tBw=62.5 kHz\n");
+      fprintf(out, "\tBw=62.5 kHz\n");
       break;
     case 0b0111:
-      printf("\tBw=125 kHz\n");
+      fprintf(out, "\tBw=125 kHz\n");
       break;
     case 0b1000:
-      printf("\tBw=250 kHz\n");
+      fprintf(out, "\tBw=250 kHz\n");
       break;
     case 0b1001:
-      printf("\tBw=500 kHz\n");
+      fprintf(out, "\tBw=500 kHz\n");
       break;
   }
   switch (((value & 0b1110) >> 1)) {
     case 0b001:
-      printf("\tCodingRate=4/5\n");
+      fprintf(out, "\tCodingRate=4/5\n");
       break;
     case 0b010:
-      printf("\tCodingRate=4/6\n");
+      fprintf(out, "\tCodingRate=4/6\n");
       break;
     case 0b011:
-      printf("\tCodingRate=4/7\n");
+      fprintf(out, "\tCodingRate=4/7\n");
       break;
     case 0b100:
-      printf("\tCodingRate=4/8\n");
+      fprintf(out, "\tCodingRate=4/8\n");
       break;
   }
-  printf("\tImplicitHeaderModeOn=%d\n", (value & 0b1));
-  printf("0x1e: RegModemConfig2\n");
+  fprintf(out, "\tImplicitHeaderModeOn=%d\n", (value & 0b1));
+  fprintf(out, "0x1e: RegModemConfig2\n");
   value = regs[0x1e];
-  printf("\tSpreadingFactor=%d\n", ((value & 0b11110000) >> 4));
+  fprintf(out, "\tSpreadingFactor=%d\n", ((value & 0b11110000) >> 4));
   if (((value & 0b1000) >> 3) != 0) {
-    printf("\tTxContinuousMode=continuous mode\n");
+    fprintf(out, "\tTxContinuousMode=continuous mode\n");
   } else {
-    printf("\tTxContinuousMode=normal mode\n");
-  }
-  printf("\tRxPayloadCrcOn=%d\n", ((value & 0b100) >> 2));
-  printf("0x1f: RegSymbTimeoutLsb:\n");
-  printf("\tSymbTimeout=%d\n", ((regs[0x1e] & 0b11) << 8) | regs[0x1f]);
-  printf("0x20: RegPreamble:\n");
-  printf("\tPreambleLength=%d\n", (regs[0x20] << 8) | regs[0x21]);
-  printf("0x22: RegPayloadLength:\n");
-  printf("\tPayloadLength=%d\n", regs[0x22]);
-  printf("0x23: RegMaxPayloadLength:\n");
-  printf("\tPayloadMaxLength=%d\n", regs[0x23]);
-  printf("0x24: RegHopPeriod:\n");
-  printf("\tFreqHoppingPeriod=%d\n", regs[0x24]);
-  printf("0x25: RegFifoRxByteAddr:\n");
-  printf("\tFifoRxByteAddrPtr=%d\n", regs[0x25]);
-  printf("0x26: RegModemConfig3:\n");
+    fprintf(out, "\tTxContinuousMode=normal mode\n");
+  }
+  fprintf(out, "\tRxPayloadCrcOn=%d\n", ((value & 0b100) >> 2));
+  fprintf(out, "0x1f: RegSymbTimeoutLsb:\n");
+  fprintf(out, "\tSymbTimeout=%d\n", ((regs[0x1e] & 0b11) << 8) | regs[0x1f]);
+  fprintf(out, "0x20: RegPreamble:\n");
+  fprintf(out, "\tPreambleLength=%d\n", (regs[0x20] << 8) | regs[0x21]);
+  fprintf(out, "0x22: RegPayloadLength:\n");
+  fprintf(out, "\tPayloadLength=%d\n", regs[0x22]);
+  fprintf(out, "0x23: RegMaxPayloadLength:\n");
+  fprintf(out, "\tPayloadMaxLength=%d\n", regs[0x23]);
+  fprintf(out, "0x24: RegHopPeriod:\n");
+  fprintf(out, "\tFreqHoppingPeriod=%d\n", regs[0x24]);
+  fprintf(out, "0x25: RegFifoRxByteAddr:\n");
+  fprintf(out, "\tFifoRxByteAddrPtr=%d\n", regs[0x25]);
+  fprintf(out, "0x26: RegModemConfig3:\n");
   value = regs[0x26];
   if ((value & 0b1000) != 0) {
-    printf("\tLowDataRateOptimize=Enabled\n");
+    fprintf(out, "\tLowDataRateOptimize=Enabled\n");
   } else {
-    printf("\tLowDataRateOptimize=Disabled\n");
-  }
-  printf("\tAgcAutoOn=%d\n", ((value & 0b100) >> 2));
-  printf("0x27: PpmCorrection:\n");
-  printf("\tPpmCorrection=%d\n", regs[0x27]);
-  printf("0x31: RegDetectOptimize:\n");
-  printf("\tDetectionOptimize=%d\n", (regs[0x31] & 0b111));
-  printf("0x37: RegDetectionThreshold:\n");
-  printf("\tDetectionThreshold=%d\n", regs[0x37]);
-  printf("0x39: RegSyncWord:\n");
-  printf("\tSyncWord=%d\n", regs[0x39]);
-  printf("0x40: RegDioMapping1\n");
+    fprintf(out, "\tLowDataRateOptimize=Disabled\n");
+  }
+  fprintf(out, "\tAgcAutoOn=%d\n", ((value & 0b100) >> 2));
+  fprintf(out, "0x27: PpmCorrection:\n");
+  fprintf(out, "\tPpmCorrection=%d\n", regs[0x27]);
+  fprintf(out, "0x31: RegDetectOptimize:\n");
+  fprintf(out, "\tDetectionOptimize=%d\n", (regs[0x31] & 0b111));
+  fprintf(out, "0x37: RegDetectionThreshold:\n");
+  fprintf(out, "\tDetectionThreshold=%d\n", regs[0x37]);
+  fprintf(out, "0x39: RegSyncWord:\n");
+  fprintf(out, "\tSyncWord=%d\n", regs[0x39]);
+  fprintf(out, "0x40: RegDioMapping1\n");
   value = ((regs[0x40] & 0b11000000) >> 6);
   switch (value) {
     case 0b00:
-      printf("\tDIO0=RxDone\n");
+      fprintf(out, "\tDIO0=RxDone\n");
       break;
     case 0b01:
-      printf("\tDIO0=TxDone\n");
+      fprintf(out, "\tDIO0=TxDone\n");
       break;
     case 0b10:
-      printf("\tDIO0=CadDone\n");
+      fprintf(out, "\tDIO0=CadDone\n");
       break;
     case 0b11:
-      printf("\tDIO0=Invalid\n");
+      fprintf(out, "\tDIO0=Invalid\n");
       break;
   }
   value = ((regs[0x40] & 0b00110000) >> 4);
   switch (value) {
     case 0b00:
-      printf("\tDIO1=RxTimeout\n");
+      fprintf(out, "\tDIO1=RxTimeout\n");
       break;
     case 0b01:
-      printf("\tDIO1=FhssChangeChannel\n");
+      fprintf(out, "\tDIO1=FhssChangeChannel\n");
       break;
     case 0b10:
-      printf("\tDIO1=CadDetected\n");
+      fprintf(out, "\tDIO1=CadDetected\n");
       break;
     case 0b11:
-      printf("\tDIO1=Invalid\n");
+      fprintf(out, "\tDIO1=Invalid\n");
       break;
   }
   value = ((regs[0x40] & 0b00001100) >> 2);
   switch (value) {
     case 0b00:
-      printf("\tDIO2=FhssChangeChannel\n");
+      fprintf(out, "\tDIO2=FhssChangeChannel\n");
       break;
     case 0b01:
-      printf("\tDIO2=FhssChangeChannel\n");
+      fprintf(out, "\tDIO2=FhssChangeChannel\n");
       break;
     case 0b10:
-      printf("\tDIO2=FhssChangeChannel\n");
+      fprintf(out, "\tDIO2=FhssChangeChannel\n");
       break;
     case 0b11:
-      printf("\tDIO2=Invalid\n");
+      fprintf(out, "\tDIO2=Invalid\n");
       break;
   }
   value = ((regs[0x40] & 0b11));
   switch (value) {
     case 0b00:
-      printf("\tDIO3=CadDone\n");
+      fprintf(out, "\tDIO3=CadDone\n");
       break;
     case 0b01:
-      printf("\tDIO3=ValidHeader\n");
+      fprintf(out, "\tDIO3=ValidHeader\n");
       break;
     case 0b10:
-      printf("\tDIO3=PayloadCrcError\n");
+      fprintf(out, "\tDIO3=PayloadCrcError\n");
       break;
     case 0b11:
-      printf("\tDIO3=Invalid\n");
+      fprintf(out, "\tDIO3=Invalid\n");
       break;
   }
-  printf("0x41: RegDioMapping2\n");
+  fprintf(out, "0x41: RegDioMapping2\n");
   value = ((regs[0x41] & 0b11000000) >> 6);
   switch (value) {
     case 0b00:
-      printf("\tDIO4=CadDetected\n");
+      fprintf(out, "\tDIO4=CadDetected\n");
       break;
     case 0b01:
-      printf("\tDIO4=PllLock\n");
+      fprintf(out, "\tDIO4=PllLock\n");
       break;
     case 0b10:
-      printf("\tDIO4=PllLock\n");
+      fprintf(out, "\tDIO4=PllLock\n");
       break;
     case 0b11:
-      printf("\tDIO4=Invalid\n");
+      fprintf(out, "\tDIO4=Invalid\n");
       break;
   }
   value = ((regs[0x41] & 0b110000) >> 4);
   switch (value) {
     case 0b00:
-      printf("\tDIO5=ModeReady\n");
+      fprintf(out, "\tDIO5=ModeReady\n");
       break;
     case 0b01:
-      printf("\tDIO5=ClkOut\n");
+      fprintf(out, "\tDIO5=ClkOut\n");
       break;
     case 0b10:
-      printf("\tDIO5=ClkOut\n");
+      fprintf(out, "\tDIO5=ClkOut\n");
       break;
     case 0b11:
-      printf("\tDIO5=Invalid\n");
+      fprintf(out, "\tDIO5=Invalid\n");
       break;
   }
   return 0;
@@ -1082,7 +1084,132 @@ int at_util_string2hex(const char *str, uint8_t **output, size_t *output_length)
   return 0;
 }
 
+// registers which are decoded together with the next registers
+static const uint8_t fsk_field_lengths[MAX_NUMBER_OF_REGISTERS] = {
+    [0x02] = 2,  // RegBitrate
+    [0x04] = 2,  // RegFdev
+    [0x06] = 3,  // RegFr
+    [0x25] = 2,  // RegPreamble
+    [0x28] = 8,  // RegSyncValue
+    [0x31] = 2,  // PayloadLength
+};
+
+static const uint8_t lora_field_lengths[MAX_NUMBER_OF_REGISTERS] = {
+    [0x06] = 3,  // RegFr
+    [0x20] = 2,  // RegPreamble
+    [0x28] = 3,  // RegFreqError
+};
+
+int get_field_length(int reg, int lora) {
+  uint8_t length = (lora ? lora_field_lengths[reg] : fsk_field_lengths[reg]);
+  return (length == 0 ? 1 : length);
+}
+
+// decode full register map and print only blocks related to registers [first, last]
+int print_decoded(const uint8_t *regs, int first, int last) {
+  char *buffer = NULL;
+  size_t buffer_length = 0;
+  FILE *decoded = open_memstream(&buffer, &buffer_length);
+  if (decoded == NULL) {
+    return -1;
+  }
+  int lora = ((regs[0x01] & SX127x_MODULATION_LORA) == SX127x_MODULATION_LORA);
+  if (lora) {
+    dump_lora_registers(regs, decoded);
+  } else {
+    dump_fsk_registers(regs, decoded);
+  }
+  fclose(decoded);
+
+  int print = 0;
+  for (char *line = strtok(buffer, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+    if (strncmp(line, "0x", 2) == 0) {
+      int block = (int) strtol(line, NULL, 16);
+      print = (block <= last && block + get_field_length(block, lora) > first);
+    }
+    if (print) {
+      printf("\t%s\n", line);
+    }
+  }
+  free(buffer);
+  return 0;
+}
+
+int decode_trace(const char *filename) {
+  FILE *file = fopen(filename, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "unable to open %s\n", filename);
+    return EXIT_FAILURE;
+  }
+  uint8_t header[SX127X_TRACE_HEADER_LENGTH];
+  if (fread(header, 1, sizeof(header), file) != sizeof(header) || header[0] != 'S' || header[1] != 'T' || header[2] != 1) {
+    fprintf(stderr, "invalid trace format\n");
+    fclose(file);
+    return EXIT_FAILURE;
+  }
+  uint8_t data_length = header[3];
+  uint16_t entries = header[4] | (header[5] << 8);
+  uint32_t total = header[6] | (header[7] << 8) | (header[8] << 16) | ((uint32_t) header[9] << 24);
+  printf("transactions: %" PRIu32 " shown: %d\n", total, entries);
+
+  // registers 0x0d - 0x3f are different for LoRa and FSK/OOK. Reset state is FSK
+  uint8_t fsk[MAX_NUMBER_OF_REGISTERS] = {0};
+  uint8_t lora[MAX_NUMBER_OF_REGISTERS] = {0};
+  uint32_t previous_timestamp = 0;
+  int transaction = -1;
+  for (uint16_t i = 0; i < entries; i++) {
+    uint8_t record[SX127X_TRACE_RECORD_HEADER_LENGTH + 255];
+    if (fread(record, 1, SX127X_TRACE_RECORD_HEADER_LENGTH, file) != SX127X_TRACE_RECORD_HEADER_LENGTH) {
+      fprintf(stderr, "truncated trace\n");
+      fclose(file);
+      return EXIT_FAILURE;
+    }
+    uint32_t timestamp = record[0] | (record[1] << 8) | (record[2] << 16) | ((uint32_t) record[3] << 24);
+    int reg = record[4];
+    uint8_t flags = record[5];
+    uint16_t length = record[6] | (record[7] << 8);
+    uint16_t prefix = (length < data_length ? length : data_length);
+    uint8_t *data = record + SX127X_TRACE_RECORD_HEADER_LENGTH;
+    if (fread(data, 1, prefix, file) != prefix) {
+      fprintf(stderr, "truncated trace\n");
+      fclose(file);
+      return EXIT_FAILURE;
+    }
+    if ((flags & SX127X_TRACE_CONTINUATION) == 0) {
+      transaction++;
+      printf("#%d +%" PRIu32 "\n", transaction, (transaction == 0 ? 0 : timestamp - previous_timestamp));
+      previous_timestamp = timestamp;
+    }
+    printf("  %s 0x%02x length=%d%s:", ((flags & SX127X_TRACE_WRITE) != 0 ? "W" : "R"), reg, length, ((flags & SX127X_TRACE_ERROR) != 0 ? " FAILED" : ""));
+    for (uint16_t j = 0; j < prefix; j++) {
+      printf(" %02x", data[j]);
+    }
+    printf("%s\n", (prefix < length ? " ..." : ""));
+    // fifo or failed transaction
+    if (reg == 0x00 || (flags & SX127X_TRACE_ERROR) != 0) {
+      continue;
+    }
+    for (uint16_t j = 0; j < prefix && reg + j < MAX_NUMBER_OF_REGISTERS; j++) {
+      int cur = reg + j;
+      uint8_t *regs = ((lora[0x01] & 0b10000000) == 0b10000000 ? lora : fsk);
+      if (cur >= SHADOW_BANKED_FIRST && cur <= SHADOW_BANKED_LAST) {
+        regs[cur] = data[j];
+      } else {
+        fsk[cur] = data[j];
+        lora[cur] = data[j];
+      }
+    }
+    uint8_t *regs = ((lora[0x01] & 0b10000000) == 0b10000000 ? lora : fsk);
+    print_decoded(regs, reg, reg + prefix - 1);
+  }
+  fclose(file);
+  return EXIT_SUCCESS;
+}
+
 int main(int argc, char **argv) {
+  if (argc == 3 && strcmp(argv[1], "--trace") == 0) {
+    return decode_trace(argv[2]);
+  }
   if (argc != 2) {
     fprintf(stderr, "missing argument\n");
     return EXIT_FAILURE;
@@ -1094,10 +1221,10 @@ int main(int argc, char **argv) {
     return EXIT_FAILURE;
   }
   if ((output[0x01] & 0b10000000) == 0b10000000) {
-    return dump_lora_registers(output);
+    return dump_lora_registers(output, stdout);
   }
   if ((output[0x01] & 0b00000000) == 0b00000000) {
-    return dump_fsk_registers(output);
+    return dump_fsk_registers(output, stdout);
   }
   if ((output[0x01] & 0b00100000) == 0b00100000) {
     printf("ook is not supported yet");
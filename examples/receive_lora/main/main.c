@@ -30,7 +30,7 @@ void handle_interrupt_task(void *arg) {
   }
 }
 
-void rx_callback(sx127x *device, uint8_t *data, uint16_t data_length) {
+void rx_callback(sx127x *device, uint8_t *data, uint16_t data_length, const sx127x_packet_meta_t *meta) {
   uint8_t payload[514];
   const char SYMBOLS[] = "0123456789ABCDEF";
   for (size_t i = 0; i < data_length; i++) {
@@ -40,13 +40,8 @@ void rx_callback(sx127x *device, uint8_t *data, uint16_t data_length) {
   }
   payload[data_length * 2] = '\0';
 
-  int16_t rssi;
-  ESP_ERROR_CHECK(sx127x_rx_get_packet_rssi(device, &rssi));
-  float snr;
-  ESP_ERROR_CHECK(sx127x_lora_rx_get_packet_snr(device, &snr));
-  int32_t frequency_error;
-  ESP_ERROR_CHECK(sx127x_rx_get_frequency_error(device, &frequency_error));
-  ESP_LOGI(TAG, "received: %d %s rssi: %d snr: %f freq_error: %" PRId32, data_length, payload, rssi, snr, frequency_error);
+  // metadata was read together with the packet
+  ESP_LOGI(TAG, "received: %d %s rssi: %d snr: %f freq_error: %" PRId32, data_length, payload, meta->rssi, meta->snr, meta->frequency_error);
   total_packets_received++;
 }
 
@@ -103,7 +98,7 @@ void app_main() {
   ESP_ERROR_CHECK(sx127x_lora_set_syncword(0x12, &device));
   ESP_ERROR_CHECK(sx127x_set_preamble_length(8, &device));
 
-  sx127x_rx_set_callback(rx_callback, &device);
+  sx127x_rx_set_meta_callback(rx_callback, NULL, &device);
   sx127x_lora_cad_set_callback(cad_callback, &device);
 
   BaseType_t task_code = xTaskCreatePinnedToCore(handle_interrupt_task, "handle interrupt", 8196, &device, 2, &handle_interrupt, xPortGetCoreID());
@@ -18,6 +18,9 @@
 
 sx127x device;
 int total_packets_received = 0;
+// survives deep sleep
+RTC_DATA_ATTR uint8_t snapshot[SX127X_SNAPSHOT_MAX_LENGTH];
+RTC_DATA_ATTR size_t snapshot_length = 0;
 static const char *TAG = "sx127x";
 
 void rx_callback(sx127x *device, uint8_t *data, uint16_t data_length) {
@@ -63,7 +66,9 @@ void app_main() {
   ESP_ERROR_CHECK(sx127x_create(spi_device, &device));
 
   esp_sleep_wakeup_cause_t cpu0WakeupReason = esp_sleep_get_wakeup_cause();
-  if (cpu0WakeupReason == ESP_SLEEP_WAKEUP_EXT0) {
+  if (cpu0WakeupReason == ESP_SLEEP_WAKEUP_EXT0 && snapshot_length > 0) {
+    // no need to read configuration registers
+    ESP_ERROR_CHECK(sx127x_snapshot_restore(snapshot, snapshot_length, &device));
     sx127x_rx_set_callback(rx_callback, &device);
     sx127x_handle_interrupt(&device);
   } else {
@@ -80,6 +85,8 @@ void app_main() {
     ESP_ERROR_CHECK(sx127x_set_preamble_length(8, &device));
     ESP_ERROR_CHECK(sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_LORA, &device));
   }
+  snapshot_length = sizeof(snapshot);
+  ESP_ERROR_CHECK(sx127x_snapshot_save(snapshot, &snapshot_length, &device));
 
   ESP_ERROR_CHECK(rtc_gpio_set_direction((gpio_num_t)DIO0, RTC_GPIO_MODE_INPUT_ONLY));
   ESP_ERROR_CHECK(rtc_gpio_pulldown_en((gpio_num_t)DIO0));
@@ -51,6 +51,8 @@ void app_main() {
   ESP_ERROR_CHECK(sx127x_set_frequency(437200012, &device));
   ESP_ERROR_CHECK(sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_FSK, &device));
   ESP_ERROR_CHECK(sx127x_fsk_ook_set_bitrate(4800.0, &device));
+  // FIFO threshold follows the bit rate and the SPI clock
+  ESP_ERROR_CHECK(sx127x_fsk_ook_set_fifo_threshold_auto(100, dev_cfg.clock_speed_hz, &device));
   ESP_ERROR_CHECK(sx127x_fsk_set_fdev(5000.0, &device));
   ESP_ERROR_CHECK(sx127x_set_preamble_length(4, &device));
   uint8_t syncWord[] = {0x12, 0xAD};
@@ -23,13 +23,23 @@ extern "C" {
 #include "sdkconfig.h"
 #endif
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define MAX_PACKET_SIZE 255
 #define MAX_PACKET_SIZE_FSK_FIXED 2047
 #define MAX_NUMBER_OF_REGISTERS 0x71
+// registers 0x0d - 0x3f have different meaning in LoRa and FSK/OOK modes
+#define SHADOW_BANKED_FIRST 0x0d
+#define SHADOW_BANKED_LAST 0x3f
+#define SHADOW_NUMBER_OF_REGISTERS (MAX_NUMBER_OF_REGISTERS + SHADOW_BANKED_LAST - SHADOW_BANKED_FIRST + 1)
+#define SHADOW_BITMAP_LENGTH ((SHADOW_NUMBER_OF_REGISTERS + 7) / 8)
+// header + bitmap of cached registers + values of cached registers
+#define SX127X_SNAPSHOT_HEADER_LENGTH 16
+#define SX127X_SNAPSHOT_MAX_LENGTH (SX127X_SNAPSHOT_HEADER_LENGTH + SHADOW_BITMAP_LENGTH + SHADOW_NUMBER_OF_REGISTERS)
 
 #define SX127X_OK 0                      /*!< esp_err_t value indicating success (no error) */
+#define SX127X_ERR_NO_MEM 0x101          /*!< Out of memory */
 #define SX127X_ERR_INVALID_ARG 0x102     /*!< Invalid argument */
 #define SX127X_ERR_INVALID_STATE 0x103   /*!< Invalid state. Most likely function is not applicable for the selected modem */
 #define SX127X_ERR_NOT_FOUND 0x105       /*!< Requested resource not found */
@@ -39,6 +49,10 @@ extern "C" {
 #define CONFIG_SX127X_MAX_PACKET_SIZE MAX_PACKET_SIZE_FSK_FIXED
 #endif
 
+#ifndef CONFIG_SX127X_MAX_FHSS_CHANNELS
+#define CONFIG_SX127X_MAX_FHSS_CHANNELS 64
+#endif
+
 /*
  * This structure used to change mode
  */
@@ -146,6 +160,88 @@ typedef enum {
   SX127X_CRC_IBM = 0b00011001     // CrcOn + CrcWhiteningType. Polynomial X16 + X15 + X2 + 1 Seed Value 0xFFFF
 } sx127x_crc_type_t;
 
+/**
+ * @brief Status of the received chunk in FSK/OOK mode
+ *
+ */
+typedef enum {
+  SX127X_RX_CHUNK_PARTIAL = 0,  // more chunks will follow
+  SX127X_RX_CHUNK_LAST = 1,     // last chunk of the packet. CRC is ok or not checked
+  SX127X_RX_CHUNK_DROPPED = 2   // CRC failed. All previous chunks of the packet should be discarded
+} sx127x_rx_chunk_status_t;
+
+/**
+ * @brief Source of the payload for FSK/OOK transmission. Exactly one of buffer and pull should be set.
+ * Payload is written into FIFO directly from the source as transmission progresses, so source must be valid until tx callback.
+ *
+ */
+typedef struct {
+  const uint8_t *buffer;                                            // Whole payload
+  int (*pull)(uint8_t *chunk, uint16_t chunk_length, void *context);  // Produce next chunk_length bytes of payload. Should return SX127X_OK on success
+  void *context;                                                    // Passed to pull
+} sx127x_tx_source_t;
+
+/**
+ * @brief Fixed-size blocks shared between several devices. Device takes the block only while packet is being received or transmitted.
+ *
+ */
+typedef struct {
+  uint8_t *memory;        // blocks_length * block_size bytes
+  uint16_t block_size;    // Max packet size
+  uint8_t blocks_length;  // Up to 32 blocks
+  uint32_t used;          // Bitmap of blocks in use
+} sx127x_packet_pool_t;
+
+/**
+ * @brief Use current frequency for the queued frame
+ */
+#define SX127X_TX_QUEUE_CURRENT_CHANNEL -1
+
+typedef struct {
+  uint8_t *data;       // Payload
+  uint16_t length;     // Payload length
+  int16_t channel;     // Index in the channel plan or SX127X_TX_QUEUE_CURRENT_CHANNEL
+  uint32_t submitted;  // Clock value when frame was queued
+  uint32_t sequence;   // Slot state. Producer owns the slot when sequence equals its position
+} sx127x_tx_slot_t;
+
+/**
+ * @brief Bounded queue of frames to transmit. Any number of threads can submit frames without locks. Frames are taken by the thread which handles interrupts of the device, so the next frame is sent right from TX_DONE / PACKET_SENT.
+ *
+ */
+typedef struct {
+  sx127x_tx_slot_t *slots;
+  uint16_t slots_length;
+  uint16_t slot_size;
+  uint32_t (*clock)(void);  // Used to measure latency. Can be NULL
+  void (*wake)(void *);     // Wakes up the interrupt handler. Can be NULL
+  void *wake_context;       // Argument of wake
+  uint32_t head;            // Number of reserved slots. Written by producers
+  uint32_t tail;            // Next frame to transmit. Written by the interrupt handler
+  bool active;              // Frame from the queue is being transmitted. Interrupt handler only
+  uint32_t sent;            // Frames transmitted
+  uint32_t rejected;        // Frames rejected because queue was full
+  uint32_t failed;          // Frames which failed to start or were aborted during TX
+  uint32_t max_depth;       // Max number of queued frames
+  uint64_t total_latency;   // Sum of delays between submit and start of TX
+  uint32_t max_latency;     // Max delay between submit and start of TX
+} sx127x_tx_queue_t;
+
+/**
+ * @brief TX queue counters. Latency is measured in units of the queue clock
+ *
+ */
+typedef struct {
+  uint32_t submitted;      // Frames accepted by the queue
+  uint32_t sent;           // Frames transmitted
+  uint32_t rejected;       // Frames rejected because queue was full
+  uint32_t failed;         // Frames which failed to start or were aborted during TX
+  uint16_t depth;          // Frames waiting in the queue
+  uint16_t max_depth;      // Max number of frames waiting in the queue
+  uint64_t total_latency;  // Sum of delays between submit and start of TX
+  uint32_t max_latency;    // Max delay between submit and start of TX
+} sx127x_tx_queue_counters_t;
+
 typedef enum {
   SX127X_FIXED = 0b00000000,
   SX127X_VARIABLE = 0b10000000
@@ -254,6 +350,68 @@ typedef struct {
   sx127x_cr_t coding_rate;
 } sx127x_tx_header_t;
 
+/**
+ * @brief Channel of the channel plan. Frequency is converted into register value in advance.
+ *
+ */
+typedef struct {
+  uint8_t frf[3];  // RegFrfMsb, RegFrfMid and RegFrfLsb
+  bool high_band;  // frequency is above 525 MHz. Used to calculate RSSI
+} sx127x_channel_t;
+
+/**
+ * @brief Channel plan. See sx127x_channel_plan_init
+ *
+ */
+typedef struct {
+  sx127x_channel_t *channels;
+  uint8_t channels_length;
+} sx127x_channel_plan_t;
+
+/**
+ * @brief Metadata of the received packet. Captured in the interrupt handler together with the payload.
+ *
+ */
+typedef struct {
+  int16_t rssi;              // RSSI (dBm). In FSK/OOK mode 0 if PreambleDetect or SyncAddress interrupt was not received
+  float snr;                 // SNR (dB). LoRa only
+  int32_t frequency_error;   // Frequency error (Hz). LoRa: FEI, FSK/OOK: AFC value
+  sx127x_cr_t coding_rate;   // Coding rate from the packet header. LoRa only
+  bool crc_present;          // LoRa: CRC was enabled in the packet header. FSK/OOK: CRC is configured
+  uint32_t timestamp;        // Time when the end of packet was handled. 0 if clock is not set
+} sx127x_packet_meta_t;
+
+/**
+ * @brief What to do when the packet is received, but RX ring is full
+ *
+ */
+typedef enum {
+  SX127X_RX_RING_DROP_NEWEST = 0,  // drop received packet
+  SX127X_RX_RING_DROP_OLDEST = 1   // drop the oldest packet not yet taken by the consumer
+} sx127x_rx_ring_overflow_t;
+
+typedef struct {
+  uint8_t *data;              // Packet
+  uint16_t length;            // Packet length
+  sx127x_packet_meta_t meta;  // RSSI, SNR, frequency error and timestamp of the packet
+} sx127x_rx_slot_t;
+
+/**
+ * @brief Lock-free ring of received packets. Interrupt handler is the only producer and reads packets straight into the slots. Single consumer can be in another thread.
+ * Packet held by the consumer stays in its slot and is never dropped or overwritten, so ring keeps up to slots_length packets including the held one.
+ *
+ */
+typedef struct {
+  sx127x_rx_slot_t *slots;
+  uint16_t slots_length;
+  uint16_t slot_size;
+  sx127x_rx_ring_overflow_t overflow;
+  uint32_t head;      // Position of the next slot for producer. Written by producer
+  uint32_t tail;      // Position of the oldest packet shifted left by one. Lowest bit is set while consumer holds it
+  uint32_t received;  // Packets put into the ring
+  uint32_t dropped;   // Packets lost because ring was full
+} sx127x_rx_ring_t;
+
 /**
  * @brief Type of interrupt. Same interrupts can happen on different digital pins.
  *
@@ -305,6 +463,19 @@ typedef enum {
   SX127x_FSK_DIO5_MODE_READY = 0b00110000
 } sx127x_fsk_ook_dio_mapping2_t;
 
+/**
+ * @brief Digital pin which triggered the interrupt. See @ref sx127x_handle_dio
+ *
+ */
+typedef enum {
+  SX127x_DIO0 = 0,
+  SX127x_DIO1 = 1,
+  SX127x_DIO2 = 2,
+  SX127x_DIO3 = 3,
+  SX127x_DIO4 = 4,
+  SX127x_DIO5 = 5
+} sx127x_dio_t;
+
 /**
  * @brief sx127x chip has 2 pins for TX. Based on the pin below chip can produce different max power.
  *
@@ -314,17 +485,122 @@ typedef enum {
   SX127x_PA_PIN_BOOST = 0b10000000  // PA_BOOST pin. Output power is limited to +20 dBm
 } sx127x_pa_pin_t;
 
+#ifndef CONFIG_SX127X_STATS_MAX_APIS
+#define CONFIG_SX127X_STATS_MAX_APIS 32
+#endif
+
+/**
+ * @brief SPI and cache counters
+ */
+typedef struct {
+  uint32_t cache_hits;     // reads served from the shadow registers
+  uint32_t cache_misses;   // reads of cacheable registers which went to the chip
+  uint32_t transactions;   // SPI transactions. Vectored transfer is counted once in total, but for every register it touched
+  uint32_t bytes_read;     // payload bytes read, excluding address byte
+  uint32_t bytes_written;  // payload bytes written, excluding address byte
+} sx127x_stats_counters_t;
+
+/**
+ * @brief Counters attributed to the outermost public function
+ */
+typedef struct {
+  const char *name;
+  sx127x_stats_counters_t counters;
+} sx127x_api_stats_t;
+
+typedef struct {
+  sx127x_stats_counters_t total;
+  sx127x_stats_counters_t registers[MAX_NUMBER_OF_REGISTERS];  // by the first register of transaction
+  sx127x_api_stats_t apis[CONFIG_SX127X_STATS_MAX_APIS];
+  uint8_t apis_length;
+} sx127x_stats_t;
+
+#ifndef CONFIG_SX127X_TRACE_LENGTH
+#define CONFIG_SX127X_TRACE_LENGTH 64
+#endif
+#ifndef CONFIG_SX127X_TRACE_DATA_LENGTH
+#define CONFIG_SX127X_TRACE_DATA_LENGTH 8
+#endif
+
+#define SX127X_TRACE_WRITE 0b00000001
+// segment of the same vectored transfer as previous entry
+#define SX127X_TRACE_CONTINUATION 0b00000010
+#define SX127X_TRACE_ERROR 0b00000100
+
+// header: magic, version, data length, number of entries and total number of transactions
+#define SX127X_TRACE_HEADER_LENGTH 10
+// timestamp, register, flags, length and data prefix
+#define SX127X_TRACE_RECORD_HEADER_LENGTH 8
+#define SX127X_TRACE_DUMP_MAX_LENGTH (SX127X_TRACE_HEADER_LENGTH + CONFIG_SX127X_TRACE_LENGTH * (SX127X_TRACE_RECORD_HEADER_LENGTH + CONFIG_SX127X_TRACE_DATA_LENGTH))
+
+/**
+ * @brief Single SPI transaction or single segment of vectored transfer
+ */
+typedef struct {
+  uint32_t timestamp;
+  uint8_t reg;
+  uint8_t flags;
+  uint16_t length;
+  uint8_t data[CONFIG_SX127X_TRACE_DATA_LENGTH];  // first bytes of data
+} sx127x_trace_entry_t;
+
+typedef struct {
+  sx127x_trace_entry_t entries[CONFIG_SX127X_TRACE_LENGTH];
+  uint32_t head;  // total number of entries ever written
+  uint32_t (*clock)(void);
+} sx127x_trace_t;
+
 /**
  * @brief Wrapper around abstract spi device.
  */
 typedef struct {
   void *spi_device;
 #ifndef CONFIG_SX127X_DISABLE_SPI_CACHE
-  uint8_t shadow_registers[MAX_NUMBER_OF_REGISTERS];
-  uint8_t shadow_registers_sync[MAX_NUMBER_OF_REGISTERS];
+  uint8_t shadow_registers[SHADOW_NUMBER_OF_REGISTERS];
+  uint8_t shadow_registers_cached[SHADOW_BITMAP_LENGTH];
+  uint8_t shadow_registers_dirty[SHADOW_BITMAP_LENGTH];
+  uint8_t bank;
+  bool transaction;
+  bool dirty;
+#endif
+#ifdef CONFIG_SX127X_ENABLE_STATS
+  sx127x_stats_t stats;
+  sx127x_api_stats_t *current_api;
+#endif
+#ifdef CONFIG_SX127X_ENABLE_TRACE
+  sx127x_trace_t trace;
 #endif
 } shadow_spi_device_t;
 
+/**
+ * @brief Consecutive registers of the radio profile
+ *
+ */
+typedef struct {
+  uint8_t reg;      // first register
+  uint8_t length;   // number of registers
+  uint16_t offset;  // index of the first value in sx127x_profile_t.values
+} sx127x_profile_range_t;
+
+/**
+ * @brief Register values and device state of the radio configuration. Generated offline by the profile_generator tool, so no calculations are made at runtime. See sx127x_apply_profile
+ *
+ */
+typedef struct {
+  sx127x_modulation_t modulation;
+  sx127x_packet_format_t fsk_ook_format;  // FSK/OOK only
+  sx127x_crc_type_t fsk_crc_type;         // FSK/OOK only
+  bool use_implicit_header;               // LoRa only
+  uint16_t expected_packet_length;
+  uint8_t fsk_ook_rx_threshold;  // FSK/OOK only
+  uint8_t fsk_ook_rx_batch;      // FSK/OOK only
+  uint8_t fsk_ook_tx_threshold;  // FSK/OOK only
+  uint8_t fsk_ook_tx_batch;      // FSK/OOK only
+  const sx127x_profile_range_t *ranges;
+  uint8_t ranges_length;
+  const uint8_t *values;
+} sx127x_profile_t;
+
 /**
  * @brief Device handle
  *
@@ -340,11 +616,38 @@ struct sx127x_t {
 
   void (*tx_callback)(sx127x *);
 
+  void (*tx_abort_callback)(sx127x *);
+
   void (*cad_callback)(sx127x *, int);
 
+  void (*rx_chunk_callback)(sx127x *, uint8_t *, uint16_t, sx127x_rx_chunk_status_t);
+
+  void (*rx_meta_callback)(sx127x *, uint8_t *, uint16_t, const sx127x_packet_meta_t *);
+
+  uint32_t (*rx_clock)(void);
+  uint32_t irq_timestamp;
+
+#ifdef CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+  uint8_t *packet;
+  uint16_t packet_capacity;
+  uint8_t *packet_buffer;
+  uint16_t packet_buffer_length;
+  sx127x_packet_pool_t *packet_pool;
+  sx127x_rx_ring_t *rx_ring;
+  bool packet_in_ring;
+#else
   uint8_t packet[CONFIG_SX127X_MAX_PACKET_SIZE];
+#endif
+  sx127x_tx_queue_t *tx_queue;
   uint16_t expected_packet_length;
   uint16_t fsk_ook_packet_sent_received;
+  uint8_t fsk_ook_rx_threshold;
+  uint8_t fsk_ook_rx_batch;
+  uint8_t fsk_ook_tx_threshold;
+  uint8_t fsk_ook_tx_batch;
+  sx127x_tx_source_t fsk_ook_tx_source;
+  uint8_t fsk_ook_tx_prefix[2];
+  uint8_t fsk_ook_tx_prefix_length;
   bool fsk_rssi_available;
   int16_t fsk_rssi;
 
@@ -353,9 +656,15 @@ struct sx127x_t {
   sx127x_packet_format_t fsk_ook_format;
   sx127x_crc_type_t fsk_crc_type;
 
-  uint64_t *frequencies;
+  uint8_t frequencies[CONFIG_SX127X_MAX_FHSS_CHANNELS][3];  // RegFrf words
   uint8_t frequencies_length;
   uint8_t current_frequency;
+
+  sx127x_channel_plan_t *channel_plan;
+  bool channel_set;
+  uint8_t current_channel;
+  bool band_known;
+  bool high_band;
 };
 
 /**
@@ -372,6 +681,125 @@ struct sx127x_t {
  */
 int sx127x_create(void *spi_device, sx127x *result);
 
+/**
+ * @brief Read all registers in a single burst and fill the cache. Subsequent read-modify-write operations won't need SPI reads.
+ * Called from @ref sx127x_create if CONFIG_SX127X_WARM_UP_SPI_CACHE is set. Does nothing if CONFIG_SX127X_DISABLE_SPI_CACHE is set.
+ *
+ * @param device Pointer to variable to hold the device handle
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_OK                on success
+ */
+int sx127x_warm_up_cache(sx127x *device);
+
+/**
+ * @brief Start configuration transaction. Until @ref sx127x_config_commit is called, register writes only update shadow registers.
+ * Writes into REG_OP_MODE, FIFO or status registers and reads which cannot be served from the cache flush pending changes first.
+ * Does nothing if CONFIG_SX127X_DISABLE_SPI_CACHE is set.
+ *
+ * @param device Pointer to variable to hold the device handle
+ * @return
+ *         - SX127X_ERR_INVALID_STATE if transaction was already started
+ *         - SX127X_OK                on success
+ */
+int sx127x_config_begin(sx127x *device);
+
+/**
+ * @brief Write all registers changed since @ref sx127x_config_begin. Adjacent registers are merged into burst writes.
+ *
+ * @param device Pointer to variable to hold the device handle
+ * @return
+ *         - SX127X_ERR_INVALID_STATE if transaction was not started
+ *         - SX127X_OK                on success
+ */
+int sx127x_config_commit(sx127x *device);
+
+/**
+ * @brief Get SPI and cache statistics. Requires CONFIG_SX127X_ENABLE_STATS.
+ *
+ * @param device Pointer to variable to hold the device handle
+ * @param stats Statistics since @ref sx127x_create or the last @ref sx127x_reset_stats
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_ERR_INVALID_STATE if statistics are disabled
+ *         - SX127X_OK                on success
+ */
+int sx127x_get_stats(sx127x *device, sx127x_stats_t *stats);
+
+/**
+ * @brief Reset SPI and cache statistics. Requires CONFIG_SX127X_ENABLE_STATS.
+ *
+ * @param device Pointer to variable to hold the device handle
+ * @return
+ *         - SX127X_ERR_INVALID_STATE if statistics are disabled
+ *         - SX127X_OK                on success
+ */
+int sx127x_reset_stats(sx127x *device);
+
+/**
+ * @brief Set source of timestamps for SPI trace. Requires CONFIG_SX127X_ENABLE_TRACE.
+ *
+ * @param clock Function which returns current time. For example, in microseconds. Timestamps are 0 if not set.
+ * @param device Pointer to variable to hold the device handle
+ * @return
+ *         - SX127X_ERR_INVALID_STATE if trace is disabled
+ *         - SX127X_OK                on success
+ */
+int sx127x_trace_set_clock(uint32_t (*clock)(void), sx127x *device);
+
+/**
+ * @brief Export last CONFIG_SX127X_TRACE_LENGTH SPI transactions in compact binary format. Can be decoded by debug_registers tool.
+ * Can be called from another thread while device is active. Entries overwritten during export are skipped.
+ *
+ * @param output Pre-allocated array. Should be at least SX127X_TRACE_DUMP_MAX_LENGTH length.
+ * @param output_length Actual length of the dump
+ * @param device Pointer to variable to hold the device handle
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_ERR_INVALID_STATE if trace is disabled
+ *         - SX127X_OK                on success
+ */
+int sx127x_trace_dump(uint8_t *output, size_t *output_length, sx127x *device);
+
+/**
+ * @brief Serialize cached registers and device state into a versioned blob. The blob can be kept in RTC memory or in a file
+ * and restored after deep sleep using @ref sx127x_snapshot_restore. Callbacks and FHSS frequencies are not saved.
+ *
+ * @param output Pre-allocated array. SX127X_SNAPSHOT_MAX_LENGTH length is always enough.
+ * @param output_length Length of output array on input. Actual length of the snapshot on output
+ * @param device Pointer to variable to hold the device handle
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid or output array is too small
+ *         - SX127X_ERR_INVALID_STATE if configuration transaction is not committed
+ *         - SX127X_OK                on success
+ */
+int sx127x_snapshot_save(uint8_t *output, size_t *output_length, sx127x *device);
+
+/**
+ * @brief Restore cached registers and device state saved by @ref sx127x_snapshot_save. Should be called after @ref sx127x_create.
+ * Device is not re-configured and registers are not read.
+ *
+ * @param input Snapshot
+ * @param input_length Snapshot length
+ * @param device Pointer to variable to hold the device handle
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if snapshot is corrupted or was created by incompatible version
+ *         - SX127X_OK                on success
+ */
+int sx127x_snapshot_restore(const uint8_t *input, size_t input_length, sx127x *device);
+
+/**
+ * @brief Apply radio profile generated by the profile_generator tool. Only registers which are different from the cached values are written. Adjacent registers are combined into bursts and sent in a single transaction.
+ * If profile has different modulation, then device is switched into SLEEP mode first. Profile contains all configuration registers of its modem, so the result doesn't depend on the previous configuration.
+ *
+ * @param profile Radio profile
+ * @param device Pointer to variable to hold the device handle
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_OK                on success
+ */
+int sx127x_apply_profile(const sx127x_profile_t *profile, sx127x *device);
+
 /**
  * @brief Set operating mode.
  *
@@ -395,6 +823,42 @@ int sx127x_set_opmod(sx127x_mode_t mode, sx127x_modulation_t modulation, sx127x
  */
 int sx127x_set_frequency(uint64_t frequency, sx127x *device);
 
+/**
+ * @brief Initialize channel plan. Frequencies are converted into register values using integer arithmetic and rounded to the nearest step (~61 hz).
+ *
+ * @param frequencies Frequencies in hz
+ * @param channels Memory for channels. Should be available while the plan is used
+ * @param channels_length Number of frequencies and channels
+ * @param plan Channel plan
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_OK                on success
+ */
+int sx127x_channel_plan_init(const uint64_t *frequencies, sx127x_channel_t *channels, uint8_t channels_length, sx127x_channel_plan_t *plan);
+
+/**
+ * @brief Use channel plan for sx127x_set_channel. Can be shared between several devices.
+ *
+ * @param plan Channel plan
+ * @param device Pointer to variable to hold the device handle
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_OK                on success
+ */
+int sx127x_set_channel_plan(sx127x_channel_plan_t *plan, sx127x *device);
+
+/**
+ * @brief Switch to the channel from the channel plan. Only register bytes which are different from the current channel are written. No calculations are made.
+ *
+ * @param index Index of the channel in the plan
+ * @param device Pointer to variable to hold the device handle
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if index is out of the plan
+ *         - SX127X_ERR_INVALID_STATE if channel plan is not set
+ *         - SX127X_OK                on success
+ */
+int sx127x_set_channel(uint8_t index, sx127x *device);
+
 /**
  * @brief Get frequency for RX or TX
  * @param device Pointer to variable to hold the device handle
@@ -508,8 +972,8 @@ int sx127x_lora_set_implicit_header(sx127x_implicit_header_t *header, sx127x *de
 regulatory requirements relating to the maximum permissible channel dwell time.
  *
  * @param period Symbol periods between frequency hops.
- * @param frequencies Set of predefined frequencies. Should be the same on RX and TX
- * @param frequencies_length Size of predefined frequencies
+ * @param frequencies Set of predefined frequencies. Should be the same on RX and TX. Converted into register values and copied into the device handle, so hop doesn't need any calculations.
+ * @param frequencies_length Size of predefined frequencies. Cannot be more than CONFIG_SX127X_MAX_FHSS_CHANNELS
  * @param device Pointer to variable to hold the device handle
  * @return
  *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
@@ -539,6 +1003,43 @@ int sx127x_dump_registers(uint8_t *output, sx127x *device);
  */
 void sx127x_handle_interrupt(sx127x *device);
 
+/**
+ * @brief Top half of @ref sx127x_handle_interrupt. Read and clear interrupt flags in the shortest possible SPI transactions. Payload, callbacks and FHSS hops are deferred to @ref sx127x_irq_process.
+ * Can be called right after DIOx interrupt from the context where SPI bus is accessible. Interrupts from several devices can be captured first and processed later.
+ *
+ * @param device Pointer to variable to hold the device handle
+ * @param event Interrupt flags and the state required to process them. Should be passed to @ref sx127x_irq_process as is
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_ERR_INVALID_STATE if modulation is not set
+ *         - SX127X_OK                on success
+ */
+int sx127x_irq_capture(sx127x *device, uint32_t *event);
+
+/**
+ * @brief Bottom half of @ref sx127x_handle_interrupt. Read the payload, hop to the next channel and invoke callbacks for the event captured by @ref sx127x_irq_capture. Can be called later from any thread.
+ * Event is ignored if modulation was changed after it was captured.
+ *
+ * @param event Event returned by @ref sx127x_irq_capture
+ * @param device Pointer to variable to hold the device handle
+ */
+void sx127x_irq_process(uint32_t event, sx127x *device);
+
+/**
+ * @brief Handle interrupt from the known digital pin. Pin mapping is set by @ref sx127x_set_opmod, so interrupt flags are not read when the pin alone tells what happened:
+ *         - LoRa TX: DIO0 TX done, DIO1 and DIO2 FHSS change channel
+ *         - LoRa RX: DIO1 RX timeout in RX single mode, DIO2 FHSS change channel
+ *         - FSK/OOK TX: DIO0 packet sent, DIO1 FIFO level (falling edge), DIO2 FIFO full, DIO3 FIFO empty
+ *         - FSK/OOK RX: DIO0 payload ready (flags are read only if CRC is enabled), DIO1 FIFO level (rising edge), DIO2 sync address, DIO4 preamble detect
+ * Other pins and modes fall back to @ref sx127x_handle_interrupt. Pins should not be re-mapped after @ref sx127x_set_opmod.
+ *
+ * @note This function SHOULD NOT be called from ISR. Use separate ISR-safe function
+ *
+ * @param dio Digital pin which triggered the interrupt
+ * @param device Pointer to variable to hold the device handle
+ */
+void sx127x_handle_dio(sx127x_dio_t dio, sx127x *device);
+
 /**
  * @brief Set RX gain. Can be manual or automatic.
  *
@@ -569,6 +1070,38 @@ int sx127x_rx_set_lna_boost_hf(bool value, sx127x *device);
  */
 void sx127x_rx_set_callback(void (*rx_callback)(sx127x *, uint8_t *, uint16_t), sx127x *device);
 
+/**
+ * @brief Set callback function for rxdone interrupt which also receives metadata of the packet. RSSI, SNR, frequency error and the header information are read together with the payload, so the callback doesn't need any SPI transactions.
+ * If set, it is called instead of the callback set by sx127x_rx_set_callback.
+ *
+ * @param rx_meta_callback Callback function. Should accept pointer to variable to hold the device handle, packet, packet length and metadata. Metadata is valid only during the callback.
+ * @param clock Function which returns current time. For example, in microseconds. Used for packet timestamps. Timestamps are 0 if NULL.
+ * @param device Pointer to variable to hold the device handle
+ */
+void sx127x_rx_set_meta_callback(void (*rx_meta_callback)(sx127x *, uint8_t *, uint16_t, const sx127x_packet_meta_t *), uint32_t (*clock)(void), sx127x *device);
+
+/**
+ * @brief Set callback function for partially received packets in FSK/OOK mode. Called every time batch of bytes was read from FIFO, so long packets can be processed while the rest is still on air.
+ * Chunks are consecutive parts of the same packet. The last chunk might be empty and has status SX127X_RX_CHUNK_LAST. If CRC check failed, then empty chunk with SX127X_RX_CHUNK_DROPPED status is reported.
+ * Callback set by sx127x_rx_set_callback is still called for the whole packet.
+ *
+ * @param rx_chunk_callback Callback function. Should accept pointer to variable to hold the device handle, chunk, chunk length and status.
+ * @param device Pointer to variable to hold the device handle
+ */
+void sx127x_fsk_ook_rx_set_chunk_callback(void (*rx_chunk_callback)(sx127x *, uint8_t *, uint16_t, sx127x_rx_chunk_status_t), sx127x *device);
+
+/**
+ * @brief Check if the packet is being received right now. LoRa modem detected a signal or a valid header, FSK/OOK modem detected a preamble or the sync word.
+ * Switching into another mode aborts the reception.
+ *
+ * @param device Pointer to variable to hold the device handle
+ * @param receiving true if the packet is being received. Always false outside of RX modes
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_OK                on success
+ */
+int sx127x_rx_is_receiving(sx127x *device, bool *receiving);
+
 /**
  * @brief RSSI of the latest packet received (dBm)
  *
@@ -663,6 +1196,14 @@ int sx127x_lora_tx_set_explicit_header(sx127x_tx_header_t *header, sx127x *devic
  */
 void sx127x_tx_set_callback(void (*tx_callback)(sx127x *), sx127x *device);
 
+/**
+ * @brief Set callback function for the frame which was aborted during TX. For example, the rest of FSK/OOK frame can't be written into FIFO. Radio is put into standby and tx callback is not called for this frame.
+ *
+ * @param tx_abort_callback Callback function. Should accept pointer to variable to hold the device handle.
+ * @param device Pointer to variable to hold the device handle
+ */
+void sx127x_tx_set_abort_callback(void (*tx_abort_callback)(sx127x *), sx127x *device);
+
 /**
  * @brief Write packet into sx127x's FIFO for transmittion. Once packet is written, set opmod to TX.
  *
@@ -682,6 +1223,7 @@ int sx127x_lora_tx_set_for_transmission(const uint8_t *data, uint8_t data_length
  * @param data_length Packet length. Maximum length depend on packet format (sx127x_packet_format_t). VARIABLE format is limited by 255 bytes. FIXED format - 2047 bytes
  * @param device Pointer to variable to hold the device handle
  * @return
+ *         - SX127X_ERR_NO_MEM        if packet pool is empty
  *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
  *         - SX127X_OK                on success
  */
@@ -695,11 +1237,39 @@ int sx127x_fsk_ook_tx_set_for_transmission(uint8_t *data, uint16_t data_length,
  * @param address_to Address to send to. Can be Node address or broadcast address
  * @param device Pointer to variable to hold the device handle
  * @return int
+ *         - SX127X_ERR_NO_MEM        if packet pool is empty
  *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
  *         - SX127X_OK                on success
  */
 int sx127x_fsk_ook_tx_set_for_transmission_with_address(uint8_t *data, uint16_t data_length, uint8_t address_to, sx127x *device);
 
+/**
+ * @brief Same as sx127x_fsk_ook_tx_set_for_transmission, but payload is not copied. First part is written into FIFO immediately and the rest is taken from the source on FIFO_LEVEL interrupts.
+ * If the source or SPI fails later, transmission is aborted: radio goes into standby and tx callback is not called.
+ *
+ * @param source Payload source. Must be valid until tx callback
+ * @param data_length Payload length. Maximum length depend on packet format (sx127x_packet_format_t). VARIABLE format is limited by 255 bytes. FIXED format - 2047 bytes
+ * @param device Pointer to variable to hold the device handle
+ * @return int
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_OK                on success
+ */
+int sx127x_fsk_ook_tx_set_source_for_transmission(const sx127x_tx_source_t *source, uint16_t data_length, sx127x *device);
+
+/**
+ * @brief Same as sx127x_fsk_ook_tx_set_for_transmission_with_address, but payload is not copied. First part is written into FIFO immediately and the rest is taken from the source on FIFO_LEVEL interrupts.
+ * If the source or SPI fails later, transmission is aborted: radio goes into standby and tx callback is not called.
+ *
+ * @param source Payload source. Must be valid until tx callback
+ * @param data_length Payload length. Maximum length depend on packet format (sx127x_packet_format_t). VARIABLE format is limited by 254 bytes. FIXED format - 2046 bytes
+ * @param address_to Address to send to. Can be Node address or broadcast address
+ * @param device Pointer to variable to hold the device handle
+ * @return int
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_OK                on success
+ */
+int sx127x_fsk_ook_tx_set_source_for_transmission_with_address(const sx127x_tx_source_t *source, uint16_t data_length, uint8_t address_to, sx127x *device);
+
 /**
  * @brief Start transmitting periodic beacon using FSK/OOK modulation. Packet format must be configured as SX127X_FIXED.
  * 
@@ -724,6 +1294,179 @@ int sx127x_fsk_ook_tx_start_beacon(uint8_t *data, uint8_t data_length, uint32_t
  */
 int sx127x_fsk_ook_tx_stop_beacon(sx127x *device);
 
+/**
+ * @brief Initialize pool of packet buffers. Pool can be shared between several devices, including devices handled from different threads.
+ *
+ * @param memory Memory for blocks. Should be at least block_size * blocks_length bytes
+ * @param block_size Size of each block. Packets bigger than that will be dropped
+ * @param blocks_length Number of blocks. Max 32
+ * @param pool Pool to initialize
+ * @return int
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_OK                on success
+ */
+int sx127x_packet_pool_init(uint8_t *memory, uint16_t block_size, uint8_t blocks_length, sx127x_packet_pool_t *pool);
+
+/**
+ * @brief Use caller-provided buffer for received and transmitted packets. Only available when CONFIG_SX127X_EXTERNAL_PACKET_BUFFER is defined. Should be called after sx127x_create.
+ *
+ * @param buffer Buffer. Must be valid while device is used
+ * @param buffer_length Buffer length. Packets bigger than that will be dropped
+ * @param device Pointer to variable to hold the device handle
+ * @return int
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_ERR_INVALID_STATE if CONFIG_SX127X_EXTERNAL_PACKET_BUFFER is not defined
+ *         - SX127X_OK                on success
+ */
+int sx127x_set_packet_buffer(uint8_t *buffer, uint16_t buffer_length, sx127x *device);
+
+/**
+ * @brief Take buffers for received and transmitted packets from the pool. Only available when CONFIG_SX127X_EXTERNAL_PACKET_BUFFER is defined. Should be called after sx127x_create.
+ * Buffer is taken once packet length is known and returned after rx callback or once whole packet is written into FIFO. If pool is empty, then received packet is dropped.
+ *
+ * @param pool Initialized pool
+ * @param device Pointer to variable to hold the device handle
+ * @return int
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_ERR_INVALID_STATE if CONFIG_SX127X_EXTERNAL_PACKET_BUFFER is not defined
+ *         - SX127X_OK                on success
+ */
+int sx127x_set_packet_pool(sx127x_packet_pool_t *pool, sx127x *device);
+
+/**
+ * @brief Initialize ring of received packets.
+ *
+ * @param slots Array of slots_length slots
+ * @param memory Memory for packets. Should be at least slots_length * slot_size bytes
+ * @param slots_length Number of slots. At least 2
+ * @param slot_size Max packet size. Bigger packets will be dropped
+ * @param overflow Policy when ring is full
+ * @param ring Ring to initialize
+ * @return int
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_OK                on success
+ */
+int sx127x_rx_ring_init(sx127x_rx_slot_t *slots, uint8_t *memory, uint16_t slots_length, uint16_t slot_size, sx127x_rx_ring_overflow_t overflow, sx127x_rx_ring_t *ring);
+
+/**
+ * @brief Receive packets straight into the ring. Only available when CONFIG_SX127X_EXTERNAL_PACKET_BUFFER is defined. Should be called after sx127x_create.
+ * Packet is published into the ring before rx callback, so callback can be used to wake up the consumer.
+ *
+ * @param ring Initialized ring
+ * @param device Pointer to variable to hold the device handle
+ * @return int
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_ERR_INVALID_STATE if CONFIG_SX127X_EXTERNAL_PACKET_BUFFER is not defined
+ *         - SX127X_OK                on success
+ */
+int sx127x_set_rx_ring(sx127x_rx_ring_t *ring, sx127x *device);
+
+/**
+ * @brief Take the oldest received packet. Packet stays valid until sx127x_rx_ring_release. Only one packet can be held at a time. Should be called from the single consumer thread.
+ *
+ * @param ring Ring
+ * @param slot Received packet
+ * @return int
+ *         - SX127X_ERR_NOT_FOUND     if ring is empty
+ *         - SX127X_ERR_INVALID_STATE if previous packet was not released
+ *         - SX127X_OK                on success
+ */
+int sx127x_rx_ring_acquire(sx127x_rx_ring_t *ring, sx127x_rx_slot_t **slot);
+
+/**
+ * @brief Return packet taken by sx127x_rx_ring_acquire.
+ *
+ * @param ring Ring
+ * @return int
+ *         - SX127X_ERR_INVALID_STATE if packet was not acquired
+ *         - SX127X_OK                on success
+ */
+int sx127x_rx_ring_release(sx127x_rx_ring_t *ring);
+
+/**
+ * @brief Get ring counters. Can be called from any thread.
+ *
+ * @param ring Ring
+ * @param received Total number of packets put into the ring
+ * @param dropped Total number of packets lost because ring was full. With SX127X_RX_RING_DROP_OLDEST the newest packet is dropped while the oldest one is held by the consumer
+ */
+void sx127x_rx_ring_get_counters(sx127x_rx_ring_t *ring, uint32_t *received, uint32_t *dropped);
+
+/**
+ * @brief Initialize TX queue
+ *
+ * @param slots Array of slots_length slots
+ * @param memory Buffer of slots_length * slot_size bytes for payloads
+ * @param slots_length Max number of queued frames
+ * @param slot_size Max payload length
+ * @param clock Function which returns current time. Used to measure latency between submit and start of TX. Can be NULL
+ * @param queue Queue to initialize
+ * @return int
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_OK                on success
+ */
+int sx127x_tx_queue_init(sx127x_tx_slot_t *slots, uint8_t *memory, uint16_t slots_length, uint16_t slot_size, uint32_t (*clock)(void), sx127x_tx_queue_t *queue);
+
+/**
+ * @brief Take frames for transmission from the queue. When queue is set, tx callback is called only after the last queued frame was sent or failed. Frame which failed is skipped and the next one is sent.
+ *
+ * @param queue Initialized queue
+ * @param device Pointer to variable to hold the device handle
+ * @return int
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_OK                on success
+ */
+int sx127x_set_tx_queue(sx127x_tx_queue_t *queue, sx127x *device);
+
+/**
+ * @brief Set function which wakes up the thread handling interrupts of the device. It is called by sx127x_tx_queue_submit when the queue might be idle, so the woken thread should call sx127x_tx_queue_start.
+ * Called from the producer thread, so it should only signal the other thread. For example, write into eventfd. See sx127x_linux_event_add_tx_queue
+ *
+ * @param wake Function to call. NULL to disable
+ * @param context Argument of the function
+ * @param queue Queue
+ * @return int
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_OK                on success
+ */
+int sx127x_tx_queue_set_wake(void (*wake)(void *), void *context, sx127x_tx_queue_t *queue);
+
+/**
+ * @brief Copy the frame into the queue. Can be called from any thread and never blocks. Frame is sent using the current modulation once the previous frames are sent.
+ * If the queue was idle, transmission should be started using sx127x_tx_queue_start. Wake function is called for this if it was set.
+ *
+ * @param data Payload
+ * @param data_length Payload length. Cannot be more than slot_size
+ * @param channel Index in the channel plan or SX127X_TX_QUEUE_CURRENT_CHANNEL. See sx127x_set_channel_plan
+ * @param queue Queue
+ * @return int
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_ERR_NO_MEM        if queue is full
+ *         - SX127X_OK                on success
+ */
+int sx127x_tx_queue_submit(const uint8_t *data, uint16_t data_length, int16_t channel, sx127x_tx_queue_t *queue);
+
+/**
+ * @brief Start transmission of the next queued frame if device is not transmitting from the queue already. Should be called from the thread which handles interrupts, i.e. after producer wakes it up.
+ * Following frames are sent from the TX_DONE / PACKET_SENT interrupt without any calls from the application.
+ * Frames which can't be sent are skipped. Radio leaves RX only for the frame with valid length and channel. If none of the taken frames could be started, tx callback is called same as when the queue is drained.
+ *
+ * @param device Pointer to variable to hold the device handle
+ * @return int
+ *         - SX127X_ERR_INVALID_STATE if queue is not set
+ *         - SX127X_ERR_NOT_FOUND     if queue is empty
+ *         - SX127X_OK                on success or if queue is already being transmitted
+ */
+int sx127x_tx_queue_start(sx127x *device);
+
+/**
+ * @brief Get queue counters. Can be called from any thread.
+ *
+ * @param queue Queue
+ * @param counters Counters
+ */
+void sx127x_tx_queue_get_counters(sx127x_tx_queue_t *queue, sx127x_tx_queue_counters_t *counters);
+
 /**
  * @brief Set callback function for caddone interrupt. int argument is 0 when no CAD detected.
  *
@@ -743,6 +1486,21 @@ void sx127x_lora_cad_set_callback(void (*cad_callback)(sx127x *, int), sx127x *d
  */
 int sx127x_fsk_ook_set_bitrate(float bitrate, sx127x *device);
 
+/**
+ * @brief Calculate FIFO thresholds and number of bytes read or written per FIFO_LEVEL interrupt from the current bit rate. By default threshold is half of FIFO.
+ * Margin is the number of bytes received or sent while interrupt is being handled and the whole FIFO is transferred over SPI. In RX the threshold is as high as possible keeping this margin before overrun, in TX - as low as possible keeping this margin before underrun.
+ * Low bit rates will take less interrupts per packet, high bit rates will get more room for the interrupt latency.
+ * Should be called after sx127x_fsk_ook_set_bitrate and before sx127x_set_opmod.
+ *
+ * @param interrupt_latency_us Worst time between FIFO_LEVEL interrupt and the start of sx127x_handle_interrupt in microseconds
+ * @param spi_frequency SPI clock in Hz
+ * @param device Pointer to variable to hold the device handle
+ * @return int
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid or latency can't be handled at the current bit rate
+ *         - SX127X_OK                on success
+ */
+int sx127x_fsk_ook_set_fifo_threshold_auto(uint32_t interrupt_latency_us, uint32_t spi_frequency, sx127x *device);
+
 /**
  * @brief Set frequency deviation for FSK modulation. It is most efficient when the modulation index of the signal is greater than 0.5 and below 10.
  *
@@ -0,0 +1,269 @@
+// Copyright 2022 Andrey Rodionov <dernasherbrezon@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//         http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef sx127x_linux_concentrator_h
+#define sx127x_linux_concentrator_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sx127x.h>
+#include <sx127x_linux_event.h>
+
+#ifndef CONFIG_SX127X_LINUX_CONCENTRATOR_MAX_RADIOS
+#define CONFIG_SX127X_LINUX_CONCENTRATOR_MAX_RADIOS 16
+#endif
+
+#ifndef CONFIG_SX127X_LINUX_CONCENTRATOR_MAX_BUSES
+#define CONFIG_SX127X_LINUX_CONCENTRATOR_MAX_BUSES 4
+#endif
+
+#ifndef CONFIG_SX127X_LINUX_CONCENTRATOR_RX_QUEUE
+#define CONFIG_SX127X_LINUX_CONCENTRATOR_RX_QUEUE 64
+#endif
+
+// rx_head and rx_tail are free running counters. Their remainder stays continuous across the counter overflow only for power of two
+#if (CONFIG_SX127X_LINUX_CONCENTRATOR_RX_QUEUE & (CONFIG_SX127X_LINUX_CONCENTRATOR_RX_QUEUE - 1)) != 0
+#error "CONFIG_SX127X_LINUX_CONCENTRATOR_RX_QUEUE should be power of two"
+#endif
+
+#ifndef CONFIG_SX127X_LINUX_CONCENTRATOR_PACKET_SIZE
+#define CONFIG_SX127X_LINUX_CONCENTRATOR_PACKET_SIZE MAX_PACKET_SIZE
+#endif
+
+typedef struct sx127x_linux_concentrator_t sx127x_linux_concentrator_t;
+
+/**
+ * @brief Radio owned by the concentrator. Device handle is accessed only while the lock of its bus is held.
+ *
+ */
+typedef struct {
+  sx127x device;                               // Device handle. Modem can be configured using this handle before sx127x_linux_concentrator_start
+  sx127x_linux_concentrator_t *concentrator;   // Owner
+  uint8_t id;                                  // Index of the radio. Received packets are tagged with it
+  uint8_t bus;                                 // Index of the bus
+  uint8_t rx_channel;                          // Channel of the channel plan used for RX. Radio returns to it after TX
+  bool transmitting;                           // Radio is busy with TX
+  uint32_t received;                           // Packets received by this radio
+  uint32_t transmitted;                        // Packets transmitted by this radio
+} sx127x_linux_concentrator_radio_t;
+
+/**
+ * @brief Radios sharing the same SPI bus. They are handled by the single thread and guarded by the single lock.
+ *
+ */
+typedef struct {
+  pthread_mutex_t lock;        // Held while any device on the bus is accessed
+  pthread_t thread;            // Event thread
+  int cpu;                     // CPU the thread is pinned to. -1 if not pinned
+  int epoll_fd;                // Waits for the event loop and the stop signal
+  int stop_fd;                 // eventfd used to stop the thread
+  sx127x_linux_event_t loop;   // Interrupts of radios on the bus
+  bool running;
+} sx127x_linux_concentrator_bus_t;
+
+/**
+ * @brief Packet received by any radio of the concentrator
+ *
+ */
+typedef struct {
+  uint8_t radio;                                            // Radio which received the packet
+  uint16_t length;                                          // Packet length
+  sx127x_packet_meta_t meta;                                // RSSI, SNR, frequency error and kernel timestamp of the interrupt
+  uint8_t data[CONFIG_SX127X_LINUX_CONCENTRATOR_PACKET_SIZE];  // Packet
+} sx127x_linux_concentrator_packet_t;
+
+/**
+ * @brief Several radios on one or more SPI buses with the unified RX queue and TX dispatcher
+ *
+ */
+struct sx127x_linux_concentrator_t {
+  sx127x_channel_plan_t *plan;
+  sx127x_linux_concentrator_radio_t radios[CONFIG_SX127X_LINUX_CONCENTRATOR_MAX_RADIOS];
+  uint8_t radios_length;
+  sx127x_linux_concentrator_bus_t buses[CONFIG_SX127X_LINUX_CONCENTRATOR_MAX_BUSES];
+  uint8_t buses_length;
+
+  pthread_mutex_t rx_lock;
+  pthread_cond_t rx_ready;
+  sx127x_linux_concentrator_packet_t rx_queue[CONFIG_SX127X_LINUX_CONCENTRATOR_RX_QUEUE];
+  uint32_t rx_head;   // Number of queued packets
+  uint32_t rx_tail;   // Next packet for consumer
+  uint32_t dropped;   // Packets lost because queue was full or packet was too big
+};
+
+/**
+ * @brief Create concentrator. Concentrator structure is big, so it is better to allocate it on the heap.
+ *
+ * @param plan Channel plan shared by all radios. See sx127x_channel_plan_init
+ * @param concentrator Pointer to the concentrator
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - errno                    if lock cannot be initialized
+ *         - SX127X_OK                on success
+ */
+int sx127x_linux_concentrator_create(sx127x_channel_plan_t *plan, sx127x_linux_concentrator_t *concentrator);
+
+/**
+ * @brief Add SPI bus. Each bus is handled by its own thread.
+ *
+ * @param cpu CPU to pin the thread to. -1 to let the scheduler decide
+ * @param bus Index of the new bus
+ * @param concentrator Pointer to the concentrator
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_ERR_NO_MEM        if there are already CONFIG_SX127X_LINUX_CONCENTRATOR_MAX_BUSES buses
+ *         - errno                    if epoll or eventfd cannot be created
+ *         - SX127X_OK                on success
+ */
+int sx127x_linux_concentrator_add_bus(int cpu, uint8_t *bus, sx127x_linux_concentrator_t *concentrator);
+
+/**
+ * @brief Create device handle and attach it to the bus. Modem should be configured using concentrator->radios[radio].device before sx127x_linux_concentrator_start.
+ * RX, TX and TX abort callbacks are installed by the concentrator and should not be changed.
+ *
+ * @param bus Index of the bus
+ * @param spi_device SPI device. See sx127x_create
+ * @param rx_channel Channel of the channel plan used for RX
+ * @param radio Index of the new radio
+ * @param concentrator Pointer to the concentrator
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_ERR_NO_MEM        if there are already CONFIG_SX127X_LINUX_CONCENTRATOR_MAX_RADIOS radios
+ *         - SX127X_OK                on success
+ */
+int sx127x_linux_concentrator_add_radio(uint8_t bus, void *spi_device, uint8_t rx_channel, uint8_t *radio, sx127x_linux_concentrator_t *concentrator);
+
+/**
+ * @brief Request DIO lines of the radio. See sx127x_linux_event_add
+ *
+ * @param radio Index of the radio
+ * @param chip_path GPIO chip. For example: /dev/gpiochip0
+ * @param offsets GPIO line offsets
+ * @param dios DIO connected to the GPIO line with the same index
+ * @param lines_length Number of lines. Max SX127X_LINUX_EVENT_MAX_LINES
+ * @param concentrator Pointer to the concentrator
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_ERR_NO_MEM        if there are already CONFIG_SX127X_LINUX_EVENT_MAX_SOURCES radios with lines on the bus
+ *         - errno                    if lines cannot be requested
+ *         - SX127X_OK                on success
+ */
+int sx127x_linux_concentrator_add_lines(uint8_t radio, const char *chip_path, const uint32_t *offsets, const sx127x_dio_t *dios, uint8_t lines_length, sx127x_linux_concentrator_t *concentrator);
+
+/**
+ * @brief Use already opened file descriptor as a source of DIO events of the radio. See sx127x_linux_event_add_fd
+ *
+ * @param radio Index of the radio
+ * @param fd File descriptor
+ * @param offsets GPIO line offsets
+ * @param dios DIO connected to the GPIO line with the same index
+ * @param lines_length Number of lines. Max SX127X_LINUX_EVENT_MAX_LINES
+ * @param concentrator Pointer to the concentrator
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_ERR_NO_MEM        if there are already CONFIG_SX127X_LINUX_EVENT_MAX_SOURCES radios with lines on the bus
+ *         - errno                    if fd cannot be added to epoll
+ *         - SX127X_OK                on success
+ */
+int sx127x_linux_concentrator_add_fd(uint8_t radio, int fd, const uint32_t *offsets, const sx127x_dio_t *dios, uint8_t lines_length, sx127x_linux_concentrator_t *concentrator);
+
+/**
+ * @brief Send frames of the TX queue using the radio. Frames are taken by the bus thread as soon as they are submitted. Radio returns to its RX channel after the queue is drained.
+ * Radio is not used by sx127x_linux_concentrator_tx while it transmits frames from the queue. Should be called before sx127x_linux_concentrator_start. See sx127x_linux_event_add_tx_queue
+ *
+ * @param radio Index of the radio
+ * @param queue Initialized queue. See sx127x_tx_queue_init
+ * @param concentrator Pointer to the concentrator
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_ERR_INVALID_STATE if concentrator is started
+ *         - SX127X_ERR_NO_MEM        if there are already CONFIG_SX127X_LINUX_EVENT_MAX_SOURCES sources on the bus
+ *         - errno                    if eventfd cannot be created
+ *         - SX127X_OK                on success
+ */
+int sx127x_linux_concentrator_add_tx_queue(uint8_t radio, sx127x_tx_queue_t *queue, sx127x_linux_concentrator_t *concentrator);
+
+/**
+ * @brief Tune all radios to their RX channels, switch them into continuous RX and start bus threads.
+ *
+ * @param concentrator Pointer to the concentrator
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_ERR_INVALID_STATE if concentrator is already started
+ *         - errno                    if thread cannot be started
+ *         - SX127X_OK                on success
+ */
+int sx127x_linux_concentrator_start(sx127x_linux_concentrator_t *concentrator);
+
+/**
+ * @brief Transmit packet using the idle radio. Radio already tuned to the channel is preferred, otherwise any idle radio is tuned to the channel and returns to its RX channel after TX.
+ * Radio which is receiving a packet is used only if all other radios are busy. Its reception is aborted.
+ * Can be called from any thread.
+ *
+ * @param channel Channel of the channel plan
+ * @param data Packet. Copied into the radio before the function returns
+ * @param data_length Packet length
+ * @param radio Index of the radio which transmits the packet. Can be NULL
+ * @param concentrator Pointer to the concentrator
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid or none of radios can send the packet of such length
+ *         - SX127X_ERR_NOT_FOUND     if all radios are busy with TX
+ *         - SX127X_OK                on success
+ */
+int sx127x_linux_concentrator_tx(uint8_t channel, const uint8_t *data, uint16_t data_length, uint8_t *radio, sx127x_linux_concentrator_t *concentrator);
+
+/**
+ * @brief Take the oldest packet received by any radio. Can be called from any thread.
+ *
+ * @param timeout_ms Timeout in milliseconds. 0 to return immediately, -1 to wait forever
+ * @param packet Where the packet will be copied to
+ * @param concentrator Pointer to the concentrator
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_ERR_NOT_FOUND     if no packet was received within the timeout
+ *         - SX127X_OK                on success
+ */
+int sx127x_linux_concentrator_rx(int timeout_ms, sx127x_linux_concentrator_packet_t *packet, sx127x_linux_concentrator_t *concentrator);
+
+/**
+ * @brief Get RX queue counters
+ *
+ * @param concentrator Pointer to the concentrator
+ * @param received Number of packets put into the RX queue
+ * @param dropped Number of packets lost because queue was full or packet was longer than CONFIG_SX127X_LINUX_CONCENTRATOR_PACKET_SIZE
+ */
+void sx127x_linux_concentrator_get_counters(sx127x_linux_concentrator_t *concentrator, uint32_t *received, uint32_t *dropped);
+
+/**
+ * @brief Stop bus threads and put all radios into standby. Can be started again using sx127x_linux_concentrator_start
+ *
+ * @param concentrator Pointer to the concentrator
+ */
+void sx127x_linux_concentrator_stop(sx127x_linux_concentrator_t *concentrator);
+
+/**
+ * @brief Stop the concentrator and release all resources
+ *
+ * @param concentrator Pointer to the concentrator
+ */
+void sx127x_linux_concentrator_destroy(sx127x_linux_concentrator_t *concentrator);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,153 @@
+// Copyright 2022 Andrey Rodionov <dernasherbrezon@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//         http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef sx127x_linux_event_h
+#define sx127x_linux_event_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sx127x.h>
+
+#ifndef CONFIG_SX127X_LINUX_EVENT_MAX_SOURCES
+#define CONFIG_SX127X_LINUX_EVENT_MAX_SOURCES 8
+#endif
+
+/**
+ * @brief Max number of DIO lines per device
+ */
+#define SX127X_LINUX_EVENT_MAX_LINES 6
+
+/**
+ * @brief Number of GPIO events read from the line request in a single read() call
+ */
+#define SX127X_LINUX_EVENT_BATCH 16
+
+/**
+ * @brief DIO lines of a single device. All lines are requested in one GPIO v2 line request.
+ *
+ */
+typedef struct {
+  int fd;                                            // line request or any other file descriptor which produces struct gpio_v2_line_event
+  bool owned;                                        // fd is closed by sx127x_linux_event_destroy
+  sx127x *device;                                    // device handle
+  uint32_t offsets[SX127X_LINUX_EVENT_MAX_LINES];    // GPIO line offsets on the chip
+  sx127x_dio_t dios[SX127X_LINUX_EVENT_MAX_LINES];   // DIO connected to the line with the same index
+  uint8_t lines_length;                              // number of lines
+  uint32_t seqno;                                    // sequence number of the last handled event. 0 if no events were handled
+  uint32_t overflows;                                // number of times kernel dropped events
+  sx127x_tx_queue_t *tx_queue;                       // queue started when eventfd is signaled. NULL for DIO lines
+} sx127x_linux_event_source_t;
+
+/**
+ * @brief Single epoll loop for interrupts from several devices
+ *
+ */
+typedef struct {
+  int epoll_fd;
+  sx127x_linux_event_source_t sources[CONFIG_SX127X_LINUX_EVENT_MAX_SOURCES];
+  uint8_t sources_length;
+} sx127x_linux_event_t;
+
+/**
+ * @brief Create event loop
+ *
+ * @param loop Pointer to the event loop
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - errno                    if epoll cannot be created
+ *         - SX127X_OK                on success
+ */
+int sx127x_linux_event_create(sx127x_linux_event_t *loop);
+
+/**
+ * @brief Request DIO lines using GPIO v2 uAPI and add them to the event loop. Both edges are requested: FIFO level in FSK/OOK TX is handled on the falling edge, the rest on the rising edge.
+ *
+ * @param chip_path GPIO chip. For example: /dev/gpiochip0
+ * @param offsets GPIO line offsets
+ * @param dios DIO connected to the GPIO line with the same index
+ * @param lines_length Number of lines. Max SX127X_LINUX_EVENT_MAX_LINES
+ * @param device Pointer to variable to hold the device handle
+ * @param loop Pointer to the event loop
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_ERR_NO_MEM        if there are already CONFIG_SX127X_LINUX_EVENT_MAX_SOURCES sources
+ *         - errno                    if lines cannot be requested
+ *         - SX127X_OK                on success
+ */
+int sx127x_linux_event_add(const char *chip_path, const uint32_t *offsets, const sx127x_dio_t *dios, uint8_t lines_length, sx127x *device, sx127x_linux_event_t *loop);
+
+/**
+ * @brief Add already opened file descriptor. It should produce struct gpio_v2_line_event records. Can be used to replay events from pipe or socket without the real GPIO chip. File descriptor is switched into non-blocking mode and not closed by the loop.
+ *
+ * @param fd File descriptor
+ * @param offsets GPIO line offsets
+ * @param dios DIO connected to the GPIO line with the same index
+ * @param lines_length Number of lines. Max SX127X_LINUX_EVENT_MAX_LINES
+ * @param device Pointer to variable to hold the device handle
+ * @param loop Pointer to the event loop
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_ERR_NO_MEM        if there are already CONFIG_SX127X_LINUX_EVENT_MAX_SOURCES sources
+ *         - errno                    if fd cannot be added to epoll
+ *         - SX127X_OK                on success
+ */
+int sx127x_linux_event_add_fd(int fd, const uint32_t *offsets, const sx127x_dio_t *dios, uint8_t lines_length, sx127x *device, sx127x_linux_event_t *loop);
+
+/**
+ * @brief Set TX queue of the device and start it from the event loop. Producers signal the loop through eventfd using @ref sx127x_tx_queue_set_wake, so frames are sent from the thread which handles interrupts of the device.
+ *
+ * @param queue Initialized queue. See sx127x_tx_queue_init
+ * @param device Pointer to variable to hold the device handle
+ * @param loop Pointer to the event loop
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_ERR_NO_MEM        if there are already CONFIG_SX127X_LINUX_EVENT_MAX_SOURCES sources
+ *         - errno                    if eventfd cannot be created
+ *         - SX127X_OK                on success
+ */
+int sx127x_linux_event_add_tx_queue(sx127x_tx_queue_t *queue, sx127x *device, sx127x_linux_event_t *loop);
+
+/**
+ * @brief Wait for GPIO events and handle them. All queued events are read in batches and handled in order using @ref sx127x_handle_dio. If kernel dropped some events, then @ref sx127x_handle_interrupt is called to catch up.
+ *
+ * @param timeout_ms Timeout in milliseconds. -1 to wait forever
+ * @param loop Pointer to the event loop
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - errno                    if events cannot be read
+ *         - SX127X_OK                on success or timeout
+ */
+int sx127x_linux_event_poll(int timeout_ms, sx127x_linux_event_t *loop);
+
+/**
+ * @brief Kernel timestamp of the GPIO event being handled in microseconds (CLOCK_MONOTONIC). Can be used as a clock in @ref sx127x_rx_set_meta_callback, so packet timestamp is the time of the interrupt rather than the time it was handled.
+ *
+ * @return Timestamp of the current event. 0 outside of @ref sx127x_linux_event_poll
+ */
+uint32_t sx127x_linux_event_clock(void);
+
+/**
+ * @brief Close epoll and line requests opened by the loop
+ *
+ * @param loop Pointer to the event loop
+ */
+void sx127x_linux_event_destroy(sx127x_linux_event_t *loop);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
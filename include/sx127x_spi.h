@@ -21,6 +21,22 @@ extern "C" {
 #include <stddef.h>
 #include <stdint.h>
 
+/**
+ * @brief Max number of segments that can be submitted in the single call to sx127x_spi_transfer
+ */
+#define SX127X_SPI_MAX_SEGMENTS 16
+
+/**
+ * @brief Single segment of the vectored SPI transfer. Segment starts with the register address followed by length bytes of data.
+ * Exactly one of rx_buffer and tx_buffer should be set.
+ */
+typedef struct {
+  int reg;                   // Register
+  uint8_t *rx_buffer;        // Buffer to read to. NULL for write segments
+  const uint8_t *tx_buffer;  // Buffer to write from. NULL for read segments
+  size_t length;             // Number of bytes to read or write
+} sx127x_spi_segment_t;
+
 /**
  * @brief Read up to 4 bytes from device via SPI
  * 
@@ -73,6 +89,19 @@ int sx127x_spi_write_register(int reg, const uint8_t *data, size_t data_length,
  */
 int sx127x_spi_write_buffer(int reg, const uint8_t *buffer, size_t buffer_length, void *spi_device);
 
+/**
+ * @brief Execute several read or write segments in one go. Chip select is toggled between segments, so every segment is the separate SPI transaction from the chip's point of view.
+ * Implementations that cannot submit multiple segments at once can execute them in a loop.
+ *
+ * @param segments Segments to execute in order
+ * @param segments_length Number of segments. Cannot be more than SX127X_SPI_MAX_SEGMENTS
+ * @param spi_device Pointer to variable to hold the device handle. Can be different on different platforms
+ * @return
+ *         - SX127X_ERR_INVALID_ARG   if parameter is invalid
+ *         - SX127X_OK                on success
+ */
+int sx127x_spi_transfer(sx127x_spi_segment_t *segments, size_t segments_length, void *spi_device);
+
 #ifdef __cplusplus
 }
 #endif
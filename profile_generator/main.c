@@ -0,0 +1,540 @@
+#define _POSIX_C_SOURCE 200809L
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sx127x.h>
+#include <sx127x_spi.h>
+
+#include "registers.h"
+
+#define MAX_LINE_LENGTH 256
+
+// In-memory chip. Registers 0x0d - 0x3f are different in FSK/OOK and LoRa modes
+typedef struct {
+  uint8_t registers[MAX_NUMBER_OF_REGISTERS];
+  uint8_t lora_registers[SHADOW_BANKED_LAST - SHADOW_BANKED_FIRST + 1];
+  bool written[MAX_NUMBER_OF_REGISTERS];
+  bool lora_written[SHADOW_BANKED_LAST - SHADOW_BANKED_FIRST + 1];
+} chip_t;
+
+static bool chip_is_lora(chip_t *chip) {
+  return (chip->registers[REG_OP_MODE] & SX127x_MODULATION_LORA) != 0;
+}
+
+static uint8_t *chip_register(chip_t *chip, int reg) {
+  if (chip_is_lora(chip) && reg >= SHADOW_BANKED_FIRST && reg <= SHADOW_BANKED_LAST) {
+    return chip->lora_registers + (reg - SHADOW_BANKED_FIRST);
+  }
+  return chip->registers + reg;
+}
+
+static bool *chip_written(chip_t *chip, int reg) {
+  if (chip_is_lora(chip) && reg >= SHADOW_BANKED_FIRST && reg <= SHADOW_BANKED_LAST) {
+    return chip->lora_written + (reg - SHADOW_BANKED_FIRST);
+  }
+  return chip->written + reg;
+}
+
+static int chip_read(int reg, uint8_t *buffer, size_t buffer_length, chip_t *chip) {
+  for (size_t i = 0; i < buffer_length; i++) {
+    // fifo is not part of configuration
+    buffer[i] = (reg == REG_FIFO ? 0 : *chip_register(chip, reg + i));
+  }
+  return SX127X_OK;
+}
+
+static int chip_write(int reg, const uint8_t *data, size_t data_length, chip_t *chip) {
+  if (reg == REG_FIFO) {
+    return SX127X_OK;
+  }
+  for (size_t i = 0; i < data_length; i++) {
+    *chip_register(chip, reg + i) = data[i];
+    *chip_written(chip, reg + i) = true;
+  }
+  return SX127X_OK;
+}
+
+int sx127x_spi_read_registers(int reg, void *spi_device, size_t data_length, uint32_t *result) {
+  uint8_t buffer[sizeof(uint32_t)];
+  chip_read(reg, buffer, data_length, spi_device);
+  *result = 0;
+  for (size_t i = 0; i < data_length; i++) {
+    *result = ((*result) << 8) | buffer[i];
+  }
+  return SX127X_OK;
+}
+
+int sx127x_spi_read_buffer(int reg, uint8_t *buffer, size_t buffer_length, void *spi_device) {
+  return chip_read(reg, buffer, buffer_length, spi_device);
+}
+
+int sx127x_spi_write_register(int reg, const uint8_t *data, size_t data_length, void *spi_device) {
+  return chip_write(reg, data, data_length, spi_device);
+}
+
+int sx127x_spi_write_buffer(int reg, const uint8_t *buffer, size_t buffer_length, void *spi_device) {
+  return chip_write(reg, buffer, buffer_length, spi_device);
+}
+
+int sx127x_spi_transfer(sx127x_spi_segment_t *segments, size_t segments_length, void *spi_device) {
+  for (size_t i = 0; i < segments_length; i++) {
+    if (segments[i].tx_buffer != NULL) {
+      chip_write(segments[i].reg, segments[i].tx_buffer, segments[i].length, spi_device);
+    } else {
+      chip_read(segments[i].reg, segments[i].rx_buffer, segments[i].length, spi_device);
+    }
+  }
+  return SX127X_OK;
+}
+
+// registers which trigger actions or are changed by the chip
+static bool is_excluded(int reg, bool lora) {
+  if (reg == REG_FIFO || reg == REG_OP_MODE) {
+    return true;
+  }
+  if (lora) {
+    return reg == 0x0d || reg == 0x12;
+  }
+  return reg == 0x3b || reg == 0x3e || reg == 0x3f;
+}
+
+static int parse_baseline(const char *value, chip_t *chip) {
+  char *copy = strdup(value);
+  int reg = 0;
+  for (char *token = strtok(copy, ","); token != NULL; token = strtok(NULL, ",")) {
+    if (reg >= MAX_NUMBER_OF_REGISTERS) {
+      break;
+    }
+    chip->registers[reg] = (uint8_t) strtol(token, NULL, 0);
+    reg++;
+  }
+  free(copy);
+  if (reg != MAX_NUMBER_OF_REGISTERS) {
+    fprintf(stderr, "baseline should have %d registers\n", MAX_NUMBER_OF_REGISTERS);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+static char *trim(char *value) {
+  while (isspace((unsigned char) *value)) {
+    value++;
+  }
+  char *end = value + strlen(value);
+  while (end > value && isspace((unsigned char) *(end - 1))) {
+    end--;
+  }
+  *end = '\0';
+  return value;
+}
+
+static bool parse_bool(const char *value) {
+  return strcasecmp(value, "true") == 0 || strcasecmp(value, "on") == 0 || strcmp(value, "1") == 0;
+}
+
+static int find_value(const char *value, const char *const *names, const int *values, size_t length, int *result) {
+  for (size_t i = 0; i < length; i++) {
+    if (strcasecmp(value, names[i]) == 0) {
+      *result = values[i];
+      return SX127X_OK;
+    }
+  }
+  return SX127X_ERR_INVALID_ARG;
+}
+
+#define FIND_VALUE(value, names, values, result) find_value(value, names, values, sizeof(values) / sizeof(values[0]), result)
+
+static int apply_lora_bandwidth(const char *value, sx127x *device) {
+  const char *const names[] = {"7800", "10400", "15600", "20800", "31250", "41700", "62500", "125000", "250000", "500000"};
+  const int values[] = {SX127x_BW_7800, SX127x_BW_10400, SX127x_BW_15600, SX127x_BW_20800, SX127x_BW_31250, SX127x_BW_41700, SX127x_BW_62500, SX127x_BW_125000, SX127x_BW_250000, SX127x_BW_500000};
+  int bandwidth;
+  if (FIND_VALUE(value, names, values, &bandwidth) != SX127X_OK) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  return sx127x_lora_set_bandwidth((sx127x_bw_t) bandwidth, device);
+}
+
+static int apply_lora_header(char *value, sx127x *device) {
+  const char *const names[] = {"4/5", "4/6", "4/7", "4/8"};
+  const int values[] = {SX127x_CR_4_5, SX127x_CR_4_6, SX127x_CR_4_7, SX127x_CR_4_8};
+  // explicit <coding rate> <crc> or implicit <length> <coding rate> <crc>
+  char *type = strtok(value, " \t");
+  if (type == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  bool implicit = (strcasecmp(type, "implicit") == 0);
+  if (!implicit && strcasecmp(type, "explicit") != 0) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  char *length = (implicit ? strtok(NULL, " \t") : NULL);
+  char *coding_rate = strtok(NULL, " \t");
+  char *crc = strtok(NULL, " \t");
+  int cr;
+  if ((implicit && length == NULL) || coding_rate == NULL || crc == NULL || FIND_VALUE(coding_rate, names, values, &cr) != SX127X_OK) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  if (implicit) {
+    sx127x_implicit_header_t header = {.length = (uint8_t) atoi(length), .enable_crc = parse_bool(crc), .coding_rate = (sx127x_cr_t) cr};
+    return sx127x_lora_set_implicit_header(&header, device);
+  }
+  sx127x_tx_header_t header = {.enable_crc = parse_bool(crc), .coding_rate = (sx127x_cr_t) cr};
+  ERROR_CHECK(sx127x_lora_set_implicit_header(NULL, device));
+  return sx127x_lora_tx_set_explicit_header(&header, device);
+}
+
+static int apply_syncword(char *value, sx127x *device) {
+  if (device->active_modem == SX127x_MODULATION_LORA) {
+    return sx127x_lora_set_syncword((uint8_t) strtol(value, NULL, 0), device);
+  }
+  // hex string. for example: 12AD
+  uint8_t syncword[8];
+  size_t length = strlen(value) / 2;
+  if (length == 0 || length > sizeof(syncword) || strlen(value) % 2 != 0) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  for (size_t i = 0; i < length; i++) {
+    char byte[3] = {value[2 * i], value[2 * i + 1], '\0'};
+    syncword[i] = (uint8_t) strtol(byte, NULL, 16);
+  }
+  return sx127x_fsk_ook_set_syncword(syncword, (uint8_t) length, device);
+}
+
+static int apply_packet_format(char *value, sx127x *device) {
+  char *format = strtok(value, " \t");
+  char *length = strtok(NULL, " \t");
+  if (format == NULL || length == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  if (strcasecmp(format, "fixed") == 0) {
+    return sx127x_fsk_ook_set_packet_format(SX127X_FIXED, (uint16_t) atoi(length), device);
+  }
+  if (strcasecmp(format, "variable") == 0) {
+    return sx127x_fsk_ook_set_packet_format(SX127X_VARIABLE, (uint16_t) atoi(length), device);
+  }
+  return SX127X_ERR_INVALID_ARG;
+}
+
+static int apply_pa(char *value, sx127x *device) {
+  char *pin = strtok(value, " \t");
+  char *power = strtok(NULL, " \t");
+  if (pin == NULL || power == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  if (strcasecmp(pin, "rfo") == 0) {
+    return sx127x_tx_set_pa_config(SX127x_PA_PIN_RFO, atoi(power), device);
+  }
+  if (strcasecmp(pin, "boost") == 0) {
+    return sx127x_tx_set_pa_config(SX127x_PA_PIN_BOOST, atoi(power), device);
+  }
+  return SX127X_ERR_INVALID_ARG;
+}
+
+static int apply_address_filtering(char *value, sx127x *device) {
+  const char *const names[] = {"none", "node", "node_and_broadcast"};
+  const int values[] = {SX127X_FILTER_NONE, SX127X_FILTER_NODE_ADDRESS, SX127X_FILTER_NODE_AND_BROADCAST};
+  char *type = strtok(value, " \t");
+  char *node = strtok(NULL, " \t");
+  char *broadcast = strtok(NULL, " \t");
+  int filter;
+  if (type == NULL || FIND_VALUE(type, names, values, &filter) != SX127X_OK) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  uint8_t node_address = (node != NULL ? (uint8_t) strtol(node, NULL, 0) : 0);
+  uint8_t broadcast_address = (broadcast != NULL ? (uint8_t) strtol(broadcast, NULL, 0) : 0);
+  return sx127x_fsk_ook_set_address_filtering((sx127x_address_filtering_t) filter, node_address, broadcast_address, device);
+}
+
+static int apply_preamble_detector(char *value, sx127x *device) {
+  if (strcasecmp(value, "off") == 0) {
+    return sx127x_fsk_ook_rx_set_preamble_detector(false, 0, 0, device);
+  }
+  char *size = strtok(value, " \t");
+  char *tolerance = strtok(NULL, " \t");
+  if (size == NULL || tolerance == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  return sx127x_fsk_ook_rx_set_preamble_detector(true, (uint8_t) atoi(size), (uint8_t) strtol(tolerance, NULL, 0), device);
+}
+
+static int apply_fifo_threshold_auto(char *value, sx127x *device) {
+  char *latency = strtok(value, " \t");
+  char *spi_frequency = strtok(NULL, " \t");
+  if (latency == NULL || spi_frequency == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  return sx127x_fsk_ook_set_fifo_threshold_auto((uint32_t) strtoul(latency, NULL, 0), (uint32_t) strtoul(spi_frequency, NULL, 0), device);
+}
+
+static int apply_fsk_data_shaping(char *value, sx127x *device) {
+  const char *const names[] = {"none", "bt_1_0", "bt_0_5", "bt_0_3"};
+  const int values[] = {SX127X_FSK_SHAPING_NONE, SX127X_BT_1_0, SX127X_BT_0_5, SX127X_BT_0_3};
+  int shaping;
+  ERROR_CHECK(FIND_VALUE(value, names, values, &shaping));
+  return sx127x_fsk_set_data_shaping((sx127x_fsk_data_shaping_t) shaping, SX127X_PA_RAMP_10, device);
+}
+
+static int apply(const char *key, char *value, sx127x *device) {
+  if (strcmp(key, "frequency") == 0) {
+    return sx127x_set_frequency(strtoull(value, NULL, 0), device);
+  }
+  if (strcmp(key, "preamble_length") == 0) {
+    return sx127x_set_preamble_length((uint16_t) atoi(value), device);
+  }
+  if (strcmp(key, "lna_gain") == 0) {
+    const char *const names[] = {"auto", "g1", "g2", "g3", "g4", "g5", "g6"};
+    const int values[] = {SX127x_LNA_GAIN_AUTO, SX127x_LNA_GAIN_G1, SX127x_LNA_GAIN_G2, SX127x_LNA_GAIN_G3, SX127x_LNA_GAIN_G4, SX127x_LNA_GAIN_G5, SX127x_LNA_GAIN_G6};
+    int gain;
+    ERROR_CHECK(FIND_VALUE(value, names, values, &gain));
+    return sx127x_rx_set_lna_gain((sx127x_gain_t) gain, device);
+  }
+  if (strcmp(key, "lna_boost_hf") == 0) {
+    return sx127x_rx_set_lna_boost_hf(parse_bool(value), device);
+  }
+  if (strcmp(key, "pa") == 0) {
+    return apply_pa(value, device);
+  }
+  if (strcmp(key, "ocp") == 0) {
+    if (strcasecmp(value, "off") == 0) {
+      return sx127x_tx_set_ocp(false, 0, device);
+    }
+    return sx127x_tx_set_ocp(true, (uint8_t) atoi(value), device);
+  }
+  if (strcmp(key, "syncword") == 0) {
+    return apply_syncword(value, device);
+  }
+  if (strcmp(key, "bandwidth") == 0) {
+    return apply_lora_bandwidth(value, device);
+  }
+  if (strcmp(key, "spreading_factor") == 0) {
+    int sf = atoi(value);
+    if (sf < 6 || sf > 12) {
+      return SX127X_ERR_INVALID_ARG;
+    }
+    return sx127x_lora_set_modem_config_2((sx127x_sf_t) (sf << 4), device);
+  }
+  if (strcmp(key, "header") == 0) {
+    return apply_lora_header(value, device);
+  }
+  if (strcmp(key, "low_datarate_optimization") == 0) {
+    return sx127x_lora_set_low_datarate_optimization(parse_bool(value), device);
+  }
+  if (strcmp(key, "bitrate") == 0) {
+    return sx127x_fsk_ook_set_bitrate(strtof(value, NULL), device);
+  }
+  if (strcmp(key, "fdev") == 0) {
+    return sx127x_fsk_set_fdev(strtof(value, NULL), device);
+  }
+  if (strcmp(key, "rx_bandwidth") == 0) {
+    return sx127x_fsk_ook_rx_set_bandwidth(strtof(value, NULL), device);
+  }
+  if (strcmp(key, "afc_bandwidth") == 0) {
+    return sx127x_fsk_ook_rx_set_afc_bandwidth(strtof(value, NULL), device);
+  }
+  if (strcmp(key, "afc_auto") == 0) {
+    return sx127x_fsk_ook_rx_set_afc_auto(parse_bool(value), device);
+  }
+  if (strcmp(key, "packet_encoding") == 0) {
+    const char *const names[] = {"nrz", "manchester", "scrambled"};
+    const int values[] = {SX127X_NRZ, SX127X_MANCHESTER, SX127X_SCRAMBLED};
+    int encoding;
+    ERROR_CHECK(FIND_VALUE(value, names, values, &encoding));
+    return sx127x_fsk_ook_set_packet_encoding((sx127x_packet_encoding_t) encoding, device);
+  }
+  if (strcmp(key, "crc") == 0) {
+    const char *const names[] = {"none", "ccitt", "ibm"};
+    const int values[] = {SX127X_CRC_NONE, SX127X_CRC_CCITT, SX127X_CRC_IBM};
+    int crc;
+    ERROR_CHECK(FIND_VALUE(value, names, values, &crc));
+    return sx127x_fsk_ook_set_crc((sx127x_crc_type_t) crc, device);
+  }
+  if (strcmp(key, "packet_format") == 0) {
+    return apply_packet_format(value, device);
+  }
+  if (strcmp(key, "address_filtering") == 0) {
+    return apply_address_filtering(value, device);
+  }
+  if (strcmp(key, "preamble_type") == 0) {
+    const char *const names[] = {"aa", "55"};
+    const int values[] = {SX127X_PREAMBLE_AA, SX127X_PREAMBLE_55};
+    int type;
+    ERROR_CHECK(FIND_VALUE(value, names, values, &type));
+    return sx127x_fsk_ook_set_preamble_type((sx127x_preamble_type_t) type, device);
+  }
+  if (strcmp(key, "data_shaping") == 0) {
+    return apply_fsk_data_shaping(value, device);
+  }
+  if (strcmp(key, "rx_trigger") == 0) {
+    const char *const names[] = {"none", "rssi", "preamble", "rssi_preamble"};
+    const int values[] = {SX127X_RX_TRIGGER_NONE, SX127X_RX_TRIGGER_RSSI, SX127X_RX_TRIGGER_PREAMBLE, SX127X_RX_TRIGGER_RSSI_PREAMBLE};
+    int trigger;
+    ERROR_CHECK(FIND_VALUE(value, names, values, &trigger));
+    return sx127x_fsk_ook_rx_set_trigger((sx127x_rx_trigger_t) trigger, device);
+  }
+  if (strcmp(key, "preamble_detector") == 0) {
+    return apply_preamble_detector(value, device);
+  }
+  if (strcmp(key, "fifo_threshold_auto") == 0) {
+    return apply_fifo_threshold_auto(value, device);
+  }
+  return SX127X_ERR_NOT_FOUND;
+}
+
+static const char *modulation_name(sx127x_modulation_t modulation) {
+  switch (modulation) {
+    case SX127x_MODULATION_LORA:
+      return "SX127x_MODULATION_LORA";
+    case SX127x_MODULATION_OOK:
+      return "SX127x_MODULATION_OOK";
+    default:
+      return "SX127x_MODULATION_FSK";
+  }
+}
+
+static void print_profile(const char *name, const char *config, chip_t *chip, sx127x *device) {
+  bool lora = (device->active_modem == SX127x_MODULATION_LORA);
+  uint8_t values[MAX_NUMBER_OF_REGISTERS];
+  size_t values_length = 0;
+  int ranges[MAX_NUMBER_OF_REGISTERS][3];
+  size_t ranges_length = 0;
+  for (int reg = 0; reg < MAX_NUMBER_OF_REGISTERS; reg++) {
+    if (is_excluded(reg, lora) || !(is_modem_register(reg, lora) || *chip_written(chip, reg))) {
+      continue;
+    }
+    if (ranges_length == 0 || ranges[ranges_length - 1][0] + ranges[ranges_length - 1][1] != reg) {
+      ranges[ranges_length][0] = reg;
+      ranges[ranges_length][1] = 0;
+      ranges[ranges_length][2] = (int) values_length;
+      ranges_length++;
+    }
+    ranges[ranges_length - 1][1]++;
+    values[values_length] = *chip_register(chip, reg);
+    values_length++;
+  }
+  printf("// Generated by profile_generator from %s. Do not edit\n", config);
+  printf("#ifndef %s_h\n#define %s_h\n\n#include <sx127x.h>\n\n", name, name);
+  printf("static const uint8_t %s_values[] = {", name);
+  for (size_t i = 0; i < values_length; i++) {
+    printf("%s0x%02x", (i == 0 ? "" : ", "), values[i]);
+  }
+  printf("};\n\n");
+  printf("static const sx127x_profile_range_t %s_ranges[] = {", name);
+  for (size_t i = 0; i < ranges_length; i++) {
+    printf("%s{0x%02x, %d, %d}", (i == 0 ? "" : ", "), ranges[i][0], ranges[i][1], ranges[i][2]);
+  }
+  printf("};\n\n");
+  printf("static const sx127x_profile_t %s = {\n", name);
+  printf("    .modulation = %s,\n", modulation_name(device->active_modem));
+  if (lora) {
+    printf("    .use_implicit_header = %s,\n", (device->use_implicit_header ? "true" : "false"));
+  } else {
+    printf("    .fsk_ook_format = %s,\n", (device->fsk_ook_format == SX127X_FIXED ? "SX127X_FIXED" : "SX127X_VARIABLE"));
+    printf("    .fsk_crc_type = %s,\n", (device->fsk_crc_type == SX127X_CRC_NONE ? "SX127X_CRC_NONE" : (device->fsk_crc_type == SX127X_CRC_IBM ? "SX127X_CRC_IBM" : "SX127X_CRC_CCITT")));
+    printf("    .fsk_ook_rx_threshold = %d,\n", device->fsk_ook_rx_threshold);
+    printf("    .fsk_ook_rx_batch = %d,\n", device->fsk_ook_rx_batch);
+    printf("    .fsk_ook_tx_threshold = %d,\n", device->fsk_ook_tx_threshold);
+    printf("    .fsk_ook_tx_batch = %d,\n", device->fsk_ook_tx_batch);
+  }
+  printf("    .expected_packet_length = %" PRIu16 ",\n", device->expected_packet_length);
+  printf("    .ranges = %s_ranges,\n", name);
+  printf("    .ranges_length = %zu,\n", ranges_length);
+  printf("    .values = %s_values};\n\n", name);
+  printf("#endif\n");
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: profile_generator [--baseline <registers>] <name> <config file>\n");
+}
+
+int main(int argc, char **argv) {
+  chip_t chip;
+  memset(&chip, 0, sizeof(chip));
+  memcpy(chip.registers, fsk_defaults, sizeof(fsk_defaults));
+  memcpy(chip.lora_registers, lora_defaults, sizeof(lora_defaults));
+  int arg = 1;
+  if (argc > 2 && strcmp(argv[1], "--baseline") == 0) {
+    if (parse_baseline(argv[2], &chip) != EXIT_SUCCESS) {
+      return EXIT_FAILURE;
+    }
+    arg += 2;
+  }
+  if (argc - arg != 2) {
+    usage();
+    return EXIT_FAILURE;
+  }
+  const char *name = argv[arg];
+  const char *config = argv[arg + 1];
+  FILE *file = fopen(config, "r");
+  if (file == NULL) {
+    fprintf(stderr, "unable to open %s\n", config);
+    return EXIT_FAILURE;
+  }
+  sx127x device;
+  if (sx127x_create(&chip, &device) != SX127X_OK) {
+    fprintf(stderr, "unable to create device\n");
+    fclose(file);
+    return EXIT_FAILURE;
+  }
+  char line[MAX_LINE_LENGTH];
+  int line_number = 0;
+  bool modulation_set = false;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    line_number++;
+    char *comment = strchr(line, '#');
+    if (comment != NULL) {
+      *comment = '\0';
+    }
+    char *separator = strchr(line, '=');
+    if (separator == NULL) {
+      if (strlen(trim(line)) != 0) {
+        fprintf(stderr, "%s:%d: expected key = value\n", config, line_number);
+        fclose(file);
+        return EXIT_FAILURE;
+      }
+      continue;
+    }
+    *separator = '\0';
+    char *key = trim(line);
+    char *value = trim(separator + 1);
+    int code;
+    if (strcmp(key, "modulation") == 0) {
+      const char *const names[] = {"lora", "fsk", "ook"};
+      const int values[] = {SX127x_MODULATION_LORA, SX127x_MODULATION_FSK, SX127x_MODULATION_OOK};
+      int modulation;
+      code = FIND_VALUE(value, names, values, &modulation);
+      if (code == SX127X_OK) {
+        code = sx127x_set_opmod(SX127x_MODE_SLEEP, (sx127x_modulation_t) modulation, &device);
+        // registers written by the mode change are not part of the profile
+        memset(chip.written, 0, sizeof(chip.written));
+        memset(chip.lora_written, 0, sizeof(chip.lora_written));
+        modulation_set = true;
+      }
+    } else if (!modulation_set) {
+      fprintf(stderr, "%s:%d: modulation should be the first\n", config, line_number);
+      fclose(file);
+      return EXIT_FAILURE;
+    } else {
+      code = apply(key, value, &device);
+    }
+    if (code == SX127X_ERR_NOT_FOUND) {
+      fprintf(stderr, "%s:%d: unknown key %s\n", config, line_number, key);
+      fclose(file);
+      return EXIT_FAILURE;
+    }
+    if (code != SX127X_OK) {
+      fprintf(stderr, "%s:%d: invalid value for %s: %d\n", config, line_number, key, code);
+      fclose(file);
+      return EXIT_FAILURE;
+    }
+  }
+  fclose(file);
+  if (!modulation_set) {
+    fprintf(stderr, "%s: modulation is missing\n", config);
+    return EXIT_FAILURE;
+  }
+  print_profile(name, config, &chip, &device);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+#ifndef registers_h
+#define registers_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sx127x.h>
+#include <sx127x_spi.h>
+
+#include "sx127x_private.h"
+
+// Register map of the chip. Shared with the round trip test in test/test_sx127x_profile.c
+
+// Registers after power on reset in FSK mode. Taken from the real chip, see debug_registers/README.md
+static const uint8_t fsk_defaults[MAX_NUMBER_OF_REGISTERS] = {0, 9, 26, 11, 0, 82, 108, 128, 0, 79, 9, 43, 32, 8, 2, 10, 255, 0, 21, 11, 40, 12, 18, 71, 50, 62, 0, 0, 0, 0, 0, 64, 0, 0, 0, 0, 5, 0, 3, 147, 85, 85, 85, 85, 85, 85, 85, 85, 144, 64, 64, 0, 0, 15, 0, 0, 0, 245, 32, 130, 244, 2, 128, 64, 0, 0, 18, 36, 45, 0, 3, 0, 4, 35, 0, 9, 5, 132, 50, 43, 20, 0, 0, 14, 0, 0, 0, 15, 224, 0, 12, 243, 8, 0, 92, 120, 0, 25, 12, 75, 204, 15, 1, 32, 4, 71, 175, 63, 221, 0, 26, 11, 208};
+
+// LoRa registers 0x0d - 0x3f after reset. Section 6.4
+static const uint8_t lora_defaults[SHADOW_BANKED_LAST - SHADOW_BANKED_FIRST + 1] = {
+    [0x0e - SHADOW_BANKED_FIRST] = 0x80,
+    [0x18 - SHADOW_BANKED_FIRST] = 0x10,
+    [0x1d - SHADOW_BANKED_FIRST] = 0x72,
+    [0x1e - SHADOW_BANKED_FIRST] = 0x70,
+    [0x1f - SHADOW_BANKED_FIRST] = 0x64,
+    [0x21 - SHADOW_BANKED_FIRST] = 0x08,
+    [0x22 - SHADOW_BANKED_FIRST] = 0x01,
+    [0x23 - SHADOW_BANKED_FIRST] = 0xff,
+    [0x26 - SHADOW_BANKED_FIRST] = 0x04,
+    [0x31 - SHADOW_BANKED_FIRST] = 0xc3,
+    [0x33 - SHADOW_BANKED_FIRST] = 0x27,
+    [0x37 - SHADOW_BANKED_FIRST] = 0x0a,
+    [0x39 - SHADOW_BANKED_FIRST] = 0x12,
+    [0x3b - SHADOW_BANKED_FIRST] = 0x1d};
+
+// LoRa configuration registers in the banked range. Others are reserved or changed by the chip. Section 6.4
+static const uint8_t lora_config_registers[] = {0x0e, 0x0f, 0x11, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x26, 0x27, 0x31, 0x33, 0x37, 0x39, 0x3b};
+
+// FSK/OOK registers in the banked range which are reserved or changed by the chip. Section 6.2
+static const uint8_t fsk_status_registers[] = {0x11, 0x17, 0x18, 0x19, 0x1b, 0x1c, 0x1d, 0x1e, 0x36, 0x3b, 0x3c, 0x3e, 0x3f};
+
+static bool contains(const uint8_t *registers, size_t registers_length, int reg) {
+  for (size_t i = 0; i < registers_length; i++) {
+    if (registers[i] == reg) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// configuration registers of the modem are always included, so profile doesn't depend on the previous configuration
+static bool is_modem_register(int reg, bool lora) {
+  if (reg < SHADOW_BANKED_FIRST) {
+    // bit rate and frequency deviation are not used by LoRa
+    return reg > REG_OP_MODE && (!lora || reg > 0x05);
+  }
+  if (reg > SHADOW_BANKED_LAST) {
+    return false;
+  }
+  if (lora) {
+    return contains(lora_config_registers, sizeof(lora_config_registers), reg);
+  }
+  return !contains(fsk_status_registers, sizeof(fsk_status_registers), reg);
+}
+
+#endif
@@ -17,9 +17,9 @@
 #include <string.h>
 #include <sx127x_spi.h>
 
-// registers
-#define REG_FIFO 0x00
-#define REG_OP_MODE 0x01
+#include "sx127x_private.h"
+
+// registers. REG_FIFO and REG_OP_MODE are in sx127x_private.h
 #define REG_BITRATE_MSB 0x02
 #define REG_FDEV_MSB 0x04
 #define REG_FRF_MSB 0x06
@@ -44,10 +44,12 @@
 #define REG_OOK_PEAK 0x14
 #define REG_OOK_FIX 0x15
 #define REG_OOK_AVG 0x16
+#define REG_MODEM_STAT 0x18
 #define REG_PKT_SNR_VALUE 0x19
 #define REG_PKT_RSSI_VALUE 0x1a
 #define REG_RSSI_VALUE 0x1b
 #define REG_AFC_VALUE 0x1b
+#define REG_HOP_CHANNEL 0x1c
 #define REG_MODEM_CONFIG_1 0x1d
 #define REG_MODEM_CONFIG_2 0x1e
 #define REG_PREAMBLE_DETECT 0x1f
@@ -92,6 +94,7 @@
 #define SX127x_VERSION 0x12
 
 #define SX127x_OSCILLATOR_FREQUENCY 32000000.0f
+#define SX127x_OSCILLATOR_FREQUENCY_HZ 32000000ULL
 #define SX127x_FREQ_ERROR_FACTOR ((1 << 24) / SX127x_OSCILLATOR_FREQUENCY)
 #define SX127x_FSTEP (SX127x_OSCILLATOR_FREQUENCY / (1 << 19))
 #define SX127x_REG_MODEM_CONFIG_3_AGC_ON 0b00000100
@@ -114,10 +117,21 @@
 #define SX127X_FSK_IRQ_PAYLOAD_READY 0b00000100
 #define SX127X_FSK_IRQ_CRC_OK 0b00000010
 #define SX127X_FSK_IRQ_LOW_BATTERY 0b00000001
+#define SX127X_FSK_IRQ_TX_READY 0b00100000
 #define SX127X_FSK_IRQ_PREAMBLE_DETECT 0b00000010
 #define SX127X_FSK_IRQ_SYNC_ADDRESS_MATCH 0b00000001
 
+// event word returned by sx127x_irq_capture
+// LoRa: RegIrqFlags, RegFifoRxCurrentAddr, RegRxNbBytes
+// FSK/OOK: RegIrqFlags2, RegIrqFlags1
+// modulation is stored in bits 24-30. Lowest bit of sx127x_modulation_t is always 0
+#define IRQ_EVENT_MODEM(modem) ((uint32_t) (modem) << 23)
+#define IRQ_EVENT_MODEM_MASK 0x7f000000UL
+#define IRQ_EVENT_CLEARED 0x80000000UL
+
 #define RF_MID_BAND_THRESHOLD 525000000
+// RF_MID_BAND_THRESHOLD in RegFrf units
+#define FRF_MID_BAND_THRESHOLD (((uint64_t) RF_MID_BAND_THRESHOLD << 19) / SX127x_OSCILLATOR_FREQUENCY_HZ)
 #define RSSI_OFFSET_HF_PORT 157
 #define RSSI_OFFSET_LF_PORT 164
 
@@ -139,14 +153,41 @@
 #define SHADOW_NOT_CACHED 0
 #define SHADOW_CACHED 1
 #define SHADOW_IGNORE 2
+// cached value was not written into the chip yet
+#define SHADOW_DIRTY 3
+
+#define SHADOW_BANK_FSK_OOK 0
+#define SHADOW_BANK_LORA 1
+
+#define BITMAP_GET(b, i) (((b)[(i) / 8] >> ((i) % 8)) & 1)
+#define BITMAP_SET(b, i) ((b)[(i) / 8] |= (1 << ((i) % 8)))
+#define BITMAP_CLEAR(b, i) ((b)[(i) / 8] &= ~(1 << ((i) % 8)))
+
+// register policies. Everything except SX127X_REGISTER_CACHEABLE is never cached and acts as a barrier for configuration transactions
+#define SX127X_REGISTER_CACHEABLE 0
+// value is changed by the chip
+#define SX127X_REGISTER_VOLATILE 1
+// write 1 to clear flags
+#define SX127X_REGISTER_IRQ 2
+#define SX127X_REGISTER_FIFO 3
+
+// Policy of individual registers can be overridden by the list of designated initializers.
+// For example: -DSX127X_LORA_REGISTER_POLICY_OVERRIDES="[0x0d]=SX127X_REGISTER_VOLATILE,"
+#ifndef SX127X_FSK_OOK_REGISTER_POLICY_OVERRIDES
+#define SX127X_FSK_OOK_REGISTER_POLICY_OVERRIDES
+#endif
+#ifndef SX127X_LORA_REGISTER_POLICY_OVERRIDES
+#define SX127X_LORA_REGISTER_POLICY_OVERRIDES
+#endif
 
-#define ERROR_CHECK(x)           \
-  do {                           \
-    int __err_rc = (x);          \
-    if (__err_rc != SX127X_OK) { \
-      return __err_rc;           \
-    }                            \
-  } while (0)
+// RX ring tail is the position of the oldest packet and the flag if the consumer holds it. Both are changed by a single CAS
+#define RX_RING_HELD 1
+#define RX_RING_POSITION(tail) ((tail) >> 1)
+#define RX_RING_TAIL(position) ((position) << 1)
+
+#define SNAPSHOT_MAGIC_1 0x12
+#define SNAPSHOT_MAGIC_2 0x7f
+#define SNAPSHOT_VERSION 2
 
 #define ERROR_CHECK_NOCODE(x)    \
   do {                           \
@@ -156,6 +197,14 @@
     }                            \
   } while (0)
 
+#define SEGMENTS_LENGTH(x) (sizeof(x) / sizeof((x)[0]))
+
+#define WRITE_SEGMENT(r, b, l) \
+  { .reg = (r), .rx_buffer = NULL, .tx_buffer = (b), .length = (l) }
+
+#define READ_SEGMENT(r, b, l) \
+  { .reg = (r), .rx_buffer = (b), .tx_buffer = NULL, .length = (l) }
+
 #define CHECK_MODULATION(x, y)         \
   do {                                 \
     if (x->active_modem != y) {        \
@@ -175,65 +224,452 @@ typedef enum {
   SX127x_HEADER_MODE_IMPLICIT = 0b00000001
 } sx127x_header_mode_t;
 
+#ifdef CONFIG_SX127X_ENABLE_STATS
+typedef struct {
+  shadow_spi_device_t *spi_device;
+  sx127x_api_stats_t *previous;
+} sx127x_stats_scope_t;
+
+sx127x_api_stats_t *sx127x_stats_find_api(const char *name, shadow_spi_device_t *spi_device) {
+  sx127x_stats_t *stats = &spi_device->stats;
+  for (uint8_t i = 0; i < stats->apis_length; i++) {
+    // __func__ is unique per function
+    if (stats->apis[i].name == name) {
+      return stats->apis + i;
+    }
+  }
+  if (stats->apis_length >= CONFIG_SX127X_STATS_MAX_APIS) {
+    return NULL;
+  }
+  sx127x_api_stats_t *result = stats->apis + stats->apis_length;
+  stats->apis_length++;
+  result->name = name;
+  return result;
+}
+
+sx127x_stats_scope_t sx127x_stats_enter(const char *name, shadow_spi_device_t *spi_device) {
+  sx127x_stats_scope_t result = {.spi_device = spi_device, .previous = spi_device->current_api};
+  // outermost api wins
+  if (spi_device->current_api == NULL) {
+    spi_device->current_api = sx127x_stats_find_api(name, spi_device);
+  }
+  return result;
+}
+
+void sx127x_stats_exit(sx127x_stats_scope_t *scope) {
+  scope->spi_device->current_api = scope->previous;
+}
+
+void sx127x_stats_add(sx127x_stats_counters_t *counters, uint32_t hits, uint32_t misses, uint32_t transactions, size_t read, size_t written) {
+  counters->cache_hits += hits;
+  counters->cache_misses += misses;
+  counters->transactions += transactions;
+  counters->bytes_read += read;
+  counters->bytes_written += written;
+}
+
+void sx127x_stats_record(int reg, uint32_t hits, uint32_t misses, uint32_t transactions, size_t read, size_t written, shadow_spi_device_t *spi_device) {
+  sx127x_stats_add(&spi_device->stats.total, hits, misses, transactions, read, written);
+  sx127x_stats_add(spi_device->stats.registers + reg, hits, misses, transactions, read, written);
+  if (spi_device->current_api != NULL) {
+    sx127x_stats_add(&spi_device->current_api->counters, hits, misses, transactions, read, written);
+  }
+}
+
+#define STATS_CACHE(reg, hit, spi_device) sx127x_stats_record(reg, (hit) ? 1 : 0, (hit) ? 0 : 1, 0, 0, 0, spi_device)
+#define STATS_BUS(reg, read, written, spi_device) sx127x_stats_record(reg, 0, 0, 1, read, written, spi_device)
+#else
+#define STATS_CACHE(reg, hit, spi_device)
+#define STATS_BUS(reg, read, written, spi_device)
+#endif
+
+// attribute SPI activity to the public function. Previous function is restored on any return
+#if defined(CONFIG_SX127X_ENABLE_STATS) && defined(__GNUC__)
+#define STATS_ENTER(device) \
+  sx127x_stats_scope_t __stats_scope __attribute__((cleanup(sx127x_stats_exit))) = sx127x_stats_enter(__func__, &(device)->spi_device)
+#else
+#define STATS_ENTER(device)
+#endif
+
+#ifdef CONFIG_SX127X_ENABLE_TRACE
+void sx127x_trace_record(int reg, uint8_t flags, const uint8_t *data, size_t data_length, int code, shadow_spi_device_t *spi_device) {
+  sx127x_trace_t *trace = &spi_device->trace;
+  // single producer: only the thread which works with device
+  uint32_t head = __atomic_load_n(&trace->head, __ATOMIC_RELAXED);
+  sx127x_trace_entry_t *entry = trace->entries + (head % CONFIG_SX127X_TRACE_LENGTH);
+  entry->timestamp = (trace->clock != NULL ? trace->clock() : 0);
+  entry->reg = (uint8_t) reg;
+  entry->flags = flags | (code != SX127X_OK ? SX127X_TRACE_ERROR : 0);
+  entry->length = (uint16_t) data_length;
+  size_t prefix = (data_length < CONFIG_SX127X_TRACE_DATA_LENGTH ? data_length : CONFIG_SX127X_TRACE_DATA_LENGTH);
+  memcpy(entry->data, data, prefix);
+  // publish entry to readers
+  __atomic_store_n(&trace->head, head + 1, __ATOMIC_RELEASE);
+}
+#define TRACE(reg, flags, data, data_length, code, spi_device) sx127x_trace_record(reg, flags, data, data_length, code, spi_device)
+#else
+#define TRACE(reg, flags, data, data_length, code, spi_device)
+#endif
+
+int sx127x_bus_read_registers(int reg, shadow_spi_device_t *spi_device, size_t data_length, uint32_t *result) {
+  STATS_BUS(reg, data_length, 0, spi_device);
+  int code = sx127x_spi_read_registers(reg, spi_device->spi_device, data_length, result);
+#ifdef CONFIG_SX127X_ENABLE_TRACE
+  uint8_t data[sizeof(uint32_t)];
+  for (size_t i = 0; i < data_length; i++) {
+    data[i] = (uint8_t) ((*result) >> (8 * (data_length - i - 1)));
+  }
+  TRACE(reg, 0, data, data_length, code, spi_device);
+#endif
+  return code;
+}
+
+int sx127x_bus_read_buffer(int reg, uint8_t *buffer, size_t buffer_length, shadow_spi_device_t *spi_device) {
+  STATS_BUS(reg, buffer_length, 0, spi_device);
+  int code = sx127x_spi_read_buffer(reg, buffer, buffer_length, spi_device->spi_device);
+  TRACE(reg, 0, buffer, buffer_length, code, spi_device);
+  return code;
+}
+
+int sx127x_bus_write_register(int reg, const uint8_t *data, size_t data_length, shadow_spi_device_t *spi_device) {
+  STATS_BUS(reg, 0, data_length, spi_device);
+  int code = sx127x_spi_write_register(reg, data, data_length, spi_device->spi_device);
+  TRACE(reg, SX127X_TRACE_WRITE, data, data_length, code, spi_device);
+  return code;
+}
+
+int sx127x_bus_write_buffer(int reg, const uint8_t *buffer, size_t buffer_length, shadow_spi_device_t *spi_device) {
+  STATS_BUS(reg, 0, buffer_length, spi_device);
+  int code = sx127x_spi_write_buffer(reg, buffer, buffer_length, spi_device->spi_device);
+  TRACE(reg, SX127X_TRACE_WRITE, buffer, buffer_length, code, spi_device);
+  return code;
+}
+
+int sx127x_bus_transfer(sx127x_spi_segment_t *segments, size_t segments_length, shadow_spi_device_t *spi_device) {
+#ifdef CONFIG_SX127X_ENABLE_STATS
+  // single transaction in total, but every segment is counted for its register
+  size_t read = 0;
+  size_t written = 0;
+  for (size_t i = 0; i < segments_length; i++) {
+    size_t segment_read = (segments[i].tx_buffer == NULL ? segments[i].length : 0);
+    size_t segment_written = (segments[i].tx_buffer != NULL ? segments[i].length : 0);
+    sx127x_stats_add(spi_device->stats.registers + segments[i].reg, 0, 0, 1, segment_read, segment_written);
+    read += segment_read;
+    written += segment_written;
+  }
+  sx127x_stats_add(&spi_device->stats.total, 0, 0, 1, read, written);
+  if (spi_device->current_api != NULL) {
+    sx127x_stats_add(&spi_device->current_api->counters, 0, 0, 1, read, written);
+  }
+#endif
+  int code = sx127x_spi_transfer(segments, segments_length, spi_device->spi_device);
+#ifdef CONFIG_SX127X_ENABLE_TRACE
+  for (size_t i = 0; i < segments_length; i++) {
+    uint8_t flags = (i > 0 ? SX127X_TRACE_CONTINUATION : 0);
+    if (segments[i].tx_buffer != NULL) {
+      TRACE(segments[i].reg, flags | SX127X_TRACE_WRITE, segments[i].tx_buffer, segments[i].length, code, spi_device);
+    } else {
+      TRACE(segments[i].reg, flags, segments[i].rx_buffer, segments[i].length, code, spi_device);
+    }
+  }
+#endif
+  return code;
+}
+
+#ifndef CONFIG_SX127X_DISABLE_SPI_CACHE
+static const uint8_t sx127x_register_policies[2][MAX_NUMBER_OF_REGISTERS] = {
+    [SHADOW_BANK_FSK_OOK] = {
+        [REG_FIFO] = SX127X_REGISTER_FIFO,
+        [REG_RSSI_VALUE_FSK] = SX127X_REGISTER_VOLATILE,
+        [0x1b] = SX127X_REGISTER_VOLATILE,  // AFC value
+        [0x1c] = SX127X_REGISTER_VOLATILE,
+        [0x1d] = SX127X_REGISTER_VOLATILE,  // FEI value
+        [0x1e] = SX127X_REGISTER_VOLATILE,
+        [REG_SEQ_CONFIG1] = SX127X_REGISTER_VOLATILE,
+        [REG_IMAGE_CAL] = SX127X_REGISTER_VOLATILE,
+        [REG_TEMP] = SX127X_REGISTER_VOLATILE,
+        [REG_IRQ_FLAGS_1] = SX127X_REGISTER_IRQ,
+        [REG_IRQ_FLAGS_2] = SX127X_REGISTER_IRQ,
+        SX127X_FSK_OOK_REGISTER_POLICY_OVERRIDES},
+    [SHADOW_BANK_LORA] = {
+        [REG_FIFO] = SX127X_REGISTER_FIFO,
+        [REG_FIFO_RX_CURRENT_ADDR] = SX127X_REGISTER_VOLATILE,
+        [REG_IRQ_FLAGS] = SX127X_REGISTER_IRQ,
+        [REG_RX_NB_BYTES] = SX127X_REGISTER_VOLATILE,
+        [0x14] = SX127X_REGISTER_VOLATILE,  // header and packet counters
+        [0x15] = SX127X_REGISTER_VOLATILE,
+        [0x16] = SX127X_REGISTER_VOLATILE,
+        [0x17] = SX127X_REGISTER_VOLATILE,
+        [REG_MODEM_STAT] = SX127X_REGISTER_VOLATILE,
+        [REG_PKT_SNR_VALUE] = SX127X_REGISTER_VOLATILE,
+        [REG_PKT_RSSI_VALUE] = SX127X_REGISTER_VOLATILE,
+        [REG_RSSI_VALUE] = SX127X_REGISTER_VOLATILE,
+        [REG_HOP_CHANNEL] = SX127X_REGISTER_VOLATILE,
+        [REG_FREQ_ERROR_MSB] = SX127X_REGISTER_VOLATILE,
+        [REG_FREQ_ERROR_MID] = SX127X_REGISTER_VOLATILE,
+        [REG_FREQ_ERROR_LSB] = SX127X_REGISTER_VOLATILE,
+        [REG_RSSI_WIDEBAND] = SX127X_REGISTER_VOLATILE,
+        SX127X_LORA_REGISTER_POLICY_OVERRIDES}};
+
+size_t sx127x_shadow_index(int reg, shadow_spi_device_t *spi_device) {
+  if (spi_device->bank == SHADOW_BANK_FSK_OOK || reg < SHADOW_BANKED_FIRST || reg > SHADOW_BANKED_LAST) {
+    return reg;
+  }
+  // LoRa registers are stored after the common register map
+  return MAX_NUMBER_OF_REGISTERS + (reg - SHADOW_BANKED_FIRST);
+}
+
+uint8_t sx127x_shadow_policy(uint8_t bank, int reg) {
+  if (reg >= SHADOW_BANKED_FIRST && reg <= SHADOW_BANKED_LAST) {
+    return sx127x_register_policies[bank][reg];
+  }
+  // common registers share the shadow slot, so override in either bank applies to both
+  uint8_t policy = sx127x_register_policies[SHADOW_BANK_FSK_OOK][reg];
+  if (policy != SX127X_REGISTER_CACHEABLE) {
+    return policy;
+  }
+  return sx127x_register_policies[SHADOW_BANK_LORA][reg];
+}
+
+uint8_t sx127x_shadow_policy_by_index(size_t index) {
+  if (index >= MAX_NUMBER_OF_REGISTERS) {
+    return sx127x_shadow_policy(SHADOW_BANK_LORA, (int) (index - MAX_NUMBER_OF_REGISTERS + SHADOW_BANKED_FIRST));
+  }
+  return sx127x_shadow_policy(SHADOW_BANK_FSK_OOK, (int) index);
+}
+
+uint8_t sx127x_shadow_sync_by_index(size_t index, shadow_spi_device_t *spi_device) {
+  if (BITMAP_GET(spi_device->shadow_registers_dirty, index)) {
+    return SHADOW_DIRTY;
+  }
+  if (BITMAP_GET(spi_device->shadow_registers_cached, index)) {
+    return SHADOW_CACHED;
+  }
+  return SHADOW_NOT_CACHED;
+}
+
+uint8_t sx127x_shadow_sync(int reg, shadow_spi_device_t *spi_device) {
+  if (sx127x_shadow_policy(spi_device->bank, reg) != SX127X_REGISTER_CACHEABLE) {
+    return SHADOW_IGNORE;
+  }
+  return sx127x_shadow_sync_by_index(sx127x_shadow_index(reg, spi_device), spi_device);
+}
+
+void sx127x_shadow_set_sync(size_t index, uint8_t state, shadow_spi_device_t *spi_device) {
+  if (state == SHADOW_CACHED || state == SHADOW_DIRTY) {
+    BITMAP_SET(spi_device->shadow_registers_cached, index);
+  } else {
+    BITMAP_CLEAR(spi_device->shadow_registers_cached, index);
+  }
+  if (state == SHADOW_DIRTY) {
+    BITMAP_SET(spi_device->shadow_registers_dirty, index);
+  } else {
+    BITMAP_CLEAR(spi_device->shadow_registers_dirty, index);
+  }
+}
+
+void sx127x_shadow_store(int reg, const uint8_t *data, size_t data_length, uint8_t state, shadow_spi_device_t *spi_device) {
+  for (size_t i = 0; i < data_length; i++) {
+    size_t index = sx127x_shadow_index(reg + i, spi_device);
+    if (data != NULL) {
+      spi_device->shadow_registers[index] = data[i];
+    }
+    sx127x_shadow_set_sync(index, state, spi_device);
+  }
+}
+
+void sx127x_shadow_select_bank(int reg, const uint8_t *data, size_t data_length, shadow_spi_device_t *spi_device) {
+  if (reg != REG_OP_MODE || data_length == 0) {
+    return;
+  }
+  spi_device->bank = ((data[0] & SX127x_MODULATION_LORA) ? SHADOW_BANK_LORA : SHADOW_BANK_FSK_OOK);
+}
+
+void sx127x_shadow_cache_written(int reg, const uint8_t *data, size_t data_length, shadow_spi_device_t *spi_device) {
+  if (sx127x_shadow_sync(reg, spi_device) != SHADOW_IGNORE) {
+    sx127x_shadow_store(reg, data, data_length, SHADOW_CACHED, spi_device);
+  }
+  sx127x_shadow_select_bank(reg, data, data_length, spi_device);
+}
+
+bool sx127x_shadow_spi_is_deferred(int reg, size_t data_length, shadow_spi_device_t *spi_device) {
+  // writes to REG_OP_MODE and to volatile registers act as a barrier
+  if (!spi_device->transaction || reg == REG_OP_MODE) {
+    return false;
+  }
+  for (size_t i = 0; i < data_length; i++) {
+    if (sx127x_shadow_sync(reg + i, spi_device) == SHADOW_IGNORE) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void sx127x_shadow_spi_defer(int reg, const uint8_t *data, size_t data_length, shadow_spi_device_t *spi_device) {
+  sx127x_shadow_store(reg, data, data_length, SHADOW_DIRTY, spi_device);
+  spi_device->dirty = true;
+}
+
+int sx127x_shadow_spi_write_dirty(sx127x_spi_segment_t *segments, size_t segments_length, shadow_spi_device_t *spi_device) {
+  int code = sx127x_bus_transfer(segments, segments_length, spi_device);
+  // on failure actual state of registers is unknown
+  uint8_t state = (code == SX127X_OK ? SHADOW_CACHED : SHADOW_NOT_CACHED);
+  for (size_t i = 0; i < segments_length; i++) {
+    sx127x_shadow_store(segments[i].reg, NULL, segments[i].length, state, spi_device);
+  }
+  return code;
+}
+
+int sx127x_shadow_spi_flush(shadow_spi_device_t *spi_device) {
+  if (!spi_device->dirty) {
+    return SX127X_OK;
+  }
+  spi_device->dirty = false;
+  sx127x_spi_segment_t segments[SX127X_SPI_MAX_SEGMENTS];
+  size_t segments_length = 0;
+  for (int reg = 0; reg < MAX_NUMBER_OF_REGISTERS; reg++) {
+    if (sx127x_shadow_sync(reg, spi_device) != SHADOW_DIRTY) {
+      continue;
+    }
+    int first = reg;
+    size_t first_index = sx127x_shadow_index(first, spi_device);
+    // address is auto-incremented, so adjacent dirty registers go into a single burst
+    // as long as they are stored next to each other
+    while (reg + 1 < MAX_NUMBER_OF_REGISTERS && sx127x_shadow_sync(reg + 1, spi_device) == SHADOW_DIRTY && sx127x_shadow_index(reg + 1, spi_device) == first_index + (reg + 1 - first)) {
+      reg++;
+    }
+    segments[segments_length] = (sx127x_spi_segment_t) WRITE_SEGMENT(first, spi_device->shadow_registers + first_index, reg - first + 1);
+    segments_length++;
+    if (segments_length < SX127X_SPI_MAX_SEGMENTS) {
+      continue;
+    }
+    int code = sx127x_shadow_spi_write_dirty(segments, segments_length, spi_device);
+    if (code != SX127X_OK) {
+      for (int i = reg + 1; i < MAX_NUMBER_OF_REGISTERS; i++) {
+        if (sx127x_shadow_sync(i, spi_device) == SHADOW_DIRTY) {
+          sx127x_shadow_store(i, NULL, 1, SHADOW_NOT_CACHED, spi_device);
+        }
+      }
+      return code;
+    }
+    segments_length = 0;
+  }
+  if (segments_length == 0) {
+    return SX127X_OK;
+  }
+  return sx127x_shadow_spi_write_dirty(segments, segments_length, spi_device);
+}
+#endif
+
 int sx127x_shadow_spi_read_registers(int reg, shadow_spi_device_t *spi_device, size_t data_length, uint32_t *result) {
 #ifdef CONFIG_SX127X_DISABLE_SPI_CACHE
-  return sx127x_spi_read_registers(reg, spi_device->spi_device, data_length, result);
+  return sx127x_bus_read_registers(reg, spi_device, data_length, result);
 #else
-  if (spi_device->shadow_registers_sync[reg] == SHADOW_IGNORE) {
-    return sx127x_spi_read_registers(reg, spi_device->spi_device, data_length, result);
+  if (sx127x_shadow_sync(reg, spi_device) == SHADOW_IGNORE) {
+    ERROR_CHECK(sx127x_shadow_spi_flush(spi_device));
+    return sx127x_bus_read_registers(reg, spi_device, data_length, result);
   }
   size_t cached_length = 0;
   uint32_t cached = 0;
   for (size_t i = 0; i < data_length; i++) {
-    if (spi_device->shadow_registers_sync[reg + i] != SHADOW_CACHED) {
+    size_t index = sx127x_shadow_index(reg + i, spi_device);
+    if (!BITMAP_GET(spi_device->shadow_registers_cached, index)) {
       break;
     }
     cached = (cached << 8);
-    cached = cached | spi_device->shadow_registers[reg + i];
+    cached = cached | spi_device->shadow_registers[index];
     cached_length++;
   }
   if (cached_length == data_length) {
+    STATS_CACHE(reg, true, spi_device);
     *result = cached;
     return SX127X_OK;
   }
+  STATS_CACHE(reg, false, spi_device);
 
-  int code = sx127x_spi_read_registers(reg, spi_device->spi_device, data_length, result);
+  // partially cached range might contain pending values
+  ERROR_CHECK(sx127x_shadow_spi_flush(spi_device));
+  int code = sx127x_bus_read_registers(reg, spi_device, data_length, result);
   if (code != SX127X_OK) {
     return code;
   }
 
   const uint8_t *pointer = ((uint8_t *) result) + (sizeof(uint32_t) - data_length);
-  memcpy(spi_device->shadow_registers + reg, pointer, data_length);
-  memset(spi_device->shadow_registers_sync + reg, SHADOW_CACHED, data_length);
+  sx127x_shadow_store(reg, pointer, data_length, SHADOW_CACHED, spi_device);
   return code;
 #endif
 }
 
 int sx127x_shadow_spi_read_buffer(int reg, uint8_t *buffer, size_t buffer_length, shadow_spi_device_t *spi_device) {
+#ifndef CONFIG_SX127X_DISABLE_SPI_CACHE
+  // fifo pointers might be pending
+  ERROR_CHECK(sx127x_shadow_spi_flush(spi_device));
+#endif
   //it's always REG_FIFO
-  return sx127x_spi_read_buffer(reg, buffer, buffer_length, spi_device->spi_device);
+  return sx127x_bus_read_buffer(reg, buffer, buffer_length, spi_device);
 }
 
 int sx127x_shadow_spi_write_register(int reg, const uint8_t *data, size_t data_length, shadow_spi_device_t *spi_device) {
-  int code = sx127x_spi_write_register(reg, data, data_length, spi_device->spi_device);
 #ifndef CONFIG_SX127X_DISABLE_SPI_CACHE
-  if (code != SX127X_OK || spi_device->shadow_registers_sync[reg] == SHADOW_IGNORE) {
-    return code;
+  if (sx127x_shadow_spi_is_deferred(reg, data_length, spi_device)) {
+    sx127x_shadow_spi_defer(reg, data, data_length, spi_device);
+    return SX127X_OK;
+  }
+  ERROR_CHECK(sx127x_shadow_spi_flush(spi_device));
+#endif
+  int code = sx127x_bus_write_register(reg, data, data_length, spi_device);
+#ifndef CONFIG_SX127X_DISABLE_SPI_CACHE
+  if (code == SX127X_OK) {
+    sx127x_shadow_cache_written(reg, data, data_length, spi_device);
   }
-  memcpy(spi_device->shadow_registers + reg, data, data_length);
-  memset(spi_device->shadow_registers_sync + reg, SHADOW_CACHED, data_length);
 #endif
   return code;
 }
 
 int sx127x_shadow_spi_write_buffer(int reg, const uint8_t *buffer, size_t buffer_length, shadow_spi_device_t *spi_device) {
-  int code = sx127x_spi_write_buffer(reg, buffer, buffer_length, spi_device->spi_device);
 #ifndef CONFIG_SX127X_DISABLE_SPI_CACHE
-  if (code != SX127X_OK || spi_device->shadow_registers_sync[reg] == SHADOW_IGNORE) {
+  ERROR_CHECK(sx127x_shadow_spi_flush(spi_device));
+#endif
+  int code = sx127x_bus_write_buffer(reg, buffer, buffer_length, spi_device);
+#ifndef CONFIG_SX127X_DISABLE_SPI_CACHE
+  if (code == SX127X_OK) {
+    sx127x_shadow_cache_written(reg, buffer, buffer_length, spi_device);
+  }
+#endif
+  return code;
+}
+
+int sx127x_shadow_spi_transfer(sx127x_spi_segment_t *segments, size_t segments_length, shadow_spi_device_t *spi_device) {
+#ifndef CONFIG_SX127X_DISABLE_SPI_CACHE
+  bool deferred = true;
+  for (size_t i = 0; i < segments_length; i++) {
+    if (segments[i].tx_buffer == NULL || !sx127x_shadow_spi_is_deferred(segments[i].reg, segments[i].length, spi_device)) {
+      deferred = false;
+      break;
+    }
+  }
+  if (deferred) {
+    for (size_t i = 0; i < segments_length; i++) {
+      sx127x_shadow_spi_defer(segments[i].reg, segments[i].tx_buffer, segments[i].length, spi_device);
+    }
+    return SX127X_OK;
+  }
+  ERROR_CHECK(sx127x_shadow_spi_flush(spi_device));
+#endif
+  int code = sx127x_bus_transfer(segments, segments_length, spi_device);
+#ifndef CONFIG_SX127X_DISABLE_SPI_CACHE
+  if (code != SX127X_OK) {
     return code;
   }
-  memcpy(spi_device->shadow_registers + reg, buffer, buffer_length);
-  memset(spi_device->shadow_registers_sync + reg, SHADOW_CACHED, buffer_length);
+  // segments are applied in order, so registers after REG_OP_MODE go into the new bank
+  for (size_t i = 0; i < segments_length; i++) {
+    const sx127x_spi_segment_t *segment = segments + i;
+    if (segment->tx_buffer != NULL) {
+      sx127x_shadow_cache_written(segment->reg, segment->tx_buffer, segment->length, spi_device);
+    } else if (sx127x_shadow_sync(segment->reg, spi_device) != SHADOW_IGNORE) {
+      sx127x_shadow_store(segment->reg, segment->rx_buffer, segment->length, SHADOW_CACHED, spi_device);
+    }
+  }
 #endif
   return code;
 }
@@ -241,48 +677,55 @@ int sx127x_shadow_spi_write_buffer(int reg, const uint8_t *buffer, size_t buffer
 int sx127x_read_register(int reg, shadow_spi_device_t *spi_device, uint8_t *result) {
 #ifdef CONFIG_SX127X_DISABLE_SPI_CACHE
   uint32_t value;
-  ERROR_CHECK(sx127x_spi_read_registers(reg, spi_device->spi_device, 1, &value));
+  ERROR_CHECK(sx127x_bus_read_registers(reg, spi_device, 1, &value));
   *result = (uint8_t) value;
   return SX127X_OK;
 #else
-  if (spi_device->shadow_registers_sync[reg] == SHADOW_IGNORE) {
+  if (sx127x_shadow_policy(spi_device->bank, reg) != SX127X_REGISTER_CACHEABLE) {
+    ERROR_CHECK(sx127x_shadow_spi_flush(spi_device));
     uint32_t value;
-    ERROR_CHECK(sx127x_spi_read_registers(reg, spi_device->spi_device, 1, &value));
+    ERROR_CHECK(sx127x_bus_read_registers(reg, spi_device, 1, &value));
     *result = (uint8_t) value;
     return SX127X_OK;
   }
-  if (spi_device->shadow_registers_sync[reg] == SHADOW_CACHED) {
-    *result = spi_device->shadow_registers[reg];
+  size_t index = sx127x_shadow_index(reg, spi_device);
+  if (BITMAP_GET(spi_device->shadow_registers_cached, index)) {
+    STATS_CACHE(reg, true, spi_device);
+    *result = spi_device->shadow_registers[index];
     return SX127X_OK;
   }
+  STATS_CACHE(reg, false, spi_device);
   uint32_t value;
-  ERROR_CHECK(sx127x_spi_read_registers(reg, spi_device->spi_device, 1, &value));
+  ERROR_CHECK(sx127x_bus_read_registers(reg, spi_device, 1, &value));
   *result = (uint8_t) value;
-  spi_device->shadow_registers_sync[reg] = SHADOW_CACHED;
-  spi_device->shadow_registers[reg] = *result;
+  sx127x_shadow_set_sync(index, SHADOW_CACHED, spi_device);
+  spi_device->shadow_registers[index] = *result;
   return SX127X_OK;
 #endif
 }
 
-int sx127x_append_register(int reg, uint8_t value, uint8_t mask, shadow_spi_device_t *spi_device) {
+int sx127x_prepare_append_register(int reg, uint8_t value, uint8_t mask, shadow_spi_device_t *spi_device, uint8_t *result) {
   uint8_t previous = 0;
   ERROR_CHECK(sx127x_read_register(reg, spi_device, &previous));
-  uint8_t data[] = {(previous & mask) | value};
+  *result = (previous & mask) | value;
+  return SX127X_OK;
+}
+
+int sx127x_append_register(int reg, uint8_t value, uint8_t mask, shadow_spi_device_t *spi_device) {
+  uint8_t data[1];
+  ERROR_CHECK(sx127x_prepare_append_register(reg, value, mask, spi_device, data));
   return sx127x_shadow_spi_write_register(reg, data, 1, spi_device);
 }
 
 int sx127x_lora_set_low_datarate_optimization(bool enable, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_MODULATION(device, SX127x_MODULATION_LORA);
   uint8_t value = (enable ? 0b00001000 : 0b00000000);
   return sx127x_append_register(REG_MODEM_CONFIG_3, value, 0b11110111, &device->spi_device);
 }
 
-int sx127x_lora_get_bandwidth(sx127x *device, uint32_t *bandwidth) {
-  CHECK_MODULATION(device, SX127x_MODULATION_LORA);
-  uint8_t config = 0;
-  ERROR_CHECK(sx127x_read_register(REG_MODEM_CONFIG_1, &device->spi_device, &config));
-  config = (config >> 4);
-  switch (config) {
+int sx127x_lora_decode_bandwidth(uint8_t modem_config_1, uint32_t *bandwidth) {
+  switch (modem_config_1 >> 4) {
     case 0b0000:
       *bandwidth = 7800;
       break;
@@ -319,22 +762,556 @@ int sx127x_lora_get_bandwidth(sx127x *device, uint32_t *bandwidth) {
   return SX127X_OK;
 }
 
-int sx127x_reload_low_datarate_optimization(sx127x *device) {
-  uint32_t bandwidth;
-  ERROR_CHECK(sx127x_lora_get_bandwidth(device, &bandwidth));
-  uint8_t spreading_factor = 0;
-  ERROR_CHECK(sx127x_read_register(REG_MODEM_CONFIG_2, &device->spi_device, &spreading_factor));
-  spreading_factor = (spreading_factor >> 4);
+int sx127x_lora_get_bandwidth(sx127x *device, uint32_t *bandwidth) {
+  STATS_ENTER(device);
+  CHECK_MODULATION(device, SX127x_MODULATION_LORA);
+  uint8_t config = 0;
+  ERROR_CHECK(sx127x_read_register(REG_MODEM_CONFIG_1, &device->spi_device, &config));
+  return sx127x_lora_decode_bandwidth(config, bandwidth);
+}
+
+void sx127x_encode_frequency(uint64_t frequency, uint8_t *frf) {
+  // integer arithmetic. round to the nearest step
+  uint64_t adjusted = ((frequency << 19) + SX127x_OSCILLATOR_FREQUENCY_HZ / 2) / SX127x_OSCILLATOR_FREQUENCY_HZ;
+  frf[0] = (uint8_t) (adjusted >> 16);
+  frf[1] = (uint8_t) (adjusted >> 8);
+  frf[2] = (uint8_t) (adjusted >> 0);
+}
+
+bool sx127x_frf_is_high_band(const uint8_t *frf) {
+  return (((uint32_t) frf[0] << 16) | ((uint32_t) frf[1] << 8) | frf[2]) >= FRF_MID_BAND_THRESHOLD;
+}
+
+int sx127x_get_band(sx127x *device, bool *high_band) {
+  if (!device->band_known) {
+    uint32_t frf;
+    ERROR_CHECK(sx127x_shadow_spi_read_registers(REG_FRF_MSB, &device->spi_device, 3, &frf));
+    device->high_band = (frf >= FRF_MID_BAND_THRESHOLD);
+    device->band_known = true;
+  }
+  *high_band = device->high_band;
+  return SX127X_OK;
+}
+
+int16_t sx127x_lora_decode_rssi(uint8_t value, float snr, bool high_band) {
+  int16_t rssi;
+  if (!high_band) {
+    rssi = value - RSSI_OFFSET_LF_PORT;
+  } else {
+    rssi = value - RSSI_OFFSET_HF_PORT;
+  }
+  // section 5.5.5.
+  if (snr < 0) {
+    rssi = rssi + snr;
+  }
+  return rssi;
+}
+
+int32_t sx127x_lora_decode_frequency_error(uint32_t frequency_error, uint32_t bandwidth) {
+  int32_t sign = 1;
+  if (frequency_error & 0x80000) {
+    // keep within original 2.5 bytes
+    frequency_error = ((~frequency_error) + 1) & 0xFFFFF;
+    sign = -1;
+  }
+  return sign * (frequency_error * SX127x_FREQ_ERROR_FACTOR * bandwidth / 500000.0f);
+}
+
+int32_t sx127x_fsk_ook_decode_frequency_error(uint32_t frequency_error) {
+  int32_t sign = 1;
+  if (frequency_error & 0x8000) {
+    // keep within original 2 bytes
+    frequency_error = ((~frequency_error) + 1) & 0xFFFF;
+    sign = -1;
+  }
+  return sign * SX127x_FSTEP * frequency_error;
+}
 
+int sx127x_lora_is_low_datarate_optimization_required(uint8_t modem_config_1, uint8_t modem_config_2, bool *required) {
+  uint32_t bandwidth;
+  ERROR_CHECK(sx127x_lora_decode_bandwidth(modem_config_1, &bandwidth));
+  uint8_t spreading_factor = (modem_config_2 >> 4);
   // Section 4.1.1.5
   uint32_t symbol_duration = 1000 / (bandwidth / (1L << spreading_factor));
-  if (symbol_duration > 16) {
-    // force low data rate optimization
-    return sx127x_lora_set_low_datarate_optimization(true, device);
+  *required = (symbol_duration > 16);
+  return SX127X_OK;
+}
+
+// low data rate optimization can only be forced. Write it together with the new modem configuration
+int sx127x_lora_write_modem_config(sx127x_spi_segment_t *segments, size_t segments_length, uint8_t modem_config_1, uint8_t modem_config_2, sx127x *device) {
+  bool required;
+  ERROR_CHECK(sx127x_lora_is_low_datarate_optimization_required(modem_config_1, modem_config_2, &required));
+  uint8_t modem_config_3;
+  if (required) {
+    ERROR_CHECK(sx127x_prepare_append_register(REG_MODEM_CONFIG_3, 0b00001000, 0b11110111, &device->spi_device, &modem_config_3));
+    segments[segments_length++] = (sx127x_spi_segment_t) WRITE_SEGMENT(REG_MODEM_CONFIG_3, &modem_config_3, 1);
+  }
+  return sx127x_shadow_spi_transfer(segments, segments_length, &device->spi_device);
+}
+
+int sx127x_packet_pool_init(uint8_t *memory, uint16_t block_size, uint8_t blocks_length, sx127x_packet_pool_t *pool) {
+  if (memory == NULL || block_size == 0 || blocks_length == 0 || blocks_length > 32 || pool == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  pool->memory = memory;
+  pool->block_size = block_size;
+  pool->blocks_length = blocks_length;
+  __atomic_store_n(&pool->used, 0, __ATOMIC_RELEASE);
+  return SX127X_OK;
+}
+
+int sx127x_packet_pool_acquire(sx127x_packet_pool_t *pool, uint8_t **block) {
+  uint32_t all = (pool->blocks_length == 32 ? UINT32_MAX : ((1U << pool->blocks_length) - 1));
+  uint32_t used = __atomic_load_n(&pool->used, __ATOMIC_RELAXED);
+  while (true) {
+    uint32_t available = (~used & all);
+    if (available == 0) {
+      return SX127X_ERR_NO_MEM;
+    }
+    uint32_t bit = (available & (~available + 1));
+    if (__atomic_compare_exchange_n(&pool->used, &used, used | bit, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      *block = pool->memory + (size_t) pool->block_size * __builtin_ctz(bit);
+      return SX127X_OK;
+    }
+  }
+}
+
+void sx127x_packet_pool_release(sx127x_packet_pool_t *pool, uint8_t *block) {
+  size_t index = (size_t) (block - pool->memory) / pool->block_size;
+  __atomic_fetch_and(&pool->used, ~(1U << index), __ATOMIC_RELEASE);
+}
+
+int sx127x_rx_ring_init(sx127x_rx_slot_t *slots, uint8_t *memory, uint16_t slots_length, uint16_t slot_size, sx127x_rx_ring_overflow_t overflow, sx127x_rx_ring_t *ring) {
+  if (slots == NULL || memory == NULL || slots_length < 2 || slot_size == 0 || ring == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  if (overflow != SX127X_RX_RING_DROP_NEWEST && overflow != SX127X_RX_RING_DROP_OLDEST) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  for (uint16_t i = 0; i < slots_length; i++) {
+    slots[i].data = memory + (size_t) i * slot_size;
+    slots[i].length = 0;
+  }
+  ring->slots = slots;
+  ring->slots_length = slots_length;
+  ring->slot_size = slot_size;
+  ring->overflow = overflow;
+  __atomic_store_n(&ring->received, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&ring->tail, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&ring->head, 0, __ATOMIC_RELEASE);
+  return SX127X_OK;
+}
+
+// positions run over 2 * slots_length, so full and empty rings are different
+uint32_t sx127x_rx_ring_next(uint32_t position, sx127x_rx_ring_t *ring) {
+  position++;
+  return (position == 2 * (uint32_t) ring->slots_length ? 0 : position);
+}
+
+uint32_t sx127x_rx_ring_used(uint32_t head, uint32_t tail, sx127x_rx_ring_t *ring) {
+  uint32_t position = RX_RING_POSITION(tail);
+  return (head >= position ? head - position : head + 2 * (uint32_t) ring->slots_length - position);
+}
+
+int sx127x_rx_ring_reserve(sx127x_rx_ring_t *ring, uint8_t **data) {
+  uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  while (sx127x_rx_ring_used(head, tail, ring) >= ring->slots_length) {
+    // slot held by the consumer is the oldest one and can't be overwritten
+    if (ring->overflow == SX127X_RX_RING_DROP_NEWEST || (tail & RX_RING_HELD) != 0) {
+      __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+      return SX127X_ERR_NO_MEM;
+    }
+    // consumer might take the same packet. then retry with new tail
+    uint32_t next = RX_RING_TAIL(sx127x_rx_ring_next(RX_RING_POSITION(tail), ring));
+    if (__atomic_compare_exchange_n(&ring->tail, &tail, next, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+      tail = next;
+    }
+  }
+  *data = ring->slots[head % ring->slots_length].data;
+  return SX127X_OK;
+}
+
+void sx127x_rx_ring_commit(sx127x_rx_ring_t *ring, uint16_t length, const sx127x_packet_meta_t *meta) {
+  uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  sx127x_rx_slot_t *slot = ring->slots + (head % ring->slots_length);
+  slot->length = length;
+  slot->meta = *meta;
+  __atomic_store_n(&ring->head, sx127x_rx_ring_next(head, ring), __ATOMIC_RELEASE);
+  __atomic_fetch_add(&ring->received, 1, __ATOMIC_RELAXED);
+}
+
+int sx127x_rx_ring_acquire(sx127x_rx_ring_t *ring, sx127x_rx_slot_t **slot) {
+  uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  if ((tail & RX_RING_HELD) != 0) {
+    return SX127X_ERR_INVALID_STATE;
+  }
+  while (true) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (RX_RING_POSITION(tail) == head) {
+      return SX127X_ERR_NOT_FOUND;
+    }
+    // producer might drop the same packet. then retry with new tail
+    if (__atomic_compare_exchange_n(&ring->tail, &tail, tail | RX_RING_HELD, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+  }
+  *slot = ring->slots + (RX_RING_POSITION(tail) % ring->slots_length);
+  return SX127X_OK;
+}
+
+int sx127x_rx_ring_release(sx127x_rx_ring_t *ring) {
+  // tail stays on the held slot until now, so producer can neither drop nor overwrite it
+  uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+  if ((tail & RX_RING_HELD) == 0) {
+    return SX127X_ERR_INVALID_STATE;
+  }
+  __atomic_store_n(&ring->tail, RX_RING_TAIL(sx127x_rx_ring_next(RX_RING_POSITION(tail), ring)), __ATOMIC_RELEASE);
+  return SX127X_OK;
+}
+
+void sx127x_rx_ring_get_counters(sx127x_rx_ring_t *ring, uint32_t *received, uint32_t *dropped) {
+  *received = __atomic_load_n(&ring->received, __ATOMIC_RELAXED);
+  *dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+}
+
+int sx127x_set_rx_ring(sx127x_rx_ring_t *ring, sx127x *device) {
+#ifdef CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+  if (ring == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  device->rx_ring = ring;
+  return SX127X_OK;
+#else
+  (void) ring;
+  (void) device;
+  return SX127X_ERR_INVALID_STATE;
+#endif
+}
+
+int sx127x_tx_queue_init(sx127x_tx_slot_t *slots, uint8_t *memory, uint16_t slots_length, uint16_t slot_size, uint32_t (*clock)(void), sx127x_tx_queue_t *queue) {
+  if (slots == NULL || memory == NULL || slots_length == 0 || slot_size == 0 || queue == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  memset(queue, 0, sizeof(sx127x_tx_queue_t));
+  queue->slots = slots;
+  queue->slots_length = slots_length;
+  queue->slot_size = slot_size;
+  queue->clock = clock;
+  for (uint16_t i = 0; i < slots_length; i++) {
+    slots[i].data = memory + (size_t) i * slot_size;
+    slots[i].length = 0;
+    __atomic_store_n(&slots[i].sequence, i, __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&queue->head, 0, __ATOMIC_RELEASE);
+  return SX127X_OK;
+}
+
+int sx127x_set_tx_queue(sx127x_tx_queue_t *queue, sx127x *device) {
+  if (queue == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  device->tx_queue = queue;
+  return SX127X_OK;
+}
+
+int sx127x_tx_queue_set_wake(void (*wake)(void *), void *context, sx127x_tx_queue_t *queue) {
+  if (queue == NULL) {
+    return SX127X_ERR_INVALID_ARG;
   }
+  queue->wake = wake;
+  queue->wake_context = context;
   return SX127X_OK;
 }
 
+int sx127x_tx_queue_submit(const uint8_t *data, uint16_t data_length, int16_t channel, sx127x_tx_queue_t *queue) {
+  if (data == NULL || data_length == 0 || queue == NULL || data_length > queue->slot_size || channel < SX127X_TX_QUEUE_CURRENT_CHANNEL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+  sx127x_tx_slot_t *slot;
+  while (true) {
+    slot = queue->slots + (head % queue->slots_length);
+    uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    int32_t diff = (int32_t) (sequence - head);
+    if (diff < 0) {
+      // slot still holds the frame from the previous lap
+      __atomic_fetch_add(&queue->rejected, 1, __ATOMIC_RELAXED);
+      return SX127X_ERR_NO_MEM;
+    }
+    // another producer took the slot. retry with the new head
+    if (diff == 0 && __atomic_compare_exchange_n(&queue->head, &head, head + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      break;
+    }
+    if (diff > 0) {
+      head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    }
+  }
+  memcpy(slot->data, data, data_length);
+  slot->length = data_length;
+  slot->channel = channel;
+  slot->submitted = (queue->clock != NULL ? queue->clock() : 0);
+  // publish the frame to the interrupt handler
+  __atomic_store_n(&slot->sequence, head + 1, __ATOMIC_RELEASE);
+  // pairs with the fence in sx127x_tx_queue_next: either consumer sees the frame or producer sees consumer stopped at it
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+  // consumer can stop only at the first frame which is not published yet
+  if (tail == head && queue->wake != NULL) {
+    queue->wake(queue->wake_context);
+  }
+  uint32_t depth = head + 1 - tail;
+  uint32_t max_depth = __atomic_load_n(&queue->max_depth, __ATOMIC_RELAXED);
+  while (depth > max_depth && !__atomic_compare_exchange_n(&queue->max_depth, &max_depth, depth, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+  return SX127X_OK;
+}
+
+// checked before radio leaves RX, so the frame which can't be sent doesn't interrupt the reception
+int sx127x_tx_queue_validate(const sx127x_tx_slot_t *slot, sx127x *device) {
+  if (slot->channel != SX127X_TX_QUEUE_CURRENT_CHANNEL && (device->channel_plan == NULL || slot->channel >= device->channel_plan->channels_length)) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  if (device->active_modem == SX127x_MODULATION_LORA) {
+    return (slot->length > MAX_PACKET_SIZE ? SX127X_ERR_INVALID_ARG : SX127X_OK);
+  }
+  if (device->fsk_ook_format == SX127X_VARIABLE && slot->length > MAX_PACKET_SIZE) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  if (device->fsk_ook_format == SX127X_FIXED && slot->length > MAX_PACKET_SIZE_FSK_FIXED) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  return SX127X_OK;
+}
+
+int sx127x_tx_queue_send(const sx127x_tx_slot_t *slot, sx127x *device) {
+  ERROR_CHECK(sx127x_tx_queue_validate(slot, device));
+  // radio can be listening when the queue is started
+  if (device->opmod == SX127x_MODE_RX_CONT || device->opmod == SX127x_MODE_RX_SINGLE || device->opmod == SX127x_MODE_CAD) {
+    ERROR_CHECK(sx127x_set_opmod(SX127x_MODE_STANDBY, device->active_modem, device));
+  }
+  if (slot->channel != SX127X_TX_QUEUE_CURRENT_CHANNEL) {
+    ERROR_CHECK(sx127x_set_channel((uint8_t) slot->channel, device));
+  }
+  if (device->active_modem == SX127x_MODULATION_LORA) {
+    ERROR_CHECK(sx127x_lora_tx_set_for_transmission(slot->data, (uint8_t) slot->length, device));
+  } else {
+    ERROR_CHECK(sx127x_fsk_ook_tx_set_for_transmission(slot->data, slot->length, device));
+  }
+  return sx127x_set_opmod(SX127x_MODE_TX, device->active_modem, device);
+}
+
+// single consumer: thread which handles interrupts of the device
+int sx127x_tx_queue_next(sx127x *device) {
+  sx127x_tx_queue_t *queue = device->tx_queue;
+  while (true) {
+    uint32_t tail = queue->tail;
+    sx127x_tx_slot_t *slot = queue->slots + (tail % queue->slots_length);
+    // pairs with the fence in sx127x_tx_queue_submit, so the producer of this slot wakes up the handler if it is not published yet
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    // empty or producer didn't finish copying yet
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != tail + 1) {
+      return SX127X_ERR_NOT_FOUND;
+    }
+    uint32_t submitted = slot->submitted;
+    // payload is copied into the chip or the packet buffer, so slot can be reused right away
+    int code = sx127x_tx_queue_send(slot, device);
+    __atomic_store_n(&slot->sequence, tail + queue->slots_length, __ATOMIC_RELEASE);
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+    if (code == SX127X_OK) {
+      if (queue->clock != NULL) {
+        uint32_t latency = queue->clock() - submitted;
+        __atomic_store_n(&queue->total_latency, queue->total_latency + latency, __ATOMIC_RELAXED);
+        if (latency > queue->max_latency) {
+          __atomic_store_n(&queue->max_latency, latency, __ATOMIC_RELAXED);
+        }
+      }
+      return SX127X_OK;
+    }
+    // skip broken frame
+    __atomic_store_n(&queue->failed, queue->failed + 1, __ATOMIC_RELAXED);
+  }
+}
+
+int sx127x_tx_queue_start(sx127x *device) {
+  STATS_ENTER(device);
+  if (device->tx_queue == NULL) {
+    return SX127X_ERR_INVALID_STATE;
+  }
+  if (device->tx_queue->active) {
+    return SX127X_OK;
+  }
+  uint32_t tail = device->tx_queue->tail;
+  int code = sx127x_tx_queue_next(device);
+  if (code == SX127X_OK) {
+    device->tx_queue->active = true;
+    return SX127X_OK;
+  }
+  // all frames failed. radio might have left RX already, so let the application restore it as if queue was drained
+  if (device->tx_queue->tail != tail && device->tx_callback != NULL) {
+    device->tx_callback(device);
+  }
+  return code;
+}
+
+void sx127x_tx_queue_get_counters(sx127x_tx_queue_t *queue, sx127x_tx_queue_counters_t *counters) {
+  counters->submitted = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+  counters->depth = (uint16_t) (counters->submitted - __atomic_load_n(&queue->tail, __ATOMIC_RELAXED));
+  counters->sent = __atomic_load_n(&queue->sent, __ATOMIC_RELAXED);
+  counters->rejected = __atomic_load_n(&queue->rejected, __ATOMIC_RELAXED);
+  counters->failed = __atomic_load_n(&queue->failed, __ATOMIC_RELAXED);
+  counters->max_depth = (uint16_t) __atomic_load_n(&queue->max_depth, __ATOMIC_RELAXED);
+  counters->total_latency = __atomic_load_n(&queue->total_latency, __ATOMIC_RELAXED);
+  counters->max_latency = __atomic_load_n(&queue->max_latency, __ATOMIC_RELAXED);
+}
+
+// called once per frame. sent is false if frame was aborted
+void sx127x_tx_done(bool sent, sx127x *device) {
+  sx127x_tx_queue_t *queue = device->tx_queue;
+  if (queue != NULL && queue->active) {
+    if (sent) {
+      __atomic_store_n(&queue->sent, queue->sent + 1, __ATOMIC_RELAXED);
+    } else {
+      __atomic_store_n(&queue->failed, queue->failed + 1, __ATOMIC_RELAXED);
+    }
+    // chain the next frame. callback is called once queue is drained
+    if (sx127x_tx_queue_next(device) == SX127X_OK) {
+      return;
+    }
+    queue->active = false;
+  } else if (!sent) {
+    if (device->tx_abort_callback != NULL) {
+      device->tx_abort_callback(device);
+    }
+    return;
+  }
+  if (device->tx_callback != NULL) {
+    device->tx_callback(device);
+  }
+}
+
+int sx127x_set_packet_buffer(uint8_t *buffer, uint16_t buffer_length, sx127x *device) {
+#ifdef CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+  if (buffer == NULL || buffer_length == 0) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  device->packet_buffer = buffer;
+  device->packet_buffer_length = buffer_length;
+  device->packet_pool = NULL;
+  return SX127X_OK;
+#else
+  (void) buffer;
+  (void) buffer_length;
+  (void) device;
+  return SX127X_ERR_INVALID_STATE;
+#endif
+}
+
+int sx127x_set_packet_pool(sx127x_packet_pool_t *pool, sx127x *device) {
+#ifdef CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+  if (pool == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  device->packet_pool = pool;
+  device->packet_buffer = NULL;
+  device->packet_buffer_length = 0;
+  return SX127X_OK;
+#else
+  (void) pool;
+  (void) device;
+  return SX127X_ERR_INVALID_STATE;
+#endif
+}
+
+bool sx127x_packet_is_acquired(sx127x *device) {
+#ifdef CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+  return device->packet != NULL;
+#else
+  (void) device;
+  return true;
+#endif
+}
+
+void sx127x_packet_release(sx127x *device) {
+#ifdef CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+  // ring slot is reused unless committed
+  if (device->packet != NULL && !device->packet_in_ring && device->packet_pool != NULL) {
+    sx127x_packet_pool_release(device->packet_pool, device->packet);
+  }
+  device->packet = NULL;
+  device->packet_in_ring = false;
+#else
+  (void) device;
+#endif
+}
+
+int sx127x_packet_acquire(uint16_t length, sx127x *device) {
+#ifdef CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+  if (device->packet == NULL) {
+    if (device->packet_buffer != NULL) {
+      device->packet = device->packet_buffer;
+      device->packet_capacity = device->packet_buffer_length;
+    } else if (device->packet_pool != NULL) {
+      ERROR_CHECK(sx127x_packet_pool_acquire(device->packet_pool, &device->packet));
+      device->packet_capacity = device->packet_pool->block_size;
+    } else {
+      return SX127X_ERR_NO_MEM;
+    }
+  }
+  if (length > device->packet_capacity) {
+    sx127x_packet_release(device);
+    return SX127X_ERR_INVALID_ARG;
+  }
+#else
+  (void) device;
+  if (length > CONFIG_SX127X_MAX_PACKET_SIZE) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+#endif
+  return SX127X_OK;
+}
+
+int sx127x_packet_acquire_rx(uint16_t length, sx127x *device) {
+#ifdef CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+  if (device->rx_ring != NULL) {
+    if (device->packet == NULL) {
+      ERROR_CHECK(sx127x_rx_ring_reserve(device->rx_ring, &device->packet));
+      device->packet_capacity = device->rx_ring->slot_size;
+      device->packet_in_ring = true;
+    }
+    if (length > device->packet_capacity) {
+      sx127x_packet_release(device);
+      return SX127X_ERR_INVALID_ARG;
+    }
+    return SX127X_OK;
+  }
+#endif
+  return sx127x_packet_acquire(length, device);
+}
+
+void sx127x_packet_commit_rx(const sx127x_packet_meta_t *meta, sx127x *device) {
+#ifdef CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+  if (device->packet_in_ring) {
+    sx127x_rx_ring_commit(device->rx_ring, device->expected_packet_length, meta);
+  }
+#else
+  (void) meta;
+  (void) device;
+#endif
+}
+
+// metadata is stored in the ring slot even if there is no meta callback
+bool sx127x_rx_meta_required(sx127x *device) {
+#ifdef CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+  if (device->rx_ring != NULL) {
+    return true;
+  }
+#endif
+  return (device->rx_meta_callback != NULL);
+}
+
 int sx127x_fsk_ook_read_fixed_packet_length(sx127x *device, uint16_t *packet_length) {
   uint16_t result;
   uint8_t value;
@@ -391,6 +1368,13 @@ void sx127x_fsk_ook_read_payload_batch(bool read_batch, sx127x *device) {
       device->expected_packet_length--;
       remaining_fifo--;
     }
+    if (sx127x_packet_acquire_rx(device->expected_packet_length, device) != SX127X_OK) {
+      return;
+    }
+  }
+  // no room for the packet. it will be dropped
+  if (!sx127x_packet_is_acquired(device)) {
+    return;
   }
 
   // safe check
@@ -398,23 +1382,25 @@ void sx127x_fsk_ook_read_payload_batch(bool read_batch, sx127x *device) {
     return;
   }
 
-  uint8_t batch_size = HALF_MAX_FIFO_THRESHOLD - 1;
-  if (read_batch && device->fsk_ook_packet_sent_received + batch_size < device->expected_packet_length) {
+  uint8_t batch_size = device->fsk_ook_rx_batch;
+  uint16_t remaining = device->expected_packet_length - device->fsk_ook_packet_sent_received;
+  if (read_batch && remaining > batch_size) {
     int code = sx127x_shadow_spi_read_buffer(REG_FIFO, device->packet + device->fsk_ook_packet_sent_received, batch_size, &device->spi_device);
     if (code != SX127X_OK) {
       return;
     }
     device->fsk_ook_packet_sent_received += batch_size;
   } else {
-    // shortcut here for packets less than max fifo size
-    if (device->fsk_ook_packet_sent_received == 0 && device->expected_packet_length <= remaining_fifo) {
-      int code = sx127x_shadow_spi_read_buffer(REG_FIFO, device->packet, device->expected_packet_length, &device->spi_device);
+    // FIFO_LEVEL guarantees more than batch_size bytes in FIFO, PAYLOAD_READY - the whole tail
+    uint16_t available = (read_batch ? batch_size : remaining_fifo);
+    if (remaining <= available) {
+      int code = sx127x_shadow_spi_read_buffer(REG_FIFO, device->packet + device->fsk_ook_packet_sent_received, remaining, &device->spi_device);
       if (code != SX127X_OK) {
         return;
       }
       device->fsk_ook_packet_sent_received = device->expected_packet_length;
     } else {
-      // else read remaining bytes one by one and check FIFO_EMPTY irq
+      // some FIFO_LEVEL interrupts were missed. read remaining bytes one by one and check FIFO_EMPTY irq
       uint8_t irq;
       do {
         uint8_t value;
@@ -428,7 +1414,7 @@ void sx127x_fsk_ook_read_payload_batch(bool read_batch, sx127x *device) {
         if (code != SX127X_OK) {
           return;
         }
-      } while ((irq & SX127X_FSK_IRQ_FIFO_EMPTY) == 0);
+      } while ((irq & SX127X_FSK_IRQ_FIFO_EMPTY) == 0 && device->fsk_ook_packet_sent_received < device->expected_packet_length);
     }
   }
 }
@@ -443,26 +1429,114 @@ int sx127x_fsk_ook_get_rssi(sx127x *device) {
 }
 
 void sx127x_fsk_ook_reset_state(sx127x *device) {
+  sx127x_packet_release(device);
   device->expected_packet_length = 0;
   device->fsk_ook_packet_sent_received = 0;
   device->fsk_rssi = 0;
   device->fsk_rssi_available = false;
 }
 
-void sx127x_fsk_ook_handle_interrupt(sx127x *device) {
-  uint8_t irq;
-  ERROR_CHECK_NOCODE(sx127x_read_register(REG_IRQ_FLAGS_2, &device->spi_device, &irq));
-  // clear the irq
-  ERROR_CHECK_NOCODE(sx127x_shadow_spi_write_register(REG_IRQ_FLAGS_2, &irq, 1, &device->spi_device));
+int sx127x_fsk_ook_tx_write_fifo(uint16_t to_send, sx127x *device) {
+  uint16_t position = device->fsk_ook_packet_sent_received;
+  uint16_t end = position + to_send;
+  sx127x_spi_segment_t segments[2];
+  size_t segments_length = 0;
+  if (position < device->fsk_ook_tx_prefix_length) {
+    uint16_t prefix_end = (end < device->fsk_ook_tx_prefix_length ? end : device->fsk_ook_tx_prefix_length);
+    segments[segments_length++] = (sx127x_spi_segment_t) WRITE_SEGMENT(REG_FIFO, device->fsk_ook_tx_prefix + position, prefix_end - position);
+    position = prefix_end;
+  }
+  uint8_t chunk[FIFO_SIZE_FSK];
+  if (position < end) {
+    const sx127x_tx_source_t *source = &device->fsk_ook_tx_source;
+    const uint8_t *data;
+    if (source->buffer != NULL) {
+      data = source->buffer + (position - device->fsk_ook_tx_prefix_length);
+    } else {
+      ERROR_CHECK(source->pull(chunk, end - position, source->context));
+      data = chunk;
+    }
+    segments[segments_length++] = (sx127x_spi_segment_t) WRITE_SEGMENT(REG_FIFO, data, end - position);
+  }
+  ERROR_CHECK(sx127x_shadow_spi_transfer(segments, segments_length, &device->spi_device));
+  device->fsk_ook_packet_sent_received = end;
+  // whole packet is in FIFO
+  if (end == device->expected_packet_length) {
+    sx127x_packet_release(device);
+  }
+  return SX127X_OK;
+}
+
+// expected_packet_length is 0 if packet length could not be read
+bool sx127x_fsk_ook_rx_is_complete(sx127x *device) {
+  return sx127x_packet_is_acquired(device) && device->expected_packet_length != 0 && device->fsk_ook_packet_sent_received == device->expected_packet_length;
+}
+
+void sx127x_fsk_ook_read_payload_chunk(bool read_batch, sx127x *device) {
+  uint16_t offset = device->fsk_ook_packet_sent_received;
+  sx127x_fsk_ook_read_payload_batch(read_batch, device);
+  if (device->rx_chunk_callback == NULL || !sx127x_packet_is_acquired(device)) {
+    return;
+  }
+  if (read_batch) {
+    if (device->fsk_ook_packet_sent_received > offset) {
+      device->rx_chunk_callback(device, device->packet + offset, device->fsk_ook_packet_sent_received - offset, SX127X_RX_CHUNK_PARTIAL);
+    }
+  } else if (sx127x_fsk_ook_rx_is_complete(device)) {
+    device->rx_chunk_callback(device, device->packet + offset, device->fsk_ook_packet_sent_received - offset, SX127X_RX_CHUNK_LAST);
+  } else if (offset > 0) {
+    // tail was not read. packet won't be delivered
+    device->rx_chunk_callback(device, device->packet + device->fsk_ook_packet_sent_received, 0, SX127X_RX_CHUNK_DROPPED);
+  }
+}
+
+void sx127x_rx_notify(const sx127x_packet_meta_t *meta, sx127x *device) {
+  if (device->rx_meta_callback != NULL) {
+    device->rx_meta_callback(device, device->packet, device->expected_packet_length, meta);
+  } else if (device->rx_callback != NULL) {
+    device->rx_callback(device, device->packet, device->expected_packet_length);
+  }
+}
+
+int sx127x_fsk_ook_rx_read_meta(sx127x_packet_meta_t *meta, sx127x *device) {
+  memset(meta, 0, sizeof(sx127x_packet_meta_t));
+  meta->timestamp = device->irq_timestamp;
+  if (device->fsk_rssi_available) {
+    meta->rssi = device->fsk_rssi;
+  }
+  meta->crc_present = (device->fsk_crc_type != SX127X_CRC_NONE);
+  uint32_t frequency_error;
+  ERROR_CHECK(sx127x_shadow_spi_read_registers(REG_AFC_VALUE, &device->spi_device, 2, &frequency_error));
+  meta->frequency_error = sx127x_fsk_ook_decode_frequency_error(frequency_error);
+  return SX127X_OK;
+}
+
+void sx127x_fsk_ook_irq_process(uint32_t event, sx127x *device) {
+  // both irq registers were cleared when event was captured
+  uint8_t irq = (uint8_t) event;
   if ((irq & SX127X_FSK_IRQ_PAYLOAD_READY) != 0) {
     if (device->fsk_crc_type != SX127X_CRC_NONE && (irq & SX127X_FSK_IRQ_CRC_OK) != SX127X_FSK_IRQ_CRC_OK) {
+      // some chunks might be already delivered
+      if (device->rx_chunk_callback != NULL && device->fsk_ook_packet_sent_received > 0) {
+        device->rx_chunk_callback(device, device->packet + device->fsk_ook_packet_sent_received, 0, SX127X_RX_CHUNK_DROPPED);
+      }
       irq = SX127X_FSK_IRQ_FIFO_OVERRUN;
       ERROR_CHECK_NOCODE(sx127x_shadow_spi_write_register(REG_IRQ_FLAGS_2, &irq, 1, &device->spi_device));
     } else {
       // read remaining of FIFO into the packet
-      sx127x_fsk_ook_read_payload_batch(false, device);
-      if (device->rx_callback != NULL) {
-        device->rx_callback(device, device->packet, device->expected_packet_length);
+      sx127x_fsk_ook_read_payload_chunk(false, device);
+      if (!sx127x_fsk_ook_rx_is_complete(device)) {
+        // packet was dropped or its length or tail could not be read. clear FIFO
+        irq = SX127X_FSK_IRQ_FIFO_OVERRUN;
+        ERROR_CHECK_NOCODE(sx127x_shadow_spi_write_register(REG_IRQ_FLAGS_2, &irq, 1, &device->spi_device));
+      } else {
+        sx127x_packet_meta_t meta;
+        if (sx127x_rx_meta_required(device)) {
+          // deliver the packet even if frequency error is not available
+          sx127x_fsk_ook_rx_read_meta(&meta, device);
+        }
+        sx127x_packet_commit_rx(&meta, device);
+        sx127x_rx_notify(&meta, device);
       }
     }
     sx127x_fsk_ook_reset_state(device);
@@ -470,25 +1544,25 @@ void sx127x_fsk_ook_handle_interrupt(sx127x *device) {
   }
   if ((irq & SX127X_FSK_IRQ_PACKET_SENT) != 0) {
     sx127x_fsk_ook_reset_state(device);
-    if (device->tx_callback != NULL) {
-      device->tx_callback(device);
-    }
+    sx127x_tx_done(true, device);
     return;
   }
   if (device->opmod == SX127x_MODE_TX) {
-    if ((irq & SX127X_FSK_IRQ_FIFO_EMPTY) != 0) {
-      // TX sequencer clears PACKET_SENT IRQ so only FIFO_EMPTY interrupt can be used to detect if message was actually sent
-      sx127x_fsk_ook_reset_state(device);
-      if (device->tx_callback != NULL) {
-        device->tx_callback(device);
+    // TX sequencer clears PACKET_SENT IRQ once it leaves TX, so FIFO_EMPTY without TX_READY means the message was actually sent.
+    // FIFO_EMPTY with TX_READY: the last byte is still being sent and PACKET_SENT will follow
+    if ((irq & SX127X_FSK_IRQ_FIFO_EMPTY) != 0 && ((event >> 8) & SX127X_FSK_IRQ_TX_READY) == 0) {
+      // frame can be reported by the previous interrupt already
+      if (device->expected_packet_length != 0 && device->fsk_ook_packet_sent_received == device->expected_packet_length) {
+        sx127x_fsk_ook_reset_state(device);
+        sx127x_tx_done(true, device);
       }
       return;
     }
     // FIFO_LEVEL == 0 - below level
     if ((irq & SX127X_FSK_IRQ_FIFO_LEVEL) == 0 && (irq & SX127X_FSK_IRQ_FIFO_FULL) == 0) {
       uint8_t to_send;
-      if (device->expected_packet_length - device->fsk_ook_packet_sent_received > (HALF_MAX_FIFO_THRESHOLD - 1)) {
-        to_send = HALF_MAX_FIFO_THRESHOLD - 1;
+      if (device->expected_packet_length - device->fsk_ook_packet_sent_received > device->fsk_ook_tx_batch) {
+        to_send = device->fsk_ook_tx_batch;
       } else {
         to_send = (uint8_t) (device->expected_packet_length - device->fsk_ook_packet_sent_received);
       }
@@ -499,17 +1573,20 @@ void sx127x_fsk_ook_handle_interrupt(sx127x *device) {
         return;
       }
       // remaining bits not written to FIFO but modulator will eventually trigger SX127X_FSK_IRQ_PACKET_SENT
-      ERROR_CHECK_NOCODE(sx127x_shadow_spi_write_buffer(REG_FIFO, device->packet + device->fsk_ook_packet_sent_received, to_send, &device->spi_device));
-      device->fsk_ook_packet_sent_received += to_send;
+      if (sx127x_fsk_ook_tx_write_fifo(to_send, device) != SX127X_OK) {
+        // the rest of the frame can't be written. stop modulator before FIFO_EMPTY reports it as sent
+        sx127x_fsk_ook_reset_state(device);
+        sx127x_set_opmod(SX127x_MODE_STANDBY, device->active_modem, device);
+        // frame is lost even if modulator can't be stopped
+        sx127x_tx_done(false, device);
+      }
     }
   } else if (device->opmod == SX127x_MODE_RX_CONT || device->opmod == SX127x_MODE_RX_SINGLE) {
     if ((irq & SX127X_FSK_IRQ_FIFO_LEVEL) != 0 && (irq & SX127X_FSK_IRQ_FIFO_FULL) == 0) {
-      sx127x_fsk_ook_read_payload_batch(true, device);
+      sx127x_fsk_ook_read_payload_chunk(true, device);
     } else {
       // if not RX irq, then try preamble detect
-      ERROR_CHECK_NOCODE(sx127x_read_register(REG_IRQ_FLAGS_1, &device->spi_device, &irq));
-      //  clear the irq
-      ERROR_CHECK_NOCODE(sx127x_shadow_spi_write_register(REG_IRQ_FLAGS_1, &irq, 1, &device->spi_device));
+      irq = (uint8_t) (event >> 8);
       if ((irq & SX127X_FSK_IRQ_PREAMBLE_DETECT) != 0 && !device->fsk_rssi_available) {
         sx127x_fsk_ook_get_rssi(device);
         return;
@@ -523,26 +1600,100 @@ void sx127x_fsk_ook_handle_interrupt(sx127x *device) {
   }
 }
 
-int sx127x_lora_rx_read_payload(sx127x *device) {
-  CHECK_MODULATION(device, SX127x_MODULATION_LORA);
-  uint8_t length;
-  if (device->expected_packet_length == 0) {
-    ERROR_CHECK(sx127x_read_register(REG_RX_NB_BYTES, &device->spi_device, &length));
-  } else {
-    length = (uint8_t) device->expected_packet_length;
+int sx127x_lora_rx_decode_meta(const uint8_t *modem_status, const uint8_t *frequency_error, sx127x_packet_meta_t *meta, sx127x *device) {
+  bool high_band;
+  ERROR_CHECK(sx127x_get_band(device, &high_band));
+  uint32_t bandwidth;
+  ERROR_CHECK(sx127x_lora_get_bandwidth(device, &bandwidth));
+  meta->snr = (float) ((int8_t) modem_status[REG_PKT_SNR_VALUE - REG_MODEM_STAT]) * 0.25f;
+  meta->rssi = sx127x_lora_decode_rssi(modem_status[REG_PKT_RSSI_VALUE - REG_MODEM_STAT], meta->snr, high_band);
+  meta->frequency_error = sx127x_lora_decode_frequency_error((frequency_error[0] << 16) | (frequency_error[1] << 8) | frequency_error[2], bandwidth);
+  // RxCodingRate is stored in the same format as CodingRate in RegModemConfig1, but 2 bits higher
+  meta->coding_rate = (sx127x_cr_t) ((modem_status[0] >> 5) << 1);
+  meta->crc_present = ((modem_status[REG_HOP_CHANNEL - REG_MODEM_STAT] & 0b01000000) != 0);
+  return SX127X_OK;
+}
+
+int sx127x_lora_rx_read_payload(uint32_t event, sx127x_packet_meta_t *meta, sx127x *device) {
+  uint8_t irq = (uint8_t) event;
+  bool cleared = ((event & IRQ_EVENT_CLEARED) != 0);
+  uint16_t length = device->expected_packet_length;
+  if (length == 0) {
+    length = (uint8_t) (event >> 16);
+  }
+  int code = sx127x_packet_acquire_rx(length, device);
+  if (code != SX127X_OK) {
+    // no room for the packet. drop it
+    if (!cleared) {
+      ERROR_CHECK(sx127x_shadow_spi_write_register(REG_IRQ_FLAGS, &irq, 1, &device->spi_device));
+    }
+    return code;
   }
   device->expected_packet_length = length;
+  uint8_t current = (uint8_t) (event >> 8);
+  // packet status and frequency error are still valid after irq is cleared
+  uint8_t modem_status[REG_HOP_CHANNEL - REG_MODEM_STAT + 1];
+  uint8_t frequency_error[REG_FREQ_ERROR_LSB - REG_FREQ_ERROR_MSB + 1];
+  // clear the irq, point to the received packet and read it in one go
+  sx127x_spi_segment_t segments[] = {
+      WRITE_SEGMENT(REG_IRQ_FLAGS, &irq, 1),
+      WRITE_SEGMENT(REG_FIFO_ADDR_PTR, &current, 1),
+      READ_SEGMENT(REG_FIFO, device->packet, device->expected_packet_length),
+      READ_SEGMENT(REG_MODEM_STAT, modem_status, sizeof(modem_status)),
+      READ_SEGMENT(REG_FREQ_ERROR_MSB, frequency_error, sizeof(frequency_error))};
+  sx127x_spi_segment_t *first = (cleared ? segments + 1 : segments);
+  size_t segments_length = SEGMENTS_LENGTH(segments) - (first - segments);
+  bool meta_required = sx127x_rx_meta_required(device);
+  if (!meta_required) {
+    segments_length -= 2;
+  }
+  code = sx127x_shadow_spi_transfer(first, segments_length, &device->spi_device);
+  if (code == SX127X_OK && meta_required) {
+    code = sx127x_lora_rx_decode_meta(modem_status, frequency_error, meta, device);
+  }
+  if (code != SX127X_OK) {
+    // packet won't be delivered
+    sx127x_packet_release(device);
+    device->expected_packet_length = 0;
+  }
+  return code;
+}
 
-  uint8_t current;
-  ERROR_CHECK(sx127x_read_register(REG_FIFO_RX_CURRENT_ADDR, &device->spi_device, &current));
-  ERROR_CHECK(sx127x_shadow_spi_write_register(REG_FIFO_ADDR_PTR, &current, 1, &device->spi_device));
-  return sx127x_shadow_spi_read_buffer(REG_FIFO, device->packet, device->expected_packet_length, &device->spi_device);
+int sx127x_lora_fhss_hop(uint32_t event, sx127x *device) {
+  uint8_t irq = (uint8_t) event;
+  bool cleared = ((event & IRQ_EVENT_CLEARED) != 0);
+  if (device->frequencies_length == 0) {
+    return (cleared ? SX127X_OK : sx127x_shadow_spi_write_register(REG_IRQ_FLAGS, &irq, 1, &device->spi_device));
+  }
+  if (device->current_frequency >= device->frequencies_length) {
+    device->current_frequency = 0;
+  }
+  // register values were calculated in sx127x_lora_set_frequency_hopping
+  // set the next frequency and clear the irq in one go
+  sx127x_spi_segment_t segments[] = {
+      WRITE_SEGMENT(REG_FRF_MSB, device->frequencies[device->current_frequency], 3),
+      WRITE_SEGMENT(REG_IRQ_FLAGS, &irq, 1)};
+  ERROR_CHECK(sx127x_shadow_spi_transfer(segments, SEGMENTS_LENGTH(segments) - (cleared ? 1 : 0), &device->spi_device));
+  device->high_band = sx127x_frf_is_high_band(device->frequencies[device->current_frequency]);
+  device->band_known = true;
+  device->channel_set = false;
+  device->current_frequency++;
+  return SX127X_OK;
 }
 
-void sx127x_lora_handle_interrupt(sx127x *device) {
-  uint8_t value;
-  ERROR_CHECK_NOCODE(sx127x_read_register(REG_IRQ_FLAGS, &device->spi_device, &value));
-  ERROR_CHECK_NOCODE(sx127x_shadow_spi_write_register(REG_IRQ_FLAGS, &value, 1, &device->spi_device));
+void sx127x_lora_irq_process(uint32_t event, sx127x *device) {
+  uint8_t value = (uint8_t) event;
+  sx127x_packet_meta_t meta = {0};
+  if ((value & (SX127x_IRQ_FLAG_CADDONE | SX127x_IRQ_FLAG_PAYLOAD_CRC_ERROR | SX127x_IRQ_FLAG_RXDONE)) == SX127x_IRQ_FLAG_RXDONE) {
+    meta.timestamp = device->irq_timestamp;
+    ERROR_CHECK_NOCODE(sx127x_lora_rx_read_payload(event, &meta, device));
+  } else if ((value & (SX127x_IRQ_FLAG_CADDONE | SX127x_IRQ_FLAG_PAYLOAD_CRC_ERROR | SX127x_IRQ_FLAG_RXDONE | SX127x_IRQ_FLAG_TXDONE)) == 0 && (value & SX127x_IRQ_FLAG_FHSSCHANGECHANNEL) != 0) {
+    // if message was sent or received, then no need to change freq
+    ERROR_CHECK_NOCODE(sx127x_lora_fhss_hop(event, device));
+    return;
+  } else if ((event & IRQ_EVENT_CLEARED) == 0) {
+    ERROR_CHECK_NOCODE(sx127x_shadow_spi_write_register(REG_IRQ_FLAGS, &value, 1, &device->spi_device));
+  }
   if ((value & SX127x_IRQ_FLAG_CADDONE) != 0) {
     if (device->cad_callback != NULL) {
       device->cad_callback(device, value & SX127x_IRQ_FLAG_CAD_DETECTED);
@@ -554,59 +1705,220 @@ void sx127x_lora_handle_interrupt(sx127x *device) {
     return;
   }
   if ((value & SX127x_IRQ_FLAG_RXDONE) != 0) {
-    ERROR_CHECK_NOCODE(sx127x_lora_rx_read_payload(device));
-    if (device->rx_callback != NULL) {
-      device->rx_callback(device, device->packet, device->expected_packet_length);
+    sx127x_packet_commit_rx(&meta, device);
+    sx127x_rx_notify(&meta, device);
+    sx127x_packet_release(device);
+    device->expected_packet_length = 0;
+    device->current_frequency = 0;
+    return;
+  }
+  if ((value & SX127x_IRQ_FLAG_TXDONE) != 0) {
+    device->current_frequency = 0;
+    sx127x_tx_done(true, device);
+    return;
+  }
+}
+
+// PreambleDetect and SyncAddressMatch are cleared only by the interrupts which handle them. FIFO_LEVEL batches in the middle of the packet keep them
+bool sx127x_fsk_ook_irq_flags_1_handled(uint8_t irq, sx127x *device) {
+  if ((irq & (SX127X_FSK_IRQ_PAYLOAD_READY | SX127X_FSK_IRQ_PACKET_SENT)) != 0) {
+    return false;
+  }
+  if (device->opmod != SX127x_MODE_RX_CONT && device->opmod != SX127x_MODE_RX_SINGLE) {
+    return false;
+  }
+  return (irq & SX127X_FSK_IRQ_FIFO_LEVEL) == 0 || (irq & SX127X_FSK_IRQ_FIFO_FULL) != 0;
+}
+
+int sx127x_irq_read(bool clear, uint32_t *event, sx127x *device) {
+  uint32_t result;
+  if (device->active_modem == SX127x_MODULATION_LORA) {
+    // REG_FIFO_RX_CURRENT_ADDR, REG_IRQ_FLAGS_MASK, REG_IRQ_FLAGS and REG_RX_NB_BYTES are next to each other
+    uint8_t status[REG_RX_NB_BYTES - REG_FIFO_RX_CURRENT_ADDR + 1];
+    sx127x_spi_segment_t segments[] = {
+        READ_SEGMENT(REG_FIFO_RX_CURRENT_ADDR, status, sizeof(status))};
+    ERROR_CHECK(sx127x_shadow_spi_transfer(segments, SEGMENTS_LENGTH(segments), &device->spi_device));
+    uint8_t irq = status[REG_IRQ_FLAGS - REG_FIFO_RX_CURRENT_ADDR];
+    // otherwise irq is cleared together with the next transfer in sx127x_irq_process
+    if (clear && irq != 0) {
+      ERROR_CHECK(sx127x_shadow_spi_write_register(REG_IRQ_FLAGS, &irq, 1, &device->spi_device));
+    }
+    result = irq | ((uint32_t) status[0] << 8) | ((uint32_t) status[REG_RX_NB_BYTES - REG_FIFO_RX_CURRENT_ADDR] << 16) | (clear ? IRQ_EVENT_CLEARED : 0);
+  } else if (device->active_modem == SX127x_MODULATION_FSK || device->active_modem == SX127x_MODULATION_OOK) {
+    uint8_t irq[REG_IRQ_FLAGS_2 - REG_IRQ_FLAGS_1 + 1];
+    sx127x_spi_segment_t segments[] = {
+        READ_SEGMENT(REG_IRQ_FLAGS_1, irq, sizeof(irq))};
+    ERROR_CHECK(sx127x_shadow_spi_transfer(segments, SEGMENTS_LENGTH(segments), &device->spi_device));
+    // only few flags can be cleared. writing the rest has no effect
+    if (sx127x_fsk_ook_irq_flags_1_handled(irq[REG_IRQ_FLAGS_2 - REG_IRQ_FLAGS_1], device)) {
+      ERROR_CHECK(sx127x_shadow_spi_write_register(REG_IRQ_FLAGS_1, irq, sizeof(irq), &device->spi_device));
+    } else {
+      ERROR_CHECK(sx127x_shadow_spi_write_register(REG_IRQ_FLAGS_2, irq + (REG_IRQ_FLAGS_2 - REG_IRQ_FLAGS_1), 1, &device->spi_device));
+    }
+    result = irq[REG_IRQ_FLAGS_2 - REG_IRQ_FLAGS_1] | ((uint32_t) irq[0] << 8) | IRQ_EVENT_CLEARED;
+  } else {
+    return SX127X_ERR_INVALID_STATE;
+  }
+  device->irq_timestamp = (device->rx_clock != NULL ? device->rx_clock() : 0);
+  *event = result | IRQ_EVENT_MODEM(device->active_modem);
+  return SX127X_OK;
+}
+
+void sx127x_irq_dispatch(uint32_t event, sx127x *device) {
+  // modulation was changed after the event was captured
+  if ((event & IRQ_EVENT_MODEM_MASK) != IRQ_EVENT_MODEM(device->active_modem)) {
+    return;
+  }
+  if (device->active_modem == SX127x_MODULATION_LORA) {
+    sx127x_lora_irq_process(event, device);
+  } else {
+    sx127x_fsk_ook_irq_process(event, device);
+  }
+}
+
+int sx127x_irq_capture(sx127x *device, uint32_t *event) {
+  STATS_ENTER(device);
+  if (event == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  return sx127x_irq_read(true, event, device);
+}
+
+void sx127x_irq_process(uint32_t event, sx127x *device) {
+  STATS_ENTER(device);
+  sx127x_irq_dispatch(event, device);
+}
+
+void sx127x_handle_interrupt(sx127x *device) {
+  STATS_ENTER(device);
+  uint32_t event;
+  ERROR_CHECK_NOCODE(sx127x_irq_read(false, &event, device));
+  sx127x_irq_dispatch(event, device);
+}
+
+int sx127x_lora_dio_event(sx127x_dio_t dio, uint32_t *event, sx127x *device) {
+  if (device->opmod == SX127x_MODE_TX) {
+    if (dio == SX127x_DIO0) {
+      // chip is in standby after TX, so pending hop can be cleared as well
+      *event = SX127x_IRQ_FLAG_TXDONE | SX127x_IRQ_FLAG_FHSSCHANGECHANNEL;
+      return SX127X_OK;
+    }
+    if (dio == SX127x_DIO1 || dio == SX127x_DIO2) {
+      *event = SX127x_IRQ_FLAG_FHSSCHANGECHANNEL;
+      return SX127X_OK;
+    }
+  } else if (device->opmod == SX127x_MODE_RX_CONT || device->opmod == SX127x_MODE_RX_SINGLE) {
+    // RX_DONE requires packet status
+    if (dio == SX127x_DIO1 && device->opmod == SX127x_MODE_RX_SINGLE) {
+      *event = SX127x_IRQ_FLAG_RXTIMEOUT;
+      return SX127X_OK;
     }
-    device->expected_packet_length = 0;
-    device->current_frequency = 0;
-    return;
-  }
-  if ((value & SX127x_IRQ_FLAG_TXDONE) != 0) {
-    device->current_frequency = 0;
-    if (device->tx_callback != NULL) {
-      device->tx_callback(device);
+    if (dio == SX127x_DIO2) {
+      *event = SX127x_IRQ_FLAG_FHSSCHANGECHANNEL;
+      return SX127X_OK;
     }
-    return;
   }
-  //always last because if message was sent or received,
-  //then no need to change freq
-  if ((value & SX127x_IRQ_FLAG_FHSSCHANGECHANNEL) != 0) {
-    if (device->current_frequency >= device->frequencies_length) {
-      device->current_frequency = 0;
+  return SX127X_ERR_NOT_FOUND;
+}
+
+int sx127x_fsk_ook_dio_event(sx127x_dio_t dio, uint32_t *event, sx127x *device) {
+  if (device->opmod == SX127x_MODE_TX) {
+    switch (dio) {
+      case SX127x_DIO0:
+        *event = SX127X_FSK_IRQ_PACKET_SENT;
+        return SX127X_OK;
+      case SX127x_DIO1:
+        // falling edge: below the threshold
+        *event = 0;
+        return SX127X_OK;
+      case SX127x_DIO2:
+        *event = SX127X_FSK_IRQ_FIFO_FULL;
+        return SX127X_OK;
+      case SX127x_DIO3:
+        // FIFO is empty before the last byte is sent. DIO0 reports PACKET_SENT, so it is handled as refill
+        *event = 0;
+        return SX127X_OK;
+      default:
+        return SX127X_ERR_NOT_FOUND;
     }
-    ERROR_CHECK_NOCODE(sx127x_set_frequency(device->frequencies[device->current_frequency], device));
-    device->current_frequency++;
-    return;
+  }
+  if (device->opmod != SX127x_MODE_RX_CONT && device->opmod != SX127x_MODE_RX_SINGLE) {
+    return SX127X_ERR_NOT_FOUND;
+  }
+  uint8_t irq;
+  switch (dio) {
+    case SX127x_DIO0:
+      if (device->fsk_crc_type == SX127X_CRC_NONE) {
+        *event = SX127X_FSK_IRQ_PAYLOAD_READY;
+        return SX127X_OK;
+      }
+      // only CRC_OK is needed. nothing to clear
+      ERROR_CHECK(sx127x_read_register(REG_IRQ_FLAGS_2, &device->spi_device, &irq));
+      *event = irq;
+      return SX127X_OK;
+    case SX127x_DIO1:
+      *event = SX127X_FSK_IRQ_FIFO_LEVEL;
+      return SX127X_OK;
+    case SX127x_DIO2:
+    case SX127x_DIO4:
+      irq = (dio == SX127x_DIO2 ? SX127X_FSK_IRQ_SYNC_ADDRESS_MATCH : SX127X_FSK_IRQ_PREAMBLE_DETECT);
+      ERROR_CHECK(sx127x_shadow_spi_write_register(REG_IRQ_FLAGS_1, &irq, 1, &device->spi_device));
+      *event = (uint32_t) irq << 8;
+      return SX127X_OK;
+    default:
+      return SX127X_ERR_NOT_FOUND;
   }
 }
 
-void sx127x_handle_interrupt(sx127x *device) {
+void sx127x_handle_dio(sx127x_dio_t dio, sx127x *device) {
+  STATS_ENTER(device);
+  uint32_t event;
+  int code;
   if (device->active_modem == SX127x_MODULATION_LORA) {
-    sx127x_lora_handle_interrupt(device);
-  } else if (device->active_modem == SX127x_MODULATION_FSK || device->active_modem == SX127x_MODULATION_OOK) {
-    sx127x_fsk_ook_handle_interrupt(device);
+    code = sx127x_lora_dio_event(dio, &event, device);
+  } else {
+    code = sx127x_fsk_ook_dio_event(dio, &event, device);
+  }
+  if (code == SX127X_OK) {
+    // flags are cleared by the lora irq process. fsk flags don't need it
+    event |= IRQ_EVENT_MODEM(device->active_modem) | (device->active_modem == SX127x_MODULATION_LORA ? 0 : IRQ_EVENT_CLEARED);
+    device->irq_timestamp = (device->rx_clock != NULL ? device->rx_clock() : 0);
+  } else if (code == SX127X_ERR_NOT_FOUND) {
+    code = sx127x_irq_read(false, &event, device);
+  }
+  ERROR_CHECK_NOCODE(code);
+  sx127x_irq_dispatch(event, device);
+}
+
+int sx127x_warm_up_cache(sx127x *device) {
+  STATS_ENTER(device);
+#ifdef CONFIG_SX127X_DISABLE_SPI_CACHE
+  (void) device;
+  return SX127X_OK;
+#else
+  shadow_spi_device_t *spi_device = &device->spi_device;
+  ERROR_CHECK(sx127x_shadow_spi_flush(spi_device));
+  uint8_t registers[MAX_NUMBER_OF_REGISTERS];
+  // skip REG_FIFO
+  ERROR_CHECK(sx127x_bus_read_buffer(0x01, registers + 1, MAX_NUMBER_OF_REGISTERS - 1, spi_device));
+  sx127x_shadow_select_bank(REG_OP_MODE, registers + REG_OP_MODE, 1, spi_device);
+  for (int reg = 1; reg < MAX_NUMBER_OF_REGISTERS; reg++) {
+    if (sx127x_shadow_sync(reg, spi_device) == SHADOW_IGNORE) {
+      continue;
+    }
+    sx127x_shadow_store(reg, registers + reg, 1, SHADOW_CACHED, spi_device);
   }
+  return SX127X_OK;
+#endif
 }
 
 int sx127x_create(void *spi_device, sx127x *result) {
   memset(result, 0, sizeof(struct sx127x_t));
   result->spi_device.spi_device = spi_device;
-#ifndef CONFIG_SX127X_DISABLE_SPI_CACHE
-  result->spi_device.shadow_registers_sync[REG_FIFO] = SHADOW_IGNORE;
-  result->spi_device.shadow_registers_sync[REG_FIFO_RX_CURRENT_ADDR] = SHADOW_IGNORE;
-  result->spi_device.shadow_registers_sync[REG_RSSI_VALUE_FSK] = SHADOW_IGNORE;
-  result->spi_device.shadow_registers_sync[REG_IRQ_FLAGS] = SHADOW_IGNORE;
-  result->spi_device.shadow_registers_sync[REG_RX_NB_BYTES] = SHADOW_IGNORE;
-  result->spi_device.shadow_registers_sync[REG_PKT_SNR_VALUE] = SHADOW_IGNORE;
-  result->spi_device.shadow_registers_sync[REG_PKT_RSSI_VALUE] = SHADOW_IGNORE;
-  result->spi_device.shadow_registers_sync[REG_FREQ_ERROR_MSB] = SHADOW_IGNORE;
-  result->spi_device.shadow_registers_sync[REG_AFC_VALUE] = SHADOW_IGNORE;
-  result->spi_device.shadow_registers_sync[REG_SEQ_CONFIG1] = SHADOW_IGNORE;
-  result->spi_device.shadow_registers_sync[REG_IMAGE_CAL] = SHADOW_IGNORE;
-  result->spi_device.shadow_registers_sync[REG_TEMP] = SHADOW_IGNORE;
-  result->spi_device.shadow_registers_sync[REG_IRQ_FLAGS_1] = SHADOW_IGNORE;
-  result->spi_device.shadow_registers_sync[REG_IRQ_FLAGS_2] = SHADOW_IGNORE;
+  STATS_ENTER(result);
+
+#ifdef CONFIG_SX127X_WARM_UP_SPI_CACHE
+  ERROR_CHECK(sx127x_warm_up_cache(result));
 #endif
 
   uint8_t version;
@@ -622,39 +1934,362 @@ int sx127x_create(void *spi_device, sx127x *result) {
   result->fsk_rssi_available = false;
   result->opmod = SX127x_MODE_STANDBY;
   result->fsk_crc_type = SX127X_CRC_CCITT;
+  result->fsk_ook_rx_threshold = HALF_MAX_FIFO_THRESHOLD;
+  result->fsk_ook_rx_batch = HALF_MAX_FIFO_THRESHOLD - 1;
+  result->fsk_ook_tx_threshold = HALF_MAX_FIFO_THRESHOLD;
+  result->fsk_ook_tx_batch = HALF_MAX_FIFO_THRESHOLD - 1;
   result->use_implicit_header = false;
   result->expected_packet_length = 0;
   return SX127X_OK;
 }
 
+int sx127x_apply_profile(const sx127x_profile_t *profile, sx127x *device) {
+  STATS_ENTER(device);
+  if (profile == NULL || (profile->ranges_length > 0 && (profile->ranges == NULL || profile->values == NULL))) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  for (uint8_t i = 0; i < profile->ranges_length; i++) {
+    // fifo and opmode are not part of configuration
+    if (profile->ranges[i].reg <= REG_OP_MODE || profile->ranges[i].reg + profile->ranges[i].length > MAX_NUMBER_OF_REGISTERS) {
+      return SX127X_ERR_INVALID_ARG;
+    }
+  }
+  if (device->active_modem != profile->modulation) {
+    // modulation can be changed only in sleep mode
+    ERROR_CHECK(sx127x_set_opmod(SX127x_MODE_SLEEP, profile->modulation, device));
+  }
+#ifdef CONFIG_SX127X_DISABLE_SPI_CACHE
+  sx127x_spi_segment_t segments[SX127X_SPI_MAX_SEGMENTS];
+  size_t segments_length = 0;
+  for (uint8_t i = 0; i < profile->ranges_length; i++) {
+    const sx127x_profile_range_t *range = profile->ranges + i;
+    segments[segments_length] = (sx127x_spi_segment_t) WRITE_SEGMENT(range->reg, profile->values + range->offset, range->length);
+    segments_length++;
+    if (segments_length == SX127X_SPI_MAX_SEGMENTS || i == profile->ranges_length - 1) {
+      ERROR_CHECK(sx127x_shadow_spi_transfer(segments, segments_length, &device->spi_device));
+      segments_length = 0;
+    }
+  }
+#else
+  // defer changed registers. flush combines them into bursts
+  bool transaction = device->spi_device.transaction;
+  device->spi_device.transaction = true;
+  int code = SX127X_OK;
+  for (uint8_t i = 0; i < profile->ranges_length && code == SX127X_OK; i++) {
+    const sx127x_profile_range_t *range = profile->ranges + i;
+    for (uint8_t j = 0; j < range->length && code == SX127X_OK; j++) {
+      int reg = range->reg + j;
+      const uint8_t *value = profile->values + range->offset + j;
+      if (sx127x_shadow_sync(reg, &device->spi_device) == SHADOW_CACHED && device->spi_device.shadow_registers[sx127x_shadow_index(reg, &device->spi_device)] == *value) {
+        continue;
+      }
+      code = sx127x_shadow_spi_write_register(reg, value, 1, &device->spi_device);
+    }
+  }
+  device->spi_device.transaction = transaction;
+  if (code == SX127X_OK && !transaction) {
+    code = sx127x_shadow_spi_flush(&device->spi_device);
+  }
+  ERROR_CHECK(code);
+#endif
+  if (profile->modulation == SX127x_MODULATION_LORA) {
+    device->use_implicit_header = profile->use_implicit_header;
+  } else {
+    device->fsk_ook_format = profile->fsk_ook_format;
+    device->fsk_crc_type = profile->fsk_crc_type;
+    device->fsk_ook_rx_threshold = profile->fsk_ook_rx_threshold;
+    device->fsk_ook_rx_batch = profile->fsk_ook_rx_batch;
+    device->fsk_ook_tx_threshold = profile->fsk_ook_tx_threshold;
+    device->fsk_ook_tx_batch = profile->fsk_ook_tx_batch;
+  }
+  device->expected_packet_length = profile->expected_packet_length;
+  // frequency might be changed
+  device->band_known = false;
+  device->channel_set = false;
+  return SX127X_OK;
+}
+
+int sx127x_config_begin(sx127x *device) {
+#ifndef CONFIG_SX127X_DISABLE_SPI_CACHE
+  if (device->spi_device.transaction) {
+    return SX127X_ERR_INVALID_STATE;
+  }
+  device->spi_device.transaction = true;
+#else
+  (void) device;
+#endif
+  return SX127X_OK;
+}
+
+int sx127x_config_commit(sx127x *device) {
+  STATS_ENTER(device);
+#ifndef CONFIG_SX127X_DISABLE_SPI_CACHE
+  if (!device->spi_device.transaction) {
+    return SX127X_ERR_INVALID_STATE;
+  }
+  device->spi_device.transaction = false;
+  return sx127x_shadow_spi_flush(&device->spi_device);
+#else
+  (void) device;
+  return SX127X_OK;
+#endif
+}
+
+int sx127x_snapshot_save(uint8_t *output, size_t *output_length, sx127x *device) {
+  if (output == NULL || output_length == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  size_t values_length = 0;
+#ifndef CONFIG_SX127X_DISABLE_SPI_CACHE
+  if (device->spi_device.transaction) {
+    return SX127X_ERR_INVALID_STATE;
+  }
+  for (size_t i = 0; i < SHADOW_NUMBER_OF_REGISTERS; i++) {
+    if (BITMAP_GET(device->spi_device.shadow_registers_cached, i)) {
+      values_length++;
+    }
+  }
+#endif
+  size_t length = SX127X_SNAPSHOT_HEADER_LENGTH + SHADOW_BITMAP_LENGTH + values_length;
+  if (*output_length < length) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  uint8_t *header = output;
+  header[0] = SNAPSHOT_MAGIC_1;
+  header[1] = SNAPSHOT_MAGIC_2;
+  header[2] = SNAPSHOT_VERSION;
+  header[3] = (uint8_t) device->active_modem;
+  header[4] = (uint8_t) device->opmod;
+  header[5] = (uint8_t) device->fsk_ook_format;
+  header[6] = (uint8_t) device->fsk_crc_type;
+  header[7] = (device->use_implicit_header ? 1 : 0);
+  header[8] = (uint8_t) (device->expected_packet_length >> 8);
+  header[9] = (uint8_t) (device->expected_packet_length);
+  uint8_t *bitmap = output + SX127X_SNAPSHOT_HEADER_LENGTH;
+  uint8_t *values = bitmap + SHADOW_BITMAP_LENGTH;
+  memset(bitmap, 0, SHADOW_BITMAP_LENGTH);
+#ifdef CONFIG_SX127X_DISABLE_SPI_CACHE
+  (void) values;
+  header[10] = SHADOW_BANK_FSK_OOK;
+#else
+  header[10] = device->spi_device.bank;
+  memcpy(bitmap, device->spi_device.shadow_registers_cached, SHADOW_BITMAP_LENGTH);
+  for (size_t i = 0; i < SHADOW_NUMBER_OF_REGISTERS; i++) {
+    if (!BITMAP_GET(bitmap, i)) {
+      continue;
+    }
+    *values = device->spi_device.shadow_registers[i];
+    values++;
+  }
+#endif
+  // set by sx127x_fsk_ook_set_fifo_threshold_auto and can't be read back from the chip
+  header[11] = device->fsk_ook_rx_threshold;
+  header[12] = device->fsk_ook_rx_batch;
+  header[13] = device->fsk_ook_tx_threshold;
+  header[14] = device->fsk_ook_tx_batch;
+  header[15] = 0;  // reserved
+  *output_length = length;
+  return SX127X_OK;
+}
+
+// enums are restored as is, so values from corrupted blob should not reach the state machine
+bool sx127x_snapshot_is_valid_header(const uint8_t *header) {
+  if (header[3] != SX127x_MODULATION_LORA && header[3] != SX127x_MODULATION_FSK && header[3] != SX127x_MODULATION_OOK) {
+    return false;
+  }
+  if (header[4] > SX127x_MODE_CAD) {
+    return false;
+  }
+  if (header[5] != SX127X_FIXED && header[5] != SX127X_VARIABLE) {
+    return false;
+  }
+  if (header[6] != SX127X_CRC_NONE && header[6] != SX127X_CRC_CCITT && header[6] != SX127X_CRC_IBM) {
+    return false;
+  }
+  if (header[11] >= FIFO_SIZE_FSK || header[12] >= FIFO_SIZE_FSK || header[13] >= FIFO_SIZE_FSK || header[14] >= FIFO_SIZE_FSK) {
+    return false;
+  }
+  return header[10] <= SHADOW_BANK_LORA;
+}
+
+int sx127x_snapshot_restore(const uint8_t *input, size_t input_length, sx127x *device) {
+  if (input == NULL || input_length < SX127X_SNAPSHOT_HEADER_LENGTH + SHADOW_BITMAP_LENGTH) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  const uint8_t *header = input;
+  if (header[0] != SNAPSHOT_MAGIC_1 || header[1] != SNAPSHOT_MAGIC_2 || header[2] != SNAPSHOT_VERSION || !sx127x_snapshot_is_valid_header(header)) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  const uint8_t *bitmap = input + SX127X_SNAPSHOT_HEADER_LENGTH;
+  const uint8_t *values = bitmap + SHADOW_BITMAP_LENGTH;
+  size_t values_length = 0;
+  for (size_t i = 0; i < SHADOW_NUMBER_OF_REGISTERS; i++) {
+    if ((bitmap[i / 8] & (1 << (i % 8))) != 0) {
+      values_length++;
+    }
+  }
+  if (input_length != (values - input) + values_length) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  device->active_modem = (sx127x_modulation_t) header[3];
+  device->opmod = (sx127x_mode_t) header[4];
+  device->fsk_ook_format = (sx127x_packet_format_t) header[5];
+  device->fsk_crc_type = (sx127x_crc_type_t) header[6];
+  device->use_implicit_header = (header[7] != 0);
+  device->expected_packet_length = (uint16_t) ((header[8] << 8) | header[9]);
+  device->fsk_ook_rx_threshold = header[11];
+  device->fsk_ook_rx_batch = header[12];
+  device->fsk_ook_tx_threshold = header[13];
+  device->fsk_ook_tx_batch = header[14];
+  device->band_known = false;
+  device->channel_set = false;
+#ifndef CONFIG_SX127X_DISABLE_SPI_CACHE
+  device->spi_device.bank = header[10];
+  for (size_t i = 0; i < SHADOW_NUMBER_OF_REGISTERS; i++) {
+    if ((bitmap[i / 8] & (1 << (i % 8))) == 0) {
+      continue;
+    }
+    uint8_t value = *values;
+    values++;
+    if (sx127x_shadow_policy_by_index(i) != SX127X_REGISTER_CACHEABLE) {
+      continue;
+    }
+    device->spi_device.shadow_registers[i] = value;
+    sx127x_shadow_set_sync(i, SHADOW_CACHED, &device->spi_device);
+  }
+#endif
+  return SX127X_OK;
+}
+
+int sx127x_get_stats(sx127x *device, sx127x_stats_t *stats) {
+#ifdef CONFIG_SX127X_ENABLE_STATS
+  if (stats == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  memcpy(stats, &device->spi_device.stats, sizeof(sx127x_stats_t));
+  return SX127X_OK;
+#else
+  (void) stats;
+  (void) device;
+  return SX127X_ERR_INVALID_STATE;
+#endif
+}
+
+int sx127x_reset_stats(sx127x *device) {
+#ifdef CONFIG_SX127X_ENABLE_STATS
+  memset(&device->spi_device.stats, 0, sizeof(sx127x_stats_t));
+  // function which called reset won't be counted anymore
+  device->spi_device.current_api = NULL;
+  return SX127X_OK;
+#else
+  (void) device;
+  return SX127X_ERR_INVALID_STATE;
+#endif
+}
+
+int sx127x_trace_set_clock(uint32_t (*clock)(void), sx127x *device) {
+#ifdef CONFIG_SX127X_ENABLE_TRACE
+  device->spi_device.trace.clock = clock;
+  return SX127X_OK;
+#else
+  (void) clock;
+  (void) device;
+  return SX127X_ERR_INVALID_STATE;
+#endif
+}
+
+int sx127x_trace_dump(uint8_t *output, size_t *output_length, sx127x *device) {
+#ifdef CONFIG_SX127X_ENABLE_TRACE
+  if (output == NULL || output_length == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  sx127x_trace_t *trace = &device->spi_device.trace;
+  uint32_t head = __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE);
+  uint32_t first = (head > CONFIG_SX127X_TRACE_LENGTH ? head - CONFIG_SX127X_TRACE_LENGTH : 0);
+  uint8_t *record = output + SX127X_TRACE_HEADER_LENGTH;
+  uint16_t entries_length = 0;
+  for (uint32_t i = first; i < head; i++) {
+    const sx127x_trace_entry_t *entry = trace->entries + (i % CONFIG_SX127X_TRACE_LENGTH);
+    uint8_t *current = record;
+    current[0] = (uint8_t) (entry->timestamp);
+    current[1] = (uint8_t) (entry->timestamp >> 8);
+    current[2] = (uint8_t) (entry->timestamp >> 16);
+    current[3] = (uint8_t) (entry->timestamp >> 24);
+    current[4] = entry->reg;
+    current[5] = entry->flags;
+    current[6] = (uint8_t) (entry->length);
+    current[7] = (uint8_t) (entry->length >> 8);
+    size_t prefix = (entry->length < CONFIG_SX127X_TRACE_DATA_LENGTH ? entry->length : CONFIG_SX127X_TRACE_DATA_LENGTH);
+    memcpy(current + SX127X_TRACE_RECORD_HEADER_LENGTH, entry->data, prefix);
+    // writer might overwrite this entry while it was copied
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint32_t latest = __atomic_load_n(&trace->head, __ATOMIC_RELAXED);
+    if (latest - i >= CONFIG_SX127X_TRACE_LENGTH) {
+      continue;
+    }
+    record += SX127X_TRACE_RECORD_HEADER_LENGTH + prefix;
+    entries_length++;
+  }
+  output[0] = 'S';
+  output[1] = 'T';
+  output[2] = 1;  // version
+  output[3] = CONFIG_SX127X_TRACE_DATA_LENGTH;
+  output[4] = (uint8_t) (entries_length);
+  output[5] = (uint8_t) (entries_length >> 8);
+  output[6] = (uint8_t) (head);
+  output[7] = (uint8_t) (head >> 8);
+  output[8] = (uint8_t) (head >> 16);
+  output[9] = (uint8_t) (head >> 24);
+  *output_length = record - output;
+  return SX127X_OK;
+#else
+  (void) output;
+  (void) output_length;
+  (void) device;
+  return SX127X_ERR_INVALID_STATE;
+#endif
+}
+
 int sx127x_set_opmod(sx127x_mode_t opmod, sx127x_modulation_t modulation, sx127x *device) {
+  STATS_ENTER(device);
+  sx127x_spi_segment_t segments[4];
+  size_t segments_length = 0;
+  uint8_t dio_mapping_1;
+  uint8_t dio_mapping_2;
+  uint8_t fifo_thresh;
+  uint8_t value = (opmod | modulation);
   // enforce DIO mappings for RX and TX
   if (modulation == SX127x_MODULATION_LORA) {
     if (opmod == SX127x_MODE_RX_CONT || opmod == SX127x_MODE_RX_SINGLE) {
-      uint8_t data = (SX127x_DIO0_RX_DONE | SX127x_DIO1_RXTIMEOUT | SX127x_DIO2_FHSS_CHANGE_CHANNEL | SX127x_DIO3_CAD_DONE);
-      ERROR_CHECK(sx127x_shadow_spi_write_register(REG_DIO_MAPPING_1, &data, 1, &device->spi_device));
+      dio_mapping_1 = (SX127x_DIO0_RX_DONE | SX127x_DIO1_RXTIMEOUT | SX127x_DIO2_FHSS_CHANGE_CHANNEL | SX127x_DIO3_CAD_DONE);
+      segments[segments_length++] = (sx127x_spi_segment_t) WRITE_SEGMENT(REG_DIO_MAPPING_1, &dio_mapping_1, 1);
     } else if (opmod == SX127x_MODE_TX) {
-      uint8_t data = (SX127x_DIO0_TX_DONE | SX127x_DIO1_FHSS_CHANGE_CHANNEL | SX127x_DIO2_FHSS_CHANGE_CHANNEL | SX127x_DIO3_CAD_DONE);
-      ERROR_CHECK(sx127x_shadow_spi_write_register(REG_DIO_MAPPING_1, &data, 1, &device->spi_device));
+      dio_mapping_1 = (SX127x_DIO0_TX_DONE | SX127x_DIO1_FHSS_CHANGE_CHANNEL | SX127x_DIO2_FHSS_CHANGE_CHANNEL | SX127x_DIO3_CAD_DONE);
+      segments[segments_length++] = (sx127x_spi_segment_t) WRITE_SEGMENT(REG_DIO_MAPPING_1, &dio_mapping_1, 1);
     } else if (opmod == SX127x_MODE_CAD) {
-      ERROR_CHECK(sx127x_append_register(REG_DIO_MAPPING_1, SX127x_DIO0_CAD_DONE, 0b00111111, &device->spi_device));
+      ERROR_CHECK(sx127x_prepare_append_register(REG_DIO_MAPPING_1, SX127x_DIO0_CAD_DONE, 0b00111111, &device->spi_device, &dio_mapping_1));
+      segments[segments_length++] = (sx127x_spi_segment_t) WRITE_SEGMENT(REG_DIO_MAPPING_1, &dio_mapping_1, 1);
     }
   } else if (modulation == SX127x_MODULATION_FSK || modulation == SX127x_MODULATION_OOK) {
     if (opmod == SX127x_MODE_RX_CONT || opmod == SX127x_MODE_RX_SINGLE) {
-      ERROR_CHECK(sx127x_append_register(REG_DIO_MAPPING_1, SX127x_FSK_DIO0_PAYLOAD_READY | SX127x_FSK_DIO1_FIFO_LEVEL | SX127x_FSK_DIO2_SYNCADDRESS, 0b00000011, &device->spi_device));
-      ERROR_CHECK(sx127x_append_register(REG_DIO_MAPPING_2, SX127x_FSK_DIO4_PREAMBLE_DETECT | 0b00000001, 0b00111110, &device->spi_device));
+      ERROR_CHECK(sx127x_prepare_append_register(REG_DIO_MAPPING_1, SX127x_FSK_DIO0_PAYLOAD_READY | SX127x_FSK_DIO1_FIFO_LEVEL | SX127x_FSK_DIO2_SYNCADDRESS, 0b00000011, &device->spi_device, &dio_mapping_1));
+      ERROR_CHECK(sx127x_prepare_append_register(REG_DIO_MAPPING_2, SX127x_FSK_DIO4_PREAMBLE_DETECT | 0b00000001, 0b00111110, &device->spi_device, &dio_mapping_2));
       // configure fifo level threshold for rx
-      uint8_t data = HALF_MAX_FIFO_THRESHOLD;
-      ERROR_CHECK(sx127x_shadow_spi_write_register(REG_FIFO_THRESH, &data, 1, &device->spi_device));
+      fifo_thresh = device->fsk_ook_rx_threshold;
+      segments[segments_length++] = (sx127x_spi_segment_t) WRITE_SEGMENT(REG_DIO_MAPPING_1, &dio_mapping_1, 1);
+      segments[segments_length++] = (sx127x_spi_segment_t) WRITE_SEGMENT(REG_DIO_MAPPING_2, &dio_mapping_2, 1);
+      segments[segments_length++] = (sx127x_spi_segment_t) WRITE_SEGMENT(REG_FIFO_THRESH, &fifo_thresh, 1);
     } else if (opmod == SX127x_MODE_TX) {
-      uint8_t data = (SX127x_FSK_DIO0_PACKET_SENT | SX127x_FSK_DIO1_FIFO_LEVEL | SX127x_FSK_DIO2_FIFO_FULL | SX127x_FSK_DIO3_FIFO_EMPTY);
-      ERROR_CHECK(sx127x_shadow_spi_write_register(REG_DIO_MAPPING_1, &data, 1, &device->spi_device));
+      dio_mapping_1 = (SX127x_FSK_DIO0_PACKET_SENT | SX127x_FSK_DIO1_FIFO_LEVEL | SX127x_FSK_DIO2_FIFO_FULL | SX127x_FSK_DIO3_FIFO_EMPTY);
       // start tx as soon as first byte in FIFO available
-      data = (TX_START_CONDITION_FIFO_EMPTY | HALF_MAX_FIFO_THRESHOLD);
-      ERROR_CHECK(sx127x_shadow_spi_write_register(REG_FIFO_THRESH, &data, 1, &device->spi_device));
+      fifo_thresh = (TX_START_CONDITION_FIFO_EMPTY | device->fsk_ook_tx_threshold);
       // use sequencer to send single packet and stop carrier
-      uint8_t value = 0b10010000;
-      ERROR_CHECK(sx127x_shadow_spi_write_register(REG_SEQ_CONFIG1, &value, 1, &device->spi_device));
+      uint8_t seq_config = 0b10010000;
+      sx127x_spi_segment_t tx_segments[] = {
+          WRITE_SEGMENT(REG_DIO_MAPPING_1, &dio_mapping_1, 1),
+          WRITE_SEGMENT(REG_FIFO_THRESH, &fifo_thresh, 1),
+          WRITE_SEGMENT(REG_SEQ_CONFIG1, &seq_config, 1)};
+      ERROR_CHECK(sx127x_shadow_spi_transfer(tx_segments, SEGMENTS_LENGTH(tx_segments), &device->spi_device));
       device->active_modem = modulation;
       device->opmod = opmod;
       return SX127X_OK;
@@ -662,8 +2297,8 @@ int sx127x_set_opmod(sx127x_mode_t opmod, sx127x_modulation_t modulation, sx127x
   } else {
     return SX127X_ERR_INVALID_ARG;
   }
-  uint8_t value = (opmod | modulation);
-  int result = sx127x_shadow_spi_write_register(REG_OP_MODE, &value, 1, &device->spi_device);
+  segments[segments_length++] = (sx127x_spi_segment_t) WRITE_SEGMENT(REG_OP_MODE, &value, 1);
+  int result = sx127x_shadow_spi_transfer(segments, segments_length, &device->spi_device);
   if (result == SX127X_OK) {
     device->active_modem = modulation;
     device->opmod = opmod;
@@ -672,20 +2307,76 @@ int sx127x_set_opmod(sx127x_mode_t opmod, sx127x_modulation_t modulation, sx127x
 }
 
 int sx127x_set_frequency(uint64_t frequency, sx127x *device) {
-  uint64_t adjusted = (frequency << 19) / SX127x_OSCILLATOR_FREQUENCY;
-  uint8_t data[] = {(uint8_t) (adjusted >> 16), (uint8_t) (adjusted >> 8), (uint8_t) (adjusted >> 0)};
+  STATS_ENTER(device);
+  uint8_t data[3];
+  sx127x_encode_frequency(frequency, data);
   ERROR_CHECK(sx127x_shadow_spi_write_register(REG_FRF_MSB, data, 3, &device->spi_device));
+  device->high_band = sx127x_frf_is_high_band(data);
+  device->band_known = true;
+  device->channel_set = false;
   return SX127X_OK;
 }
 
 int sx127x_get_frequency(sx127x *device, uint64_t *frequency) {
+  STATS_ENTER(device);
   uint32_t frequency_raw;
   ERROR_CHECK(sx127x_shadow_spi_read_registers(REG_FRF_MSB, &device->spi_device, 3, &frequency_raw));
-  *frequency = (uint64_t) (frequency_raw * SX127x_OSCILLATOR_FREQUENCY) >> 19;
+  *frequency = ((uint64_t) frequency_raw * SX127x_OSCILLATOR_FREQUENCY_HZ + (1 << 18)) >> 19;
+  return SX127X_OK;
+}
+
+int sx127x_channel_plan_init(const uint64_t *frequencies, sx127x_channel_t *channels, uint8_t channels_length, sx127x_channel_plan_t *plan) {
+  if (frequencies == NULL || channels == NULL || channels_length == 0 || plan == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  for (uint8_t i = 0; i < channels_length; i++) {
+    sx127x_encode_frequency(frequencies[i], channels[i].frf);
+    channels[i].high_band = (frequencies[i] >= RF_MID_BAND_THRESHOLD);
+  }
+  plan->channels = channels;
+  plan->channels_length = channels_length;
+  return SX127X_OK;
+}
+
+int sx127x_set_channel_plan(sx127x_channel_plan_t *plan, sx127x *device) {
+  if (plan == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  device->channel_plan = plan;
+  // registers might contain a frequency which is not in the plan
+  device->channel_set = false;
+  return SX127X_OK;
+}
+
+int sx127x_set_channel(uint8_t index, sx127x *device) {
+  STATS_ENTER(device);
+  if (device->channel_plan == NULL) {
+    return SX127X_ERR_INVALID_STATE;
+  }
+  if (index >= device->channel_plan->channels_length) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  const sx127x_channel_t *channel = &device->channel_plan->channels[index];
+  size_t first = 0;
+  if (device->channel_set) {
+    const uint8_t *current = device->channel_plan->channels[device->current_channel].frf;
+    while (first < sizeof(channel->frf) && current[first] == channel->frf[first]) {
+      first++;
+    }
+  }
+  // new frequency is applied only when RegFrfLsb is written. so write everything from the first changed byte
+  if (first < sizeof(channel->frf)) {
+    ERROR_CHECK(sx127x_shadow_spi_write_register(REG_FRF_MSB + first, channel->frf + first, sizeof(channel->frf) - first, &device->spi_device));
+  }
+  device->current_channel = index;
+  device->channel_set = true;
+  device->high_band = channel->high_band;
+  device->band_known = true;
   return SX127X_OK;
 }
 
 int sx127x_lora_reset_fifo(sx127x *device) {
+  STATS_ENTER(device);
   CHECK_MODULATION(device, SX127x_MODULATION_LORA);
   // reset both RX and TX
   uint8_t data[] = {FIFO_TX_BASE_ADDR, FIFO_RX_BASE_ADDR};
@@ -693,36 +2384,57 @@ int sx127x_lora_reset_fifo(sx127x *device) {
 }
 
 int sx127x_rx_set_lna_gain(sx127x_gain_t gain, sx127x *device) {
+  STATS_ENTER(device);
   if (device->active_modem == SX127x_MODULATION_LORA) {
     if (gain == SX127x_LNA_GAIN_AUTO) {
       return sx127x_append_register(REG_MODEM_CONFIG_3, SX127x_REG_MODEM_CONFIG_3_AGC_ON, 0b11111011, &device->spi_device);
     }
-    ERROR_CHECK(sx127x_append_register(REG_MODEM_CONFIG_3, SX127x_REG_MODEM_CONFIG_3_AGC_OFF, 0b11111011, &device->spi_device));
-    return sx127x_append_register(REG_LNA, gain, 0b00011111, &device->spi_device);
+    uint8_t modem_config_3;
+    ERROR_CHECK(sx127x_prepare_append_register(REG_MODEM_CONFIG_3, SX127x_REG_MODEM_CONFIG_3_AGC_OFF, 0b11111011, &device->spi_device, &modem_config_3));
+    uint8_t lna;
+    ERROR_CHECK(sx127x_prepare_append_register(REG_LNA, gain, 0b00011111, &device->spi_device, &lna));
+    sx127x_spi_segment_t segments[] = {
+        WRITE_SEGMENT(REG_MODEM_CONFIG_3, &modem_config_3, 1),
+        WRITE_SEGMENT(REG_LNA, &lna, 1)};
+    return sx127x_shadow_spi_transfer(segments, SEGMENTS_LENGTH(segments), &device->spi_device);
   } else if (device->active_modem == SX127x_MODULATION_FSK || device->active_modem == SX127x_MODULATION_OOK) {
     if (gain == SX127x_LNA_GAIN_AUTO) {
       return sx127x_append_register(REG_RX_CONFIG, 0b00001000, 0b11110111, &device->spi_device);
     }
     // gain manual
-    ERROR_CHECK(sx127x_append_register(REG_RX_CONFIG, 0b00000000, 0b11110111, &device->spi_device));
-    return sx127x_append_register(REG_LNA, gain, 0b00011111, &device->spi_device);
+    uint8_t rx_config;
+    ERROR_CHECK(sx127x_prepare_append_register(REG_RX_CONFIG, 0b00000000, 0b11110111, &device->spi_device, &rx_config));
+    uint8_t lna;
+    ERROR_CHECK(sx127x_prepare_append_register(REG_LNA, gain, 0b00011111, &device->spi_device, &lna));
+    sx127x_spi_segment_t segments[] = {
+        WRITE_SEGMENT(REG_RX_CONFIG, &rx_config, 1),
+        WRITE_SEGMENT(REG_LNA, &lna, 1)};
+    return sx127x_shadow_spi_transfer(segments, SEGMENTS_LENGTH(segments), &device->spi_device);
   } else {
     return SX127X_ERR_INVALID_ARG;
   }
 }
 
 int sx127x_rx_set_lna_boost_hf(bool enable, sx127x *device) {
+  STATS_ENTER(device);
   uint8_t value = (enable ? 0b00000011 : 0b00000000);
   return sx127x_append_register(REG_LNA, value, 0b11111100, &device->spi_device);
 }
 
 int sx127x_lora_set_bandwidth(sx127x_bw_t bandwidth, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_MODULATION(device, SX127x_MODULATION_LORA);
-  ERROR_CHECK(sx127x_append_register(REG_MODEM_CONFIG_1, bandwidth, 0b00001111, &device->spi_device));
-  return sx127x_reload_low_datarate_optimization(device);
+  uint8_t modem_config_1;
+  ERROR_CHECK(sx127x_prepare_append_register(REG_MODEM_CONFIG_1, bandwidth, 0b00001111, &device->spi_device, &modem_config_1));
+  uint8_t modem_config_2;
+  ERROR_CHECK(sx127x_read_register(REG_MODEM_CONFIG_2, &device->spi_device, &modem_config_2));
+  sx127x_spi_segment_t segments[2] = {
+      WRITE_SEGMENT(REG_MODEM_CONFIG_1, &modem_config_1, 1)};
+  return sx127x_lora_write_modem_config(segments, 1, modem_config_1, modem_config_2, device);
 }
 
 int sx127x_lora_set_modem_config_2(sx127x_sf_t spreading_factor, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_MODULATION(device, SX127x_MODULATION_LORA);
   if (spreading_factor == SX127x_SF_6 && !device->use_implicit_header) {
     return SX127X_ERR_INVALID_ARG;
@@ -737,22 +2449,38 @@ int sx127x_lora_set_modem_config_2(sx127x_sf_t spreading_factor, sx127x *device)
     detection_optimize = 0xc3;
     detection_threshold = 0x0a;
   }
-  ERROR_CHECK(sx127x_shadow_spi_write_register(REG_DETECTION_OPTIMIZE, &detection_optimize, 1, &device->spi_device));
-  ERROR_CHECK(sx127x_shadow_spi_write_register(REG_DETECTION_THRESHOLD, &detection_threshold, 1, &device->spi_device));
-  ERROR_CHECK(sx127x_append_register(REG_MODEM_CONFIG_2, spreading_factor, 0b00001111, &device->spi_device));
-  return sx127x_reload_low_datarate_optimization(device);
+  uint8_t modem_config_2;
+  ERROR_CHECK(sx127x_prepare_append_register(REG_MODEM_CONFIG_2, spreading_factor, 0b00001111, &device->spi_device, &modem_config_2));
+  uint8_t modem_config_1;
+  ERROR_CHECK(sx127x_read_register(REG_MODEM_CONFIG_1, &device->spi_device, &modem_config_1));
+  sx127x_spi_segment_t segments[4] = {
+      WRITE_SEGMENT(REG_DETECTION_OPTIMIZE, &detection_optimize, 1),
+      WRITE_SEGMENT(REG_DETECTION_THRESHOLD, &detection_threshold, 1),
+      WRITE_SEGMENT(REG_MODEM_CONFIG_2, &modem_config_2, 1)};
+  return sx127x_lora_write_modem_config(segments, 3, modem_config_1, modem_config_2, device);
 }
 
 void sx127x_rx_set_callback(void (*rx_callback)(sx127x *, uint8_t *, uint16_t), sx127x *device) {
   device->rx_callback = rx_callback;
 }
 
+void sx127x_rx_set_meta_callback(void (*rx_meta_callback)(sx127x *, uint8_t *, uint16_t, const sx127x_packet_meta_t *), uint32_t (*clock)(void), sx127x *device) {
+  device->rx_meta_callback = rx_meta_callback;
+  device->rx_clock = clock;
+}
+
+void sx127x_fsk_ook_rx_set_chunk_callback(void (*rx_chunk_callback)(sx127x *, uint8_t *, uint16_t, sx127x_rx_chunk_status_t), sx127x *device) {
+  device->rx_chunk_callback = rx_chunk_callback;
+}
+
 int sx127x_lora_set_syncword(uint8_t value, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_MODULATION(device, SX127x_MODULATION_LORA);
   return sx127x_shadow_spi_write_register(REG_SYNC_WORD, &value, 1, &device->spi_device);
 }
 
 int sx127x_set_preamble_length(uint16_t value, sx127x *device) {
+  STATS_ENTER(device);
   uint8_t data[] = {(uint8_t) (value >> 8), (uint8_t) (value >> 0)};
   if (device->active_modem == SX127x_MODULATION_LORA) {
     return sx127x_shadow_spi_write_register(REG_PREAMBLE_MSB, data, 2, &device->spi_device);
@@ -764,6 +2492,7 @@ int sx127x_set_preamble_length(uint16_t value, sx127x *device) {
 }
 
 int sx127x_lora_set_implicit_header(sx127x_implicit_header_t *header, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_MODULATION(device, SX127x_MODULATION_LORA);
   if (header == NULL) {
     device->expected_packet_length = 0;
@@ -772,41 +2501,66 @@ int sx127x_lora_set_implicit_header(sx127x_implicit_header_t *header, sx127x *de
   } else {
     device->expected_packet_length = header->length;
     device->use_implicit_header = true;
-    ERROR_CHECK(sx127x_append_register(REG_MODEM_CONFIG_1, SX127x_HEADER_MODE_IMPLICIT | header->coding_rate, 0b11110000, &device->spi_device));
-    ERROR_CHECK(sx127x_shadow_spi_write_register(REG_PAYLOAD_LENGTH, &(header->length), 1, &device->spi_device));
+    uint8_t modem_config_1;
+    ERROR_CHECK(sx127x_prepare_append_register(REG_MODEM_CONFIG_1, SX127x_HEADER_MODE_IMPLICIT | header->coding_rate, 0b11110000, &device->spi_device, &modem_config_1));
     uint8_t value = (header->enable_crc ? 0b00000100 : 0b00000000);
-    return sx127x_append_register(REG_MODEM_CONFIG_2, value, 0b11111011, &device->spi_device);
+    uint8_t modem_config_2;
+    ERROR_CHECK(sx127x_prepare_append_register(REG_MODEM_CONFIG_2, value, 0b11111011, &device->spi_device, &modem_config_2));
+    sx127x_spi_segment_t segments[] = {
+        WRITE_SEGMENT(REG_MODEM_CONFIG_1, &modem_config_1, 1),
+        WRITE_SEGMENT(REG_PAYLOAD_LENGTH, &(header->length), 1),
+        WRITE_SEGMENT(REG_MODEM_CONFIG_2, &modem_config_2, 1)};
+    return sx127x_shadow_spi_transfer(segments, SEGMENTS_LENGTH(segments), &device->spi_device);
   }
 }
 
 int sx127x_lora_set_frequency_hopping(uint8_t period, uint64_t *frequencies, uint8_t frequencies_length, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_MODULATION(device, SX127x_MODULATION_LORA);
-  if (frequencies == NULL || frequencies_length == 0) {
+  if (frequencies == NULL || frequencies_length == 0 || frequencies_length > CONFIG_SX127X_MAX_FHSS_CHANNELS) {
     return SX127X_ERR_INVALID_ARG;
   }
-  device->frequencies = frequencies;
+  for (uint8_t i = 0; i < frequencies_length; i++) {
+    sx127x_encode_frequency(frequencies[i], device->frequencies[i]);
+  }
   device->frequencies_length = frequencies_length;
   return sx127x_shadow_spi_write_register(REG_HOP_PERIOD, &period, 1, &device->spi_device);
 }
 
+int sx127x_rx_is_receiving(sx127x *device, bool *receiving) {
+  STATS_ENTER(device);
+  if (receiving == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  *receiving = false;
+  if (device->opmod != SX127x_MODE_RX_CONT && device->opmod != SX127x_MODE_RX_SINGLE) {
+    return SX127X_OK;
+  }
+  uint8_t value;
+  if (device->active_modem == SX127x_MODULATION_LORA) {
+    ERROR_CHECK(sx127x_read_register(REG_MODEM_STAT, &device->spi_device, &value));
+    // signal detected, signal synchronized, rx on-going or header info valid
+    *receiving = ((value & 0b00001111) != 0);
+  } else if (device->active_modem == SX127x_MODULATION_FSK || device->active_modem == SX127x_MODULATION_OOK) {
+    ERROR_CHECK(sx127x_read_register(REG_IRQ_FLAGS_1, &device->spi_device, &value));
+    *receiving = ((value & (SX127X_FSK_IRQ_PREAMBLE_DETECT | SX127X_FSK_IRQ_SYNC_ADDRESS_MATCH)) != 0);
+  } else {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  return SX127X_OK;
+}
+
 int sx127x_rx_get_packet_rssi(sx127x *device, int16_t *rssi) {
+  STATS_ENTER(device);
   if (device->active_modem == SX127x_MODULATION_LORA) {
     uint8_t value;
     ERROR_CHECK(sx127x_read_register(REG_PKT_RSSI_VALUE, &device->spi_device, &value));
-    uint64_t frequency;
-    ERROR_CHECK(sx127x_get_frequency(device, &frequency));
-    if (frequency < RF_MID_BAND_THRESHOLD) {
-      *rssi = value - RSSI_OFFSET_LF_PORT;
-    } else {
-      *rssi = value - RSSI_OFFSET_HF_PORT;
-    }
-    // section 5.5.5.
+    bool high_band;
+    ERROR_CHECK(sx127x_get_band(device, &high_band));
     float snr;
     int code = sx127x_lora_rx_get_packet_snr(device, &snr);
     // if snr failed then rssi is not precise
-    if (code == SX127X_OK && snr < 0) {
-      *rssi = *rssi + snr;
-    }
+    *rssi = sx127x_lora_decode_rssi(value, (code == SX127X_OK ? snr : 0), high_band);
   } else if (device->active_modem == SX127x_MODULATION_FSK || device->active_modem == SX127x_MODULATION_OOK) {
     if (!device->fsk_rssi_available) {
       *rssi = 0;
@@ -823,6 +2577,7 @@ int sx127x_rx_get_packet_rssi(sx127x *device, int16_t *rssi) {
 }
 
 int sx127x_lora_rx_get_packet_snr(sx127x *device, float *snr) {
+  STATS_ENTER(device);
   CHECK_MODULATION(device, SX127x_MODULATION_LORA);
   uint8_t value;
   ERROR_CHECK(sx127x_read_register(REG_PKT_SNR_VALUE, &device->spi_device, &value));
@@ -831,32 +2586,19 @@ int sx127x_lora_rx_get_packet_snr(sx127x *device, float *snr) {
 }
 
 int sx127x_rx_get_frequency_error(sx127x *device, int32_t *result) {
+  STATS_ENTER(device);
   if (device->active_modem == SX127x_MODULATION_LORA) {
     uint32_t frequency_error;
     ERROR_CHECK(sx127x_shadow_spi_read_registers(REG_FREQ_ERROR_MSB, &device->spi_device, 3, &frequency_error));
     uint32_t bandwidth;
     ERROR_CHECK(sx127x_lora_get_bandwidth(device, &bandwidth));
-    if (frequency_error & 0x80000) {
-      // keep within original 2.5 bytes
-      frequency_error = ((~frequency_error) + 1) & 0xFFFFF;
-      *result = -1;
-    } else {
-      *result = 1;
-    }
-    *result = (*result) * (frequency_error * SX127x_FREQ_ERROR_FACTOR * bandwidth / 500000.0f);
+    *result = sx127x_lora_decode_frequency_error(frequency_error, bandwidth);
     return SX127X_OK;
   } else if (device->active_modem == SX127x_MODULATION_FSK || device->active_modem == SX127x_MODULATION_OOK) {
     uint32_t frequency_error;
     // for some reason register FEI always contains 0
     ERROR_CHECK(sx127x_shadow_spi_read_registers(REG_AFC_VALUE, &device->spi_device, 2, &frequency_error));
-    if (frequency_error & 0x8000) {
-      // keep within original 2 bytes
-      frequency_error = ((~frequency_error) + 1) & 0xFFFF;
-      *result = -1;
-    } else {
-      *result = 1;
-    }
-    *result = (*result) * SX127x_FSTEP * frequency_error;
+    *result = sx127x_fsk_ook_decode_frequency_error(frequency_error);
     return SX127X_OK;
   } else {
     return SX127X_ERR_INVALID_ARG;
@@ -864,18 +2606,47 @@ int sx127x_rx_get_frequency_error(sx127x *device, int32_t *result) {
 }
 
 int sx127x_dump_registers(uint8_t *output, sx127x *device) {
+  STATS_ENTER(device);
+#ifndef CONFIG_SX127X_DISABLE_SPI_CACHE
+  ERROR_CHECK(sx127x_shadow_spi_flush(&device->spi_device));
+#endif
   //Reading from 0x00 register will actually read from fifo
   //skip it
   output[0] = 0x00;
   //bypass shadow registers
-  return sx127x_spi_read_buffer(0x01, output + 1, MAX_NUMBER_OF_REGISTERS - 1, device->spi_device.spi_device);
+  return sx127x_bus_read_buffer(0x01, output + 1, MAX_NUMBER_OF_REGISTERS - 1, &device->spi_device);
 }
 
 void sx127x_tx_set_callback(void (*tx_callback)(sx127x *), sx127x *device) {
   device->tx_callback = tx_callback;
 }
 
+void sx127x_tx_set_abort_callback(void (*tx_abort_callback)(sx127x *), sx127x *device) {
+  device->tx_abort_callback = tx_abort_callback;
+}
+
+int sx127x_tx_calculate_ocp(bool enable, uint8_t max_current, uint8_t *value) {
+  if (max_current < 45) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  if (!enable) {
+    *value = 0b00000000;
+    return SX127X_OK;
+  }
+  // 5.4.4. Over Current Protection
+  if (max_current <= 120) {
+    *value = (max_current - 45) / 5;
+  } else if (max_current <= 240) {
+    *value = (max_current + 30) / 10;
+  } else {
+    *value = 27;
+  }
+  *value |= 0b00100000;
+  return SX127X_OK;
+}
+
 int sx127x_tx_set_pa_config(sx127x_pa_pin_t pin, int power, sx127x *device) {
+  STATS_ENTER(device);
   if (pin == SX127x_PA_PIN_RFO && (power < -4 || power > 15)) {
     return SX127X_ERR_INVALID_ARG;
   }
@@ -888,7 +2659,6 @@ int sx127x_tx_set_pa_config(sx127x_pa_pin_t pin, int power, sx127x *device) {
   } else {
     data[0] = SX127x_HIGH_POWER_OFF;
   }
-  ERROR_CHECK(sx127x_shadow_spi_write_register(REG_PA_DAC, data, 1, &device->spi_device));
   uint8_t max_current;
   // according to 2.5.1. Power Consumption
   if (pin == SX127x_PA_PIN_BOOST) {
@@ -904,7 +2674,8 @@ int sx127x_tx_set_pa_config(sx127x_pa_pin_t pin, int power, sx127x *device) {
       max_current = 20;
     }
   }
-  ERROR_CHECK(sx127x_tx_set_ocp(true, max_current, device));
+  uint8_t ocp;
+  ERROR_CHECK(sx127x_tx_calculate_ocp(true, max_current, &ocp));
   uint8_t value;
   if (pin == SX127x_PA_PIN_RFO) {
     if (power < 0) {
@@ -920,56 +2691,57 @@ int sx127x_tx_set_pa_config(sx127x_pa_pin_t pin, int power, sx127x *device) {
       value = SX127x_PA_PIN_BOOST | (power - 2);
     }
   }
-  return sx127x_shadow_spi_write_register(REG_PA_CONFIG, &value, 1, &device->spi_device);
+  sx127x_spi_segment_t segments[] = {
+      WRITE_SEGMENT(REG_PA_DAC, data, 1),
+      WRITE_SEGMENT(REG_OCP, &ocp, 1),
+      WRITE_SEGMENT(REG_PA_CONFIG, &value, 1)};
+  return sx127x_shadow_spi_transfer(segments, SEGMENTS_LENGTH(segments), &device->spi_device);
 }
 
 int sx127x_tx_set_ocp(bool enable, uint8_t max_current, sx127x *device) {
-  if (max_current < 45) {
-    return SX127X_ERR_INVALID_ARG;
-  }
-  if (!enable) {
-    uint8_t value = 0b00000000;
-    return sx127x_shadow_spi_write_register(REG_OCP, &value, 1, &device->spi_device);
-  }
+  STATS_ENTER(device);
   uint8_t value;
-  // 5.4.4. Over Current Protection
-  if (max_current <= 120) {
-    value = (max_current - 45) / 5;
-  } else if (max_current <= 240) {
-    value = (max_current + 30) / 10;
-  } else {
-    value = 27;
-  }
-  value |= 0b00100000;
+  ERROR_CHECK(sx127x_tx_calculate_ocp(enable, max_current, &value));
   return sx127x_shadow_spi_write_register(REG_OCP, &value, 1, &device->spi_device);
 }
 
 int sx127x_lora_tx_set_explicit_header(sx127x_tx_header_t *header, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_MODULATION(device, SX127x_MODULATION_LORA);
   if (header == NULL) {
     return SX127X_ERR_INVALID_ARG;
   }
   device->use_implicit_header = false;
   device->expected_packet_length = 0;
-  ERROR_CHECK(sx127x_append_register(REG_MODEM_CONFIG_1, header->coding_rate | SX127x_HEADER_MODE_EXPLICIT, 0b11110000, &device->spi_device));
+  uint8_t modem_config_1;
+  ERROR_CHECK(sx127x_prepare_append_register(REG_MODEM_CONFIG_1, header->coding_rate | SX127x_HEADER_MODE_EXPLICIT, 0b11110000, &device->spi_device, &modem_config_1));
   uint8_t value = (header->enable_crc ? 0b00000100 : 0b00000000);
-  return sx127x_append_register(REG_MODEM_CONFIG_2, value, 0b11111011, &device->spi_device);
+  uint8_t modem_config_2;
+  ERROR_CHECK(sx127x_prepare_append_register(REG_MODEM_CONFIG_2, value, 0b11111011, &device->spi_device, &modem_config_2));
+  sx127x_spi_segment_t segments[] = {
+      WRITE_SEGMENT(REG_MODEM_CONFIG_1, &modem_config_1, 1),
+      WRITE_SEGMENT(REG_MODEM_CONFIG_2, &modem_config_2, 1)};
+  return sx127x_shadow_spi_transfer(segments, SEGMENTS_LENGTH(segments), &device->spi_device);
 }
 
 int sx127x_lora_tx_set_for_transmission(const uint8_t *data, uint8_t data_length, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_MODULATION(device, SX127x_MODULATION_LORA);
   // uint8_t can't be more than MAX_PACKET_SIZE
   if (data_length == 0) {
     return SX127X_ERR_INVALID_ARG;
   }
   uint8_t fifo_addr[] = {FIFO_TX_BASE_ADDR};
-  ERROR_CHECK(sx127x_shadow_spi_write_register(REG_FIFO_ADDR_PTR, fifo_addr, 1, &device->spi_device));
   uint8_t reg_data[] = {data_length};
-  ERROR_CHECK(sx127x_shadow_spi_write_register(REG_PAYLOAD_LENGTH, reg_data, 1, &device->spi_device));
-  return sx127x_shadow_spi_write_buffer(REG_FIFO, data, data_length, &device->spi_device);
+  sx127x_spi_segment_t segments[] = {
+      WRITE_SEGMENT(REG_FIFO_ADDR_PTR, fifo_addr, 1),
+      WRITE_SEGMENT(REG_PAYLOAD_LENGTH, reg_data, 1),
+      WRITE_SEGMENT(REG_FIFO, data, data_length)};
+  return sx127x_shadow_spi_transfer(segments, SEGMENTS_LENGTH(segments), &device->spi_device);
 }
 
 int sx127x_lora_set_ppm_offset(int32_t frequency_error, sx127x *device) {
+  STATS_ENTER(device);
   uint64_t frequency;
   ERROR_CHECK(sx127x_get_frequency(device, &frequency));
   uint8_t value = (uint8_t) (0.95f * ((float) frequency_error / (frequency / 1E6f)));
@@ -984,11 +2756,12 @@ int sx127x_fsk_ook_tx_set_for_transmission_with_remaining(uint16_t data_length,
     to_send = data_length;
   }
   device->expected_packet_length = data_length;
-  device->fsk_ook_packet_sent_received = to_send;
-  return sx127x_shadow_spi_write_buffer(REG_FIFO, device->packet, to_send, &device->spi_device);
+  device->fsk_ook_packet_sent_received = 0;
+  return sx127x_fsk_ook_tx_write_fifo(to_send, device);
 }
 
 int sx127x_fsk_ook_tx_set_for_transmission(uint8_t *data, uint16_t data_length, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_FSK_OOK_MODULATION(device);
   if (device->fsk_ook_format == SX127X_VARIABLE && data_length > MAX_PACKET_SIZE) {
     return SX127X_ERR_INVALID_ARG;
@@ -996,6 +2769,7 @@ int sx127x_fsk_ook_tx_set_for_transmission(uint8_t *data, uint16_t data_length,
   if (device->fsk_ook_format == SX127X_FIXED && data_length > MAX_PACKET_SIZE_FSK_FIXED) {
     return SX127X_ERR_INVALID_ARG;
   }
+  ERROR_CHECK(sx127x_packet_acquire(device->fsk_ook_format == SX127X_VARIABLE ? data_length + 1 : data_length, device));
   if (device->fsk_ook_format == SX127X_VARIABLE) {
     device->packet[0] = (uint8_t) data_length;
     // packet length is always more than 255
@@ -1004,10 +2778,13 @@ int sx127x_fsk_ook_tx_set_for_transmission(uint8_t *data, uint16_t data_length,
   } else {
     memcpy(device->packet, data, sizeof(uint8_t) * data_length);
   }
+  device->fsk_ook_tx_source = (sx127x_tx_source_t) {.buffer = device->packet};
+  device->fsk_ook_tx_prefix_length = 0;
   return sx127x_fsk_ook_tx_set_for_transmission_with_remaining(data_length, device);
 }
 
 int sx127x_fsk_ook_tx_set_for_transmission_with_address(uint8_t *data, uint16_t data_length, uint8_t address_to, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_FSK_OOK_MODULATION(device);
   if (device->fsk_ook_format == SX127X_VARIABLE && data_length > (MAX_PACKET_SIZE - 1)) {
     return SX127X_ERR_INVALID_ARG;
@@ -1017,6 +2794,7 @@ int sx127x_fsk_ook_tx_set_for_transmission_with_address(uint8_t *data, uint16_t
   }
   uint16_t offset = 0;
   uint16_t packet_length = data_length + 1;
+  ERROR_CHECK(sx127x_packet_acquire(device->fsk_ook_format == SX127X_VARIABLE ? packet_length + 1 : packet_length, device));
   if (device->fsk_ook_format == SX127X_VARIABLE) {
     device->packet[offset] = (uint8_t) packet_length;
     offset++;
@@ -1025,10 +2803,54 @@ int sx127x_fsk_ook_tx_set_for_transmission_with_address(uint8_t *data, uint16_t
   device->packet[offset] = address_to;
   offset++;
   memcpy(device->packet + offset, data, sizeof(uint8_t) * data_length);
+  device->fsk_ook_tx_source = (sx127x_tx_source_t) {.buffer = device->packet};
+  device->fsk_ook_tx_prefix_length = 0;
   return sx127x_fsk_ook_tx_set_for_transmission_with_remaining(packet_length, device);
 }
 
+int sx127x_fsk_ook_tx_set_source_for_transmission(const sx127x_tx_source_t *source, uint16_t data_length, sx127x *device) {
+  STATS_ENTER(device);
+  CHECK_FSK_OOK_MODULATION(device);
+  if (source == NULL || (source->buffer == NULL) == (source->pull == NULL)) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  if (device->fsk_ook_format == SX127X_VARIABLE && data_length > MAX_PACKET_SIZE) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  if (device->fsk_ook_format == SX127X_FIXED && data_length > MAX_PACKET_SIZE_FSK_FIXED) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  device->fsk_ook_tx_source = *source;
+  device->fsk_ook_tx_prefix_length = 0;
+  if (device->fsk_ook_format == SX127X_VARIABLE) {
+    device->fsk_ook_tx_prefix[device->fsk_ook_tx_prefix_length++] = (uint8_t) data_length;
+  }
+  return sx127x_fsk_ook_tx_set_for_transmission_with_remaining(device->fsk_ook_tx_prefix_length + data_length, device);
+}
+
+int sx127x_fsk_ook_tx_set_source_for_transmission_with_address(const sx127x_tx_source_t *source, uint16_t data_length, uint8_t address_to, sx127x *device) {
+  STATS_ENTER(device);
+  CHECK_FSK_OOK_MODULATION(device);
+  if (source == NULL || (source->buffer == NULL) == (source->pull == NULL)) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  if (device->fsk_ook_format == SX127X_VARIABLE && data_length > (MAX_PACKET_SIZE - 1)) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  if (device->fsk_ook_format == SX127X_FIXED && data_length > (MAX_PACKET_SIZE_FSK_FIXED - 1)) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  device->fsk_ook_tx_source = *source;
+  device->fsk_ook_tx_prefix_length = 0;
+  if (device->fsk_ook_format == SX127X_VARIABLE) {
+    device->fsk_ook_tx_prefix[device->fsk_ook_tx_prefix_length++] = (uint8_t) (data_length + 1);
+  }
+  device->fsk_ook_tx_prefix[device->fsk_ook_tx_prefix_length++] = address_to;
+  return sx127x_fsk_ook_tx_set_for_transmission_with_remaining(device->fsk_ook_tx_prefix_length + data_length, device);
+}
+
 int sx127x_fsk_ook_tx_start_beacon(uint8_t *data, uint8_t data_length, uint32_t interval_ms, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_FSK_OOK_MODULATION(device);
   if (device->fsk_ook_format != SX127X_FIXED) {
     return SX127X_ERR_INVALID_STATE;
@@ -1094,33 +2916,43 @@ int sx127x_fsk_ook_tx_start_beacon(uint8_t *data, uint8_t data_length, uint32_t
   } else {
     timer_resolution += 0b00000011;
   }
-  ERROR_CHECK(sx127x_shadow_spi_write_register(REG_TIMER1_COEF, &timer1_coefficient, 1, &device->spi_device));
-  ERROR_CHECK(sx127x_shadow_spi_write_register(REG_TIMER2_COEF, &timer2_coefficient, 1, &device->spi_device));
-  ERROR_CHECK(sx127x_shadow_spi_write_register(REG_TIMER_RESOLUTION, &timer_resolution, 1, &device->spi_device));
-
+  // REG_TIMER_RESOLUTION, REG_TIMER1_COEF and REG_TIMER2_COEF are next to each other
+  uint8_t timers[] = {timer_resolution, timer1_coefficient, timer2_coefficient};
   // start tx as soon as first byte in FIFO available
-  uint8_t value = (0b10000000 | HALF_MAX_FIFO_THRESHOLD);
-  ERROR_CHECK(sx127x_shadow_spi_write_register(REG_FIFO_THRESH, &value, 1, &device->spi_device));
+  uint8_t fifo_thresh = (TX_START_CONDITION_FIFO_EMPTY | device->fsk_ook_tx_threshold);
   // reset FIFO if something was there
-  value = 0b00010000;
-  ERROR_CHECK(sx127x_shadow_spi_write_register(0x3f, &value, 1, &device->spi_device));
+  uint8_t irq = 0b00010000;
+  sx127x_spi_segment_t segments[] = {
+      WRITE_SEGMENT(REG_TIMER_RESOLUTION, timers, sizeof(timers)),
+      WRITE_SEGMENT(REG_FIFO_THRESH, &fifo_thresh, 1),
+      WRITE_SEGMENT(REG_IRQ_FLAGS_2, &irq, 1)};
+  ERROR_CHECK(sx127x_shadow_spi_transfer(segments, SEGMENTS_LENGTH(segments), &device->spi_device));
   ERROR_CHECK(sx127x_fsk_ook_tx_set_for_transmission(data, data_length, device));
-  value = 0b00001000;  // beacon on
-  ERROR_CHECK(sx127x_append_register(REG_PACKET_CONFIG2, value, 0b11110111, &device->spi_device));
+  uint8_t packet_config_2;
+  // beacon on
+  ERROR_CHECK(sx127x_prepare_append_register(REG_PACKET_CONFIG2, 0b00001000, 0b11110111, &device->spi_device, &packet_config_2));
   // start sequencer
-  value = 0b10100100;
-  return sx127x_shadow_spi_write_register(REG_SEQ_CONFIG1, &value, 1, &device->spi_device);
+  uint8_t seq_config = 0b10100100;
+  sx127x_spi_segment_t start_segments[] = {
+      WRITE_SEGMENT(REG_PACKET_CONFIG2, &packet_config_2, 1),
+      WRITE_SEGMENT(REG_SEQ_CONFIG1, &seq_config, 1)};
+  return sx127x_shadow_spi_transfer(start_segments, SEGMENTS_LENGTH(start_segments), &device->spi_device);
 }
 
 int sx127x_fsk_ook_tx_stop_beacon(sx127x *device) {
+  STATS_ENTER(device);
   CHECK_FSK_OOK_MODULATION(device);
   // stop sequencer
-  uint8_t value = 0b01000000;
-  ERROR_CHECK(sx127x_shadow_spi_write_register(REG_SEQ_CONFIG1, &value, 1, &device->spi_device));
-  value = 0b00010000;
-  ERROR_CHECK(sx127x_shadow_spi_write_register(REG_IRQ_FLAGS_2, &value, 1, &device->spi_device));
-  value = 0b00000000;  // beacon off
-  return sx127x_append_register(REG_PACKET_CONFIG2, value, 0b11110111, &device->spi_device);
+  uint8_t seq_config = 0b01000000;
+  uint8_t irq = 0b00010000;
+  uint8_t packet_config_2;
+  // beacon off
+  ERROR_CHECK(sx127x_prepare_append_register(REG_PACKET_CONFIG2, 0b00000000, 0b11110111, &device->spi_device, &packet_config_2));
+  sx127x_spi_segment_t segments[] = {
+      WRITE_SEGMENT(REG_SEQ_CONFIG1, &seq_config, 1),
+      WRITE_SEGMENT(REG_IRQ_FLAGS_2, &irq, 1),
+      WRITE_SEGMENT(REG_PACKET_CONFIG2, &packet_config_2, 1)};
+  return sx127x_shadow_spi_transfer(segments, SEGMENTS_LENGTH(segments), &device->spi_device);
 }
 
 void sx127x_lora_cad_set_callback(void (*cad_callback)(sx127x *, int), sx127x *device) {
@@ -1128,6 +2960,7 @@ void sx127x_lora_cad_set_callback(void (*cad_callback)(sx127x *, int), sx127x *d
 }
 
 int sx127x_fsk_ook_set_bitrate(float bitrate, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_FSK_OOK_MODULATION(device);
   uint16_t bitrate_value;
   uint8_t bitrate_fractional;
@@ -1148,11 +2981,47 @@ int sx127x_fsk_ook_set_bitrate(float bitrate, sx127x *device) {
     return SX127X_ERR_INVALID_ARG;
   }
   uint8_t data[] = {(uint8_t) (bitrate_value >> 8), (uint8_t) (bitrate_value >> 0)};
-  ERROR_CHECK(sx127x_shadow_spi_write_register(REG_BITRATE_MSB, data, 2, &device->spi_device));
-  return sx127x_shadow_spi_write_register(REG_BITRATE_FRAC, &bitrate_fractional, 1, &device->spi_device);
+  sx127x_spi_segment_t segments[] = {
+      WRITE_SEGMENT(REG_BITRATE_MSB, data, 2),
+      WRITE_SEGMENT(REG_BITRATE_FRAC, &bitrate_fractional, 1)};
+  return sx127x_shadow_spi_transfer(segments, SEGMENTS_LENGTH(segments), &device->spi_device);
+}
+
+int sx127x_fsk_ook_set_fifo_threshold_auto(uint32_t interrupt_latency_us, uint32_t spi_frequency, sx127x *device) {
+  STATS_ENTER(device);
+  CHECK_FSK_OOK_MODULATION(device);
+  if (spi_frequency == 0) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  uint32_t bitrate_value;
+  ERROR_CHECK(sx127x_shadow_spi_read_registers(REG_BITRATE_MSB, &device->spi_device, 2, &bitrate_value));
+  uint8_t fractional = 0;
+  if (device->active_modem == SX127x_MODULATION_FSK) {
+    ERROR_CHECK(sx127x_read_register(REG_BITRATE_FRAC, &device->spi_device, &fractional));
+    fractional &= 0x0F;
+  }
+  uint32_t value = bitrate_value * 16 + fractional;
+  if (value == 0) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  float bitrate = SX127x_OSCILLATOR_FREQUENCY * 16.0f / value;
+  // bytes in flight while interrupt is pending and the whole FIFO is transferred. Rounded up + 1 guard byte
+  float margin_us = interrupt_latency_us + FIFO_SIZE_FSK * 8 * 1E6f / spi_frequency;
+  uint32_t margin = (uint32_t) (margin_us * bitrate / 8E6f) + 2;
+  // every interrupt should transfer at least as many bytes as arrive or drain while it is being handled, otherwise FIFO overruns over several batches
+  if (margin > (FIFO_SIZE_FSK - 2) / 2) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  // FIFO_LEVEL is set when number of bytes in FIFO is more than threshold
+  device->fsk_ook_rx_threshold = (uint8_t) (FIFO_SIZE_FSK - 1 - margin);
+  device->fsk_ook_rx_batch = device->fsk_ook_rx_threshold - 1;
+  device->fsk_ook_tx_threshold = (uint8_t) margin;
+  device->fsk_ook_tx_batch = FIFO_SIZE_FSK - device->fsk_ook_tx_threshold - 1;
+  return SX127X_OK;
 }
 
 int sx127x_fsk_set_fdev(float frequency_deviation, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_MODULATION(device, SX127x_MODULATION_FSK);
   if (frequency_deviation < 600 || frequency_deviation > 200000) {
     return SX127X_ERR_INVALID_ARG;
@@ -1163,32 +3032,57 @@ int sx127x_fsk_set_fdev(float frequency_deviation, sx127x *device) {
 }
 
 int sx127x_ook_rx_set_peak_mode(sx127x_ook_peak_thresh_step_t step, uint8_t floor_threshold, sx127x_ook_peak_thresh_dec_t decrement, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_MODULATION(device, SX127x_MODULATION_OOK);
-  ERROR_CHECK(sx127x_shadow_spi_write_register(REG_OOK_FIX, &floor_threshold, 1, &device->spi_device));
-  ERROR_CHECK(sx127x_append_register(REG_OOK_AVG, decrement, 0b00011111, &device->spi_device));
-  return sx127x_append_register(REG_OOK_PEAK, (0b00001000 | step), 0b11100000, &device->spi_device);
+  uint8_t ook_avg;
+  ERROR_CHECK(sx127x_prepare_append_register(REG_OOK_AVG, decrement, 0b00011111, &device->spi_device, &ook_avg));
+  uint8_t ook_peak;
+  ERROR_CHECK(sx127x_prepare_append_register(REG_OOK_PEAK, (0b00001000 | step), 0b11100000, &device->spi_device, &ook_peak));
+  sx127x_spi_segment_t segments[] = {
+      WRITE_SEGMENT(REG_OOK_FIX, &floor_threshold, 1),
+      WRITE_SEGMENT(REG_OOK_AVG, &ook_avg, 1),
+      WRITE_SEGMENT(REG_OOK_PEAK, &ook_peak, 1)};
+  return sx127x_shadow_spi_transfer(segments, SEGMENTS_LENGTH(segments), &device->spi_device);
 }
 
 int sx127x_ook_rx_set_fixed_mode(uint8_t fixed_threshold, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_MODULATION(device, SX127x_MODULATION_OOK);
-  ERROR_CHECK(sx127x_shadow_spi_write_register(REG_OOK_FIX, &fixed_threshold, 1, &device->spi_device));
-  return sx127x_append_register(REG_OOK_PEAK, 0b00000000, 0b11100111, &device->spi_device);
+  uint8_t ook_peak;
+  ERROR_CHECK(sx127x_prepare_append_register(REG_OOK_PEAK, 0b00000000, 0b11100111, &device->spi_device, &ook_peak));
+  sx127x_spi_segment_t segments[] = {
+      WRITE_SEGMENT(REG_OOK_FIX, &fixed_threshold, 1),
+      WRITE_SEGMENT(REG_OOK_PEAK, &ook_peak, 1)};
+  return sx127x_shadow_spi_transfer(segments, SEGMENTS_LENGTH(segments), &device->spi_device);
 }
 
 int sx127x_ook_rx_set_avg_mode(sx127x_ook_avg_offset_t avg_offset, sx127x_ook_avg_thresh_t avg_thresh, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_MODULATION(device, SX127x_MODULATION_OOK);
-  ERROR_CHECK(sx127x_append_register(REG_OOK_AVG, (avg_offset | avg_thresh), 0b11110000, &device->spi_device));
-  return sx127x_append_register(REG_OOK_PEAK, 0b00010000, 0b11100111, &device->spi_device);
+  uint8_t ook_avg;
+  ERROR_CHECK(sx127x_prepare_append_register(REG_OOK_AVG, (avg_offset | avg_thresh), 0b11110000, &device->spi_device, &ook_avg));
+  uint8_t ook_peak;
+  ERROR_CHECK(sx127x_prepare_append_register(REG_OOK_PEAK, 0b00010000, 0b11100111, &device->spi_device, &ook_peak));
+  sx127x_spi_segment_t segments[] = {
+      WRITE_SEGMENT(REG_OOK_AVG, &ook_avg, 1),
+      WRITE_SEGMENT(REG_OOK_PEAK, &ook_peak, 1)};
+  return sx127x_shadow_spi_transfer(segments, SEGMENTS_LENGTH(segments), &device->spi_device);
 }
 
 int sx127x_fsk_ook_rx_set_collision_restart(bool enable, uint8_t threshold, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_FSK_OOK_MODULATION(device);
-  ERROR_CHECK(sx127x_shadow_spi_write_register(REG_RSSI_COLLISION, &threshold, 1, &device->spi_device));
   uint8_t value = (enable ? 0b10000000 : 0b00000000);
-  return sx127x_append_register(REG_RX_CONFIG, value, 0b01111111, &device->spi_device);
+  uint8_t rx_config;
+  ERROR_CHECK(sx127x_prepare_append_register(REG_RX_CONFIG, value, 0b01111111, &device->spi_device, &rx_config));
+  sx127x_spi_segment_t segments[] = {
+      WRITE_SEGMENT(REG_RSSI_COLLISION, &threshold, 1),
+      WRITE_SEGMENT(REG_RX_CONFIG, &rx_config, 1)};
+  return sx127x_shadow_spi_transfer(segments, SEGMENTS_LENGTH(segments), &device->spi_device);
 }
 
 int sx127x_fsk_ook_rx_set_afc_auto(bool afc_auto, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_FSK_OOK_MODULATION(device);
   uint8_t value = (afc_auto ? 0b00010000 : 0b00000000);
   return sx127x_append_register(REG_RX_CONFIG, value, 0b11101111, &device->spi_device);
@@ -1211,23 +3105,27 @@ uint8_t sx127x_fsk_ook_calculate_bw_register(float bandwidth) {
 }
 
 int sx127x_fsk_ook_rx_set_afc_bandwidth(float bandwidth, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_FSK_OOK_MODULATION(device);
   uint8_t value = sx127x_fsk_ook_calculate_bw_register(bandwidth);
   return sx127x_shadow_spi_write_register(REG_AFC_BW, &value, 1, &device->spi_device);
 }
 
 int sx127x_fsk_ook_rx_set_bandwidth(float bandwidth, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_FSK_OOK_MODULATION(device);
   uint8_t value = sx127x_fsk_ook_calculate_bw_register(bandwidth);
   return sx127x_shadow_spi_write_register(REG_RX_BW, &value, 1, &device->spi_device);
 }
 
 int sx127x_fsk_ook_rx_set_trigger(sx127x_rx_trigger_t trigger, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_FSK_OOK_MODULATION(device);
   return sx127x_append_register(REG_RX_CONFIG, trigger, 0b11111000, &device->spi_device);
 }
 
 int sx127x_fsk_ook_set_syncword(uint8_t *syncword, uint8_t syncword_length, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_FSK_OOK_MODULATION(device);
   if (syncword_length == 0 || syncword_length > 8) {
     return SX127X_ERR_INVALID_ARG;
@@ -1238,11 +3136,19 @@ int sx127x_fsk_ook_set_syncword(uint8_t *syncword, uint8_t syncword_length, sx12
     }
   }
   // SYNC_ON + On, without waiting for the PLL to re-lock
-  ERROR_CHECK(sx127x_append_register(REG_SYNC_CONFIG, 0b01010000 | (syncword_length - 1), 0b00101000, &device->spi_device));
-  return sx127x_shadow_spi_write_buffer(REG_SYNC_VALUE1, syncword, syncword_length, &device->spi_device);
+  uint8_t sync_config;
+  ERROR_CHECK(sx127x_prepare_append_register(REG_SYNC_CONFIG, 0b01010000 | (syncword_length - 1), 0b00101000, &device->spi_device, &sync_config));
+  // REG_SYNC_CONFIG is followed by REG_SYNC_VALUE1
+  uint8_t data[9];
+  data[0] = sync_config;
+  memcpy(data + 1, syncword, syncword_length);
+  sx127x_spi_segment_t segments[] = {
+      WRITE_SEGMENT(REG_SYNC_CONFIG, data, syncword_length + 1)};
+  return sx127x_shadow_spi_transfer(segments, SEGMENTS_LENGTH(segments), &device->spi_device);
 }
 
 int sx127x_fsk_ook_rx_set_rssi_config(sx127x_rssi_smoothing_t smoothing, int8_t offset, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_FSK_OOK_MODULATION(device);
   if (offset < -16 || offset > 15) {
     return SX127X_ERR_INVALID_ARG;
@@ -1252,11 +3158,13 @@ int sx127x_fsk_ook_rx_set_rssi_config(sx127x_rssi_smoothing_t smoothing, int8_t
 }
 
 int sx127x_fsk_ook_set_packet_encoding(sx127x_packet_encoding_t encoding, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_FSK_OOK_MODULATION(device);
   return sx127x_append_register(REG_PACKET_CONFIG1, encoding, 0b10011111, &device->spi_device);
 }
 
 int sx127x_fsk_ook_set_crc(sx127x_crc_type_t crc_type, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_FSK_OOK_MODULATION(device);
   int result = sx127x_append_register(REG_PACKET_CONFIG1, (uint8_t) crc_type, 0b11100110, &device->spi_device);
   if (result == SX127X_OK) {
@@ -1266,6 +3174,7 @@ int sx127x_fsk_ook_set_crc(sx127x_crc_type_t crc_type, sx127x *device) {
 }
 
 int sx127x_fsk_ook_set_packet_format(sx127x_packet_format_t format, uint16_t max_payload_length, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_FSK_OOK_MODULATION(device);
   if (format == SX127X_FIXED && (max_payload_length == 0 || max_payload_length > MAX_PACKET_SIZE_FSK_FIXED)) {
     return SX127X_ERR_INVALID_ARG;
@@ -1274,44 +3183,59 @@ int sx127x_fsk_ook_set_packet_format(sx127x_packet_format_t format, uint16_t max
   if (format == SX127X_VARIABLE && (max_payload_length == 0 || (max_payload_length > MAX_PACKET_SIZE && max_payload_length != MAX_PACKET_SIZE_FSK_FIXED))) {
     return SX127X_ERR_INVALID_ARG;
   }
+  // REG_PACKET_CONFIG1, REG_PACKET_CONFIG2 and REG_PAYLOAD_LENGTH_FSK are next to each other
+  uint8_t data[3];
+  ERROR_CHECK(sx127x_prepare_append_register(REG_PACKET_CONFIG1, format, 0b01111111, &device->spi_device, data));
   uint8_t msb_bits = ((max_payload_length >> 8) & 0b111);
-  ERROR_CHECK(sx127x_append_register(REG_PACKET_CONFIG2, msb_bits, 0b11111000, &device->spi_device));
-  uint8_t lsb_bits = (max_payload_length & 0xFF);
-  ERROR_CHECK(sx127x_shadow_spi_write_register(REG_PAYLOAD_LENGTH_FSK, &lsb_bits, 1, &device->spi_device));
-  ERROR_CHECK(sx127x_append_register(REG_PACKET_CONFIG1, format, 0b01111111, &device->spi_device));
+  ERROR_CHECK(sx127x_prepare_append_register(REG_PACKET_CONFIG2, msb_bits, 0b11111000, &device->spi_device, data + 1));
+  data[2] = (max_payload_length & 0xFF);
+  sx127x_spi_segment_t segments[] = {
+      WRITE_SEGMENT(REG_PACKET_CONFIG1, data, sizeof(data))};
+  ERROR_CHECK(sx127x_shadow_spi_transfer(segments, SEGMENTS_LENGTH(segments), &device->spi_device));
   device->fsk_ook_format = format;
   return SX127X_OK;
 }
 
 int sx127x_fsk_ook_set_address_filtering(sx127x_address_filtering_t type, uint8_t node_address, uint8_t broadcast_address, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_FSK_OOK_MODULATION(device);
+  uint8_t packet_config_1;
+  ERROR_CHECK(sx127x_prepare_append_register(REG_PACKET_CONFIG1, type, 0b11111001, &device->spi_device, &packet_config_1));
+  // REG_NODE_ADDR is followed by REG_BROADCAST_ADDR
+  uint8_t addresses[] = {node_address, broadcast_address};
+  sx127x_spi_segment_t segments[2];
+  size_t segments_length = 0;
   if (type == SX127X_FILTER_NODE_AND_BROADCAST) {
-    ERROR_CHECK(sx127x_shadow_spi_write_register(REG_BROADCAST_ADDR, &broadcast_address, 1, &device->spi_device));
-  }
-  if (type == SX127X_FILTER_NODE_AND_BROADCAST || type == SX127X_FILTER_NODE_ADDRESS) {
-    ERROR_CHECK(sx127x_shadow_spi_write_register(REG_NODE_ADDR, &node_address, 1, &device->spi_device));
+    segments[segments_length++] = (sx127x_spi_segment_t) WRITE_SEGMENT(REG_NODE_ADDR, addresses, 2);
+  } else if (type == SX127X_FILTER_NODE_ADDRESS) {
+    segments[segments_length++] = (sx127x_spi_segment_t) WRITE_SEGMENT(REG_NODE_ADDR, addresses, 1);
   }
-  return sx127x_append_register(REG_PACKET_CONFIG1, type, 0b11111001, &device->spi_device);
+  segments[segments_length++] = (sx127x_spi_segment_t) WRITE_SEGMENT(REG_PACKET_CONFIG1, &packet_config_1, 1);
+  return sx127x_shadow_spi_transfer(segments, segments_length, &device->spi_device);
 }
 
 int sx127x_fsk_set_data_shaping(sx127x_fsk_data_shaping_t data_shaping, sx127x_pa_ramp_t pa_ramp, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_MODULATION(device, SX127x_MODULATION_FSK);
   uint8_t value = (data_shaping | pa_ramp);
   return sx127x_shadow_spi_write_register(REG_PA_RAMP, &value, 1, &device->spi_device);
 }
 
 int sx127x_ook_set_data_shaping(sx127x_ook_data_shaping_t data_shaping, sx127x_pa_ramp_t pa_ramp, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_MODULATION(device, SX127x_MODULATION_OOK);
   uint8_t value = (data_shaping | pa_ramp);
   return sx127x_shadow_spi_write_register(REG_PA_RAMP, &value, 1, &device->spi_device);
 }
 
 int sx127x_fsk_ook_set_preamble_type(sx127x_preamble_type_t type, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_FSK_OOK_MODULATION(device);
   return sx127x_append_register(REG_SYNC_CONFIG, type, 0b11011111, &device->spi_device);
 }
 
 int sx127x_fsk_ook_rx_set_preamble_detector(bool enable, uint8_t detector_size, uint8_t detector_tolerance, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_FSK_OOK_MODULATION(device);
   if (detector_size > 3 || detector_size < 1) {
     return SX127X_ERR_INVALID_ARG;
@@ -1322,6 +3246,7 @@ int sx127x_fsk_ook_rx_set_preamble_detector(bool enable, uint8_t detector_size,
 }
 
 int sx127x_fsk_ook_rx_calibrate(sx127x *device) {
+  STATS_ENTER(device);
   CHECK_FSK_OOK_MODULATION(device);
   if (device->opmod != SX127x_MODE_STANDBY) {
     return SX127X_ERR_INVALID_STATE;
@@ -1338,6 +3263,7 @@ int sx127x_fsk_ook_rx_calibrate(sx127x *device) {
 }
 
 int sx127x_fsk_ook_get_raw_temperature(sx127x *device, int8_t *raw_temperature) {
+  STATS_ENTER(device);
   CHECK_FSK_OOK_MODULATION(device);
   uint8_t value;
   ERROR_CHECK(sx127x_read_register(REG_TEMP, &device->spi_device, &value));
@@ -1350,6 +3276,7 @@ int sx127x_fsk_ook_get_raw_temperature(sx127x *device, int8_t *raw_temperature)
 }
 
 int sx127x_fsk_ook_set_temp_monitor(bool enable, sx127x *device) {
+  STATS_ENTER(device);
   CHECK_FSK_OOK_MODULATION(device);
   // the field is called TempMonitorOff, thus inverted
   uint8_t value = (enable ? 0b00000000 : 0b00000001);
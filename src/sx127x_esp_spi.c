@@ -13,6 +13,7 @@
 // limitations under the License.
 #include <driver/spi_master.h>
 #include <esp_err.h>
+#include <freertos/FreeRTOS.h>
 #include <sx127x_spi.h>
 
 int sx127x_spi_read_registers(int reg, void *spi_device, size_t data_length, uint32_t *result) {
@@ -74,3 +75,26 @@ int sx127x_spi_write_buffer(int reg, const uint8_t *buffer, size_t buffer_length
       .length = buffer_length * 8};
   return spi_device_polling_transmit(spi_device, &t);
 }
+
+int sx127x_spi_transfer(sx127x_spi_segment_t *segments, size_t segments_length, void *spi_device) {
+  if (segments_length == 0 || segments_length > SX127X_SPI_MAX_SEGMENTS) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  // keep other devices on the same bus away until all segments are sent
+  esp_err_t code = spi_device_acquire_bus(spi_device, portMAX_DELAY);
+  if (code != ESP_OK) {
+    return code;
+  }
+  for (size_t i = 0; i < segments_length; i++) {
+    if (segments[i].tx_buffer != NULL) {
+      code = sx127x_spi_write_buffer(segments[i].reg, segments[i].tx_buffer, segments[i].length, spi_device);
+    } else {
+      code = sx127x_spi_read_buffer(segments[i].reg, segments[i].rx_buffer, segments[i].length, spi_device);
+    }
+    if (code != ESP_OK) {
+      break;
+    }
+  }
+  spi_device_release_bus(spi_device);
+  return code;
+}
@@ -0,0 +1,447 @@
+// Copyright 2022 Andrey Rodionov <dernasherbrezon@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//         http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <stddef.h>
+#include <string.h>
+#include <sx127x_linux_concentrator.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BUS_EVENT_LOOP 0
+#define BUS_EVENT_STOP 1
+
+sx127x_linux_concentrator_radio_t *sx127x_linux_concentrator_radio(sx127x *device) {
+  return (sx127x_linux_concentrator_radio_t *) ((uint8_t *) device - offsetof(sx127x_linux_concentrator_radio_t, device));
+}
+
+int sx127x_linux_concentrator_radio_rx(sx127x_linux_concentrator_radio_t *radio) {
+  int code = sx127x_set_channel(radio->rx_channel, &radio->device);
+  if (code != SX127X_OK) {
+    return code;
+  }
+  return sx127x_set_opmod(SX127x_MODE_RX_CONT, radio->device.active_modem, &radio->device);
+}
+
+// called from the bus thread while bus lock is held
+void sx127x_linux_concentrator_rx_callback(sx127x *device, uint8_t *data, uint16_t data_length, const sx127x_packet_meta_t *meta) {
+  sx127x_linux_concentrator_radio_t *radio = sx127x_linux_concentrator_radio(device);
+  sx127x_linux_concentrator_t *concentrator = radio->concentrator;
+  radio->received++;
+  pthread_mutex_lock(&concentrator->rx_lock);
+  if (concentrator->rx_head - concentrator->rx_tail >= CONFIG_SX127X_LINUX_CONCENTRATOR_RX_QUEUE || data_length > CONFIG_SX127X_LINUX_CONCENTRATOR_PACKET_SIZE) {
+    concentrator->dropped++;
+    pthread_mutex_unlock(&concentrator->rx_lock);
+    return;
+  }
+  sx127x_linux_concentrator_packet_t *packet = concentrator->rx_queue + (concentrator->rx_head % CONFIG_SX127X_LINUX_CONCENTRATOR_RX_QUEUE);
+  packet->radio = radio->id;
+  packet->length = data_length;
+  packet->meta = *meta;
+  memcpy(packet->data, data, data_length);
+  concentrator->rx_head++;
+  pthread_cond_signal(&concentrator->rx_ready);
+  pthread_mutex_unlock(&concentrator->rx_lock);
+}
+
+// called from the bus thread while bus lock is held
+void sx127x_linux_concentrator_tx_callback(sx127x *device) {
+  sx127x_linux_concentrator_radio_t *radio = sx127x_linux_concentrator_radio(device);
+  radio->transmitting = false;
+  radio->transmitted++;
+  sx127x_linux_concentrator_radio_rx(radio);
+}
+
+// called from the bus thread while bus lock is held. radio is in standby after the aborted frame
+void sx127x_linux_concentrator_tx_abort_callback(sx127x *device) {
+  sx127x_linux_concentrator_radio_t *radio = sx127x_linux_concentrator_radio(device);
+  radio->transmitting = false;
+  sx127x_linux_concentrator_radio_rx(radio);
+}
+
+int sx127x_linux_concentrator_create(sx127x_channel_plan_t *plan, sx127x_linux_concentrator_t *concentrator) {
+  if (plan == NULL || concentrator == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  memset(concentrator, 0, sizeof(sx127x_linux_concentrator_t));
+  concentrator->plan = plan;
+  int code = pthread_mutex_init(&concentrator->rx_lock, NULL);
+  if (code != 0) {
+    return code;
+  }
+  // timeouts should not depend on wall clock adjustments
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  code = pthread_cond_init(&concentrator->rx_ready, &attr);
+  pthread_condattr_destroy(&attr);
+  if (code != 0) {
+    pthread_mutex_destroy(&concentrator->rx_lock);
+    return code;
+  }
+  return SX127X_OK;
+}
+
+int sx127x_linux_concentrator_add_bus(int cpu, uint8_t *bus, sx127x_linux_concentrator_t *concentrator) {
+  if (bus == NULL || concentrator == NULL || cpu < -1 || cpu >= CPU_SETSIZE) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  if (concentrator->buses_length >= CONFIG_SX127X_LINUX_CONCENTRATOR_MAX_BUSES) {
+    return SX127X_ERR_NO_MEM;
+  }
+  sx127x_linux_concentrator_bus_t *result = concentrator->buses + concentrator->buses_length;
+  memset(result, 0, sizeof(sx127x_linux_concentrator_bus_t));
+  result->cpu = cpu;
+  result->stop_fd = -1;
+  result->epoll_fd = -1;
+  int code = sx127x_linux_event_create(&result->loop);
+  if (code != SX127X_OK) {
+    return code;
+  }
+  result->stop_fd = eventfd(0, EFD_CLOEXEC);
+  result->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (result->stop_fd < 0 || result->epoll_fd < 0) {
+    code = errno;
+  } else {
+    // epoll of the event loop becomes readable when any line has events
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u32 = BUS_EVENT_LOOP;
+    if (epoll_ctl(result->epoll_fd, EPOLL_CTL_ADD, result->loop.epoll_fd, &event) < 0) {
+      code = errno;
+    } else {
+      event.data.u32 = BUS_EVENT_STOP;
+      if (epoll_ctl(result->epoll_fd, EPOLL_CTL_ADD, result->stop_fd, &event) < 0) {
+        code = errno;
+      } else {
+        code = pthread_mutex_init(&result->lock, NULL);
+      }
+    }
+  }
+  if (code != SX127X_OK) {
+    if (result->stop_fd >= 0) {
+      close(result->stop_fd);
+    }
+    if (result->epoll_fd >= 0) {
+      close(result->epoll_fd);
+    }
+    sx127x_linux_event_destroy(&result->loop);
+    return code;
+  }
+  *bus = concentrator->buses_length;
+  concentrator->buses_length++;
+  return SX127X_OK;
+}
+
+int sx127x_linux_concentrator_add_radio(uint8_t bus, void *spi_device, uint8_t rx_channel, uint8_t *radio, sx127x_linux_concentrator_t *concentrator) {
+  if (radio == NULL || concentrator == NULL || bus >= concentrator->buses_length || rx_channel >= concentrator->plan->channels_length) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  if (concentrator->radios_length >= CONFIG_SX127X_LINUX_CONCENTRATOR_MAX_RADIOS) {
+    return SX127X_ERR_NO_MEM;
+  }
+  sx127x_linux_concentrator_radio_t *result = concentrator->radios + concentrator->radios_length;
+  memset(result, 0, sizeof(sx127x_linux_concentrator_radio_t));
+  int code = sx127x_create(spi_device, &result->device);
+  if (code != SX127X_OK) {
+    return code;
+  }
+  code = sx127x_set_channel_plan(concentrator->plan, &result->device);
+  if (code != SX127X_OK) {
+    return code;
+  }
+  sx127x_rx_set_meta_callback(sx127x_linux_concentrator_rx_callback, sx127x_linux_event_clock, &result->device);
+  sx127x_tx_set_callback(sx127x_linux_concentrator_tx_callback, &result->device);
+  sx127x_tx_set_abort_callback(sx127x_linux_concentrator_tx_abort_callback, &result->device);
+  result->concentrator = concentrator;
+  result->id = concentrator->radios_length;
+  result->bus = bus;
+  result->rx_channel = rx_channel;
+  *radio = result->id;
+  concentrator->radios_length++;
+  return SX127X_OK;
+}
+
+int sx127x_linux_concentrator_add_lines(uint8_t radio, const char *chip_path, const uint32_t *offsets, const sx127x_dio_t *dios, uint8_t lines_length, sx127x_linux_concentrator_t *concentrator) {
+  if (concentrator == NULL || radio >= concentrator->radios_length) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  sx127x_linux_concentrator_radio_t *result = concentrator->radios + radio;
+  return sx127x_linux_event_add(chip_path, offsets, dios, lines_length, &result->device, &concentrator->buses[result->bus].loop);
+}
+
+int sx127x_linux_concentrator_add_fd(uint8_t radio, int fd, const uint32_t *offsets, const sx127x_dio_t *dios, uint8_t lines_length, sx127x_linux_concentrator_t *concentrator) {
+  if (concentrator == NULL || radio >= concentrator->radios_length) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  sx127x_linux_concentrator_radio_t *result = concentrator->radios + radio;
+  return sx127x_linux_event_add_fd(fd, offsets, dios, lines_length, &result->device, &concentrator->buses[result->bus].loop);
+}
+
+int sx127x_linux_concentrator_add_tx_queue(uint8_t radio, sx127x_tx_queue_t *queue, sx127x_linux_concentrator_t *concentrator) {
+  if (concentrator == NULL || radio >= concentrator->radios_length) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  sx127x_linux_concentrator_radio_t *result = concentrator->radios + radio;
+  // event loop is not guarded by the bus lock
+  if (concentrator->buses[result->bus].running) {
+    return SX127X_ERR_INVALID_STATE;
+  }
+  return sx127x_linux_event_add_tx_queue(queue, &result->device, &concentrator->buses[result->bus].loop);
+}
+
+void *sx127x_linux_concentrator_bus_run(void *arg) {
+  sx127x_linux_concentrator_bus_t *bus = (sx127x_linux_concentrator_bus_t *) arg;
+  while (1) {
+    struct epoll_event events[2];
+    // wait outside of the lock, so TX can be submitted in the meantime
+    int events_length = epoll_wait(bus->epoll_fd, events, 2, -1);
+    if (events_length < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return NULL;
+    }
+    for (int i = 0; i < events_length; i++) {
+      if (events[i].data.u32 != BUS_EVENT_STOP) {
+        continue;
+      }
+      // consume the signal, so the bus can be started again
+      uint64_t value;
+      if (read(bus->stop_fd, &value, sizeof(value)) == sizeof(value)) {
+        return NULL;
+      }
+    }
+    pthread_mutex_lock(&bus->lock);
+    sx127x_linux_event_poll(0, &bus->loop);
+    pthread_mutex_unlock(&bus->lock);
+  }
+}
+
+int sx127x_linux_concentrator_bus_start(sx127x_linux_concentrator_bus_t *bus) {
+  int code = pthread_create(&bus->thread, NULL, sx127x_linux_concentrator_bus_run, bus);
+  if (code != 0) {
+    return code;
+  }
+  bus->running = true;
+  if (bus->cpu < 0) {
+    return SX127X_OK;
+  }
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(bus->cpu, &cpus);
+  return pthread_setaffinity_np(bus->thread, sizeof(cpus), &cpus);
+}
+
+int sx127x_linux_concentrator_start(sx127x_linux_concentrator_t *concentrator) {
+  if (concentrator == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  for (uint8_t i = 0; i < concentrator->buses_length; i++) {
+    if (concentrator->buses[i].running) {
+      return SX127X_ERR_INVALID_STATE;
+    }
+  }
+  // threads are not running yet, so no need to lock
+  for (uint8_t i = 0; i < concentrator->radios_length; i++) {
+    concentrator->radios[i].transmitting = false;
+    int code = sx127x_linux_concentrator_radio_rx(concentrator->radios + i);
+    if (code != SX127X_OK) {
+      return code;
+    }
+  }
+  for (uint8_t i = 0; i < concentrator->buses_length; i++) {
+    int code = sx127x_linux_concentrator_bus_start(concentrator->buses + i);
+    if (code != SX127X_OK) {
+      sx127x_linux_concentrator_stop(concentrator);
+      return code;
+    }
+  }
+  return SX127X_OK;
+}
+
+int sx127x_linux_concentrator_radio_tx(uint8_t channel, const uint8_t *data, uint16_t data_length, sx127x_linux_concentrator_radio_t *radio) {
+  sx127x *device = &radio->device;
+  int code = sx127x_set_opmod(SX127x_MODE_STANDBY, device->active_modem, device);
+  if (code == SX127X_OK) {
+    code = sx127x_set_channel(channel, device);
+  }
+  if (code == SX127X_OK) {
+    if (device->active_modem == SX127x_MODULATION_LORA) {
+      code = sx127x_lora_tx_set_for_transmission(data, (uint8_t) data_length, device);
+    } else {
+      // payload is copied
+      code = sx127x_fsk_ook_tx_set_for_transmission((uint8_t *) data, data_length, device);
+    }
+  }
+  if (code == SX127X_OK) {
+    radio->transmitting = true;
+    code = sx127x_set_opmod(SX127x_MODE_TX, device->active_modem, device);
+  }
+  if (code != SX127X_OK) {
+    radio->transmitting = false;
+    sx127x_linux_concentrator_radio_rx(radio);
+  }
+  return code;
+}
+
+// called while bus lock is held
+bool sx127x_linux_concentrator_radio_transmitting(sx127x_linux_concentrator_radio_t *radio) {
+  return radio->transmitting || (radio->device.tx_queue != NULL && radio->device.tx_queue->active);
+}
+
+// called while bus lock is held. radio which can't be checked is treated as receiving
+bool sx127x_linux_concentrator_radio_receiving(sx127x_linux_concentrator_radio_t *radio) {
+  bool receiving;
+  if (sx127x_rx_is_receiving(&radio->device, &receiving) != SX127X_OK) {
+    return true;
+  }
+  return receiving;
+}
+
+int sx127x_linux_concentrator_tx(uint8_t channel, const uint8_t *data, uint16_t data_length, uint8_t *radio, sx127x_linux_concentrator_t *concentrator) {
+  if (data == NULL || data_length == 0 || concentrator == NULL || channel >= concentrator->plan->channels_length) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  bool supported = false;
+  // first pass: idle radio already listening on the channel. second pass: any idle radio. third pass: radio which is receiving a packet. TX aborts the reception
+  for (int pass = 0; pass < 3; pass++) {
+    for (uint8_t i = 0; i < concentrator->buses_length; i++) {
+      sx127x_linux_concentrator_bus_t *bus = concentrator->buses + i;
+      pthread_mutex_lock(&bus->lock);
+      for (uint8_t j = 0; j < concentrator->radios_length; j++) {
+        sx127x_linux_concentrator_radio_t *current = concentrator->radios + j;
+        if (current->bus != i) {
+          continue;
+        }
+        // FSK radio can still send it
+        if (current->device.active_modem == SX127x_MODULATION_LORA && data_length > MAX_PACKET_SIZE) {
+          continue;
+        }
+        supported = true;
+        if (sx127x_linux_concentrator_radio_transmitting(current) || (pass == 0 && current->rx_channel != channel)) {
+          continue;
+        }
+        if (pass < 2 && sx127x_linux_concentrator_radio_receiving(current)) {
+          continue;
+        }
+        int code = sx127x_linux_concentrator_radio_tx(channel, data, data_length, current);
+        pthread_mutex_unlock(&bus->lock);
+        if (code == SX127X_OK && radio != NULL) {
+          *radio = current->id;
+        }
+        return code;
+      }
+      pthread_mutex_unlock(&bus->lock);
+    }
+  }
+  return (supported ? SX127X_ERR_NOT_FOUND : SX127X_ERR_INVALID_ARG);
+}
+
+int sx127x_linux_concentrator_rx(int timeout_ms, sx127x_linux_concentrator_packet_t *packet, sx127x_linux_concentrator_t *concentrator) {
+  if (packet == NULL || concentrator == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += timeout_ms / 1000;
+  deadline.tv_nsec += (long) (timeout_ms % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+  pthread_mutex_lock(&concentrator->rx_lock);
+  while (concentrator->rx_head == concentrator->rx_tail) {
+    if (timeout_ms == 0) {
+      pthread_mutex_unlock(&concentrator->rx_lock);
+      return SX127X_ERR_NOT_FOUND;
+    }
+    int code;
+    if (timeout_ms < 0) {
+      code = pthread_cond_wait(&concentrator->rx_ready, &concentrator->rx_lock);
+    } else {
+      code = pthread_cond_timedwait(&concentrator->rx_ready, &concentrator->rx_lock, &deadline);
+    }
+    if (code == ETIMEDOUT) {
+      pthread_mutex_unlock(&concentrator->rx_lock);
+      return SX127X_ERR_NOT_FOUND;
+    }
+  }
+  const sx127x_linux_concentrator_packet_t *oldest = concentrator->rx_queue + (concentrator->rx_tail % CONFIG_SX127X_LINUX_CONCENTRATOR_RX_QUEUE);
+  packet->radio = oldest->radio;
+  packet->length = oldest->length;
+  packet->meta = oldest->meta;
+  memcpy(packet->data, oldest->data, oldest->length);
+  concentrator->rx_tail++;
+  pthread_mutex_unlock(&concentrator->rx_lock);
+  return SX127X_OK;
+}
+
+void sx127x_linux_concentrator_get_counters(sx127x_linux_concentrator_t *concentrator, uint32_t *received, uint32_t *dropped) {
+  pthread_mutex_lock(&concentrator->rx_lock);
+  *received = concentrator->rx_head;
+  *dropped = concentrator->dropped;
+  pthread_mutex_unlock(&concentrator->rx_lock);
+}
+
+void sx127x_linux_concentrator_stop(sx127x_linux_concentrator_t *concentrator) {
+  if (concentrator == NULL) {
+    return;
+  }
+  for (uint8_t i = 0; i < concentrator->buses_length; i++) {
+    sx127x_linux_concentrator_bus_t *bus = concentrator->buses + i;
+    if (!bus->running) {
+      continue;
+    }
+    uint64_t value = 1;
+    if (write(bus->stop_fd, &value, sizeof(value)) == sizeof(value)) {
+      pthread_join(bus->thread, NULL);
+    }
+    bus->running = false;
+  }
+  for (uint8_t i = 0; i < concentrator->radios_length; i++) {
+    sx127x_linux_concentrator_radio_t *radio = concentrator->radios + i;
+    // sx127x_linux_concentrator_tx might still be called
+    pthread_mutex_lock(&concentrator->buses[radio->bus].lock);
+    sx127x_set_opmod(SX127x_MODE_STANDBY, radio->device.active_modem, &radio->device);
+    radio->transmitting = false;
+    // frame being sent is lost. the rest is sent after the next start
+    if (radio->device.tx_queue != NULL) {
+      radio->device.tx_queue->active = false;
+    }
+    pthread_mutex_unlock(&concentrator->buses[radio->bus].lock);
+  }
+}
+
+void sx127x_linux_concentrator_destroy(sx127x_linux_concentrator_t *concentrator) {
+  if (concentrator == NULL) {
+    return;
+  }
+  sx127x_linux_concentrator_stop(concentrator);
+  for (uint8_t i = 0; i < concentrator->buses_length; i++) {
+    sx127x_linux_concentrator_bus_t *bus = concentrator->buses + i;
+    close(bus->stop_fd);
+    close(bus->epoll_fd);
+    sx127x_linux_event_destroy(&bus->loop);
+    pthread_mutex_destroy(&bus->lock);
+  }
+  concentrator->buses_length = 0;
+  concentrator->radios_length = 0;
+  pthread_cond_destroy(&concentrator->rx_ready);
+  pthread_mutex_destroy(&concentrator->rx_lock);
+}
@@ -0,0 +1,255 @@
+// Copyright 2022 Andrey Rodionov <dernasherbrezon@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//         http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <string.h>
+#include <sx127x_linux_event.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+// the loop is single threaded, but several loops can run in parallel
+static __thread uint64_t sx127x_linux_event_timestamp_ns = 0;
+
+int sx127x_linux_event_create(sx127x_linux_event_t *loop) {
+  if (loop == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  memset(loop, 0, sizeof(sx127x_linux_event_t));
+  loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (loop->epoll_fd < 0) {
+    return errno;
+  }
+  return SX127X_OK;
+}
+
+int sx127x_linux_event_add_source(int fd, bool owned, const uint32_t *offsets, const sx127x_dio_t *dios, uint8_t lines_length, sx127x *device, sx127x_linux_event_t *loop) {
+  // all queued events are read until EAGAIN
+  int flags = fcntl(fd, F_GETFL);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    return errno;
+  }
+  sx127x_linux_event_source_t *source = loop->sources + loop->sources_length;
+  memset(source, 0, sizeof(sx127x_linux_event_source_t));
+  source->fd = fd;
+  source->owned = owned;
+  source->device = device;
+  // eventfd of TX queue has no lines
+  if (lines_length > 0) {
+    memcpy(source->offsets, offsets, sizeof(uint32_t) * lines_length);
+    memcpy(source->dios, dios, sizeof(sx127x_dio_t) * lines_length);
+  }
+  source->lines_length = lines_length;
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.u32 = loop->sources_length;
+  if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+    return errno;
+  }
+  loop->sources_length++;
+  return SX127X_OK;
+}
+
+int sx127x_linux_event_check(const uint32_t *offsets, const sx127x_dio_t *dios, uint8_t lines_length, sx127x *device, sx127x_linux_event_t *loop) {
+  if (offsets == NULL || dios == NULL || lines_length == 0 || lines_length > SX127X_LINUX_EVENT_MAX_LINES || device == NULL || loop == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  if (loop->sources_length >= CONFIG_SX127X_LINUX_EVENT_MAX_SOURCES) {
+    return SX127X_ERR_NO_MEM;
+  }
+  return SX127X_OK;
+}
+
+int sx127x_linux_event_add(const char *chip_path, const uint32_t *offsets, const sx127x_dio_t *dios, uint8_t lines_length, sx127x *device, sx127x_linux_event_t *loop) {
+  if (chip_path == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  int code = sx127x_linux_event_check(offsets, dios, lines_length, device, loop);
+  if (code != SX127X_OK) {
+    return code;
+  }
+  int chip_fd = open(chip_path, O_RDONLY | O_CLOEXEC);
+  if (chip_fd < 0) {
+    return errno;
+  }
+  struct gpio_v2_line_request rq;
+  memset(&rq, 0, sizeof(rq));
+  memcpy(rq.offsets, offsets, sizeof(uint32_t) * lines_length);
+  rq.num_lines = lines_length;
+  strncpy(rq.consumer, "sx127x", sizeof(rq.consumer) - 1);
+  rq.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+  code = ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &rq);
+  if (code < 0) {
+    code = errno;
+    close(chip_fd);
+    return code;
+  }
+  close(chip_fd);
+  code = sx127x_linux_event_add_source(rq.fd, true, offsets, dios, lines_length, device, loop);
+  if (code != SX127X_OK) {
+    close(rq.fd);
+  }
+  return code;
+}
+
+int sx127x_linux_event_add_fd(int fd, const uint32_t *offsets, const sx127x_dio_t *dios, uint8_t lines_length, sx127x *device, sx127x_linux_event_t *loop) {
+  if (fd < 0) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  int code = sx127x_linux_event_check(offsets, dios, lines_length, device, loop);
+  if (code != SX127X_OK) {
+    return code;
+  }
+  return sx127x_linux_event_add_source(fd, false, offsets, dios, lines_length, device, loop);
+}
+
+// called from producer threads
+void sx127x_linux_event_wake(void *context) {
+  sx127x_linux_event_source_t *source = (sx127x_linux_event_source_t *) context;
+  uint64_t value = 1;
+  // counter can't overflow with the bounded queue
+  if (write(source->fd, &value, sizeof(value)) < 0) {
+    return;
+  }
+}
+
+int sx127x_linux_event_add_tx_queue(sx127x_tx_queue_t *queue, sx127x *device, sx127x_linux_event_t *loop) {
+  if (queue == NULL || device == NULL || loop == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  if (loop->sources_length >= CONFIG_SX127X_LINUX_EVENT_MAX_SOURCES) {
+    return SX127X_ERR_NO_MEM;
+  }
+  int fd = eventfd(0, EFD_CLOEXEC);
+  if (fd < 0) {
+    return errno;
+  }
+  sx127x_linux_event_source_t *source = loop->sources + loop->sources_length;
+  int code = sx127x_linux_event_add_source(fd, true, NULL, NULL, 0, device, loop);
+  if (code != SX127X_OK) {
+    close(fd);
+    return code;
+  }
+  source->tx_queue = queue;
+  sx127x_set_tx_queue(queue, device);
+  sx127x_tx_queue_set_wake(sx127x_linux_event_wake, source, queue);
+  // frames could be submitted before the queue was added
+  sx127x_linux_event_wake(source);
+  return SX127X_OK;
+}
+
+int sx127x_linux_event_start_tx_queue(sx127x_linux_event_source_t *source) {
+  uint64_t value;
+  if (read(source->fd, &value, sizeof(value)) < 0) {
+    return (errno == EAGAIN || errno == EWOULDBLOCK ? SX127X_OK : errno);
+  }
+  int code = sx127x_tx_queue_start(source->device);
+  // frame was taken by the previous wake up or none of frames could be started. tx callback restores the radio then
+  return (code == SX127X_ERR_NOT_FOUND ? SX127X_OK : code);
+}
+
+void sx127x_linux_event_handle(const struct gpio_v2_line_event *event, sx127x_linux_event_source_t *source) {
+  // seqno is per line request and starts from 1
+  bool overflow = (source->seqno != 0 && event->seqno != source->seqno + 1);
+  source->seqno = event->seqno;
+  sx127x_linux_event_timestamp_ns = event->timestamp_ns;
+  if (overflow) {
+    // some edges were lost. current irq flags will tell what happened
+    source->overflows++;
+    sx127x_handle_interrupt(source->device);
+    return;
+  }
+  for (uint8_t i = 0; i < source->lines_length; i++) {
+    if (source->offsets[i] != event->offset) {
+      continue;
+    }
+    sx127x *device = source->device;
+    // in FSK/OOK TX FIFO level goes down when FIFO needs to be refilled
+    bool falling = (source->dios[i] == SX127x_DIO1 && device->active_modem != SX127x_MODULATION_LORA && device->opmod == SX127x_MODE_TX);
+    if ((event->id == GPIO_V2_LINE_EVENT_FALLING_EDGE) == falling) {
+      sx127x_handle_dio(source->dios[i], device);
+    }
+    return;
+  }
+}
+
+int sx127x_linux_event_read(sx127x_linux_event_source_t *source) {
+  struct gpio_v2_line_event events[SX127X_LINUX_EVENT_BATCH];
+  while (1) {
+    ssize_t length = read(source->fd, events, sizeof(events));
+    if (length < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return SX127X_OK;
+      }
+      return errno;
+    }
+    size_t events_length = (size_t) length / sizeof(struct gpio_v2_line_event);
+    for (size_t i = 0; i < events_length; i++) {
+      sx127x_linux_event_handle(events + i, source);
+    }
+    if (events_length < SX127X_LINUX_EVENT_BATCH) {
+      return SX127X_OK;
+    }
+  }
+}
+
+int sx127x_linux_event_poll(int timeout_ms, sx127x_linux_event_t *loop) {
+  if (loop == NULL) {
+    return SX127X_ERR_INVALID_ARG;
+  }
+  struct epoll_event events[CONFIG_SX127X_LINUX_EVENT_MAX_SOURCES];
+  int events_length = epoll_wait(loop->epoll_fd, events, CONFIG_SX127X_LINUX_EVENT_MAX_SOURCES, timeout_ms);
+  if (events_length < 0) {
+    return (errno == EINTR ? SX127X_OK : errno);
+  }
+  int result = SX127X_OK;
+  for (int i = 0; i < events_length; i++) {
+    sx127x_linux_event_source_t *source = loop->sources + events[i].data.u32;
+    // handle the rest of devices even if one failed
+    int code = (source->tx_queue != NULL ? sx127x_linux_event_start_tx_queue(source) : sx127x_linux_event_read(source));
+    if (code != SX127X_OK) {
+      result = code;
+    }
+  }
+  sx127x_linux_event_timestamp_ns = 0;
+  return result;
+}
+
+uint32_t sx127x_linux_event_clock(void) {
+  return (uint32_t) (sx127x_linux_event_timestamp_ns / 1000);
+}
+
+void sx127x_linux_event_destroy(sx127x_linux_event_t *loop) {
+  if (loop == NULL) {
+    return;
+  }
+  for (uint8_t i = 0; i < loop->sources_length; i++) {
+    // producers should not signal closed eventfd
+    if (loop->sources[i].tx_queue != NULL) {
+      sx127x_tx_queue_set_wake(NULL, NULL, loop->sources[i].tx_queue);
+    }
+    if (loop->sources[i].owned) {
+      close(loop->sources[i].fd);
+    }
+  }
+  loop->sources_length = 0;
+  if (loop->epoll_fd >= 0) {
+    close(loop->epoll_fd);
+    loop->epoll_fd = -1;
+  }
+}
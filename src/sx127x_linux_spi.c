@@ -17,7 +17,6 @@
 #include <string.h>
 #include <sx127x_spi.h>
 #include <sys/ioctl.h>
-#include <stdlib.h>
 
 int sx127x_spi_read_registers(int reg, void *spi_device, size_t data_length, uint32_t *result) {
   if (data_length == 0 || data_length > 4) {
@@ -45,24 +44,19 @@ int sx127x_spi_read_buffer(int reg, uint8_t *buffer, size_t buffer_length, void
   if (buffer_length < 1) {
     return 0;
   }
-  uint8_t *tmp = malloc(buffer_length + 1);
-  if (tmp == NULL) {
-    return ENOMEM;
-  }
-  struct spi_ioc_transfer tr;
-  memset(&tr, 0, sizeof(tr));
-  uint64_t tx_buf = ((uint8_t) reg & 0x7F);
-  tr.tx_buf = (__u64) &tx_buf;
-  tr.rx_buf = (__u64) tmp;
-  tr.len = buffer_length + 1;
-  int code = ioctl(*(int *) spi_device, SPI_IOC_MESSAGE(1), &tr);
+  // address byte and payload are sent as 2 transfers within the same message
+  // so chip select stays asserted and payload goes directly into the buffer
+  struct spi_ioc_transfer tr[2];
+  memset(tr, 0, sizeof(tr));
+  uint8_t address = ((uint8_t) reg & 0x7F);
+  tr[0].tx_buf = (__u64) &address;
+  tr[0].len = 1;
+  tr[1].rx_buf = (__u64) buffer;
+  tr[1].len = buffer_length;
+  int code = ioctl(*(int *) spi_device, SPI_IOC_MESSAGE(2), tr);
   if (code == -1) {
-    free(tmp);
     return errno;
   }
-  // shift 1 byte to the right
-  memcpy(buffer, tmp + 1, buffer_length);
-  free(tmp);
   return 0;
 }
 
@@ -85,18 +79,46 @@ int sx127x_spi_write_register(int reg, const uint8_t *data, size_t data_length,
 }
 
 int sx127x_spi_write_buffer(int reg, const uint8_t *buffer, size_t buffer_length, void *spi_device) {
-  uint8_t *tmp = malloc(buffer_length + 1);
-  if (tmp == NULL) {
-    return ENOMEM;
+  struct spi_ioc_transfer tr[2];
+  memset(tr, 0, sizeof(tr));
+  uint8_t address = reg | 0x80;
+  tr[0].tx_buf = (__u64) &address;
+  tr[0].len = 1;
+  tr[1].tx_buf = (__u64) buffer;
+  tr[1].len = buffer_length;
+  int code = ioctl(*(int *) spi_device, SPI_IOC_MESSAGE(2), tr);
+  if (code == -1) {
+    return errno;
   }
-  tmp[0] = reg | 0x80;
-  memcpy(tmp + 1, buffer, buffer_length);
-  struct spi_ioc_transfer tr;
-  memset(&tr, 0, sizeof(tr));
-  tr.tx_buf = (__u64) tmp;
-  tr.len = buffer_length + 1;
-  int code = ioctl(*(int *) spi_device, SPI_IOC_MESSAGE(1), &tr);
-  free(tmp);
+  return 0;
+}
+
+int sx127x_spi_transfer(sx127x_spi_segment_t *segments, size_t segments_length, void *spi_device) {
+  if (segments_length == 0 || segments_length > SX127X_SPI_MAX_SEGMENTS) {
+    return -1;
+  }
+  // every segment is address + data transfers. cs_change on the data transfer
+  // releases chip select before the next segment
+  struct spi_ioc_transfer tr[SX127X_SPI_MAX_SEGMENTS * 2];
+  uint8_t addresses[SX127X_SPI_MAX_SEGMENTS];
+  memset(tr, 0, sizeof(struct spi_ioc_transfer) * segments_length * 2);
+  for (size_t i = 0; i < segments_length; i++) {
+    struct spi_ioc_transfer *address = &tr[i * 2];
+    struct spi_ioc_transfer *data = &tr[i * 2 + 1];
+    if (segments[i].tx_buffer != NULL) {
+      addresses[i] = segments[i].reg | 0x80;
+      data->tx_buf = (__u64) segments[i].tx_buffer;
+    } else {
+      addresses[i] = ((uint8_t) segments[i].reg & 0x7F);
+      data->rx_buf = (__u64) segments[i].rx_buffer;
+    }
+    address->tx_buf = (__u64) &addresses[i];
+    address->len = 1;
+    data->len = segments[i].length;
+    // cs_change on the last transfer has different meaning: keep chip select asserted
+    data->cs_change = (i + 1 < segments_length);
+  }
+  int code = ioctl(*(int *) spi_device, SPI_IOC_MESSAGE(segments_length * 2), tr);
   if (code == -1) {
     return errno;
   }
@@ -0,0 +1,34 @@
+// Copyright 2022 Andrey Rodionov <dernasherbrezon@gmail.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//         http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef sx127x_private_h
+#define sx127x_private_h
+
+#include <sx127x.h>
+
+// Not part of the public API. Shared with profile_generator which configures the in-memory chip using the library
+
+// registers which are not part of the configuration
+#define REG_FIFO 0x00
+#define REG_OP_MODE 0x01
+
+// return error code of the library function to the caller
+#define ERROR_CHECK(x)           \
+  do {                           \
+    int __err_rc = (x);          \
+    if (__err_rc != SX127X_OK) { \
+      return __err_rc;           \
+    }                            \
+  } while (0)
+
+#endif
@@ -0,0 +1,132 @@
+// Host benchmark for the Linux concentrator.
+//
+// Radios are simulated in memory (see sx127x_sim_spi.c) and raise DIO0 through pipes, so the
+// numbers show how many packets bus threads can read and queue when SPI and GPIO cost nothing.
+// Radio accepts the next packet only after the previous one was read.
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sx127x_linux_concentrator.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sx127x_sim_spi.h"
+
+#define PACKETS 200000
+#define PACKET_LENGTH 64
+#define DIO0_OFFSET 17
+
+typedef struct {
+  sx127x_sim_radio_t *sims;
+  int radios;
+  volatile int stop;
+} producer_t;
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void *produce(void *arg) {
+  producer_t *producer = (producer_t *) arg;
+  uint8_t payload[PACKET_LENGTH];
+  memset(payload, 0x5a, sizeof(payload));
+  while (!producer->stop) {
+    for (int i = 0; i < producer->radios; i++) {
+      sx127x_sim_radio_receive(payload, sizeof(payload), producer->sims + i);
+    }
+  }
+  return NULL;
+}
+
+static int run(int radios, int buses) {
+  uint64_t frequencies[] = {868100000, 868300000, 868500000, 867100000, 867300000, 867500000, 867700000, 867900000};
+  sx127x_channel_t channels[sizeof(frequencies) / sizeof(frequencies[0])];
+  sx127x_channel_plan_t plan;
+  sx127x_linux_concentrator_t *concentrator = malloc(sizeof(sx127x_linux_concentrator_t));
+  sx127x_sim_radio_t *sims = malloc(sizeof(sx127x_sim_radio_t) * radios);
+  int(*pipes)[2] = malloc(sizeof(int[2]) * radios);
+  if (concentrator == NULL || sims == NULL || pipes == NULL) {
+    return EXIT_FAILURE;
+  }
+  if (sx127x_channel_plan_init(frequencies, channels, sizeof(channels) / sizeof(channels[0]), &plan) != SX127X_OK || sx127x_linux_concentrator_create(&plan, concentrator) != SX127X_OK) {
+    return EXIT_FAILURE;
+  }
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  for (int i = 0; i < buses; i++) {
+    uint8_t bus;
+    // one core per bus if possible
+    if (sx127x_linux_concentrator_add_bus(cpus > buses ? i + 1 : -1, &bus, concentrator) != SX127X_OK) {
+      return EXIT_FAILURE;
+    }
+  }
+  uint32_t offsets[] = {DIO0_OFFSET};
+  sx127x_dio_t dios[] = {SX127x_DIO0};
+  for (int i = 0; i < radios; i++) {
+    uint8_t radio;
+    if (pipe(pipes[i]) != 0 || sx127x_sim_radio_init(pipes[i][1], DIO0_OFFSET, sims + i) != 0) {
+      return EXIT_FAILURE;
+    }
+    if (sx127x_linux_concentrator_add_radio(i % buses, sims + i, i % plan.channels_length, &radio, concentrator) != SX127X_OK || sx127x_linux_concentrator_add_fd(radio, pipes[i][0], offsets, dios, 1, concentrator) != SX127X_OK) {
+      return EXIT_FAILURE;
+    }
+    sx127x *device = &concentrator->radios[radio].device;
+    if (sx127x_set_opmod(SX127x_MODE_SLEEP, SX127x_MODULATION_LORA, device) != SX127X_OK || sx127x_lora_set_bandwidth(SX127x_BW_125000, device) != SX127X_OK) {
+      return EXIT_FAILURE;
+    }
+    sims[i].transactions = 0;
+  }
+  if (sx127x_linux_concentrator_start(concentrator) != SX127X_OK) {
+    return EXIT_FAILURE;
+  }
+
+  producer_t producer = {.sims = sims, .radios = radios, .stop = 0};
+  pthread_t thread;
+  uint64_t start = now_ns();
+  pthread_create(&thread, NULL, produce, &producer);
+  sx127x_linux_concentrator_packet_t packet;
+  uint64_t latency_us = 0;
+  int received = 0;
+  while (received < PACKETS && sx127x_linux_concentrator_rx(1000, &packet, concentrator) == SX127X_OK) {
+    // from the interrupt to the consumer
+    latency_us += (uint32_t) (now_ns() / 1000) - packet.meta.timestamp;
+    received++;
+  }
+  uint64_t elapsed = now_ns() - start;
+  producer.stop = 1;
+  pthread_join(thread, NULL);
+  sx127x_linux_concentrator_stop(concentrator);
+
+  uint64_t transactions = 0;
+  for (int i = 0; i < radios; i++) {
+    transactions += sims[i].transactions;
+  }
+  uint32_t queued;
+  uint32_t dropped;
+  sx127x_linux_concentrator_get_counters(concentrator, &queued, &dropped);
+  fprintf(stdout, "%2d radios %d buses: %9.0f packets/s %6.1f us latency %4.2f transactions/packet %" PRIu32 " dropped\n", radios, buses, (double) received * 1000000000 / elapsed, (double) latency_us / (received > 0 ? received : 1), (double) transactions / (queued + dropped), dropped);
+
+  sx127x_linux_concentrator_destroy(concentrator);
+  for (int i = 0; i < radios; i++) {
+    sx127x_sim_radio_destroy(sims + i);
+    close(pipes[i][0]);
+    close(pipes[i][1]);
+  }
+  free(pipes);
+  free(sims);
+  free(concentrator);
+  return (received == PACKETS ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+int main(void) {
+  int configs[][2] = {{1, 1}, {4, 1}, {8, 1}, {8, 2}, {16, 2}, {16, 4}};
+  for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+    if (run(configs[i][0], configs[i][1]) != EXIT_SUCCESS) {
+      fprintf(stderr, "%d radios %d buses failed\n", configs[i][0], configs[i][1]);
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+// Host benchmark for FHSS channel hop handling.
+//
+// SPI is served by the mock, so the numbers show CPU time spent in the driver between
+// FHSS_CHANGE_CHANNEL interrupt and the new frequency written to the bus.
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sx127x.h>
+#include <time.h>
+
+#include "sx127x_mock_spi.h"
+
+#define ITERATIONS 1000000
+
+// mock depends on unity
+void setUp() {
+}
+
+void tearDown() {
+}
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int main(void) {
+  uint8_t registers[256];
+  memset(registers, 0, sizeof(registers));
+  registers[0x42] = 0x12;
+  spi_mock_registers(registers, SX127X_OK);
+  sx127x *device = malloc(sizeof(sx127x));
+  if (device == NULL || sx127x_create(NULL, device) != SX127X_OK) {
+    fprintf(stderr, "unable to create device\n");
+    return EXIT_FAILURE;
+  }
+  uint64_t frequencies[] = {868900000, 863125000, 865100000, 864500000, 863625000, 867100000, 867500000, 864100000};
+  if (sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_LORA, device) != SX127X_OK || sx127x_lora_set_frequency_hopping(5, frequencies, sizeof(frequencies) / sizeof(uint64_t), device) != SX127X_OK) {
+    fprintf(stderr, "unable to configure FHSS\n");
+    return EXIT_FAILURE;
+  }
+
+  // frequency calculated on every hop
+  spi_mock_transactions();
+  uint64_t start = now_ns();
+  for (int i = 0; i < ITERATIONS; i++) {
+    sx127x_set_frequency(frequencies[i % (sizeof(frequencies) / sizeof(uint64_t))], device);
+  }
+  uint64_t elapsed = now_ns() - start;
+  fprintf(stdout, "%-20s %8.1f ns/hop %4.2f transactions/hop\n", "sx127x_set_frequency", (double) elapsed / ITERATIONS, (double) spi_mock_transactions() / ITERATIONS);
+
+  // full interrupt: status, irq clear and precalculated frequency
+  start = now_ns();
+  for (int i = 0; i < ITERATIONS; i++) {
+    registers[0x12] = 0b00000010;  // fhss change channel
+    sx127x_handle_interrupt(device);
+  }
+  elapsed = now_ns() - start;
+  fprintf(stdout, "%-20s %8.1f ns/hop %4.2f transactions/hop\n", "interrupt", (double) elapsed / ITERATIONS, (double) spi_mock_transactions() / ITERATIONS);
+  free(device);
+  return EXIT_SUCCESS;
+}
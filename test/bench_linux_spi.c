@@ -0,0 +1,86 @@
+// Host benchmark for the Linux spidev backend.
+//
+// ioctl, malloc and free are wrapped at link time (-Wl,--wrap) so the backend
+// can run without /dev/spidev: every SPI_IOC_MESSAGE is emulated in memory and
+// every heap allocation made by the backend is counted.
+#include <inttypes.h>
+#include <linux/spi/spidev.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sx127x_spi.h>
+#include <time.h>
+
+#define ITERATIONS 100000
+
+static uint64_t allocations = 0;
+static uint64_t messages = 0;
+static uint64_t transfers = 0;
+
+void *__real_malloc(size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size) {
+  allocations++;
+  return __real_malloc(size);
+}
+
+void __wrap_free(void *ptr) {
+  __real_free(ptr);
+}
+
+int __wrap_ioctl(int fd, unsigned long request, ...) {
+  va_list args;
+  va_start(args, request);
+  struct spi_ioc_transfer *tr = va_arg(args, struct spi_ioc_transfer *);
+  va_end(args);
+  size_t count = _IOC_SIZE(request) / sizeof(struct spi_ioc_transfer);
+  messages++;
+  for (size_t i = 0; i < count; i++) {
+    transfers++;
+    if (tr[i].rx_buf != 0) {
+      memset((void *) (uintptr_t) tr[i].rx_buf, 0x5a, tr[i].len);
+    }
+  }
+  return 0;
+}
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void run(const char *name, int write, size_t length) {
+  int fd = 0;
+  uint8_t buffer[2048];
+  memset(buffer, 0xa5, sizeof(buffer));
+  allocations = 0;
+  messages = 0;
+  transfers = 0;
+  uint64_t start = now_ns();
+  for (int i = 0; i < ITERATIONS; i++) {
+    int code;
+    if (write) {
+      code = sx127x_spi_write_buffer(0x00, buffer, length, &fd);
+    } else {
+      code = sx127x_spi_read_buffer(0x00, buffer, length, &fd);
+    }
+    if (code != 0) {
+      fprintf(stderr, "%s failed: %d\n", name, code);
+      exit(EXIT_FAILURE);
+    }
+  }
+  uint64_t elapsed = now_ns() - start;
+  fprintf(stdout, "%-16s %5zu bytes: %8.1f ns/packet %6.2f allocations/packet %4.2f transfers/packet\n", name, length, (double) elapsed / ITERATIONS, (double) allocations / ITERATIONS, (double) transfers / messages);
+}
+
+int main(void) {
+  size_t lengths[] = {16, 64, 255, 2047};
+  for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+    run("fifo read", 0, lengths[i]);
+    run("fifo write", 1, lengths[i]);
+  }
+  return EXIT_SUCCESS;
+}
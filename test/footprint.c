@@ -0,0 +1,19 @@
+// Memory footprint of the device handle. Compiled with and without CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+#include <stdio.h>
+#include <stdlib.h>
+#include <sx127x.h>
+
+#define RADIOS 16
+#define POOL_BLOCKS 4
+
+int main(void) {
+  fprintf(stdout, "shadow_spi_device_t: %zu bytes\n", sizeof(shadow_spi_device_t));
+  fprintf(stdout, "sx127x: %zu bytes\n", sizeof(sx127x));
+#ifdef CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+  size_t pool = POOL_BLOCKS * MAX_PACKET_SIZE;
+  fprintf(stdout, "%d radios + pool of %d x %d bytes: %zu bytes\n", RADIOS, POOL_BLOCKS, MAX_PACKET_SIZE, RADIOS * sizeof(sx127x) + pool);
+#else
+  fprintf(stdout, "%d radios: %zu bytes\n", RADIOS, RADIOS * sizeof(sx127x));
+#endif
+  return EXIT_SUCCESS;
+}
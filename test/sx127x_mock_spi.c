@@ -10,10 +10,24 @@ int sx127x_mock_expected_code = 0;
 uint8_t actual_request[4096];
 size_t sx127x_mock_actual_request_length = 0;
 int sx127x_mock_expected_write_code = 0;
+int sx127x_mock_write_failure = 0;
 
 uint8_t *sx127x_mock_registers;
 
-int sx127x_spi_read_registers(int reg, void *spi_device, size_t data_length, uint32_t *result) {
+size_t sx127x_mock_register_writes[256];
+size_t sx127x_mock_transactions = 0;
+size_t sx127x_mock_read_transactions = 0;
+
+static int mock_write_code() {
+  if (sx127x_mock_write_failure != 0) {
+    int result = sx127x_mock_write_failure;
+    sx127x_mock_write_failure = 0;
+    return result;
+  }
+  return sx127x_mock_expected_write_code;
+}
+
+static void mock_read_registers(int reg, size_t data_length, uint32_t *result) {
   *result = 0;
   if (reg == 0) {
     for (int i = 0; i < data_length; i++) {
@@ -30,37 +44,84 @@ int sx127x_spi_read_registers(int reg, void *spi_device, size_t data_length, uin
       *result = (*result) + sx127x_mock_registers[reg + i];
     }
   }
-  return sx127x_mock_expected_code;
 }
 
-int sx127x_spi_read_buffer(int reg, uint8_t *buffer, size_t buffer_length, void *spi_device) {
+static void mock_read_buffer(int reg, uint8_t *buffer, size_t buffer_length) {
+  // not fifo
+  if (reg != 0) {
+    memcpy(buffer, sx127x_mock_registers + reg, buffer_length);
+    return;
+  }
   TEST_ASSERT_EQUAL_INT(sx127x_mock_expected_response_current + buffer_length <= sx127x_mock_expected_response_length, 1);
   memcpy(buffer, sx127x_mock_expected_response + sx127x_mock_expected_response_current, buffer_length);
   sx127x_mock_expected_response_current += buffer_length;
   if (sx127x_mock_expected_response_current == sx127x_mock_expected_response_length) {
     sx127x_mock_registers[0x3f] = 0b01000000;  // fifo empty
   }
-  return sx127x_mock_expected_code;
 }
 
-int sx127x_spi_write_register(int reg, const uint8_t *data, size_t data_length, void *spi_device) {
+static void mock_write(int reg, const uint8_t *data, size_t data_length) {
   if (reg == 0) {
-    return sx127x_spi_write_buffer(reg, data, data_length, spi_device);
+    memcpy(actual_request + sx127x_mock_actual_request_length, data, data_length);
+    sx127x_mock_actual_request_length += data_length;
+    return;
   }
   for (size_t i = 0; i < data_length; i++) {
     sx127x_mock_registers[reg + i] = data[i];
+    sx127x_mock_register_writes[reg + i]++;
   }
-  return sx127x_mock_expected_write_code;
+}
+
+int sx127x_spi_read_registers(int reg, void *spi_device, size_t data_length, uint32_t *result) {
+  sx127x_mock_transactions++;
+  sx127x_mock_read_transactions++;
+  mock_read_registers(reg, data_length, result);
+  return sx127x_mock_expected_code;
+}
+
+int sx127x_spi_read_buffer(int reg, uint8_t *buffer, size_t buffer_length, void *spi_device) {
+  sx127x_mock_transactions++;
+  sx127x_mock_read_transactions++;
+  mock_read_buffer(reg, buffer, buffer_length);
+  return sx127x_mock_expected_code;
+}
+
+int sx127x_spi_write_register(int reg, const uint8_t *data, size_t data_length, void *spi_device) {
+  sx127x_mock_transactions++;
+  mock_write(reg, data, data_length);
+  return mock_write_code();
 }
 
 int sx127x_spi_write_buffer(int reg, const uint8_t *buffer, size_t buffer_length, void *spi_device) {
-  // not fifo
-  if (reg != 0) {
-    return sx127x_spi_write_register(reg, buffer, buffer_length, spi_device);
+  sx127x_mock_transactions++;
+  mock_write(reg, buffer, buffer_length);
+  return mock_write_code();
+}
+
+int sx127x_spi_transfer(sx127x_spi_segment_t *segments, size_t segments_length, void *spi_device) {
+  TEST_ASSERT_TRUE(segments_length <= SX127X_SPI_MAX_SEGMENTS);
+  sx127x_mock_transactions++;
+  for (size_t i = 0; i < segments_length; i++) {
+    if (segments[i].rx_buffer != NULL) {
+      sx127x_mock_read_transactions++;
+      break;
+    }
   }
-  memcpy(actual_request + sx127x_mock_actual_request_length, buffer, buffer_length);
-  sx127x_mock_actual_request_length += buffer_length;
-  return sx127x_mock_expected_write_code;
+  for (size_t i = 0; i < segments_length; i++) {
+    if (segments[i].tx_buffer != NULL) {
+      mock_write(segments[i].reg, segments[i].tx_buffer, segments[i].length);
+      int code = mock_write_code();
+      if (code != 0) {
+        return code;
+      }
+    } else {
+      mock_read_buffer(segments[i].reg, segments[i].rx_buffer, segments[i].length);
+      if (sx127x_mock_expected_code != 0) {
+        return sx127x_mock_expected_code;
+      }
+    }
+  }
+  return 0;
 }
 
 void spi_mock_registers(uint8_t *expected, int code) {
@@ -82,7 +143,35 @@ void spi_assert_write(uint8_t *expected, size_t expected_length) {
   }
 }
 
+const uint8_t *spi_mock_written(size_t *length) {
+  *length = sx127x_mock_actual_request_length;
+  return actual_request;
+}
+
 void spi_mock_write(int code) {
   sx127x_mock_expected_write_code = code;
+  sx127x_mock_write_failure = 0;
   sx127x_mock_actual_request_length = 0;
 }
+
+void spi_mock_write_failure(int code) {
+  sx127x_mock_write_failure = code;
+}
+
+size_t spi_mock_transactions() {
+  size_t result = sx127x_mock_transactions;
+  sx127x_mock_transactions = 0;
+  return result;
+}
+
+size_t spi_mock_read_transactions() {
+  size_t result = sx127x_mock_read_transactions;
+  sx127x_mock_read_transactions = 0;
+  return result;
+}
+
+size_t spi_mock_register_writes(int reg) {
+  size_t result = sx127x_mock_register_writes[reg];
+  sx127x_mock_register_writes[reg] = 0;
+  return result;
+}
@@ -10,6 +10,20 @@ void spi_mock_fifo(uint8_t *expected, size_t expected_length, int code);
 
 void spi_mock_write(int code);
 
+// only the next write fails
+void spi_mock_write_failure(int code);
+
 void spi_assert_write(uint8_t *expected, size_t expected_length);
 
+// data written into FIFO since the last spi_mock_write
+const uint8_t *spi_mock_written(size_t *length);
+
+// vectored transfer counts as a single transaction
+size_t spi_mock_transactions();
+
+size_t spi_mock_read_transactions();
+
+// writes into the register since the last call
+size_t spi_mock_register_writes(int reg);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,196 @@
+#include "sx127x_sim_spi.h"
+
+#include <linux/gpio.h>
+#include <string.h>
+#include <sx127x_spi.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SIM_REG_FIFO 0x00
+#define SIM_REG_OP_MODE 0x01
+#define SIM_REG_FIFO_ADDR_PTR 0x0d
+#define SIM_REG_FIFO_RX_CURRENT_ADDR 0x10
+#define SIM_REG_IRQ_FLAGS 0x12
+#define SIM_REG_RX_NB_BYTES 0x13
+#define SIM_REG_MODEM_STAT 0x18
+#define SIM_REG_VERSION 0x42
+
+#define SIM_LONG_RANGE 0x80
+#define SIM_MODE_MASK 0x07
+#define SIM_MODE_STANDBY 0x01
+#define SIM_MODE_TX 0x03
+#define SIM_MODE_RX_CONT 0x05
+#define SIM_IRQ_RX_DONE 0x40
+#define SIM_IRQ_TX_DONE 0x08
+#define SIM_MODEM_STAT_RECEIVING 0x0f
+#define SIM_MODEM_STAT_CLEAR 0x10
+
+static void sim_emit(uint32_t offset, uint32_t id, sx127x_sim_radio_t *radio) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  struct gpio_v2_line_event event;
+  memset(&event, 0, sizeof(event));
+  event.timestamp_ns = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+  event.id = id;
+  event.offset = offset;
+  event.seqno = ++radio->seqno;
+  event.line_seqno = event.seqno;
+  if (write(radio->fd, &event, sizeof(event)) != sizeof(event)) {
+    radio->seqno--;
+  }
+}
+
+static void sim_emit_dio0(sx127x_sim_radio_t *radio) {
+  sim_emit(radio->dio0, GPIO_V2_LINE_EVENT_RISING_EDGE, radio);
+}
+
+// called while radio lock is held
+static int sim_write_failed(sx127x_sim_radio_t *radio) {
+  if (radio->write_failures == 0) {
+    return 0;
+  }
+  radio->write_failures--;
+  return 1;
+}
+
+static void sim_read(int reg, uint8_t *buffer, size_t length, sx127x_sim_radio_t *radio) {
+  for (size_t i = 0; i < length; i++) {
+    if (reg == SIM_REG_FIFO) {
+      buffer[i] = radio->fifo[radio->registers[SIM_REG_FIFO_ADDR_PTR]++];
+    } else {
+      buffer[i] = radio->registers[(reg + i) & 0xff];
+    }
+  }
+}
+
+static void sim_write(int reg, const uint8_t *buffer, size_t length, sx127x_sim_radio_t *radio) {
+  for (size_t i = 0; i < length; i++) {
+    if (reg == SIM_REG_FIFO) {
+      radio->fifo[radio->registers[SIM_REG_FIFO_ADDR_PTR]++] = buffer[i];
+      continue;
+    }
+    int current = (reg + i) & 0xff;
+    if (current == SIM_REG_IRQ_FLAGS) {
+      radio->registers[current] &= ~buffer[i];
+    } else {
+      radio->registers[current] = buffer[i];
+    }
+    // any other mode aborts the reception
+    if (current == SIM_REG_OP_MODE && (buffer[i] & SIM_MODE_MASK) != SIM_MODE_RX_CONT) {
+      radio->registers[SIM_REG_MODEM_STAT] = SIM_MODEM_STAT_CLEAR;
+    }
+    // packet is sent immediately and radio goes back to standby
+    if (current == SIM_REG_OP_MODE && (buffer[i] & SIM_LONG_RANGE) != 0 && (buffer[i] & SIM_MODE_MASK) == SIM_MODE_TX) {
+      radio->registers[current] = (buffer[i] & ~SIM_MODE_MASK) | SIM_MODE_STANDBY;
+      radio->registers[SIM_REG_IRQ_FLAGS] |= SIM_IRQ_TX_DONE;
+      sim_emit_dio0(radio);
+    }
+  }
+}
+
+int sx127x_sim_radio_init(int fd, uint32_t dio0, sx127x_sim_radio_t *radio) {
+  memset(radio, 0, sizeof(sx127x_sim_radio_t));
+  radio->registers[SIM_REG_VERSION] = 0x12;
+  radio->fd = fd;
+  radio->dio0 = dio0;
+  return pthread_mutex_init(&radio->lock, NULL);
+}
+
+int sx127x_sim_radio_receive(const uint8_t *data, uint8_t data_length, sx127x_sim_radio_t *radio) {
+  pthread_mutex_lock(&radio->lock);
+  uint8_t op_mode = radio->registers[SIM_REG_OP_MODE];
+  if ((op_mode & SIM_LONG_RANGE) == 0 || (op_mode & SIM_MODE_MASK) != SIM_MODE_RX_CONT || (radio->registers[SIM_REG_IRQ_FLAGS] & SIM_IRQ_RX_DONE) != 0) {
+    pthread_mutex_unlock(&radio->lock);
+    return -1;
+  }
+  memcpy(radio->fifo, data, data_length);
+  radio->registers[SIM_REG_FIFO_RX_CURRENT_ADDR] = 0;
+  radio->registers[SIM_REG_RX_NB_BYTES] = data_length;
+  radio->registers[SIM_REG_IRQ_FLAGS] |= SIM_IRQ_RX_DONE;
+  sim_emit_dio0(radio);
+  pthread_mutex_unlock(&radio->lock);
+  return 0;
+}
+
+void sx127x_sim_radio_set_receiving(int receiving, sx127x_sim_radio_t *radio) {
+  pthread_mutex_lock(&radio->lock);
+  radio->registers[SIM_REG_MODEM_STAT] = (receiving ? SIM_MODEM_STAT_RECEIVING : SIM_MODEM_STAT_CLEAR);
+  pthread_mutex_unlock(&radio->lock);
+}
+
+void sx127x_sim_radio_emit(uint32_t offset, uint32_t id, sx127x_sim_radio_t *radio) {
+  pthread_mutex_lock(&radio->lock);
+  sim_emit(offset, id, radio);
+  pthread_mutex_unlock(&radio->lock);
+}
+
+void sx127x_sim_radio_fail_write(sx127x_sim_radio_t *radio) {
+  pthread_mutex_lock(&radio->lock);
+  radio->write_failures++;
+  pthread_mutex_unlock(&radio->lock);
+}
+
+void sx127x_sim_radio_destroy(sx127x_sim_radio_t *radio) {
+  pthread_mutex_destroy(&radio->lock);
+}
+
+int sx127x_spi_read_registers(int reg, void *spi_device, size_t data_length, uint32_t *result) {
+  sx127x_sim_radio_t *radio = (sx127x_sim_radio_t *) spi_device;
+  uint8_t buffer[4];
+  pthread_mutex_lock(&radio->lock);
+  radio->transactions++;
+  sim_read(reg, buffer, data_length, radio);
+  pthread_mutex_unlock(&radio->lock);
+  *result = 0;
+  for (size_t i = 0; i < data_length; i++) {
+    *result = (*result << 8) | buffer[i];
+  }
+  return 0;
+}
+
+int sx127x_spi_read_buffer(int reg, uint8_t *buffer, size_t buffer_length, void *spi_device) {
+  sx127x_sim_radio_t *radio = (sx127x_sim_radio_t *) spi_device;
+  pthread_mutex_lock(&radio->lock);
+  radio->transactions++;
+  sim_read(reg, buffer, buffer_length, radio);
+  pthread_mutex_unlock(&radio->lock);
+  return 0;
+}
+
+int sx127x_spi_write_register(int reg, const uint8_t *data, size_t data_length, void *spi_device) {
+  sx127x_sim_radio_t *radio = (sx127x_sim_radio_t *) spi_device;
+  pthread_mutex_lock(&radio->lock);
+  radio->transactions++;
+  if (sim_write_failed(radio)) {
+    pthread_mutex_unlock(&radio->lock);
+    return -1;
+  }
+  sim_write(reg, data, data_length, radio);
+  pthread_mutex_unlock(&radio->lock);
+  return 0;
+}
+
+int sx127x_spi_write_buffer(int reg, const uint8_t *buffer, size_t buffer_length, void *spi_device) {
+  return sx127x_spi_write_register(reg, buffer, buffer_length, spi_device);
+}
+
+int sx127x_spi_transfer(sx127x_spi_segment_t *segments, size_t segments_length, void *spi_device) {
+  sx127x_sim_radio_t *radio = (sx127x_sim_radio_t *) spi_device;
+  pthread_mutex_lock(&radio->lock);
+  radio->transactions++;
+  for (size_t i = 0; i < segments_length; i++) {
+    if (segments[i].tx_buffer != NULL && sim_write_failed(radio)) {
+      pthread_mutex_unlock(&radio->lock);
+      return -1;
+    }
+  }
+  for (size_t i = 0; i < segments_length; i++) {
+    if (segments[i].tx_buffer != NULL) {
+      sim_write(segments[i].reg, segments[i].tx_buffer, segments[i].length, radio);
+    } else {
+      sim_read(segments[i].reg, segments[i].rx_buffer, segments[i].length, radio);
+    }
+  }
+  pthread_mutex_unlock(&radio->lock);
+  return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef sx127x_sim_spi_h
+#define sx127x_sim_spi_h
+
+#include <pthread.h>
+#include <stdint.h>
+
+// Simulated LoRa radio for host tests and benchmarks. Used as spi_device.
+// FIFO, write-1-to-clear irq flags and TX are emulated. DIO0 events are written
+// into fd as struct gpio_v2_line_event, so it can be read by sx127x_linux_event
+typedef struct {
+  pthread_mutex_t lock;
+  uint8_t registers[256];
+  uint8_t fifo[256];
+  int fd;            // write end of the pipe
+  uint32_t dio0;     // line offset of DIO0
+  uint32_t seqno;
+  uint64_t transactions;
+  int write_failures;  // number of the next write transactions which fail
+} sx127x_sim_radio_t;
+
+int sx127x_sim_radio_init(int fd, uint32_t dio0, sx127x_sim_radio_t *radio);
+
+// put the packet into FIFO and raise RX_DONE. returns -1 if radio is not in RX or previous packet was not handled yet
+int sx127x_sim_radio_receive(const uint8_t *data, uint8_t data_length, sx127x_sim_radio_t *radio);
+
+// header of the packet was detected. TX or standby aborts the reception
+void sx127x_sim_radio_set_receiving(int receiving, sx127x_sim_radio_t *radio);
+
+// write gpio event for the line. for example, DIO1 in FSK/OOK mode
+void sx127x_sim_radio_emit(uint32_t offset, uint32_t id, sx127x_sim_radio_t *radio);
+
+// next write transaction returns error
+void sx127x_sim_radio_fail_write(sx127x_sim_radio_t *radio);
+
+void sx127x_sim_radio_destroy(sx127x_sim_radio_t *radio);
+
+#endif
@@ -23,9 +23,14 @@ void IRAM_ATTR handle_interrupt_fromisr(void *arg) {
 }
 
 void handle_interrupt_task(void *arg) {
+  sx127x *device = (sx127x *) arg;
   while (1) {
     vTaskSuspend(NULL);
-    sx127x_handle_interrupt((sx127x *) arg);
+    // run both stages on the real chip. examples use sx127x_handle_interrupt
+    uint32_t event;
+    if (sx127x_irq_capture(device, &event) == SX127X_OK) {
+      sx127x_irq_process(event, device);
+    }
   }
 }
 
@@ -5,12 +5,22 @@
 
 #include "sx127x_mock_spi.h"
 
+#ifdef CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 sx127x *device = NULL;
 int transmitted = 0;
 int cad_status = 0;
 uint8_t *registers = NULL;
 uint8_t registers_length = 255;
 
+#ifdef CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+uint8_t pool_memory[MAX_PACKET_SIZE_FSK_FIXED];
+sx127x_packet_pool_t pool;
+#endif
+
 uint8_t *rx_callback_data = NULL;
 uint16_t rx_callback_data_length = 0;
 
@@ -23,6 +33,32 @@ void rx_callback(sx127x *local_device, uint8_t *data, uint16_t data_length) {
   rx_callback_data_length = data_length;
 }
 
+uint8_t rx_chunks_data[2048];
+uint16_t rx_chunks_data_length = 0;
+int rx_chunks = 0;
+sx127x_rx_chunk_status_t rx_chunk_status = SX127X_RX_CHUNK_PARTIAL;
+
+void rx_chunk_callback(sx127x *local_device, uint8_t *data, uint16_t data_length, sx127x_rx_chunk_status_t status) {
+  TEST_ASSERT_EQUAL_INT(SX127X_RX_CHUNK_PARTIAL, rx_chunk_status);
+  memcpy(rx_chunks_data + rx_chunks_data_length, data, data_length);
+  rx_chunks_data_length += data_length;
+  rx_chunks++;
+  rx_chunk_status = status;
+}
+
+sx127x_packet_meta_t rx_meta;
+int rx_meta_spi_transactions = 0;
+
+void rx_meta_callback(sx127x *local_device, uint8_t *data, uint16_t data_length, const sx127x_packet_meta_t *meta) {
+  rx_callback(local_device, data, data_length);
+  rx_meta = *meta;
+  rx_meta_spi_transactions = spi_mock_transactions();
+}
+
+uint32_t rx_meta_clock() {
+  return 1234;
+}
+
 void cad_callback(sx127x *local_device, int cad_detected) {
   cad_status = cad_detected;
 }
@@ -105,11 +141,14 @@ void test_fsk_ook_rx() {
   TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_address_filtering(SX127X_FILTER_NONE, 0x00, 0x00, device));
   spi_mock_fifo(payload, packet_length, SX127X_OK);
   registers[0x3f] = 0b00100000;  // fifolevel
-  for (int i = 0; i < 80; i++) {
+  for (int i = 0; i < 67; i++) {
     sx127x_handle_interrupt(device);
   }
   registers[0x3f] = 0b00000110;  // payload_ready & crc_ok
+  spi_mock_transactions();
   sx127x_handle_interrupt(device);
+  // irq read, irq clear and the tail in a single burst
+  TEST_ASSERT_EQUAL_INT(3, spi_mock_transactions());
   TEST_ASSERT_EQUAL_INT(packet_length, rx_callback_data_length);
   TEST_ASSERT_EQUAL_MEMORY(payload, rx_callback_data, rx_callback_data_length);
 
@@ -149,6 +188,341 @@ void test_fsk_ook_rx() {
   TEST_ASSERT_EQUAL_MEMORY(payload + 1, rx_callback_data, rx_callback_data_length);
 }
 
+int fsk_ook_rx_interrupts(uint8_t *payload, uint16_t packet_length) {
+  rx_callback_data_length = 0;
+  spi_mock_fifo(payload, packet_length, SX127X_OK);
+  int interrupts = 0;
+  // simulate FIFO_LEVEL interrupts while the whole batch is in FIFO
+  uint16_t received = 0;
+  while (packet_length - received > device->fsk_ook_rx_batch) {
+    registers[0x3f] = 0b00100000;  // fifolevel
+    sx127x_handle_interrupt(device);
+    received += device->fsk_ook_rx_batch;
+    interrupts++;
+  }
+  registers[0x3f] = 0b00000110;  // payload_ready & crc_ok
+  sx127x_handle_interrupt(device);
+  interrupts++;
+  TEST_ASSERT_EQUAL_INT(packet_length, rx_callback_data_length);
+  TEST_ASSERT_EQUAL_MEMORY(payload, rx_callback_data, rx_callback_data_length);
+  return interrupts;
+}
+
+void test_fsk_ook_fifo_threshold_auto() {
+  uint8_t payload[2047];
+  for (int i = 0; i < sizeof(payload); i++) {
+    payload[i] = i;
+  }
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_FSK, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_packet_format(SX127X_FIXED, sizeof(payload), device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_crc(SX127X_CRC_NONE, device));
+  sx127x_rx_set_callback(rx_callback, device);
+
+  // default threshold is half of FIFO
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_FSK, device));
+  TEST_ASSERT_EQUAL_INT(31, registers[0x35]);
+  TEST_ASSERT_EQUAL_INT(69, fsk_ook_rx_interrupts(payload, sizeof(payload)));
+
+  // 1.2 kbps: almost whole FIFO per interrupt
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_FSK, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_bitrate(1200.0, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_fifo_threshold_auto(100, 8000000, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_FSK, device));
+  TEST_ASSERT_EQUAL_INT(61, registers[0x35]);
+  TEST_ASSERT_EQUAL_INT(35, fsk_ook_rx_interrupts(payload, sizeof(payload)));
+
+  // 300 kbps: 8 bytes arrive during interrupt latency and FIFO transfer
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_FSK, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_bitrate(300000.0, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_fifo_threshold_auto(100, 8000000, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_FSK, device));
+  TEST_ASSERT_EQUAL_INT(55, registers[0x35]);
+  TEST_ASSERT_EQUAL_INT(38, fsk_ook_rx_interrupts(payload, sizeof(payload)));
+
+  // TX refills everything above the threshold
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_FSK, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_tx_set_for_transmission(payload, sizeof(payload), device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_TX, SX127x_MODULATION_FSK, device));
+  TEST_ASSERT_EQUAL_INT(0b10000000 | 8, registers[0x35]);
+  int interrupts = 0;
+  while (device->fsk_ook_packet_sent_received < sizeof(payload)) {
+    registers[0x3f] = 0b00000000;  // below fifolevel
+    sx127x_handle_interrupt(device);
+    interrupts++;
+  }
+  TEST_ASSERT_EQUAL_INT(37, interrupts);
+  spi_assert_write(payload, sizeof(payload));
+
+  // 500us latency at 300 kbps is still possible, but 1ms would overrun FIFO
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_fifo_threshold_auto(500, 8000000, device));
+  TEST_ASSERT_EQUAL_INT(40, device->fsk_ook_rx_threshold);
+  TEST_ASSERT_EQUAL_INT(23, device->fsk_ook_tx_threshold);
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_fsk_ook_set_fifo_threshold_auto(1000, 8000000, device));
+  TEST_ASSERT_EQUAL_INT(40, device->fsk_ook_rx_threshold);
+}
+
+void test_fsk_ook_rx_chunks() {
+  uint8_t payload[2047];
+  for (int i = 0; i < sizeof(payload); i++) {
+    payload[i] = i;
+  }
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_FSK, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_packet_format(SX127X_FIXED, sizeof(payload), device));
+  sx127x_rx_set_callback(rx_callback, device);
+  sx127x_fsk_ook_rx_set_chunk_callback(rx_chunk_callback, device);
+
+  spi_mock_fifo(payload, sizeof(payload), SX127X_OK);
+  registers[0x3f] = 0b00100000;  // fifolevel
+  for (int i = 0; i < 67; i++) {
+    sx127x_handle_interrupt(device);
+    // data is available before the packet is fully received
+    TEST_ASSERT_EQUAL_INT((i + 1) * 30, rx_chunks_data_length);
+  }
+  TEST_ASSERT_EQUAL_INT(SX127X_RX_CHUNK_PARTIAL, rx_chunk_status);
+  TEST_ASSERT_EQUAL_INT(0, rx_callback_data_length);
+  registers[0x3f] = 0b00000110;  // payload_ready & crc_ok
+  sx127x_handle_interrupt(device);
+  TEST_ASSERT_EQUAL_INT(68, rx_chunks);
+  TEST_ASSERT_EQUAL_INT(SX127X_RX_CHUNK_LAST, rx_chunk_status);
+  TEST_ASSERT_EQUAL_INT(sizeof(payload), rx_chunks_data_length);
+  TEST_ASSERT_EQUAL_MEMORY(payload, rx_chunks_data, rx_chunks_data_length);
+  TEST_ASSERT_EQUAL_INT(sizeof(payload), rx_callback_data_length);
+
+  // failed CRC
+  rx_chunks = 0;
+  rx_chunks_data_length = 0;
+  rx_chunk_status = SX127X_RX_CHUNK_PARTIAL;
+  rx_callback_data_length = 0;
+  spi_mock_fifo(payload, sizeof(payload), SX127X_OK);
+  registers[0x3f] = 0b00100000;  // fifolevel
+  sx127x_handle_interrupt(device);
+  registers[0x3f] = 0b00000100;  // payload_ready
+  sx127x_handle_interrupt(device);
+  TEST_ASSERT_EQUAL_INT(2, rx_chunks);
+  TEST_ASSERT_EQUAL_INT(SX127X_RX_CHUNK_DROPPED, rx_chunk_status);
+  TEST_ASSERT_EQUAL_INT(0, rx_callback_data_length);
+
+  // SPI failed while reading the tail
+  rx_chunks = 0;
+  rx_chunks_data_length = 0;
+  rx_chunk_status = SX127X_RX_CHUNK_PARTIAL;
+  spi_mock_fifo(payload, 40, SX127X_OK);
+  registers[0x3f] = 0b00100000;  // fifolevel
+  sx127x_handle_interrupt(device);
+  registers[0x3f] = 0b00000110;  // payload_ready & crc_ok
+  uint32_t event;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_irq_capture(device, &event));
+  spi_mock_fifo(payload + 30, 10, SX127X_ERR_INVALID_STATE);
+  sx127x_irq_process(event, device);
+  TEST_ASSERT_EQUAL_INT(2, rx_chunks);
+  TEST_ASSERT_EQUAL_INT(30, rx_chunks_data_length);
+  TEST_ASSERT_EQUAL_INT(SX127X_RX_CHUNK_DROPPED, rx_chunk_status);
+  TEST_ASSERT_EQUAL_INT(0, rx_callback_data_length);
+  TEST_ASSERT_EQUAL_INT(0, device->expected_packet_length);
+
+  // SPI failed while reading the length
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_packet_format(SX127X_VARIABLE, 255, device));
+  rx_chunks = 0;
+  rx_chunks_data_length = 0;
+  rx_chunk_status = SX127X_RX_CHUNK_PARTIAL;
+  spi_mock_fifo(payload, 0, SX127X_OK);
+  registers[0x3f] = 0b00000110;  // payload_ready & crc_ok
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_irq_capture(device, &event));
+  spi_mock_register_writes(0x3f);
+  spi_mock_fifo(payload, 10, SX127X_ERR_INVALID_STATE);
+  sx127x_irq_process(event, device);
+  TEST_ASSERT_EQUAL_INT(0, rx_chunks);
+  TEST_ASSERT_EQUAL_INT(0, rx_callback_data_length);
+  // FIFO is cleared
+  TEST_ASSERT_EQUAL_INT(1, spi_mock_register_writes(0x3f));
+  TEST_ASSERT_EQUAL_INT(0b00010000, registers[0x3f]);
+  spi_mock_fifo(payload, 0, SX127X_OK);
+}
+
+int tx_pull(uint8_t *chunk, uint16_t chunk_length, void *context) {
+  uint8_t *counter = (uint8_t *) context;
+  for (uint16_t i = 0; i < chunk_length; i++) {
+    chunk[i] = (*counter)++;
+  }
+  return SX127X_OK;
+}
+
+// only the first FIFO is available
+int tx_pull_failing(uint8_t *chunk, uint16_t chunk_length, void *context) {
+  uint8_t *counter = (uint8_t *) context;
+  if (*counter > 0) {
+    return SX127X_ERR_INVALID_STATE;
+  }
+  return tx_pull(chunk, chunk_length, context);
+}
+
+void test_fsk_ook_tx_source() {
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_FSK, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_packet_format(SX127X_FIXED, 2047, device));
+  sx127x_tx_set_callback(tx_callback, device);
+
+  uint8_t payload[2048];
+  for (int i = 0; i < sizeof(payload); i++) {
+    payload[i] = i;
+  }
+
+  // 1. Max fixed payload straight from the buffer
+  sx127x_tx_source_t source = {.buffer = payload};
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_tx_set_source_for_transmission(&source, 2047, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_TX, SX127x_MODULATION_FSK, device));
+  registers[0x3f] = 0b00000000;  // fifolevel goes down. request for refill
+  for (int i = 0; i < 70; i++) {
+    sx127x_handle_interrupt(device);
+  }
+  registers[0x3f] = 0b00001000;  // packet_sent
+  sx127x_handle_interrupt(device);
+  spi_assert_write(payload, 2047);
+  TEST_ASSERT_EQUAL_INT(1, transmitted);
+#ifndef CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+  // nothing staged
+  TEST_ASSERT_EQUAL_INT(0, device->packet[1]);
+#endif
+
+  // 2. Variable payload with address produced on the fly
+  transmitted = 0;
+  spi_mock_write(SX127X_OK);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_packet_format(SX127X_VARIABLE, 255, device));
+  uint8_t counter = 0;
+  source = (sx127x_tx_source_t) {.pull = tx_pull, .context = &counter};
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_tx_set_source_for_transmission_with_address(&source, 254, 0x11, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_TX, SX127x_MODULATION_FSK, device));
+  registers[0x3f] = 0b00000000;
+  for (int i = 0; i < 10; i++) {
+    sx127x_handle_interrupt(device);
+  }
+  registers[0x3f] = 0b00001000;
+  sx127x_handle_interrupt(device);
+  TEST_ASSERT_EQUAL_INT(254, counter);
+  payload[0] = 255;
+  payload[1] = 0x11;
+  for (int i = 2; i < 256; i++) {
+    payload[i] = i - 2;
+  }
+  spi_assert_write(payload, 256);
+  TEST_ASSERT_EQUAL_INT(1, transmitted);
+
+  source = (sx127x_tx_source_t) {0};
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_fsk_ook_tx_set_source_for_transmission(&source, 10, device));
+  source = (sx127x_tx_source_t) {.buffer = payload};
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_fsk_ook_tx_set_source_for_transmission(&source, 256, device));
+
+  // 3. Source fails on the tail. Frame is aborted and not reported as sent
+  transmitted = 0;
+  spi_mock_write(SX127X_OK);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_packet_format(SX127X_FIXED, 100, device));
+  counter = 0;
+  source = (sx127x_tx_source_t) {.pull = tx_pull_failing, .context = &counter};
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_tx_set_source_for_transmission(&source, 100, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_TX, SX127x_MODULATION_FSK, device));
+  registers[0x3f] = 0b00000000;
+  sx127x_handle_interrupt(device);
+  TEST_ASSERT_EQUAL_INT(SX127x_MODE_STANDBY, device->opmod);
+  TEST_ASSERT_EQUAL_INT(0, device->expected_packet_length);
+  registers[0x3f] = 0b01000000;  // fifo_empty
+  sx127x_handle_interrupt(device);
+  TEST_ASSERT_EQUAL_INT(0, transmitted);
+}
+
+typedef struct {
+  int interrupts;
+  int max_level;  // max number of bytes in FIFO when interrupt handler reads it
+} fifo_simulation_t;
+
+static uint64_t fifo_simulation_arrived(uint64_t time_ns, uint32_t bitrate, uint16_t packet_length) {
+  uint64_t result = time_ns * bitrate / 8000000000ULL;
+  return (result > packet_length ? packet_length : result);
+}
+
+// bytes arrive at the bit rate, interrupt is handled after the latency and SPI takes time to drain the FIFO
+fifo_simulation_t fsk_ook_rx_simulate(uint8_t *payload, uint16_t packet_length, uint32_t bitrate, uint32_t interrupt_latency_us, uint32_t spi_frequency) {
+  rx_callback_data_length = 0;
+  spi_mock_fifo(payload, packet_length, SX127X_OK);
+  fifo_simulation_t result = {0};
+  uint8_t threshold = registers[0x35] & 0b00111111;
+  uint64_t now = 0;
+  while (rx_callback_data_length == 0) {
+    uint16_t consumed = device->fsk_ook_packet_sent_received;
+    // FIFO_LEVEL is raised when FIFO has more than threshold bytes, PAYLOAD_READY when the last byte arrives
+    uint64_t level_bytes = consumed + threshold + 1;
+    if (level_bytes > packet_length) {
+      level_bytes = packet_length;
+    }
+    uint64_t raised = (level_bytes * 8000000000ULL + bitrate - 1) / bitrate;
+    if (raised < now) {
+      raised = now;
+    }
+    // interrupt flags are read before the FIFO
+    uint64_t read = raised + interrupt_latency_us * 1000ULL + 2 * 8 * 1000000000ULL / spi_frequency;
+    uint64_t arrived = fifo_simulation_arrived(read, bitrate, packet_length);
+    if ((int) (arrived - consumed) > result.max_level) {
+      result.max_level = (int) (arrived - consumed);
+    }
+    registers[0x3f] = (arrived == packet_length ? 0b00000110 : 0b00100000);  // payload_ready & crc_ok or fifolevel
+    sx127x_handle_interrupt(device);
+    result.interrupts++;
+    uint16_t transferred = device->fsk_ook_packet_sent_received - consumed;
+    TEST_ASSERT_TRUE(transferred > 0 || rx_callback_data_length != 0);
+    now = read + (transferred + 1) * 8 * 1000000000ULL / spi_frequency;
+  }
+  TEST_ASSERT_EQUAL_INT(packet_length, rx_callback_data_length);
+  TEST_ASSERT_EQUAL_MEMORY(payload, rx_callback_data, rx_callback_data_length);
+  return result;
+}
+
+void test_fsk_ook_fifo_threshold_simulation() {
+  uint8_t payload[2047];
+  for (int i = 0; i < sizeof(payload); i++) {
+    payload[i] = i;
+  }
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_FSK, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_packet_format(SX127X_FIXED, sizeof(payload), device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_crc(SX127X_CRC_NONE, device));
+  sx127x_rx_set_callback(rx_callback, device);
+
+  // 300 kbps with 1ms latency: every interrupt gets less than arrives in the meantime. Half FIFO overruns, adaptive rejects it
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_bitrate(300000.0, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_FSK, device));
+  fifo_simulation_t result = fsk_ook_rx_simulate(payload, sizeof(payload), 300000, 1000, 8000000);
+  TEST_ASSERT_TRUE(result.max_level > 64);
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_fsk_ook_set_fifo_threshold_auto(1000, 8000000, device));
+
+  // 1.2 kbps with 100us latency: both fit, but adaptive threshold needs half of interrupts
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_FSK, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_bitrate(1200.0, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_FSK, device));
+  result = fsk_ook_rx_simulate(payload, sizeof(payload), 1200, 100, 8000000);
+  TEST_ASSERT_TRUE(result.max_level <= 64);
+  TEST_ASSERT_EQUAL_INT(69, result.interrupts);
+
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_FSK, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_fifo_threshold_auto(100, 8000000, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_FSK, device));
+  result = fsk_ook_rx_simulate(payload, sizeof(payload), 1200, 100, 8000000);
+  TEST_ASSERT_TRUE(result.max_level <= 64);
+  TEST_ASSERT_EQUAL_INT(35, result.interrupts);
+
+  // any accepted combination never overruns
+  uint32_t bitrates[] = {1200, 4800, 19200, 76800, 150000, 300000};
+  uint32_t latencies[] = {10, 100, 500, 1000, 2000, 5000};
+  for (int i = 0; i < sizeof(bitrates) / sizeof(bitrates[0]); i++) {
+    for (int j = 0; j < sizeof(latencies) / sizeof(latencies[0]); j++) {
+      TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_FSK, device));
+      TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_bitrate((float) bitrates[i], device));
+      if (sx127x_fsk_ook_set_fifo_threshold_auto(latencies[j], 8000000, device) != SX127X_OK) {
+        continue;
+      }
+      TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_FSK, device));
+      result = fsk_ook_rx_simulate(payload, sizeof(payload), bitrates[i], latencies[j], 8000000);
+      TEST_ASSERT_TRUE(result.max_level <= 64);
+    }
+  }
+}
+
 void test_fsk_ook_beacon() {
   uint8_t data[] = {0xCA, 0xFE};
   TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_FSK, device));
@@ -177,6 +551,13 @@ void test_fsk_ook_beacon() {
   TEST_ASSERT_EQUAL_INT(156, registers[0x3a]);
   TEST_ASSERT_EQUAL_INT(0b00000101, registers[0x38]);
 
+  // adaptive TX threshold
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_bitrate(4800.0, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_fifo_threshold_auto(100, 4000000, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_tx_start_beacon(data, sizeof(data), 1000, device));
+  TEST_ASSERT_EQUAL_INT(0b10000000 | device->fsk_ook_tx_threshold, registers[0x35]);
+  TEST_ASSERT_EQUAL_INT(2, device->fsk_ook_tx_threshold);
+
   TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_tx_stop_beacon(device));
   TEST_ASSERT_EQUAL_INT(0b01000000, registers[0x36]); //stop sequencer
   TEST_ASSERT_EQUAL_INT(0b00010000, registers[0x3f]);
@@ -338,7 +719,12 @@ void test_lora_rx() {
   spi_mock_fifo(payload, sizeof(payload), SX127X_OK);
   registers[0x12] = 0b01000000;  // rx done
   registers[0x13] = sizeof(payload);
+  registers[0x10] = 0x00;
+  spi_mock_transactions();
   sx127x_handle_interrupt(device);
+  // status burst + irq clear, fifo pointer and payload
+  TEST_ASSERT_EQUAL_INT(2, spi_mock_transactions());
+  TEST_ASSERT_EQUAL_INT(0, registers[0x0d]);
 
   TEST_ASSERT_EQUAL_INT(sizeof(payload), rx_callback_data_length);
   TEST_ASSERT_EQUAL_MEMORY(payload, rx_callback_data, rx_callback_data_length);
@@ -356,6 +742,393 @@ void test_lora_rx() {
   TEST_ASSERT_EQUAL_INT(header.length, rx_callback_data_length);
 }
 
+void test_rx_meta() {
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_LORA, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_frequency(437200012, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_set_bandwidth(SX127x_BW_125000, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_LORA, device));
+  sx127x_rx_set_meta_callback(rx_meta_callback, rx_meta_clock, device);
+  uint8_t payload[16];
+  for (int i = 0; i < sizeof(payload); i++) {
+    payload[i] = i;
+  }
+  spi_mock_fifo(payload, sizeof(payload), SX127X_OK);
+  registers[0x12] = 0b01000000;  // rx done
+  registers[0x13] = sizeof(payload);
+  registers[0x18] = 0b01100000;  // coding rate 4/7
+  registers[0x19] = (uint8_t) (-21);
+  registers[0x1a] = 134;
+  registers[0x1c] = 0b01000000;  // crc on payload
+  registers[0x28] = 0x0F;
+  registers[0x29] = 0xFF;
+  registers[0x2a] = 0xF0;
+  spi_mock_transactions();
+  sx127x_handle_interrupt(device);
+  // status burst + irq clear, fifo pointer, payload and metadata. nothing in callback
+  TEST_ASSERT_EQUAL_INT(2, rx_meta_spi_transactions);
+  TEST_ASSERT_EQUAL_INT(0, spi_mock_transactions());
+  TEST_ASSERT_EQUAL_INT(sizeof(payload), rx_callback_data_length);
+  TEST_ASSERT_EQUAL_MEMORY(payload, rx_callback_data, rx_callback_data_length);
+  TEST_ASSERT_EQUAL_FLOAT(-5.25, rx_meta.snr);
+  TEST_ASSERT_EQUAL_INT(-35, rx_meta.rssi);
+  TEST_ASSERT_EQUAL_INT(-2, rx_meta.frequency_error);
+  TEST_ASSERT_EQUAL_INT(SX127x_CR_4_7, rx_meta.coding_rate);
+  TEST_ASSERT_TRUE(rx_meta.crc_present);
+  TEST_ASSERT_EQUAL_INT(1234, rx_meta.timestamp);
+
+  // values are the same as in getters
+  int16_t rssi;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_rx_get_packet_rssi(device, &rssi));
+  TEST_ASSERT_EQUAL_INT(rssi, rx_meta.rssi);
+  int32_t frequency_error;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_rx_get_frequency_error(device, &frequency_error));
+  TEST_ASSERT_EQUAL_INT(frequency_error, rx_meta.frequency_error);
+
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_FSK, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_packet_format(SX127X_VARIABLE, 255, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_crc(SX127X_CRC_CCITT, device));
+  registers[0x3f] = 0b00000000;
+  registers[0x3e] = 0b00000010;  // preamble detect
+  registers[0x11] = 30;
+  sx127x_handle_interrupt(device);
+  payload[0] = sizeof(payload) - 1;
+  spi_mock_fifo(payload, sizeof(payload), SX127X_OK);
+  registers[0x3f] = 0b00000110;  // payload_ready & crc_ok
+  registers[0x1b] = 0xFF;
+  registers[0x1c] = 0xF0;
+  sx127x_handle_interrupt(device);
+  TEST_ASSERT_EQUAL_INT(payload[0], rx_callback_data_length);
+  TEST_ASSERT_EQUAL_MEMORY(payload + 1, rx_callback_data, rx_callback_data_length);
+  TEST_ASSERT_EQUAL_INT(-15, rx_meta.rssi);
+  TEST_ASSERT_EQUAL_INT(-976, rx_meta.frequency_error);
+  TEST_ASSERT_TRUE(rx_meta.crc_present);
+  TEST_ASSERT_EQUAL_INT(1234, rx_meta.timestamp);
+}
+
+void test_lora_fhss() {
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_LORA, device));
+  uint64_t frequencies[CONFIG_SX127X_MAX_FHSS_CHANNELS + 1] = {437200012, 868000000};
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_lora_set_frequency_hopping(5, frequencies, 0, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_lora_set_frequency_hopping(5, frequencies, CONFIG_SX127X_MAX_FHSS_CHANNELS + 1, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_set_frequency_hopping(5, frequencies, 2, device));
+  TEST_ASSERT_EQUAL_INT(5, registers[0x24]);
+  // register values are copied
+  frequencies[0] = 0;
+  uint8_t expected[][3] = {{0x6d, 0x4c, 0xcd}, {0xd9, 0x00, 0x00}, {0x6d, 0x4c, 0xcd}};
+  for (int i = 0; i < 3; i++) {
+    registers[0x12] = 0b00000010;  // fhss change channel
+    spi_mock_transactions();
+    sx127x_handle_interrupt(device);
+    // irq status + frequency and irq clear
+    TEST_ASSERT_EQUAL_INT(2, spi_mock_transactions());
+    TEST_ASSERT_EQUAL_MEMORY(expected[i], registers + 0x06, 3);
+  }
+  // no hop after the packet received
+  registers[0x12] = 0b01000010;
+  registers[0x13] = 0;
+  sx127x_handle_interrupt(device);
+  TEST_ASSERT_EQUAL_MEMORY(expected[2], registers + 0x06, 3);
+}
+
+void test_frequency_round_trip() {
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_SLEEP, SX127x_MODULATION_LORA, device));
+  int64_t max_error = 0;
+  int64_t max_float_error = 0;
+  for (uint64_t frequency = 137000000; frequency < 1020000000; frequency += 1000003) {
+    TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_frequency(frequency, device));
+    uint32_t frf = (registers[0x06] << 16) | (registers[0x07] << 8) | registers[0x08];
+    // previous float implementation
+    uint64_t float_frf = (frequency << 19) / 32000000.0f;
+    TEST_ASSERT_UINT32_WITHIN(1, float_frf, frf);
+    uint64_t float_frequency = (uint64_t) (float_frf * 32000000.0f) >> 19;
+    int64_t float_error = (int64_t) float_frequency - (int64_t) frequency;
+    if (float_error < 0) {
+      float_error = -float_error;
+    }
+    if (float_error > max_float_error) {
+      max_float_error = float_error;
+    }
+
+    uint64_t actual;
+    TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_get_frequency(device, &actual));
+    int64_t error = (int64_t) actual - (int64_t) frequency;
+    if (error < 0) {
+      error = -error;
+    }
+    if (error > max_error) {
+      max_error = error;
+    }
+  }
+  // half of the step (61.03 hz)
+  TEST_ASSERT_LESS_OR_EQUAL_INT64(31, max_error);
+  TEST_ASSERT_LESS_OR_EQUAL_INT64(max_float_error, max_error);
+}
+
+void test_channel_plan() {
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_LORA, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_STATE, sx127x_set_channel(0, device));
+  uint64_t frequencies[] = {868100000, 868300000, 868500000, 433175000};
+  sx127x_channel_t channels[sizeof(frequencies) / sizeof(uint64_t)];
+  sx127x_channel_plan_t plan;
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_channel_plan_init(frequencies, channels, 0, &plan));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_channel_plan_init(frequencies, channels, sizeof(frequencies) / sizeof(uint64_t), &plan));
+  TEST_ASSERT_TRUE(channels[0].high_band);
+  TEST_ASSERT_FALSE(channels[3].high_band);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_channel_plan(&plan, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_set_channel(4, device));
+
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_channel(0, device));
+  uint8_t expected_0[] = {0xd9, 0x06, 0x66};
+  TEST_ASSERT_EQUAL_MEMORY(expected_0, registers + 0x06, 3);
+
+  // RegFrfMsb is the same and not written
+  registers[0x06] = 0xAA;
+  spi_mock_transactions();
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_channel(1, device));
+  TEST_ASSERT_EQUAL_INT(1, spi_mock_transactions());
+  uint8_t expected_1[] = {0xAA, 0x13, 0x33};
+  TEST_ASSERT_EQUAL_MEMORY(expected_1, registers + 0x06, 3);
+  // same channel
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_channel(1, device));
+  TEST_ASSERT_EQUAL_INT(0, spi_mock_transactions());
+
+  // RSSI offset from the channel band
+  registers[0x19] = 0;
+  registers[0x1a] = 134;
+  int16_t rssi;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_rx_get_packet_rssi(device, &rssi));
+  TEST_ASSERT_EQUAL_INT(134 - 157, rssi);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_channel(3, device));
+  uint8_t expected_3[] = {0x6c, 0x4b, 0x33};
+  TEST_ASSERT_EQUAL_MEMORY(expected_3, registers + 0x06, 3);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_rx_get_packet_rssi(device, &rssi));
+  TEST_ASSERT_EQUAL_INT(134 - 164, rssi);
+
+  // frequency outside of the plan
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_frequency(868300000, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_rx_get_packet_rssi(device, &rssi));
+  TEST_ASSERT_EQUAL_INT(134 - 157, rssi);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_channel(3, device));
+  TEST_ASSERT_EQUAL_MEMORY(expected_3, registers + 0x06, 3);
+}
+
+void test_apply_profile() {
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_FSK, device));
+  // bitrate 4800, fdev 5000, 437.2 mhz, variable packet with CRC CCITT
+  const uint8_t values[] = {0x1A, 0x0A, 0x00, 0x51, 0x6d, 0x4c, 0xcd, 0xD0, 0x40, 0xFF};
+  const sx127x_profile_range_t ranges[] = {{0x02, 4, 0}, {0x06, 3, 4}, {0x30, 3, 7}};
+  sx127x_profile_t profile = {
+      .modulation = SX127x_MODULATION_FSK,
+      .fsk_ook_format = SX127X_VARIABLE,
+      .fsk_crc_type = SX127X_CRC_CCITT,
+      .expected_packet_length = 0,
+      .fsk_ook_rx_threshold = 61,
+      .fsk_ook_rx_batch = 60,
+      .fsk_ook_tx_threshold = 2,
+      .fsk_ook_tx_batch = 61,
+      .ranges = ranges,
+      .ranges_length = sizeof(ranges) / sizeof(ranges[0]),
+      .values = values};
+  spi_mock_transactions();
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_apply_profile(&profile, device));
+  TEST_ASSERT_EQUAL_INT(1, spi_mock_transactions());
+  TEST_ASSERT_EQUAL_MEMORY(values, registers + 0x02, 7);
+  TEST_ASSERT_EQUAL_MEMORY(values + 7, registers + 0x30, 3);
+  TEST_ASSERT_EQUAL_INT(SX127X_CRC_CCITT, device->fsk_crc_type);
+  TEST_ASSERT_EQUAL_INT(61, device->fsk_ook_rx_threshold);
+
+  // nothing changed
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_apply_profile(&profile, device));
+  TEST_ASSERT_EQUAL_INT(0, spi_mock_transactions());
+
+  // only frequency is written
+  const uint8_t values_868[] = {0x1A, 0x0A, 0x00, 0x51, 0xd9, 0x13, 0x33, 0xD0, 0x40, 0xFF};
+  profile.values = values_868;
+  registers[0x02] = 0xEE;
+  registers[0x07] = 0xEE;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_apply_profile(&profile, device));
+  TEST_ASSERT_EQUAL_INT(1, spi_mock_transactions());
+  TEST_ASSERT_EQUAL_INT(0xEE, registers[0x02]);
+  TEST_ASSERT_EQUAL_MEMORY(values_868 + 4, registers + 0x06, 3);
+
+  // switch modulation in sleep mode. registers are in the LoRa bank
+  const uint8_t lora_values[] = {0x72, 0x94};
+  const sx127x_profile_range_t lora_ranges[] = {{0x1d, 2, 0}};
+  sx127x_profile_t lora = {
+      .modulation = SX127x_MODULATION_LORA,
+      .ranges = lora_ranges,
+      .ranges_length = 1,
+      .values = lora_values};
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_apply_profile(&lora, device));
+  TEST_ASSERT_EQUAL_INT(SX127x_MODULATION_LORA, device->active_modem);
+  TEST_ASSERT_EQUAL_INT(0b10000000, registers[0x01]);
+  TEST_ASSERT_EQUAL_MEMORY(lora_values, registers + 0x1d, 2);
+
+  const sx127x_profile_range_t invalid_ranges[] = {{0x01, 2, 0}};
+  lora.ranges = invalid_ranges;
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_apply_profile(&lora, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_apply_profile(NULL, device));
+}
+
+void test_irq_capture_process() {
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_LORA, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_frequency(437200012, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_set_bandwidth(SX127x_BW_125000, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_LORA, device));
+  sx127x_rx_set_meta_callback(rx_meta_callback, rx_meta_clock, device);
+  uint8_t payload[16];
+  for (int i = 0; i < sizeof(payload); i++) {
+    payload[i] = i;
+  }
+  spi_mock_fifo(payload, sizeof(payload), SX127X_OK);
+  registers[0x12] = 0b01000000;  // rx done
+  registers[0x13] = sizeof(payload);
+  registers[0x10] = 0x00;
+  uint32_t event;
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_irq_capture(device, NULL));
+  spi_mock_transactions();
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_irq_capture(device, &event));
+  // status burst and irq clear. nothing else
+  TEST_ASSERT_EQUAL_INT(2, spi_mock_transactions());
+  TEST_ASSERT_EQUAL_INT(0, rx_callback_data_length);
+  // next packet might be written by the chip
+  registers[0x12] = 0;
+  registers[0x13] = 0;
+  sx127x_irq_process(event, device);
+  // fifo pointer, payload and metadata
+  TEST_ASSERT_EQUAL_INT(1, rx_meta_spi_transactions);
+  TEST_ASSERT_EQUAL_INT(sizeof(payload), rx_callback_data_length);
+  TEST_ASSERT_EQUAL_MEMORY(payload, rx_callback_data, rx_callback_data_length);
+  TEST_ASSERT_EQUAL_INT(1234, rx_meta.timestamp);
+
+  // fhss hop is a single transaction
+  uint64_t frequencies[] = {437200012, 868000000};
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_set_frequency_hopping(5, frequencies, 2, device));
+  registers[0x12] = 0b00000010;  // fhss change channel
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_irq_capture(device, &event));
+  spi_mock_transactions();
+  sx127x_irq_process(event, device);
+  TEST_ASSERT_EQUAL_INT(1, spi_mock_transactions());
+  TEST_ASSERT_EQUAL_HEX8(0x6d, registers[0x06]);
+
+  // modulation was changed after the capture
+  registers[0x12] = 0b00000010;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_irq_capture(device, &event));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_FSK, device));
+  spi_mock_transactions();
+  sx127x_irq_process(event, device);
+  TEST_ASSERT_EQUAL_INT(0, spi_mock_transactions());
+
+  // both fsk irq registers are read in one go
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_FSK, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_packet_format(SX127X_VARIABLE, 255, device));
+  registers[0x3e] = 0b00000010;  // preamble detect
+  registers[0x3f] = 0;
+  registers[0x11] = 30;
+  spi_mock_transactions();
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_irq_capture(device, &event));
+  TEST_ASSERT_EQUAL_INT(2, spi_mock_transactions());
+  sx127x_irq_process(event, device);
+  int16_t rssi;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_rx_get_packet_rssi(device, &rssi));
+  TEST_ASSERT_EQUAL_INT(-15, rssi);
+
+  // fifo level batch keeps preamble detect and sync address match
+  registers[0x3e] = 0b00000011;
+  registers[0x3f] = 0b00100000;
+  spi_mock_register_writes(0x3e);
+  spi_mock_register_writes(0x3f);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_irq_capture(device, &event));
+  TEST_ASSERT_EQUAL_INT(0, spi_mock_register_writes(0x3e));
+  TEST_ASSERT_EQUAL_INT(1, spi_mock_register_writes(0x3f));
+  TEST_ASSERT_EQUAL_INT(0b00000011, (event >> 8) & 0xff);
+  // and so does payload ready
+  registers[0x3f] = 0b00000100;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_irq_capture(device, &event));
+  TEST_ASSERT_EQUAL_INT(0, spi_mock_register_writes(0x3e));
+  // cleared by the interrupt which handles them
+  registers[0x3f] = 0;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_irq_capture(device, &event));
+  TEST_ASSERT_EQUAL_INT(1, spi_mock_register_writes(0x3e));
+}
+
+void test_handle_dio() {
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_FSK, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_packet_format(SX127X_VARIABLE, 255, device));
+  sx127x_rx_set_callback(rx_callback, device);
+  uint8_t payload[256];
+  for (int i = 1; i < sizeof(payload); i++) {
+    payload[i] = i - 1;
+  }
+  payload[0] = 255;
+  spi_mock_fifo(payload, sizeof(payload), SX127X_OK);
+  // preamble detect: irq clear and rssi
+  registers[0x11] = 30;
+  spi_mock_transactions();
+  sx127x_handle_dio(SX127x_DIO4, device);
+  TEST_ASSERT_EQUAL_INT(2, spi_mock_transactions());
+  int16_t rssi;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_rx_get_packet_rssi(device, &rssi));
+  TEST_ASSERT_EQUAL_INT(-15, rssi);
+  // fifo level: only fifo is read
+  registers[0x3f] = 0;
+  for (int i = 0; i < 8; i++) {
+    sx127x_handle_dio(SX127x_DIO1, device);
+    TEST_ASSERT_EQUAL_INT(i == 0 ? 2 : 1, spi_mock_transactions());
+  }
+  // payload ready: crc status and the tail
+  registers[0x3f] = 0b00000110;
+  sx127x_handle_dio(SX127x_DIO0, device);
+  TEST_ASSERT_EQUAL_INT(2, spi_mock_transactions());
+  TEST_ASSERT_EQUAL_INT(payload[0], rx_callback_data_length);
+  TEST_ASSERT_EQUAL_MEMORY(payload + 1, rx_callback_data, rx_callback_data_length);
+
+  // fsk tx: refill on fifo level and packet sent without reading irq flags
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_FSK, device));
+  sx127x_tx_set_callback(tx_callback, device);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_tx_set_for_transmission(payload, 200, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_TX, SX127x_MODULATION_FSK, device));
+  spi_mock_transactions();
+  spi_mock_read_transactions();
+  sx127x_handle_dio(SX127x_DIO1, device);
+  TEST_ASSERT_EQUAL_INT(1, spi_mock_transactions());
+  sx127x_handle_dio(SX127x_DIO2, device);
+  sx127x_handle_dio(SX127x_DIO0, device);
+  TEST_ASSERT_EQUAL_INT(0, spi_mock_transactions());
+  TEST_ASSERT_EQUAL_INT(0, spi_mock_read_transactions());
+  TEST_ASSERT_EQUAL_INT(1, transmitted);
+
+  // lora tx done: only irq clear
+  transmitted = 0;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_TX, SX127x_MODULATION_LORA, device));
+  spi_mock_transactions();
+  sx127x_handle_dio(SX127x_DIO0, device);
+  TEST_ASSERT_EQUAL_INT(1, spi_mock_transactions());
+  TEST_ASSERT_EQUAL_INT(0, spi_mock_read_transactions());
+  TEST_ASSERT_EQUAL_INT(1, transmitted);
+
+  // lora fhss: frequency and irq clear
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_LORA, device));
+  uint64_t frequencies[] = {868000000};
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_set_frequency_hopping(5, frequencies, 1, device));
+  spi_mock_transactions();
+  sx127x_handle_dio(SX127x_DIO2, device);
+  TEST_ASSERT_EQUAL_INT(1, spi_mock_transactions());
+  TEST_ASSERT_EQUAL_INT(0, spi_mock_read_transactions());
+  TEST_ASSERT_EQUAL_HEX8(0xd9, registers[0x06]);
+  TEST_ASSERT_EQUAL_HEX8(0b00000010, registers[0x12]);
+
+  // rx done requires packet status
+  rx_callback_data_length = 0;
+  spi_mock_fifo(payload, 16, SX127X_OK);
+  registers[0x12] = 0b01000000;
+  registers[0x13] = 16;
+  registers[0x10] = 0;
+  sx127x_handle_dio(SX127x_DIO0, device);
+  TEST_ASSERT_EQUAL_INT(2, spi_mock_transactions());
+  TEST_ASSERT_EQUAL_INT(16, rx_callback_data_length);
+}
+
 void test_lora_cad() {
   TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_CAD, SX127x_MODULATION_LORA, device));
   TEST_ASSERT_EQUAL_INT(0b10000000, registers[0x40]);
@@ -572,6 +1345,725 @@ void test_lora() {
   TEST_ASSERT_EQUAL_INT(0b00001100, registers[0x26]); // + previous config
 }
 
+void test_lora_config_transaction() {
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_SLEEP, SX127x_MODULATION_LORA, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_STATE, sx127x_config_commit(device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_config_begin(device));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_STATE, sx127x_config_begin(device));
+  spi_mock_transactions();
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_set_bandwidth(SX127x_BW_125000, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_set_modem_config_2(SX127x_SF_9, device));
+  sx127x_tx_header_t header = {
+      .enable_crc = true,
+      .coding_rate = SX127x_CR_4_5};
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_tx_set_explicit_header(&header, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_preamble_length(8, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_set_syncword(18, device));
+  // only cache misses
+  TEST_ASSERT_EQUAL_INT(2, spi_mock_transactions());
+  TEST_ASSERT_EQUAL_INT(0, registers[0x1d]);
+  TEST_ASSERT_EQUAL_INT(0, registers[0x1e]);
+  TEST_ASSERT_EQUAL_INT(0, registers[0x21]);
+  TEST_ASSERT_EQUAL_INT(0, registers[0x39]);
+
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_config_commit(device));
+  TEST_ASSERT_EQUAL_INT(1, spi_mock_transactions());
+  TEST_ASSERT_EQUAL_INT(0b01110010, registers[0x1d]);
+  TEST_ASSERT_EQUAL_INT(0b10010100, registers[0x1e]);
+  TEST_ASSERT_EQUAL_INT(0, registers[0x20]);
+  TEST_ASSERT_EQUAL_INT(8, registers[0x21]);
+  TEST_ASSERT_EQUAL_INT(0xc3, registers[0x31]);
+  TEST_ASSERT_EQUAL_INT(0x0a, registers[0x37]);
+  TEST_ASSERT_EQUAL_INT(18, registers[0x39]);
+
+  // opmod is a barrier
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_config_begin(device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_preamble_length(12, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_LORA, device));
+  TEST_ASSERT_EQUAL_INT(12, registers[0x21]);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_config_commit(device));
+}
+
+void test_warm_up_cache() {
+  // only active bank is cached
+  registers[0x01] = 0b10000000;
+  registers[0x1d] = 0b01110010;
+  registers[0x26] = 0b00000100;
+  registers[0x4d] = 0b10000100;
+  spi_mock_read_transactions();
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_warm_up_cache(device));
+  TEST_ASSERT_EQUAL_INT(1, spi_mock_read_transactions());
+
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_SLEEP, SX127x_MODULATION_LORA, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_frequency(437200012, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_reset_fifo(device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_LORA, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_rx_set_lna_boost_hf(true, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_rx_set_lna_gain(SX127x_LNA_GAIN_G4, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_tx_set_pa_config(SX127x_PA_PIN_BOOST, 4, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_set_bandwidth(SX127x_BW_125000, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_set_implicit_header(NULL, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_set_modem_config_2(SX127x_SF_9, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_set_syncword(18, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_preamble_length(8, device));
+  sx127x_tx_header_t header = {
+      .enable_crc = true,
+      .coding_rate = SX127x_CR_4_5};
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_tx_set_explicit_header(&header, device));
+  TEST_ASSERT_EQUAL_INT(0, spi_mock_read_transactions());
+  TEST_ASSERT_EQUAL_INT(0b10000100, registers[0x4d]);
+  TEST_ASSERT_EQUAL_INT(0b01110010, registers[0x1d]);
+}
+
+void test_banked_cache() {
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_SLEEP, SX127x_MODULATION_LORA, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_set_bandwidth(SX127x_BW_125000, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_SLEEP, SX127x_MODULATION_FSK, device));
+  // mock has single register map. Emulate FSK register at the same address
+  registers[0x1d] = 0xFF;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_SLEEP, SX127x_MODULATION_LORA, device));
+  spi_mock_read_transactions();
+  uint32_t bandwidth;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_get_bandwidth(device, &bandwidth));
+  TEST_ASSERT_EQUAL_INT(125000, bandwidth);
+  TEST_ASSERT_EQUAL_INT(0, spi_mock_read_transactions());
+}
+
+void test_snapshot() {
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_SLEEP, SX127x_MODULATION_LORA, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_frequency(437200012, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_set_bandwidth(SX127x_BW_125000, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_set_modem_config_2(SX127x_SF_9, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_LORA, device));
+  // as if sx127x_fsk_ook_set_fifo_threshold_auto was called
+  device->fsk_ook_rx_threshold = 40;
+  device->fsk_ook_rx_batch = 39;
+  device->fsk_ook_tx_threshold = 23;
+  device->fsk_ook_tx_batch = 40;
+
+  uint8_t snapshot[SX127X_SNAPSHOT_MAX_LENGTH];
+  size_t snapshot_length = SX127X_SNAPSHOT_HEADER_LENGTH;
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_snapshot_save(snapshot, &snapshot_length, device));
+  snapshot_length = sizeof(snapshot);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_snapshot_save(snapshot, &snapshot_length, device));
+  TEST_ASSERT_TRUE(snapshot_length < SX127X_SNAPSHOT_MAX_LENGTH);
+  // exact length is enough
+  size_t exact_length = snapshot_length;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_snapshot_save(snapshot, &snapshot_length, device));
+  TEST_ASSERT_EQUAL_INT(exact_length, snapshot_length);
+
+  // wake up from deep sleep
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_create(NULL, device));
+#ifdef CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_packet_pool(&pool, device));
+#endif
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_snapshot_restore(snapshot, snapshot_length - 1, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_snapshot_restore(snapshot, snapshot_length, device));
+  TEST_ASSERT_EQUAL_INT(40, device->fsk_ook_rx_threshold);
+  TEST_ASSERT_EQUAL_INT(39, device->fsk_ook_rx_batch);
+  TEST_ASSERT_EQUAL_INT(23, device->fsk_ook_tx_threshold);
+  TEST_ASSERT_EQUAL_INT(40, device->fsk_ook_tx_batch);
+  sx127x_rx_set_callback(rx_callback, device);
+  uint32_t bandwidth;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_get_bandwidth(device, &bandwidth));
+  TEST_ASSERT_EQUAL_INT(125000, bandwidth);
+
+  uint8_t payload[] = {0xCA, 0xFE};
+  spi_mock_fifo(payload, sizeof(payload), SX127X_OK);
+  registers[0x12] = 0b01000000;  // rx done
+  registers[0x13] = sizeof(payload);
+  spi_mock_read_transactions();
+  sx127x_handle_interrupt(device);
+  // status burst and fifo
+  TEST_ASSERT_EQUAL_INT(2, spi_mock_read_transactions());
+  TEST_ASSERT_EQUAL_INT(sizeof(payload), rx_callback_data_length);
+  TEST_ASSERT_EQUAL_MEMORY(payload, rx_callback_data, rx_callback_data_length);
+
+  // values outside of enums or FIFO
+  uint8_t corrupted[SX127X_SNAPSHOT_MAX_LENGTH];
+  const uint8_t invalid[][2] = {{3, 0x40}, {4, 0x08}, {5, 0x01}, {6, 0x00}, {10, 0xff}, {11, 64}, {14, 64}};
+  for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+    memcpy(corrupted, snapshot, snapshot_length);
+    corrupted[invalid[i][0]] = invalid[i][1];
+    TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_snapshot_restore(corrupted, snapshot_length, device));
+  }
+
+  snapshot[0] = 0x00;
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_snapshot_restore(snapshot, snapshot_length, device));
+}
+
+void test_stats() {
+  sx127x_stats_t stats;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_get_stats(device, &stats));
+  // version
+  TEST_ASSERT_EQUAL_INT(1, stats.total.cache_misses);
+  TEST_ASSERT_EQUAL_INT(1, stats.registers[0x42].transactions);
+
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_reset_stats(device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_SLEEP, SX127x_MODULATION_LORA, device));
+  uint32_t bandwidth;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_get_bandwidth(device, &bandwidth));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_get_bandwidth(device, &bandwidth));
+  int16_t rssi;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_rx_get_packet_rssi(device, &rssi));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_get_stats(device, &stats));
+
+  TEST_ASSERT_EQUAL_INT(1, stats.registers[0x1d].cache_misses);
+  TEST_ASSERT_EQUAL_INT(1, stats.registers[0x1d].cache_hits);
+  TEST_ASSERT_EQUAL_INT(1, stats.registers[0x1d].transactions);
+  TEST_ASSERT_EQUAL_INT(1, stats.registers[0x1d].bytes_read);
+  // volatile register always goes to the chip
+  TEST_ASSERT_EQUAL_INT(0, stats.registers[0x1a].cache_hits);
+  TEST_ASSERT_EQUAL_INT(1, stats.registers[0x1a].transactions);
+
+  const sx127x_api_stats_t *get_bandwidth = NULL;
+  for (uint8_t i = 0; i < stats.apis_length; i++) {
+    if (strcmp(stats.apis[i].name, "sx127x_lora_get_bandwidth") == 0) {
+      get_bandwidth = stats.apis + i;
+    }
+  }
+  TEST_ASSERT_NOT_NULL(get_bandwidth);
+  TEST_ASSERT_EQUAL_INT(1, get_bandwidth->counters.cache_hits);
+  TEST_ASSERT_EQUAL_INT(1, get_bandwidth->counters.cache_misses);
+  TEST_ASSERT_EQUAL_INT(1, get_bandwidth->counters.transactions);
+  TEST_ASSERT_EQUAL_INT(3, stats.apis_length);
+  TEST_ASSERT_EQUAL_INT(stats.total.transactions, stats.apis[0].counters.transactions + stats.apis[1].counters.transactions + stats.apis[2].counters.transactions);
+}
+
+uint32_t trace_time = 0;
+
+uint32_t trace_clock() {
+  trace_time += 10;
+  return trace_time;
+}
+
+void test_trace() {
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_trace_set_clock(trace_clock, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_SLEEP, SX127x_MODULATION_LORA, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_frequency(437200012, device));
+  registers[0x12] = 0b00001000;  // tx done
+  sx127x_handle_interrupt(device);
+
+  uint8_t output[SX127X_TRACE_DUMP_MAX_LENGTH];
+  size_t output_length = 0;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_trace_dump(output, &output_length, device));
+  TEST_ASSERT_EQUAL_INT('S', output[0]);
+  TEST_ASSERT_EQUAL_INT('T', output[1]);
+  // version, opmod, frequency, status read and irq clear
+  uint16_t entries = output[4] | (output[5] << 8);
+  TEST_ASSERT_EQUAL_INT(5, entries);
+  const uint8_t *record = output + SX127X_TRACE_HEADER_LENGTH;
+  // version was read before clock was set
+  TEST_ASSERT_EQUAL_INT(0, record[0]);
+  TEST_ASSERT_EQUAL_INT(0x42, record[4]);
+  TEST_ASSERT_EQUAL_INT(0, record[5]);
+  TEST_ASSERT_EQUAL_INT(0x12, record[8]);
+  record += SX127X_TRACE_RECORD_HEADER_LENGTH + 1;
+  record += SX127X_TRACE_RECORD_HEADER_LENGTH + 1;
+  TEST_ASSERT_EQUAL_INT(20, record[0]);
+  TEST_ASSERT_EQUAL_INT(0x06, record[4]);
+  TEST_ASSERT_EQUAL_INT(SX127X_TRACE_WRITE, record[5]);
+  TEST_ASSERT_EQUAL_INT(3, record[6]);
+  uint8_t frequency[] = {0x6d, 0x4c, 0xcd};
+  TEST_ASSERT_EQUAL_MEMORY(frequency, record + SX127X_TRACE_RECORD_HEADER_LENGTH, sizeof(frequency));
+  TEST_ASSERT_EQUAL_INT(output_length, record - output + SX127X_TRACE_RECORD_HEADER_LENGTH + 3 + (SX127X_TRACE_RECORD_HEADER_LENGTH + 4) + (SX127X_TRACE_RECORD_HEADER_LENGTH + 1));
+}
+
+void test_packet_pool() {
+  uint8_t memory[MAX_PACKET_SIZE];
+  sx127x_packet_pool_t small_pool;
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_packet_pool_init(memory, sizeof(memory), 33, &small_pool));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_packet_pool_init(memory, sizeof(memory), 1, &small_pool));
+#ifdef CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+  // two radios share single block
+  sx127x *other = malloc(sizeof(struct sx127x_t));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_create(NULL, other));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_packet_pool(&small_pool, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_packet_pool(&small_pool, other));
+
+  // block is taken only while packet is in flight
+  uint8_t payload[MAX_PACKET_SIZE];
+  for (int i = 0; i < sizeof(payload); i++) {
+    payload[i] = i;
+  }
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_LORA, device));
+  sx127x_rx_set_callback(rx_callback, device);
+  spi_mock_fifo(payload, sizeof(payload), SX127X_OK);
+  registers[0x12] = 0b01000000;  // rx done
+  registers[0x13] = sizeof(payload);
+  sx127x_handle_interrupt(device);
+  TEST_ASSERT_EQUAL_INT(sizeof(payload), rx_callback_data_length);
+  TEST_ASSERT_EQUAL_PTR(memory, rx_callback_data);
+  TEST_ASSERT_EQUAL_INT(0, small_pool.used);
+
+  // SPI failure after the block was taken returns it into the pool
+  rx_callback_data_length = 0;
+  uint32_t event;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_irq_capture(device, &event));
+  spi_mock_fifo(payload, sizeof(payload), SX127X_ERR_INVALID_STATE);
+  sx127x_irq_process(event, device);
+  TEST_ASSERT_EQUAL_INT(0, rx_callback_data_length);
+  TEST_ASSERT_EQUAL_INT(0, small_pool.used);
+  TEST_ASSERT_EQUAL_INT(0, device->expected_packet_length);
+  TEST_ASSERT_NULL(device->packet);
+  spi_mock_fifo(payload, sizeof(payload), SX127X_OK);
+
+  // long TX holds the block until the last byte is in FIFO
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_FSK, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_FSK, other));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_tx_set_for_transmission(payload, 100, device));
+  TEST_ASSERT_EQUAL_INT(1, small_pool.used);
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_NO_MEM, sx127x_fsk_ook_tx_set_for_transmission(payload, 10, other));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_TX, SX127x_MODULATION_FSK, device));
+  registers[0x3f] = 0b00000000;  // fifolevel goes down. request for refill
+  sx127x_handle_interrupt(device);
+  sx127x_handle_interrupt(device);
+  TEST_ASSERT_EQUAL_INT(0, small_pool.used);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_tx_set_for_transmission(payload, 10, other));
+  TEST_ASSERT_EQUAL_INT(0, small_pool.used);
+
+  // packet bigger than block is dropped
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_packet_format(SX127X_FIXED, 300, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_FSK, device));
+  rx_callback_data_length = 0;
+  uint8_t big[300] = {0};
+  spi_mock_fifo(big, sizeof(big), SX127X_OK);
+  registers[0x3f] = 0b00000110;  // payload_ready & crc_ok
+  sx127x_handle_interrupt(device);
+  TEST_ASSERT_EQUAL_INT(0, rx_callback_data_length);
+  TEST_ASSERT_EQUAL_INT(0b00010000, registers[0x3f]);  // fifo_overrun
+  TEST_ASSERT_EQUAL_INT(0, small_pool.used);
+  free(other);
+#else
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_STATE, sx127x_set_packet_pool(&small_pool, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_STATE, sx127x_set_packet_buffer(memory, sizeof(memory), device));
+#endif
+}
+
+#ifdef CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+#define RX_RING_PACKETS 5000
+
+sx127x_rx_ring_t rx_ring;
+bool rx_ring_done = false;
+uint32_t rx_ring_consumed = 0;
+uint32_t rx_ring_errors = 0;
+
+void *rx_ring_consumer(void *arg) {
+  int32_t last = -1;
+  while (true) {
+    // all packets are in the ring once producer is done
+    bool done = __atomic_load_n(&rx_ring_done, __ATOMIC_ACQUIRE);
+    sx127x_rx_slot_t *slot;
+    int code = sx127x_rx_ring_acquire(&rx_ring, &slot);
+    if (code == SX127X_ERR_NOT_FOUND) {
+      if (done) {
+        break;
+      }
+      sched_yield();
+      continue;
+    }
+    int32_t sequence = slot->data[0] | (slot->data[1] << 8);
+    if (code != SX127X_OK || sequence <= last || slot->length != 16 + sequence % 32) {
+      rx_ring_errors++;
+    }
+    for (uint16_t i = 2; i < slot->length; i++) {
+      if (slot->data[i] != (uint8_t) (sequence + i)) {
+        rx_ring_errors++;
+      }
+    }
+    last = sequence;
+    rx_ring_consumed++;
+    sx127x_rx_ring_release(&rx_ring);
+  }
+  return NULL;
+}
+
+void rx_ring_run(sx127x_rx_ring_overflow_t overflow) {
+  sx127x_rx_slot_t slots[4];
+  uint8_t memory[sizeof(slots) / sizeof(slots[0]) * 64];
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_rx_ring_init(slots, memory, sizeof(slots) / sizeof(slots[0]), 64, overflow, &rx_ring));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_rx_ring(&rx_ring, device));
+  rx_ring_done = false;
+  rx_ring_consumed = 0;
+  rx_ring_errors = 0;
+  pthread_t consumer;
+  TEST_ASSERT_EQUAL_INT(0, pthread_create(&consumer, NULL, rx_ring_consumer, NULL));
+
+  uint8_t payload[64];
+  for (uint32_t sequence = 0; sequence < RX_RING_PACKETS; sequence++) {
+    uint16_t length = 16 + sequence % 32;
+    payload[0] = (uint8_t) sequence;
+    payload[1] = (uint8_t) (sequence >> 8);
+    for (uint16_t i = 2; i < length; i++) {
+      payload[i] = (uint8_t) (sequence + i);
+    }
+    spi_mock_fifo(payload, length, SX127X_OK);
+    registers[0x12] = 0b01000000;  // rx done
+    registers[0x13] = length;
+    sx127x_handle_interrupt(device);
+    if (sequence % 7 == 0) {
+      sched_yield();
+    }
+  }
+  __atomic_store_n(&rx_ring_done, true, __ATOMIC_RELEASE);
+  TEST_ASSERT_EQUAL_INT(0, pthread_join(consumer, NULL));
+
+  uint32_t received;
+  uint32_t dropped;
+  sx127x_rx_ring_get_counters(&rx_ring, &received, &dropped);
+  TEST_ASSERT_EQUAL_INT(0, rx_ring_errors);
+  if (overflow == SX127X_RX_RING_DROP_NEWEST) {
+    TEST_ASSERT_EQUAL_INT(RX_RING_PACKETS, received + dropped);
+    TEST_ASSERT_EQUAL_INT(received, rx_ring_consumed);
+  } else {
+    // newest packets are dropped while the oldest one is held
+    TEST_ASSERT_TRUE(received <= RX_RING_PACKETS);
+    TEST_ASSERT_EQUAL_INT(RX_RING_PACKETS, rx_ring_consumed + dropped);
+  }
+}
+
+void rx_ring_receive(uint8_t sequence) {
+  uint8_t payload[] = {sequence, sequence, sequence};
+  spi_mock_fifo(payload, sizeof(payload), SX127X_OK);
+  registers[0x12] = 0b01000000;  // rx done
+  registers[0x13] = sizeof(payload);
+  registers[0x19] = sequence * 4;  // snr
+  sx127x_handle_interrupt(device);
+}
+
+void rx_ring_hold() {
+  sx127x_rx_slot_t slots[4];
+  uint8_t memory[sizeof(slots) / sizeof(slots[0]) * 16];
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_rx_ring_init(slots, memory, sizeof(slots) / sizeof(slots[0]), 16, SX127X_RX_RING_DROP_OLDEST, &rx_ring));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_rx_ring(&rx_ring, device));
+  rx_ring_receive(1);
+  rx_ring_receive(2);
+  sx127x_rx_slot_t *held;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_rx_ring_acquire(&rx_ring, &held));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_STATE, sx127x_rx_ring_acquire(&rx_ring, &held));
+  // metadata is stored even without meta callback
+  TEST_ASSERT_EQUAL_FLOAT(1.0f, held->meta.snr);
+  // overflow the ring several times while the consumer holds the oldest packet
+  for (uint8_t sequence = 3; sequence < 20; sequence++) {
+    rx_ring_receive(sequence);
+  }
+  uint8_t expected[] = {1, 1, 1};
+  TEST_ASSERT_EQUAL_INT(sizeof(expected), held->length);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, held->data, sizeof(expected));
+  uint32_t received;
+  uint32_t dropped;
+  sx127x_rx_ring_get_counters(&rx_ring, &received, &dropped);
+  TEST_ASSERT_EQUAL_INT(4, received);
+  TEST_ASSERT_EQUAL_INT(15, dropped);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_rx_ring_release(&rx_ring));
+
+  // slot of the released packet is reused and the oldest one is dropped
+  rx_ring_receive(20);
+  rx_ring_receive(21);
+  uint8_t sequences[] = {3, 4, 20, 21};
+  for (size_t i = 0; i < sizeof(sequences); i++) {
+    sx127x_rx_slot_t *slot;
+    TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_rx_ring_acquire(&rx_ring, &slot));
+    TEST_ASSERT_EQUAL_UINT8(sequences[i], slot->data[0]);
+    TEST_ASSERT_EQUAL_FLOAT((float) sequences[i], slot->meta.snr);
+    TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_rx_ring_release(&rx_ring));
+  }
+  sx127x_rx_slot_t *slot;
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_NOT_FOUND, sx127x_rx_ring_acquire(&rx_ring, &slot));
+  sx127x_rx_ring_get_counters(&rx_ring, &received, &dropped);
+  TEST_ASSERT_EQUAL_INT(6, received);
+  TEST_ASSERT_EQUAL_INT(16, dropped);
+}
+#endif
+
+void test_rx_ring() {
+  sx127x_rx_slot_t slots[2];
+  uint8_t memory[2 * MAX_PACKET_SIZE];
+  sx127x_rx_ring_t ring;
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_rx_ring_init(slots, memory, 1, MAX_PACKET_SIZE, SX127X_RX_RING_DROP_NEWEST, &ring));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_rx_ring_init(slots, memory, 2, MAX_PACKET_SIZE, SX127X_RX_RING_DROP_NEWEST, &ring));
+  sx127x_rx_slot_t *slot;
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_NOT_FOUND, sx127x_rx_ring_acquire(&ring, &slot));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_STATE, sx127x_rx_ring_release(&ring));
+#ifdef CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_LORA, device));
+  rx_ring_run(SX127X_RX_RING_DROP_NEWEST);
+  rx_ring_run(SX127X_RX_RING_DROP_OLDEST);
+  rx_ring_hold();
+#else
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_STATE, sx127x_set_rx_ring(&ring, device));
+#endif
+}
+
+uint32_t tx_queue_now = 0;
+int tx_queue_wakes = 0;
+
+uint32_t tx_queue_clock() {
+  return tx_queue_now;
+}
+
+void tx_queue_wake(void *context) {
+  TEST_ASSERT_EQUAL_PTR(&tx_queue_wakes, context);
+  tx_queue_wakes++;
+}
+
+#ifdef CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+#define TX_QUEUE_PRODUCERS 4
+#define TX_QUEUE_FRAMES 2000
+
+sx127x_tx_queue_t tx_queue;
+uint32_t tx_queue_busy[TX_QUEUE_PRODUCERS];
+
+void *tx_queue_producer(void *arg) {
+  uint8_t producer = (uint8_t) (uintptr_t) arg;
+  uint8_t payload[16];
+  for (uint32_t sequence = 0; sequence < TX_QUEUE_FRAMES; sequence++) {
+    uint16_t length = 3 + sequence % 13;
+    payload[0] = producer;
+    payload[1] = (uint8_t) sequence;
+    payload[2] = (uint8_t) (sequence >> 8);
+    for (uint16_t i = 3; i < length; i++) {
+      payload[i] = (uint8_t) (sequence + i);
+    }
+    // queue is full. retry later
+    while (sx127x_tx_queue_submit(payload, length, SX127X_TX_QUEUE_CURRENT_CHANNEL, &tx_queue) == SX127X_ERR_NO_MEM) {
+      tx_queue_busy[producer]++;
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+void tx_queue_run() {
+  sx127x_tx_slot_t slots[4];
+  uint8_t memory[sizeof(slots) / sizeof(slots[0]) * 16];
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_tx_queue_init(slots, memory, sizeof(slots) / sizeof(slots[0]), 16, NULL, &tx_queue));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_tx_queue(&tx_queue, device));
+  pthread_t producers[TX_QUEUE_PRODUCERS];
+  for (uintptr_t i = 0; i < TX_QUEUE_PRODUCERS; i++) {
+    tx_queue_busy[i] = 0;
+    TEST_ASSERT_EQUAL_INT(0, pthread_create(producers + i, NULL, tx_queue_producer, (void *) i));
+  }
+  int32_t last[TX_QUEUE_PRODUCERS] = {-1, -1, -1, -1};
+  uint32_t frames = 0;
+  uint32_t errors = 0;
+  while (frames < TX_QUEUE_PRODUCERS * TX_QUEUE_FRAMES) {
+    spi_mock_write(SX127X_OK);
+    if (tx_queue.active) {
+      registers[0x12] = 0b00001000;  // tx done
+      sx127x_handle_interrupt(device);
+    } else if (sx127x_tx_queue_start(device) != SX127X_OK) {
+      sched_yield();
+      continue;
+    }
+    size_t length;
+    const uint8_t *data = spi_mock_written(&length);
+    // queue is drained
+    if (length == 0) {
+      continue;
+    }
+    int32_t sequence = data[1] | (data[2] << 8);
+    // frames of the same producer are sent in order
+    if (data[0] >= TX_QUEUE_PRODUCERS || sequence != last[data[0]] + 1 || length != 3 + sequence % 13) {
+      errors++;
+      break;
+    }
+    for (size_t i = 3; i < length; i++) {
+      if (data[i] != (uint8_t) (sequence + i)) {
+        errors++;
+      }
+    }
+    last[data[0]] = sequence;
+    frames++;
+  }
+  for (int i = 0; i < TX_QUEUE_PRODUCERS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, pthread_join(producers[i], NULL));
+  }
+  TEST_ASSERT_EQUAL_INT(0, errors);
+  sx127x_tx_queue_counters_t counters;
+  sx127x_tx_queue_get_counters(&tx_queue, &counters);
+  TEST_ASSERT_EQUAL_INT(TX_QUEUE_PRODUCERS * TX_QUEUE_FRAMES, counters.submitted);
+  TEST_ASSERT_EQUAL_INT(0, counters.depth);
+  uint32_t busy = 0;
+  for (int i = 0; i < TX_QUEUE_PRODUCERS; i++) {
+    busy += tx_queue_busy[i];
+  }
+  TEST_ASSERT_EQUAL_INT(busy, counters.rejected);
+  TEST_ASSERT_EQUAL_INT(0, counters.failed);
+  TEST_ASSERT_TRUE(counters.max_depth <= sizeof(slots) / sizeof(slots[0]));
+}
+#endif
+
+void test_tx_queue() {
+  sx127x_tx_slot_t slots[2];
+  uint8_t memory[2 * 16];
+  sx127x_tx_queue_t queue;
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_tx_queue_init(slots, memory, 0, 16, tx_queue_clock, &queue));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_tx_queue_init(slots, memory, 2, 16, tx_queue_clock, &queue));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_STATE, sx127x_tx_queue_start(device));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_set_tx_queue(NULL, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_tx_queue(&queue, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_NOT_FOUND, sx127x_tx_queue_start(device));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_tx_queue_set_wake(tx_queue_wake, &tx_queue_wakes, NULL));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_tx_queue_set_wake(tx_queue_wake, &tx_queue_wakes, &queue));
+  tx_queue_wakes = 0;
+
+  uint64_t frequencies[] = {868100000, 868300000};
+  sx127x_channel_t channels[2];
+  sx127x_channel_plan_t plan;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_channel_plan_init(frequencies, channels, 2, &plan));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_channel_plan(&plan, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_LORA, device));
+  sx127x_tx_set_callback(tx_callback, device);
+
+  uint8_t first[] = {1, 2, 3};
+  uint8_t second[] = {4, 5, 6, 7};
+  uint8_t big[17] = {0};
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_tx_queue_submit(big, sizeof(big), SX127X_TX_QUEUE_CURRENT_CHANNEL, &queue));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_tx_queue_submit(first, 0, SX127X_TX_QUEUE_CURRENT_CHANNEL, &queue));
+  tx_queue_now = 10;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_tx_queue_submit(first, sizeof(first), SX127X_TX_QUEUE_CURRENT_CHANNEL, &queue));
+  tx_queue_now = 15;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_tx_queue_submit(second, sizeof(second), 1, &queue));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_NO_MEM, sx127x_tx_queue_submit(first, sizeof(first), SX127X_TX_QUEUE_CURRENT_CHANNEL, &queue));
+  // only the first frame can find the handler idle
+  TEST_ASSERT_EQUAL_INT(1, tx_queue_wakes);
+
+  tx_queue_now = 20;
+  spi_mock_write(SX127X_OK);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_tx_queue_start(device));
+  spi_assert_write(first, sizeof(first));
+  TEST_ASSERT_EQUAL_INT(SX127x_MODE_TX | SX127x_MODULATION_LORA, registers[0x01]);
+  // already transmitting
+  spi_mock_transactions();
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_tx_queue_start(device));
+  TEST_ASSERT_EQUAL_INT(0, spi_mock_transactions());
+
+  // next frame is sent from tx done
+  tx_queue_now = 40;
+  spi_mock_write(SX127X_OK);
+  registers[0x12] = 0b00001000;  // tx done
+  sx127x_handle_interrupt(device);
+  spi_assert_write(second, sizeof(second));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(channels[1].frf, registers + 0x06, 3);
+  TEST_ASSERT_EQUAL_INT(0, transmitted);
+
+  // queue is drained
+  spi_mock_write(SX127X_OK);
+  registers[0x12] = 0b00001000;
+  sx127x_handle_interrupt(device);
+  spi_assert_write(NULL, 0);
+  TEST_ASSERT_EQUAL_INT(1, transmitted);
+
+  sx127x_tx_queue_counters_t counters;
+  sx127x_tx_queue_get_counters(&queue, &counters);
+  TEST_ASSERT_EQUAL_INT(2, counters.submitted);
+  TEST_ASSERT_EQUAL_INT(2, counters.sent);
+  TEST_ASSERT_EQUAL_INT(1, counters.rejected);
+  TEST_ASSERT_EQUAL_INT(0, counters.failed);
+  TEST_ASSERT_EQUAL_INT(0, counters.depth);
+  TEST_ASSERT_EQUAL_INT(2, counters.max_depth);
+  TEST_ASSERT_EQUAL_INT(35, counters.total_latency);
+  TEST_ASSERT_EQUAL_INT(25, counters.max_latency);
+
+  // frame for unknown channel doesn't interrupt RX
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_LORA, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_tx_queue_submit(first, sizeof(first), 2, &queue));
+  transmitted = 0;
+  spi_mock_transactions();
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_NOT_FOUND, sx127x_tx_queue_start(device));
+  TEST_ASSERT_EQUAL_INT(0, spi_mock_transactions());
+  TEST_ASSERT_EQUAL_INT(SX127x_MODE_RX_CONT | SX127x_MODULATION_LORA, registers[0x01]);
+  // but queue is drained
+  TEST_ASSERT_EQUAL_INT(1, transmitted);
+  sx127x_tx_queue_get_counters(&queue, &counters);
+  TEST_ASSERT_EQUAL_INT(1, counters.failed);
+  TEST_ASSERT_EQUAL_INT(0, counters.depth);
+
+  // handler is idle again
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_tx_queue_submit(first, sizeof(first), SX127X_TX_QUEUE_CURRENT_CHANNEL, &queue));
+  TEST_ASSERT_EQUAL_INT(3, tx_queue_wakes);
+#ifdef CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+  tx_queue_run();
+#endif
+}
+
+void test_tx_queue_fsk() {
+  sx127x_tx_slot_t slots[4];
+  uint8_t memory[4 * 128];
+  sx127x_tx_queue_t queue;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_tx_queue_init(slots, memory, 4, 128, tx_queue_clock, &queue));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_tx_queue(&queue, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_FSK, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_packet_format(SX127X_VARIABLE, 255, device));
+  sx127x_tx_set_callback(tx_callback, device);
+
+  uint8_t payload[101];
+  for (int i = 1; i < sizeof(payload); i++) {
+    payload[i] = i;
+  }
+  tx_queue_now = 0;
+  // channel plan is not set, so the frame fails to start
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_tx_queue_submit(payload + 1, 3, 1, &queue));
+  tx_queue_now = 10;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_tx_queue_submit(payload + 1, 3, SX127X_TX_QUEUE_CURRENT_CHANNEL, &queue));
+  tx_queue_now = 11;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_tx_queue_submit(payload + 1, 100, SX127X_TX_QUEUE_CURRENT_CHANNEL, &queue));
+  tx_queue_now = 12;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_tx_queue_submit(payload + 1, 3, SX127X_TX_QUEUE_CURRENT_CHANNEL, &queue));
+
+  tx_queue_now = 20;
+  spi_mock_write(SX127X_OK);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_tx_queue_start(device));
+  payload[0] = 3;
+  spi_assert_write(payload, 4);
+
+  // fifo is empty before the last byte is sent. frame is finished by packet sent
+  spi_mock_write(SX127X_OK);
+  sx127x_handle_dio(SX127x_DIO3, device);
+  spi_assert_write(NULL, 0);
+  tx_queue_now = 30;
+  sx127x_handle_dio(SX127x_DIO0, device);
+  payload[0] = 100;
+  spi_assert_write(payload, 64);
+
+  // the rest of the frame can't be written. the next frame is sent
+  spi_mock_write(SX127X_OK);
+  spi_mock_write_failure(SX127X_ERR_INVALID_STATE);
+  tx_queue_now = 40;
+  sx127x_handle_dio(SX127x_DIO1, device);
+  size_t length;
+  const uint8_t *data = spi_mock_written(&length);
+  TEST_ASSERT_EQUAL_INT(device->fsk_ook_tx_batch + 4, length);
+  payload[0] = 3;
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, data + device->fsk_ook_tx_batch, 4);
+  TEST_ASSERT_EQUAL_INT(SX127x_MODE_TX, device->opmod);
+  TEST_ASSERT_EQUAL_INT(0, transmitted);
+
+  // packet sent was cleared by the sequencer. fifo empty and tx ready is used instead
+  registers[0x3e] = 0b00100000;  // tx ready
+  registers[0x3f] = 0b01000000;  // fifo empty
+  sx127x_handle_interrupt(device);
+  TEST_ASSERT_EQUAL_INT(0, transmitted);
+  registers[0x3e] = 0;
+  sx127x_handle_interrupt(device);
+  TEST_ASSERT_EQUAL_INT(1, transmitted);
+  // flag is still set, but frame is reported only once
+  sx127x_handle_interrupt(device);
+  TEST_ASSERT_EQUAL_INT(1, transmitted);
+
+  sx127x_tx_queue_counters_t counters;
+  sx127x_tx_queue_get_counters(&queue, &counters);
+  TEST_ASSERT_EQUAL_INT(4, counters.submitted);
+  TEST_ASSERT_EQUAL_INT(2, counters.sent);
+  TEST_ASSERT_EQUAL_INT(2, counters.failed);
+  TEST_ASSERT_EQUAL_INT(0, counters.rejected);
+  // frame which failed to start is not measured
+  TEST_ASSERT_EQUAL_INT(10 + 19 + 28, counters.total_latency);
+  TEST_ASSERT_EQUAL_INT(28, counters.max_latency);
+  TEST_ASSERT_FALSE(queue.active);
+}
+
 void test_init_failure() {
   spi_mock_registers(registers, SX127X_ERR_INVALID_ARG);
   TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_create(NULL, device));
@@ -602,20 +2094,45 @@ void setUp() {
   spi_mock_registers(registers, SX127X_OK);
   device = malloc(sizeof(struct sx127x_t));
   TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_create(NULL, device));
+#ifdef CONFIG_SX127X_EXTERNAL_PACKET_BUFFER
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_packet_pool_init(pool_memory, MAX_PACKET_SIZE_FSK_FIXED, 1, &pool));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_packet_pool(&pool, device));
+#endif
   spi_mock_write(SX127X_OK);
 }
 
 int main(void) {
   UNITY_BEGIN();
   RUN_TEST(test_lora);
+  RUN_TEST(test_lora_config_transaction);
+  RUN_TEST(test_warm_up_cache);
+  RUN_TEST(test_banked_cache);
+  RUN_TEST(test_snapshot);
+  RUN_TEST(test_stats);
+  RUN_TEST(test_trace);
+  RUN_TEST(test_packet_pool);
+  RUN_TEST(test_rx_ring);
   RUN_TEST(test_init_failure);
   RUN_TEST(test_fsk_ook);
   RUN_TEST(test_fsk_ook_rssi);
   RUN_TEST(test_lora_tx);
   RUN_TEST(test_lora_rx);
+  RUN_TEST(test_rx_meta);
+  RUN_TEST(test_lora_fhss);
+  RUN_TEST(test_frequency_round_trip);
+  RUN_TEST(test_channel_plan);
+  RUN_TEST(test_apply_profile);
+  RUN_TEST(test_irq_capture_process);
+  RUN_TEST(test_handle_dio);
   RUN_TEST(test_lora_cad);
   RUN_TEST(test_fsk_ook_tx);
   RUN_TEST(test_fsk_ook_beacon);
   RUN_TEST(test_fsk_ook_rx);
+  RUN_TEST(test_fsk_ook_fifo_threshold_auto);
+  RUN_TEST(test_fsk_ook_fifo_threshold_simulation);
+  RUN_TEST(test_fsk_ook_rx_chunks);
+  RUN_TEST(test_fsk_ook_tx_source);
+  RUN_TEST(test_tx_queue);
+  RUN_TEST(test_tx_queue_fsk);
   return UNITY_END();
 }
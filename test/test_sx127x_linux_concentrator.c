@@ -0,0 +1,297 @@
+#include <linux/gpio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sx127x_linux_concentrator.h>
+#include <unistd.h>
+
+#include "sx127x_sim_spi.h"
+#include "unity.h"
+
+#define RADIOS 3
+#define DIO0_OFFSET 17
+#define DIO1_OFFSET 18
+
+sx127x_linux_concentrator_t *concentrator;
+sx127x_sim_radio_t sims[RADIOS];
+int pipes[RADIOS][2];
+sx127x_channel_t channels[3];
+sx127x_channel_plan_t plan;
+
+static void receive(int index, const uint8_t *data, uint8_t data_length) {
+  // previous packet is still being handled
+  while (sx127x_sim_radio_receive(data, data_length, sims + index) != 0) {
+    usleep(100);
+  }
+}
+
+static uint32_t transmitted(int index) {
+  sx127x_linux_concentrator_radio_t *radio = concentrator->radios + index;
+  pthread_mutex_t *lock = &concentrator->buses[radio->bus].lock;
+  pthread_mutex_lock(lock);
+  uint32_t result = (radio->transmitting ? 0 : radio->transmitted);
+  pthread_mutex_unlock(lock);
+  return result;
+}
+
+static void wait_transmitted(int index, uint32_t expected) {
+  for (int i = 0; i < 10000 && transmitted(index) != expected; i++) {
+    usleep(100);
+  }
+  TEST_ASSERT_EQUAL_UINT32(expected, transmitted(index));
+}
+
+void test_rx() {
+  uint8_t first[] = {0xCA, 0xFE};
+  uint8_t second[] = {1, 2, 3, 4, 5};
+  receive(1, first, sizeof(first));
+  receive(2, second, sizeof(second));
+  sx127x_linux_concentrator_packet_t packets[2];
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_concentrator_rx(1000, packets, concentrator));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_concentrator_rx(1000, packets + 1, concentrator));
+  // radios are on different buses, so order is not known
+  if (packets[0].radio == 2) {
+    sx127x_linux_concentrator_packet_t temp = packets[0];
+    packets[0] = packets[1];
+    packets[1] = temp;
+  }
+  TEST_ASSERT_EQUAL_INT(1, packets[0].radio);
+  TEST_ASSERT_EQUAL_INT(sizeof(first), packets[0].length);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(first, packets[0].data, sizeof(first));
+  TEST_ASSERT_EQUAL_INT(2, packets[1].radio);
+  TEST_ASSERT_EQUAL_INT(sizeof(second), packets[1].length);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(second, packets[1].data, sizeof(second));
+  // kernel timestamp of the interrupt
+  TEST_ASSERT_TRUE(packets[0].meta.timestamp != 0);
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_NOT_FOUND, sx127x_linux_concentrator_rx(0, packets, concentrator));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_NOT_FOUND, sx127x_linux_concentrator_rx(10, packets, concentrator));
+  uint32_t received;
+  uint32_t dropped;
+  sx127x_linux_concentrator_get_counters(concentrator, &received, &dropped);
+  TEST_ASSERT_EQUAL_UINT32(2, received);
+  TEST_ASSERT_EQUAL_UINT32(0, dropped);
+}
+
+void test_rx_overflow() {
+  uint8_t payload[] = {1, 2, 3};
+  for (int i = 0; i < CONFIG_SX127X_LINUX_CONCENTRATOR_RX_QUEUE + 2; i++) {
+    receive(0, payload, sizeof(payload));
+  }
+  // last packet is read and queued before the bus thread stops
+  bool pending = true;
+  for (int i = 0; i < 10000 && pending; i++) {
+    pthread_mutex_lock(&sims[0].lock);
+    pending = ((sims[0].registers[0x12] & 0x40) != 0);
+    pthread_mutex_unlock(&sims[0].lock);
+    usleep(100);
+  }
+  sx127x_linux_concentrator_stop(concentrator);
+  uint32_t received;
+  uint32_t dropped;
+  sx127x_linux_concentrator_get_counters(concentrator, &received, &dropped);
+  TEST_ASSERT_EQUAL_UINT32(CONFIG_SX127X_LINUX_CONCENTRATOR_RX_QUEUE, received);
+  TEST_ASSERT_EQUAL_UINT32(2, dropped);
+  TEST_ASSERT_EQUAL_UINT32(CONFIG_SX127X_LINUX_CONCENTRATOR_RX_QUEUE + 2, concentrator->radios[0].received);
+  sx127x_linux_concentrator_packet_t packet;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_concentrator_rx(0, &packet, concentrator));
+  TEST_ASSERT_EQUAL_INT(0, packet.radio);
+}
+
+void test_tx() {
+  uint8_t payload[] = {0xAB, 0xCD, 0xEF};
+  uint8_t radio = 0xff;
+  // radio listening on the channel is preferred
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_concentrator_tx(1, payload, sizeof(payload), &radio, concentrator));
+  TEST_ASSERT_EQUAL_INT(1, radio);
+  wait_transmitted(1, 1);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, sims[1].fifo, sizeof(payload));
+  TEST_ASSERT_EQUAL_INT(SX127x_MODE_RX_CONT, concentrator->radios[1].device.opmod);
+
+  // nobody listens on channel 2. idle radio is tuned and goes back to its rx channel
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_concentrator_tx(2, payload, sizeof(payload), &radio, concentrator));
+  TEST_ASSERT_EQUAL_INT(0, radio);
+  wait_transmitted(0, 1);
+  TEST_ASSERT_EQUAL_INT(0, concentrator->radios[0].device.current_channel);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(channels[0].frf, sims[0].registers + 0x06, 3);
+  TEST_ASSERT_EQUAL_INT(SX127x_MODE_RX_CONT, concentrator->radios[0].device.opmod);
+
+  // all radios are busy
+  for (int i = 0; i < RADIOS; i++) {
+    pthread_mutex_lock(&concentrator->buses[concentrator->radios[i].bus].lock);
+    concentrator->radios[i].transmitting = true;
+    pthread_mutex_unlock(&concentrator->buses[concentrator->radios[i].bus].lock);
+  }
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_NOT_FOUND, sx127x_linux_concentrator_tx(1, payload, sizeof(payload), &radio, concentrator));
+}
+
+void test_tx_receiving() {
+  uint8_t payload[] = {0x42};
+  uint8_t radio = 0xff;
+  // radio 1 listens on the channel, but is receiving a packet
+  sx127x_sim_radio_set_receiving(1, sims + 1);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_concentrator_tx(1, payload, sizeof(payload), &radio, concentrator));
+  TEST_ASSERT_EQUAL_INT(2, radio);
+  wait_transmitted(2, 1);
+  TEST_ASSERT_EQUAL_UINT32(0, transmitted(1));
+
+  // idle radio tuned to another channel is still better
+  sx127x_sim_radio_set_receiving(1, sims + 2);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_concentrator_tx(1, payload, sizeof(payload), &radio, concentrator));
+  TEST_ASSERT_EQUAL_INT(0, radio);
+  wait_transmitted(0, 1);
+
+  // everybody is receiving. reception is aborted
+  sx127x_sim_radio_set_receiving(1, sims + 0);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_concentrator_tx(1, payload, sizeof(payload), &radio, concentrator));
+  TEST_ASSERT_EQUAL_INT(0, radio);
+  wait_transmitted(0, 2);
+}
+
+void test_tx_queue() {
+  sx127x_tx_slot_t slots[4];
+  uint8_t memory[4 * 16];
+  sx127x_tx_queue_t queue;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_tx_queue_init(slots, memory, 4, 16, NULL, &queue));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_STATE, sx127x_linux_concentrator_add_tx_queue(2, &queue, concentrator));
+  sx127x_linux_concentrator_stop(concentrator);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_concentrator_add_tx_queue(2, &queue, concentrator));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_concentrator_start(concentrator));
+
+  // bus thread is woken up by the producer
+  uint8_t payload[] = {0x42, 0x43};
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_tx_queue_submit(payload, sizeof(payload), 2, &queue));
+  }
+  sx127x_tx_queue_counters_t counters;
+  for (int i = 0; i < 10000; i++) {
+    sx127x_tx_queue_get_counters(&queue, &counters);
+    if (counters.sent == 3 && transmitted(2) > 0) {
+      break;
+    }
+    usleep(100);
+  }
+  TEST_ASSERT_EQUAL_INT(3, counters.sent);
+  TEST_ASSERT_EQUAL_INT(0, counters.failed);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, sims[2].fifo, sizeof(payload));
+  // radio goes back to its rx channel once queue is drained
+  pthread_mutex_lock(&concentrator->buses[1].lock);
+  TEST_ASSERT_EQUAL_INT(SX127x_MODE_RX_CONT, concentrator->radios[2].device.opmod);
+  TEST_ASSERT_EQUAL_INT(1, concentrator->radios[2].device.current_channel);
+  pthread_mutex_unlock(&concentrator->buses[1].lock);
+}
+
+void test_tx_abort() {
+  uint8_t big[MAX_PACKET_SIZE + 1] = {0};
+  uint8_t radio = 0xff;
+  // none of lora radios can send it
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_linux_concentrator_tx(1, big, sizeof(big), &radio, concentrator));
+
+  // radio 0 is FSK with fixed packet format
+  sx127x_linux_concentrator_stop(concentrator);
+  sx127x *device = &concentrator->radios[0].device;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_SLEEP, SX127x_MODULATION_FSK, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_packet_format(SX127X_FIXED, 2047, device));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_concentrator_start(concentrator));
+
+  // frame doesn't fit into FIFO
+  uint8_t payload[100] = {0};
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_concentrator_tx(0, payload, sizeof(payload), &radio, concentrator));
+  TEST_ASSERT_EQUAL_INT(0, radio);
+  // refill fails
+  sx127x_sim_radio_fail_write(sims + 0);
+  sx127x_sim_radio_emit(DIO1_OFFSET, GPIO_V2_LINE_EVENT_FALLING_EDGE, sims + 0);
+  pthread_mutex_t *lock = &concentrator->buses[concentrator->radios[0].bus].lock;
+  bool transmitting = true;
+  for (int i = 0; i < 10000 && transmitting; i++) {
+    usleep(100);
+    pthread_mutex_lock(lock);
+    transmitting = concentrator->radios[0].transmitting;
+    pthread_mutex_unlock(lock);
+  }
+  // radio listens again and can be used for TX
+  TEST_ASSERT_FALSE(transmitting);
+  pthread_mutex_lock(lock);
+  TEST_ASSERT_EQUAL_INT(SX127x_MODE_RX_CONT, device->opmod);
+  TEST_ASSERT_EQUAL_INT(0, concentrator->radios[0].transmitted);
+  pthread_mutex_unlock(lock);
+
+  // lora radios are skipped, but fsk radio can send it
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_concentrator_tx(1, big, sizeof(big), &radio, concentrator));
+  TEST_ASSERT_EQUAL_INT(0, radio);
+}
+
+void test_restart() {
+  sx127x_linux_concentrator_stop(concentrator);
+  TEST_ASSERT_EQUAL_INT(SX127x_MODE_STANDBY, concentrator->radios[2].device.opmod);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_concentrator_start(concentrator));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_STATE, sx127x_linux_concentrator_start(concentrator));
+  uint8_t payload[] = {7};
+  receive(2, payload, sizeof(payload));
+  sx127x_linux_concentrator_packet_t packet;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_concentrator_rx(1000, &packet, concentrator));
+  TEST_ASSERT_EQUAL_INT(2, packet.radio);
+}
+
+void test_invalid_args() {
+  uint8_t payload[] = {1};
+  uint8_t index;
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_linux_concentrator_create(NULL, concentrator));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_linux_concentrator_add_bus(-2, &index, concentrator));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_linux_concentrator_add_radio(5, sims, 0, &index, concentrator));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_linux_concentrator_add_radio(0, sims, 3, &index, concentrator));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_linux_concentrator_add_fd(RADIOS, pipes[0][0], NULL, NULL, 0, concentrator));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_linux_concentrator_tx(3, payload, sizeof(payload), NULL, concentrator));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_linux_concentrator_tx(0, payload, 0, NULL, concentrator));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_linux_concentrator_tx(0, payload, MAX_PACKET_SIZE + 1, NULL, concentrator));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_linux_concentrator_rx(0, NULL, concentrator));
+}
+
+void setUp() {
+  uint64_t frequencies[] = {868100000, 868300000, 868500000};
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_channel_plan_init(frequencies, channels, 3, &plan));
+  concentrator = malloc(sizeof(sx127x_linux_concentrator_t));
+  TEST_ASSERT_NOT_NULL(concentrator);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_concentrator_create(&plan, concentrator));
+  uint8_t buses[2];
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_concentrator_add_bus(-1, buses, concentrator));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_concentrator_add_bus(0, buses + 1, concentrator));
+  // radios 0 and 1 share the bus
+  uint8_t radio_buses[RADIOS] = {buses[0], buses[0], buses[1]};
+  uint8_t rx_channels[RADIOS] = {0, 1, 1};
+  uint32_t offsets[] = {DIO0_OFFSET, DIO1_OFFSET};
+  sx127x_dio_t dios[] = {SX127x_DIO0, SX127x_DIO1};
+  for (int i = 0; i < RADIOS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, pipe(pipes[i]));
+    TEST_ASSERT_EQUAL_INT(0, sx127x_sim_radio_init(pipes[i][1], DIO0_OFFSET, sims + i));
+    uint8_t radio;
+    TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_concentrator_add_radio(radio_buses[i], sims + i, rx_channels[i], &radio, concentrator));
+    TEST_ASSERT_EQUAL_INT(i, radio);
+    TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_concentrator_add_fd(radio, pipes[i][0], offsets, dios, 2, concentrator));
+    sx127x *device = &concentrator->radios[radio].device;
+    TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_SLEEP, SX127x_MODULATION_LORA, device));
+    TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_set_bandwidth(SX127x_BW_125000, device));
+  }
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_concentrator_start(concentrator));
+}
+
+void tearDown() {
+  sx127x_linux_concentrator_destroy(concentrator);
+  free(concentrator);
+  for (int i = 0; i < RADIOS; i++) {
+    sx127x_sim_radio_destroy(sims + i);
+    close(pipes[i][0]);
+    close(pipes[i][1]);
+  }
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_rx);
+  RUN_TEST(test_rx_overflow);
+  RUN_TEST(test_tx);
+  RUN_TEST(test_tx_receiving);
+  RUN_TEST(test_tx_queue);
+  RUN_TEST(test_tx_abort);
+  RUN_TEST(test_restart);
+  RUN_TEST(test_invalid_args);
+  return UNITY_END();
+}
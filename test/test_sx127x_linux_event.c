@@ -0,0 +1,214 @@
+#include <linux/gpio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sx127x_linux_event.h>
+#include <unistd.h>
+
+#include "sx127x_mock_spi.h"
+#include "unity.h"
+
+#define DEVICES 2
+
+sx127x *devices[DEVICES];
+int pipes[DEVICES][2];
+uint32_t seqno[DEVICES];
+sx127x_linux_event_t loop;
+uint8_t registers[255];
+int transmitted[DEVICES];
+uint32_t rx_timestamp = 0;
+uint16_t rx_length = 0;
+
+static int device_index(sx127x *device) {
+  for (int i = 0; i < DEVICES; i++) {
+    if (devices[i] == device) {
+      return i;
+    }
+  }
+  TEST_FAIL_MESSAGE("unknown device");
+  return -1;
+}
+
+void tx_callback(sx127x *device) {
+  transmitted[device_index(device)]++;
+}
+
+void rx_meta_callback(sx127x *device, uint8_t *data, uint16_t data_length, const sx127x_packet_meta_t *meta) {
+  rx_length = data_length;
+  rx_timestamp = meta->timestamp;
+}
+
+// replay kernel event
+static void emit(int index, uint32_t offset, uint32_t id, uint64_t timestamp_ns) {
+  struct gpio_v2_line_event event;
+  memset(&event, 0, sizeof(event));
+  event.timestamp_ns = timestamp_ns;
+  event.id = id;
+  event.offset = offset;
+  event.seqno = ++seqno[index];
+  event.line_seqno = event.seqno;
+  TEST_ASSERT_EQUAL_INT(sizeof(event), write(pipes[index][1], &event, sizeof(event)));
+}
+
+void test_dispatch() {
+  // lora tx on lines 17 and 18, fsk tx on lines 22 and 23
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_TX, SX127x_MODULATION_LORA, devices[0]));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_FSK, devices[1]));
+  uint8_t payload[200] = {0};
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_tx_set_for_transmission(payload, sizeof(payload), devices[1]));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_TX, SX127x_MODULATION_FSK, devices[1]));
+
+  emit(0, 17, GPIO_V2_LINE_EVENT_RISING_EDGE, 1000);
+  // fifo level above threshold is ignored in tx
+  emit(1, 23, GPIO_V2_LINE_EVENT_RISING_EDGE, 2000);
+  spi_mock_transactions();
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_event_poll(100, &loop));
+  TEST_ASSERT_EQUAL_INT(1, transmitted[0]);
+  TEST_ASSERT_EQUAL_INT(0, transmitted[1]);
+  // lora irq clear only
+  TEST_ASSERT_EQUAL_INT(1, spi_mock_transactions());
+
+  // refill on falling edge, then packet sent
+  emit(1, 23, GPIO_V2_LINE_EVENT_FALLING_EDGE, 3000);
+  emit(1, 22, GPIO_V2_LINE_EVENT_RISING_EDGE, 4000);
+  // unknown line
+  emit(1, 30, GPIO_V2_LINE_EVENT_RISING_EDGE, 5000);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_event_poll(100, &loop));
+  TEST_ASSERT_EQUAL_INT(1, spi_mock_transactions());
+  TEST_ASSERT_EQUAL_INT(1, transmitted[0]);
+  TEST_ASSERT_EQUAL_INT(1, transmitted[1]);
+
+  // timeout
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_event_poll(0, &loop));
+  TEST_ASSERT_EQUAL_INT(0, spi_mock_transactions());
+}
+
+void test_batch() {
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_LORA, devices[0]));
+  uint64_t frequencies[] = {868000000, 868200000};
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_lora_set_frequency_hopping(5, frequencies, 2, devices[0]));
+  // more events than a single read
+  int hops = SX127X_LINUX_EVENT_BATCH * 2 + 3;
+  for (int i = 0; i < hops; i++) {
+    emit(0, 19, GPIO_V2_LINE_EVENT_RISING_EDGE, 1000 + i);
+  }
+  spi_mock_transactions();
+  spi_mock_read_transactions();
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_event_poll(100, &loop));
+  // single transaction per hop
+  TEST_ASSERT_EQUAL_INT(hops, spi_mock_transactions());
+  TEST_ASSERT_EQUAL_INT(0, spi_mock_read_transactions());
+  TEST_ASSERT_EQUAL_INT(0, loop.sources[0].overflows);
+
+  // kernel dropped some events. irq flags are read
+  seqno[0] += 5;
+  registers[0x12] = 0b00000010;
+  emit(0, 19, GPIO_V2_LINE_EVENT_RISING_EDGE, 2000);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_event_poll(100, &loop));
+  TEST_ASSERT_EQUAL_INT(1, loop.sources[0].overflows);
+  TEST_ASSERT_EQUAL_INT(1, spi_mock_read_transactions());
+}
+
+void test_timestamp() {
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_RX_CONT, SX127x_MODULATION_FSK, devices[1]));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_packet_format(SX127X_VARIABLE, 255, devices[1]));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_fsk_ook_set_crc(SX127X_CRC_NONE, devices[1]));
+  sx127x_rx_set_meta_callback(rx_meta_callback, sx127x_linux_event_clock, devices[1]);
+  uint8_t payload[11] = {10, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+  spi_mock_fifo(payload, sizeof(payload), SX127X_OK);
+  emit(1, 22, GPIO_V2_LINE_EVENT_RISING_EDGE, 123456789000ULL);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_event_poll(100, &loop));
+  TEST_ASSERT_EQUAL_INT(10, rx_length);
+  // kernel timestamp rather than the time of handling
+  TEST_ASSERT_EQUAL_UINT32((uint32_t) 123456789ULL, rx_timestamp);
+  TEST_ASSERT_EQUAL_UINT32(0, sx127x_linux_event_clock());
+}
+
+void test_tx_queue() {
+  sx127x_tx_slot_t slots[2];
+  uint8_t memory[2 * 16];
+  sx127x_tx_queue_t queue;
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_tx_queue_init(slots, memory, 2, 16, NULL, &queue));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_linux_event_add_tx_queue(NULL, devices[0], &loop));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_STANDBY, SX127x_MODULATION_LORA, devices[0]));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_event_add_tx_queue(&queue, devices[0], &loop));
+  // nothing to send yet
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_event_poll(100, &loop));
+  TEST_ASSERT_FALSE(queue.active);
+
+  // producer wakes up the loop
+  uint8_t first[] = {1, 2, 3};
+  uint8_t second[] = {4, 5};
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_tx_queue_submit(first, sizeof(first), SX127X_TX_QUEUE_CURRENT_CHANNEL, &queue));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_event_poll(100, &loop));
+  spi_assert_write(first, sizeof(first));
+  TEST_ASSERT_TRUE(queue.active);
+  TEST_ASSERT_EQUAL_INT(SX127x_MODE_TX, devices[0]->opmod);
+
+  // frame submitted during TX is chained from tx done
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_tx_queue_submit(second, sizeof(second), SX127X_TX_QUEUE_CURRENT_CHANNEL, &queue));
+  spi_mock_write(SX127X_OK);
+  emit(0, 17, GPIO_V2_LINE_EVENT_RISING_EDGE, 1000);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_event_poll(100, &loop));
+  spi_assert_write(second, sizeof(second));
+  TEST_ASSERT_EQUAL_INT(0, transmitted[0]);
+  emit(0, 17, GPIO_V2_LINE_EVENT_RISING_EDGE, 2000);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_event_poll(100, &loop));
+  TEST_ASSERT_EQUAL_INT(1, transmitted[0]);
+  TEST_ASSERT_FALSE(queue.active);
+
+  sx127x_linux_event_destroy(&loop);
+  TEST_ASSERT_NULL(queue.wake);
+}
+
+void test_invalid_args() {
+  uint32_t offsets[] = {1};
+  sx127x_dio_t dios[] = {SX127x_DIO0};
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_linux_event_create(NULL));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_linux_event_add_fd(-1, offsets, dios, 1, devices[0], &loop));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_linux_event_add_fd(pipes[0][0], offsets, dios, 0, devices[0], &loop));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_linux_event_add_fd(pipes[0][0], offsets, dios, SX127X_LINUX_EVENT_MAX_LINES + 1, devices[0], &loop));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_linux_event_add(NULL, offsets, dios, 1, devices[0], &loop));
+  TEST_ASSERT_NOT_EQUAL(SX127X_OK, sx127x_linux_event_add("/nonexistent/gpiochip", offsets, dios, 1, devices[0], &loop));
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_INVALID_ARG, sx127x_linux_event_poll(0, NULL));
+  loop.sources_length = CONFIG_SX127X_LINUX_EVENT_MAX_SOURCES;
+  TEST_ASSERT_EQUAL_INT(SX127X_ERR_NO_MEM, sx127x_linux_event_add_fd(pipes[0][0], offsets, dios, 1, devices[0], &loop));
+  loop.sources_length = DEVICES;
+}
+
+void setUp() {
+  memset(registers, 0, sizeof(registers));
+  registers[0x42] = 0x12;
+  spi_mock_registers(registers, SX127X_OK);
+  spi_mock_write(SX127X_OK);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_event_create(&loop));
+  uint32_t offsets[DEVICES][3] = {{17, 18, 19}, {22, 23, 24}};
+  sx127x_dio_t dios[] = {SX127x_DIO0, SX127x_DIO1, SX127x_DIO2};
+  for (int i = 0; i < DEVICES; i++) {
+    devices[i] = malloc(sizeof(sx127x));
+    TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_create(NULL, devices[i]));
+    sx127x_tx_set_callback(tx_callback, devices[i]);
+    TEST_ASSERT_EQUAL_INT(0, pipe(pipes[i]));
+    TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_linux_event_add_fd(pipes[i][0], offsets[i], dios, 3, devices[i], &loop));
+    seqno[i] = 0;
+    transmitted[i] = 0;
+  }
+}
+
+void tearDown() {
+  sx127x_linux_event_destroy(&loop);
+  for (int i = 0; i < DEVICES; i++) {
+    close(pipes[i][0]);
+    close(pipes[i][1]);
+    free(devices[i]);
+  }
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_dispatch);
+  RUN_TEST(test_batch);
+  RUN_TEST(test_timestamp);
+  RUN_TEST(test_tx_queue);
+  RUN_TEST(test_invalid_args);
+  return UNITY_END();
+}
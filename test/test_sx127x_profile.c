@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <string.h>
+#include <sx127x.h>
+#include <sx127x_spi.h>
+
+#include "registers.h"
+#include "fsk_4800.h"
+#include "lora_sf9.h"
+#include "sx127x_mock_spi.h"
+#include "unity.h"
+
+#define REGISTERS_LENGTH 255
+
+uint8_t registers[REGISTERS_LENGTH];
+uint8_t configured[REGISTERS_LENGTH];
+uint8_t initial[REGISTERS_LENGTH];
+sx127x device;
+sx127x expected;
+
+// same as profile_generator/fsk_4800.conf
+static int configure_fsk_4800(sx127x *device) {
+  uint8_t syncword[] = {0x12, 0xAD};
+  int code = sx127x_set_frequency(437200012, device);
+  code |= sx127x_fsk_ook_set_bitrate(4800, device);
+  code |= sx127x_fsk_set_fdev(5000, device);
+  code |= sx127x_fsk_ook_rx_set_bandwidth(20000, device);
+  code |= sx127x_fsk_ook_rx_set_afc_bandwidth(20000, device);
+  code |= sx127x_fsk_ook_rx_set_afc_auto(true, device);
+  code |= sx127x_set_preamble_length(4, device);
+  code |= sx127x_fsk_ook_set_syncword(syncword, sizeof(syncword), device);
+  code |= sx127x_fsk_ook_set_packet_encoding(SX127X_NRZ, device);
+  code |= sx127x_fsk_ook_set_crc(SX127X_CRC_CCITT, device);
+  code |= sx127x_fsk_ook_set_packet_format(SX127X_VARIABLE, 255, device);
+  code |= sx127x_fsk_ook_set_address_filtering(SX127X_FILTER_NONE, 0, 0, device);
+  code |= sx127x_fsk_set_data_shaping(SX127X_BT_0_5, SX127X_PA_RAMP_10, device);
+  code |= sx127x_fsk_ook_rx_set_preamble_detector(true, 2, 10, device);
+  code |= sx127x_fsk_ook_rx_set_trigger(SX127X_RX_TRIGGER_PREAMBLE, device);
+  code |= sx127x_rx_set_lna_gain(SX127x_LNA_GAIN_G4, device);
+  code |= sx127x_tx_set_pa_config(SX127x_PA_PIN_BOOST, 4, device);
+  code |= sx127x_tx_set_ocp(true, 120, device);
+  code |= sx127x_fsk_ook_set_fifo_threshold_auto(100, 3000000, device);
+  return code;
+}
+
+// same as profile_generator/lora_sf9.conf
+static int configure_lora_sf9(sx127x *device) {
+  sx127x_tx_header_t header = {.enable_crc = true, .coding_rate = SX127x_CR_4_5};
+  int code = sx127x_set_frequency(868200012, device);
+  code |= sx127x_lora_set_bandwidth(SX127x_BW_125000, device);
+  code |= sx127x_lora_set_modem_config_2(SX127x_SF_9, device);
+  code |= sx127x_lora_set_implicit_header(NULL, device);
+  code |= sx127x_lora_tx_set_explicit_header(&header, device);
+  code |= sx127x_lora_set_syncword(0x12, device);
+  code |= sx127x_set_preamble_length(8, device);
+  code |= sx127x_rx_set_lna_boost_hf(true, device);
+  code |= sx127x_rx_set_lna_gain(SX127x_LNA_GAIN_AUTO, device);
+  code |= sx127x_tx_set_pa_config(SX127x_PA_PIN_BOOST, 4, device);
+  return code;
+}
+
+static bool profile_contains(const sx127x_profile_t *profile, int reg) {
+  for (uint8_t i = 0; i < profile->ranges_length; i++) {
+    if (reg >= profile->ranges[i].reg && reg < profile->ranges[i].reg + profile->ranges[i].length) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void power_on(bool lora) {
+  memcpy(registers, fsk_defaults, sizeof(fsk_defaults));
+  if (lora) {
+    memcpy(registers + SHADOW_BANKED_FIRST, lora_defaults, sizeof(lora_defaults));
+  }
+  spi_mock_registers(registers, SX127X_OK);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_create(NULL, &device));
+}
+
+static void round_trip(const sx127x_profile_t *profile, int (*configure)(sx127x *)) {
+  bool lora = (profile->modulation == SX127x_MODULATION_LORA);
+  // configuration functions against the chip after reset
+  power_on(lora);
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_set_opmod(SX127x_MODE_SLEEP, profile->modulation, &device));
+  memcpy(initial, registers, sizeof(registers));
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, configure(&device));
+  memcpy(configured, registers, sizeof(registers));
+  expected = device;
+
+  // profile is applied on top of unrelated configuration
+  power_on(lora);
+  memset(registers + REG_OP_MODE + 1, 0xEE, MAX_NUMBER_OF_REGISTERS - REG_OP_MODE - 1);
+  registers[0x42] = fsk_defaults[0x42];
+  TEST_ASSERT_EQUAL_INT(SX127X_OK, sx127x_apply_profile(profile, &device));
+
+  for (int reg = REG_OP_MODE + 1; reg < MAX_NUMBER_OF_REGISTERS; reg++) {
+    char message[32];
+    snprintf(message, sizeof(message), "register 0x%02x", reg);
+    if (is_modem_register(reg, lora)) {
+      // profile doesn't depend on the previous configuration
+      TEST_ASSERT_TRUE_MESSAGE(profile_contains(profile, reg), message);
+    }
+    if (profile_contains(profile, reg)) {
+      TEST_ASSERT_EQUAL_HEX8_MESSAGE(configured[reg], registers[reg], message);
+    } else {
+      // everything changed by the configuration is in the profile
+      TEST_ASSERT_EQUAL_HEX8_MESSAGE(initial[reg], configured[reg], message);
+    }
+  }
+  TEST_ASSERT_EQUAL_INT(expected.active_modem, device.active_modem);
+  TEST_ASSERT_EQUAL_INT(expected.expected_packet_length, device.expected_packet_length);
+  if (lora) {
+    TEST_ASSERT_EQUAL_INT(expected.use_implicit_header, device.use_implicit_header);
+  } else {
+    TEST_ASSERT_EQUAL_INT(expected.fsk_ook_format, device.fsk_ook_format);
+    TEST_ASSERT_EQUAL_INT(expected.fsk_crc_type, device.fsk_crc_type);
+    TEST_ASSERT_EQUAL_INT(expected.fsk_ook_rx_threshold, device.fsk_ook_rx_threshold);
+    TEST_ASSERT_EQUAL_INT(expected.fsk_ook_rx_batch, device.fsk_ook_rx_batch);
+    TEST_ASSERT_EQUAL_INT(expected.fsk_ook_tx_threshold, device.fsk_ook_tx_threshold);
+    TEST_ASSERT_EQUAL_INT(expected.fsk_ook_tx_batch, device.fsk_ook_tx_batch);
+  }
+}
+
+void test_fsk_round_trip() {
+  round_trip(&fsk_4800, configure_fsk_4800);
+}
+
+void test_lora_round_trip() {
+  round_trip(&lora_sf9, configure_lora_sf9);
+}
+
+void setUp() {
+  memset(registers, 0, sizeof(registers));
+  spi_mock_write(SX127X_OK);
+}
+
+void tearDown() {
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_fsk_round_trip);
+  RUN_TEST(test_lora_round_trip);
+  return UNITY_END();
+}